@@ -78,6 +78,12 @@ void mk_task_interrupt(mk_task_t *task) MK_FFI_NOEXCEPT;
 /** mk_task_destroy() waits for task to complete and frees resources. */
 void mk_task_destroy(mk_task_t *task) MK_FFI_NOEXCEPT;
 
+/** mk_task_set_max_concurrency() sets the maximum number of tasks that can
+ * run concurrently in this process. Tasks started when the limit has been
+ * reached wait until it is their turn to run. Zero restores the default
+ * value, which is one. */
+void mk_task_set_max_concurrency(size_t max_concurrency) MK_FFI_NOEXCEPT;
+
 #ifdef __cplusplus
 }  // extern "C"
 
@@ -4,6 +4,8 @@
 #ifndef INCLUDE_MEASUREMENT_KIT_INTERNAL_ENGINE_TASK_HPP
 #define INCLUDE_MEASUREMENT_KIT_INTERNAL_ENGINE_TASK_HPP
 
+#include <stddef.h>
+
 #include <memory>
 
 #include <measurement_kit/common/nlohmann/json.hpp>
@@ -20,8 +22,11 @@ class TaskImpl;
 ///
 /// Creating a Task also creates the thread that will run it. Altough you can
 /// construct more than one Task at a time, Measurement Kit will make sure that
-/// tasks do not run concurrently, even though there is no guarantee that they
-/// will actually run sequentially.
+/// no more than a process-wide number of tasks run concurrently. By default
+/// such number is one, so tasks do not run concurrently. Use the static
+/// set_max_concurrency() method to change it. Tasks waiting to run are
+/// started by decreasing value of their "priority" setting and, among tasks
+/// with equal priority, in the order in which they have been created.
 ///
 /// A Task will emit events while running, which you can retrieve using the
 /// wait_for_next_event() call, which blocks until next event occurs. You can
@@ -58,6 +63,11 @@ class Task {
     /// ~Task waits for the task to finish and deallocates resources.
     ~Task();
 
+    /// set_max_concurrency sets the maximum number of tasks that can run
+    /// concurrently in this process. Passing zero restores the default,
+    /// which is one. Lowering the value does not stop running tasks.
+    static void set_max_concurrency(size_t value);
+
     // Implementation note: this class is _explicitly_ non copyable and non
     // movable so we don't have to worry about pimpl's validity.
     Task(const Task &) noexcept = delete;
@@ -6,6 +6,8 @@
 
 #include <functional>
 
+#include "src/libmeasurement_kit/common/unique_function.hpp"
+
 namespace mk {
 
 /// \brief `Callback` is syntactic sugar for writing callback functions. In
@@ -17,5 +19,11 @@ namespace mk {
 /// \since v0.2.0.
 template <typename... T> using Callback = std::function<void(T...)>;
 
+/// \brief `UniqueCallback` is like `Callback` but is move-only and stores
+/// larger callables inline. Use it for callbacks that are called once and
+/// whose ownership is passed along, e.g. to the Reactor, since moving it
+/// neither allocates nor copies what the callback has captured.
+template <typename... T> using UniqueCallback = UniqueFunction<void(T...)>;
+
 } // namespace
 #endif
@@ -4,39 +4,94 @@
 #ifndef SRC_LIBMEASUREMENT_KIT_COMMON_DELEGATE_HPP
 #define SRC_LIBMEASUREMENT_KIT_COMMON_DELEGATE_HPP
 
+#include <stdint.h>
+
 #include <cstddef>
 #include <functional>
+#include <utility>
+
+#include "src/libmeasurement_kit/common/unique_function.hpp"
 
 namespace mk {
 
-// Implementation note: this class could also have been written as a subclass
-// of function but I, er, was not able to write it like so because I do not
-// know enough about templates syntax, plus it's not totally clear to me what
-// would be the proper way to wrap `swap` and `assign`.
+// Delegate_ holds a function that may be replaced while it is running, e.g.
+// when an event handler registers another handler for the same event. To
+// keep the running function alive, we used to copy it before calling it,
+// which could allocate and bumped the reference count of everything it had
+// captured. Now the function is stored inline and, while it runs, it is
+// moved onto the stack of the caller, so that reassigning the delegate
+// from within the function does not destroy it. When the function returns
+// we move it back, unless the delegate has been reassigned meanwhile.
 template <typename T> class Delegate_ {
   public:
     Delegate_() {}
-    template <typename F> Delegate_(F f) : func(f) {}
-    Delegate_(std::function<T> f) : func(f) {}
+    template <typename F> Delegate_(F f) { *this = std::move(f); }
 
-    ~Delegate_() {}
-
-    void operator=(std::function<T> f) { func = f; }
-    template <typename F> void operator=(F f) { func = f; }
-    void operator=(std::nullptr_t f) { func = f; }
+    ~Delegate_() {
+        // The function may destroy the delegate while it is running
+        for (Call *call = calls; call != nullptr; call = call->prev) {
+            call->self = nullptr;
+        }
+    }
 
-    // not implementing swap and assign
+    template <typename F> void operator=(F f) {
+        func = std::move(f);
+        running = nullptr;
+        ++generation;
+    }
+    void operator=(std::nullptr_t) {
+        func = nullptr;
+        running = nullptr;
+        ++generation;
+    }
 
-    operator bool() { return static_cast<bool>(func); }
+    operator bool() { return func || running != nullptr; }
 
     template <typename... Args> void operator()(Args &&... args) {
-        // Make sure the original closure is not destroyed before end of scope
-        auto orig = this->func;
-        orig(std::forward<Args>(args)...);
+        if (!func) {
+            if (running == nullptr) {
+                throw std::bad_function_call();
+            }
+            // Called again by the running function: it is on the stack
+            // of an outer call, which will take care of moving it back
+            (*running)(std::forward<Args>(args)...);
+            return;
+        }
+        Call call{this};
+        call.func(std::forward<Args>(args)...);
     }
 
   private:
-    std::function<T> func;
+    // Call moves the function onto the stack for the duration of a call
+    // and moves it back, also if the function throws.
+    class Call {
+      public:
+        explicit Call(Delegate_ *d)
+            : self{d}, prev{d->calls}, func{std::move(d->func)},
+              generation{d->generation} {
+            self->calls = this;
+            self->running = &func;
+        }
+        ~Call() {
+            if (self == nullptr) {
+                return;
+            }
+            self->calls = prev;
+            if (self->generation == generation) {
+                self->running = nullptr;
+                self->func = std::move(func);
+            }
+        }
+        Delegate_ *self;
+        Call *prev;
+        UniqueFunction<T> func;
+        uint64_t generation;
+    };
+
+    Call *calls = nullptr;
+    UniqueFunction<T> func;
+    UniqueFunction<T> *running = nullptr;
+    uint64_t generation = 0;
 };
 
 template <typename... T> using Delegate = Delegate_<void(T...)>;
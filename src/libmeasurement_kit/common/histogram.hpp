@@ -0,0 +1,111 @@
+// Part of Measurement Kit <https://measurement-kit.github.io/>.
+// Measurement Kit is free software under the BSD license. See AUTHORS
+// and LICENSE for more information on the copying conditions.
+#ifndef SRC_LIBMEASUREMENT_KIT_COMMON_HISTOGRAM_HPP
+#define SRC_LIBMEASUREMENT_KIT_COMMON_HISTOGRAM_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+
+namespace mk {
+
+// Histogram counts non-negative integer samples using buckets whose size
+// grows as powers of two: bucket zero counts zeroes and bucket `i` counts
+// samples in [2^(i-1), 2^i). This gives a bounded relative error with a
+// fixed, small, amount of memory. Adding a sample costs a few relaxed atomic
+// operations, so many threads can add samples concurrently.
+//
+// Copying a histogram takes a snapshot of it. The snapshot may not be
+// consistent if samples are being added concurrently.
+class Histogram {
+  public:
+    static constexpr size_t buckets = 65;
+
+    Histogram() = default;
+
+    Histogram(const Histogram &other) { *this = other; }
+
+    Histogram &operator=(const Histogram &other) {
+        for (size_t i = 0; i < buckets; ++i) {
+            buckets_[i] = other.buckets_[i].load(std::memory_order_relaxed);
+        }
+        count_ = other.count_.load(std::memory_order_relaxed);
+        max_ = other.max_.load(std::memory_order_relaxed);
+        sum_ = other.sum_.load(std::memory_order_relaxed);
+        return *this;
+    }
+
+    void add(uint64_t value) {
+        buckets_[bucket_of(value)].fetch_add(1, std::memory_order_relaxed);
+        count_.fetch_add(1, std::memory_order_relaxed);
+        sum_.fetch_add(value, std::memory_order_relaxed);
+        uint64_t prev = max_.load(std::memory_order_relaxed);
+        while (value > prev && !max_.compare_exchange_weak(
+                                       prev, value, std::memory_order_relaxed)) {
+            /* nothing */;
+        }
+    }
+
+    uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+
+    uint64_t max() const { return max_.load(std::memory_order_relaxed); }
+
+    uint64_t sum() const { return sum_.load(std::memory_order_relaxed); }
+
+    double mean() const {
+        uint64_t n = count();
+        return (n > 0) ? (double)sum() / (double)n : 0.0;
+    }
+
+    // bucket returns the number of samples in the i-th bucket.
+    uint64_t bucket(size_t i) const {
+        return buckets_[i].load(std::memory_order_relaxed);
+    }
+
+    // percentile returns an upper bound of the q-th quantile, with q in
+    // [0, 1], which is the upper bound of the bucket containing it. The
+    // result is never larger than max(). Returns zero if empty.
+    uint64_t percentile(double q) const {
+        uint64_t n = count();
+        if (n <= 0) {
+            return 0;
+        }
+        uint64_t rank = (uint64_t)(q * (double)n + 0.5);
+        rank = (rank > 0) ? rank : 1;
+        uint64_t seen = 0;
+        for (size_t i = 0; i < buckets; ++i) {
+            seen += bucket(i);
+            if (seen >= rank) {
+                uint64_t upper = upper_bound_of(i);
+                return (upper < max()) ? upper : max();
+            }
+        }
+        return max();
+    }
+
+    // bucket_of returns the index of the bucket counting value.
+    static size_t bucket_of(uint64_t value) {
+        size_t i = 0;
+        while (value != 0) {
+            value >>= 1;
+            ++i;
+        }
+        return i;
+    }
+
+    // upper_bound_of returns the largest value counted by the i-th bucket.
+    static uint64_t upper_bound_of(size_t i) {
+        return (i >= 64) ? ~uint64_t{0} : (uint64_t{1} << i) - 1;
+    }
+
+  private:
+    std::atomic<uint64_t> buckets_[buckets] = {};
+    std::atomic<uint64_t> count_{0};
+    std::atomic<uint64_t> max_{0};
+    std::atomic<uint64_t> sum_{0};
+};
+
+} // namespace mk
+#endif
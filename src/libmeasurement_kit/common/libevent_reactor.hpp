@@ -12,11 +12,14 @@
 #include "src/libmeasurement_kit/common/non_movable.hpp"          // for mk::NonMovable
 #include "src/libmeasurement_kit/common/reactor.hpp"              // for mk::Reactor
 #include "src/libmeasurement_kit/common/socket.hpp"               // for mk::socket_t
+#include "src/libmeasurement_kit/common/timer_wheel.hpp"          // for mk::TimerWheel
 #include "src/libmeasurement_kit/common/utils.hpp"                // for mk::timeval_init
 #include "src/libmeasurement_kit/common/unique_ptr.hpp"           // for mk::UniquePtr
 #include "src/libmeasurement_kit/common/worker.hpp"               // for mk::Worker
 #include <atomic>                                  // for std::atomic_bool
 #include <cassert>                                 // for assert
+#include <chrono>                                  // for std::chrono
+#include <cmath>                                   // for std::ceil
 #include <event2/event.h>                          // for event_base_*
 #include <event2/thread.h>                         // for evthread_use_*
 #include <event2/util.h>                           // for evutil_socket_t
@@ -24,13 +27,16 @@
 #include <measurement_kit/common/data_usage.hpp>   // for mk::DataUsage
 #include "src/libmeasurement_kit/common/error.hpp"        // for mk::Error
 #include <measurement_kit/common/logger.hpp>       // for mk::warn
-#include <mutex>                                   // for std::recursive_mutex
+#include <mutex>                                   // for std::mutex
 #include <signal.h>                                // for sigaction
 #include <stdexcept>                               // for std::runtime_error
 #include <utility>                                 // for std::move
+#include <vector>                                  // for std::vector
 
 extern "C" {
+static inline void mk_call_soon_cb(evutil_socket_t, short, void *);
 static inline void mk_pollfd_cb(evutil_socket_t, short, void *);
+static inline void mk_event_cb(evutil_socket_t, short, void *);
 }
 
 namespace mk {
@@ -45,6 +51,16 @@ class EventBaseDeleter {
     }
 };
 
+// Deleter for an event pointer.
+class EventDeleter {
+  public:
+    void operator()(event *ev) {
+        if (ev != nullptr) {
+            event_free(ev);
+        }
+    }
+};
+
 // LibeventReactor is an mk::Reactor implementation using libevent.
 //
 // The current implementation as of 2017-11-01 does not need to be explicitly
@@ -93,40 +109,52 @@ class LibeventReactor : public Reactor, public NonCopyable, public NonMovable {
         if (evbase.get() == nullptr) {
             throw std::runtime_error("event_base_new");
         }
+        // The wakeup event is pending while there is background work, to
+        // keep the loop alive, and background threads activate it when they
+        // complete a callback, to wake up the I/O thread immediately.
+        wakeup_cb = [this]() { on_background_work_done(); };
+        wakeup.reset(event_new(evbase.get(), -1, EV_PERSIST, mk_event_cb,
+                &wakeup_cb));
+        if (wakeup.get() == nullptr) {
+            throw std::runtime_error("event_new");
+        }
+        worker.on_complete([ev = wakeup.get()]() { event_active(ev, 0, 0); });
+        // The timer event fires when it's time to advance the timer wheel
+        // used to implement call_later(). See arm_timer_event().
+        timer_cb = [this]() { on_timer_event(); };
+        timer_event.reset(event_new(evbase.get(), -1, 0, mk_event_cb,
+                &timer_cb));
+        if (timer_event.get() == nullptr) {
+            throw std::runtime_error("event_new");
+        }
     }
 
-    ~LibeventReactor() override {}
+    ~LibeventReactor() override {
+        // Make sure no background thread is using the wakeup event
+        // before we go on and destroy it.
+        worker.on_complete(nullptr);
+        // Must run while the event base is still alive
+        run_stop_callbacks();
+    }
 
     // ## Event loop management
 
     event_base *get_event_base() override { return evbase.get(); }
 
     void run() override {
-        do {
-            auto ev_status = event_base_dispatch(evbase.get());
-            if (ev_status < 0) {
-                throw std::runtime_error("event_base_dispatch");
-            }
-            /*
-                Explanation: event_base_loop() returns one when there are no
-                pending events. In such case, before leaving the event loop, we
-                make sure we have no pending background threads. They are, as
-                of now, mostly used to perform DNS queries with getaddrinfo(),
-                which is blocking. If there are threads running, treat them
-                like pending events, even though they are not managed by
-                libevent, and continue running the loop. To avoid spinning
-                and to be sure we're ready to deal /pronto/ with any upcoming
-                libevent event, schedule a call for the near future so to
-                keep the libevent loop active, and ready to react.
-
-                The exact possible values for `ev_status` are -1, 0, and +1, but
-                I have coded more broad checks for robustness.
-            */
-            if (ev_status > 0 && worker.concurrency() <= 0) {
-                break;
-            }
-            call_later(0.250, []() {});
-        } while (true);
+        /*
+            Explanation: event_base_loop() returns one when there are no
+            pending events. Background work, mostly used to perform DNS
+            queries with getaddrinfo(), which is blocking, is not managed
+            by libevent. So, while there is background work, we keep the
+            wakeup event pending, such that libevent treats it like any
+            other pending event and blocks waiting for it without the
+            need of periodic timers. See call_in_thread().
+        */
+        if (event_base_dispatch(evbase.get()) < 0) {
+            throw std::runtime_error("event_base_dispatch");
+        }
+        run_stop_callbacks();
     }
 
     void stop() override {
@@ -135,43 +163,132 @@ class LibeventReactor : public Reactor, public NonCopyable, public NonMovable {
         }
     }
 
+    void on_stop(UniqueCallback<> &&cb) override {
+        std::unique_lock<std::mutex> _{stop_mutex};
+        stop_callbacks.push_back(std::move(cb));
+    }
+
+    // Runs the callbacks registered with on_stop() with the mutex unlocked,
+    // so that they can register callbacks for the next stop.
+    void run_stop_callbacks() {
+        std::vector<UniqueCallback<>> callbacks;
+        {
+            std::unique_lock<std::mutex> _{stop_mutex};
+            std::swap(callbacks, stop_callbacks);
+        }
+        for (auto &cb : callbacks) {
+            cb();
+        }
+    }
+
     // ## Call later
 
-    void call_in_thread(SharedPtr<Logger> logger, Callback<> &&cb) override {
-        worker.call_in_thread(logger, std::move(cb));
+    void call_in_thread(
+            SharedPtr<Logger> logger, UniqueCallback<> &&cb) override {
+        // Add the wakeup event before scheduling, so that it is pending when
+        // the callback completes, and hold the lock such that we don't race
+        // with on_background_work_done() running in the I/O thread.
+        //
+        // Note: libevent does not count an event without fd and timeout
+        // as pending, so we use a long timeout. When it expires we just
+        // check again whether there is still background work.
+        std::unique_lock<std::mutex> _{wakeup_mutex};
+        timeval tv{};
+        if (event_add(wakeup.get(), timeval_init(&tv, 3600.0)) != 0) {
+            throw std::runtime_error("event_add");
+        }
+        try {
+            worker.call_in_thread(logger, std::move(cb));
+        } catch (...) {
+            if (worker.pending() <= 0) {
+                (void)event_del(wakeup.get());
+            }
+            throw;
+        }
+        if (instrumented) {
+            stats.worker_queue_depth.add(worker.stats().queue_depth);
+        }
     }
 
-    void call_soon(Callback<> &&cb) override { call_later(0.0, std::move(cb)); }
+    // `worker_stats()` returns the counters of the background threads pool
+    // used to implement call_in_thread().
+    Worker::Stats worker_stats() const { return worker.stats(); }
 
-    void call_later(double delay, Callback<> &&cb) override {
+    void call_soon(UniqueCallback<> &&cb) override {
+        if (instrumented) {
+            cb = [this, due = current_usec(), cb = std::move(cb)]() mutable {
+                run_instrumented(due, cb);
+            };
+        }
+        // Note: we don't use pollfd() because wrapping the callback would
+        // not fit the inline buffer of UniqueCallback and would allocate.
+        //
         // Note: according to libevent documentation, it is not necessary to
         // pass `EV_TIMEOUT` to get a timeout. But I find passing it more clear.
-        pollfd(-1, EV_TIMEOUT, delay, [cb = std::move(cb)](Error, short) {
-            cb();
-        });
+        timeval tv{};
+        auto cbp = new UniqueCallback<>(std::move(cb));
+        if (event_base_once(evbase.get(), -1, EV_TIMEOUT, mk_call_soon_cb, cbp,
+                    timeval_init(&tv, 0.0)) != 0) {
+            delete cbp;
+            throw std::runtime_error("event_base_once");
+        }
+    }
+
+    TimerHandle call_later(double delay, UniqueCallback<> &&cb) override {
+        if (delay < 0.0) {
+            // Preserve the documented behavior: the callback is never called
+            // and, since it is not pending, it does not keep the loop alive.
+            return TimerHandle{};
+        }
+        // Note: we round up to the next tick and we add one more tick since
+        // the current tick has already partly elapsed, so we never fire early.
+        double ticks = std::ceil(delay * ticks_per_second) + 1;
+        // The loop lag is measured from when the callback was due, not from
+        // the tick at which it expires, which is rounded up
+        uint64_t deadline = 0;
+        if (instrumented && ticks < (double)TimerWheel::max_delay) {
+            deadline = current_usec() + (uint64_t)(delay * 1000000);
+        }
+        std::unique_lock<std::mutex> _{timers_mutex};
+        // Note: the wheel time lags behind the clock when we're not called
+        // from a timer callback, so account for the difference.
+        uint64_t lag = current_tick() - timers.now();
+        uint64_t delta = (ticks < (double)TimerWheel::max_delay)
+                                 ? (uint64_t)ticks + lag
+                                 : TimerWheel::max_delay;
+        TimerHandle handle;
+        handle.id = timers.schedule(delta, std::move(cb), deadline);
+        arm_timer_event();
+        return handle;
+    }
+
+    bool cancel(TimerHandle handle) override {
+        std::unique_lock<std::mutex> _{timers_mutex};
+        if (!timers.cancel(handle.id)) {
+            return false;
+        }
+        arm_timer_event();
+        return true;
     }
 
     // ## Poll sockets
 
-    void pollin_once(socket_t fd, double timeo, Callback<Error> &&cb) override {
-        pollfd(fd, EV_READ, timeo, [cb = std::move(cb)](Error err, short) {
-            cb(std::move(err));
-        });
+    void pollin_once(
+            socket_t fd, double timeo, UniqueCallback<Error> &&cb) override {
+        pollfd(fd, EV_READ, timeo, maybe_instrument_poll(std::move(cb)));
     }
 
     void pollout_once(
-            socket_t fd, double timeo, Callback<Error> &&cb) override {
-        pollfd(fd, EV_WRITE, timeo, [cb = std::move(cb)](Error err, short) {
-            cb(std::move(err));
-        });
+            socket_t fd, double timeo, UniqueCallback<Error> &&cb) override {
+        pollfd(fd, EV_WRITE, timeo, maybe_instrument_poll(std::move(cb)));
     }
 
     // ## Internals
 
     void pollfd(socket_t sockfd, short evflags, double timeout,
-            Callback<Error, short> &&callback) {
+            UniqueCallback<Error> &&callback) {
         timeval tv{};
-        auto cbp = new Callback<Error, short>(callback);
+        auto cbp = new UniqueCallback<Error>(std::move(callback));
         if (event_base_once(evbase.get(), sockfd, evflags, mk_pollfd_cb, cbp,
                     timeval_init(&tv, timeout)) != 0) {
             delete cbp;
@@ -179,8 +296,110 @@ class LibeventReactor : public Reactor, public NonCopyable, public NonMovable {
         }
     }
 
+    // ## Timers
+
+    static constexpr double ticks_per_second = 1000.0;
+
+    static uint64_t current_tick() {
+        return (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now().time_since_epoch())
+                .count();
+    }
+
+    // Makes sure that the timer event fires when the first timer in the
+    // wheel may expire, or that is not pending when the wheel is empty
+    // such that it doesn't keep the loop alive. Must be called with the
+    // timers_mutex locked.
+    void arm_timer_event() {
+        uint64_t next = timers.next_expiry();
+        if (next == timer_event_expiry) {
+            return;
+        }
+        if (next == 0) {
+            if (event_del(timer_event.get()) != 0) {
+                throw std::runtime_error("event_del");
+            }
+        } else {
+            uint64_t now = current_tick();
+            double delta = (next > now) ? (next - now) / ticks_per_second : 0.0;
+            timeval tv{};
+            if (event_add(timer_event.get(), timeval_init(&tv, delta)) != 0) {
+                throw std::runtime_error("event_add");
+            }
+        }
+        timer_event_expiry = next;
+    }
+
+    // Called in the I/O thread when the timer event fires. We run callbacks
+    // with the mutex unlocked, so they can schedule and cancel timers.
+    void on_timer_event() {
+        std::unique_lock<std::mutex> lock{timers_mutex};
+        timer_event_expiry = 0;
+        timers.advance(current_tick());
+        if (instrumented) {
+            stats.pending_timers.add(timers.size());
+        }
+        UniqueCallback<> func;
+        uint64_t deadline = 0;
+        while (timers.pop_expired(func, &deadline)) {
+            lock.unlock();
+            if (instrumented) {
+                // Zero if instrumentation was off when scheduling
+                run_instrumented(deadline, func);
+            } else {
+                func();
+            }
+            func = nullptr; // destroy captured state while unlocked
+            lock.lock();
+        }
+        arm_timer_event();
+    }
+
+    // ## Instrumentation
+
+    void set_instrumentation(bool enabled) override { instrumented = enabled; }
+
+    ReactorStats instrumentation_stats() override { return stats; }
+
+    static uint64_t current_usec() {
+        return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now().time_since_epoch())
+                .count();
+    }
+
+    // Runs func measuring how long it takes and, unless due is zero, how
+    // late it started with respect to when it was due.
+    template <typename Func> void run_instrumented(uint64_t due, Func &&func) {
+        uint64_t begin = current_usec();
+        if (due > 0) {
+            stats.loop_lag.add((begin > due) ? begin - due : 0);
+        }
+        func();
+        uint64_t end = current_usec();
+        stats.callback_time.add((end > begin) ? end - begin : 0);
+    }
+
+    UniqueCallback<Error> maybe_instrument_poll(UniqueCallback<Error> &&cb) {
+        if (!instrumented) {
+            return std::move(cb);
+        }
+        stats.pending_polls.add(++pending_polls);
+        return [this, cb = std::move(cb)](Error err) mutable {
+            --pending_polls;
+            run_instrumented(0, [&]() { cb(std::move(err)); });
+        };
+    }
+
+    // Called in the I/O thread when a background callback has completed.
+    void on_background_work_done() {
+        std::unique_lock<std::mutex> _{wakeup_mutex};
+        if (worker.pending() <= 0 && event_del(wakeup.get()) != 0) {
+            throw std::runtime_error("event_del");
+        }
+    }
+
     static void pollfd_cb(short evflags, void *opaque) {
-        auto cbp = static_cast<mk::Callback<mk::Error, short> *>(opaque);
+        auto cbp = static_cast<mk::UniqueCallback<mk::Error> *>(opaque);
         mk::Error err = mk::NoError();
         assert((evflags & (~(EV_TIMEOUT | EV_READ | EV_WRITE))) == 0);
         if ((evflags & EV_TIMEOUT) != 0) {
@@ -189,7 +408,7 @@ class LibeventReactor : public Reactor, public NonCopyable, public NonMovable {
         // In case of exception here, the stack is going to unwind, tearing down
         // the libevent loop and leaking forever `cbp` and the event once that
         // was used to invoke this callback.
-        (*cbp)(std::move(err), evflags);
+        (*cbp)(std::move(err));
         delete cbp;
     }
 
@@ -204,8 +423,21 @@ class LibeventReactor : public Reactor, public NonCopyable, public NonMovable {
     // ## Private attributes
 
     UniquePtr<event_base, EventBaseDeleter> evbase;
+    UniquePtr<event, EventDeleter> wakeup;
+    Callback<> wakeup_cb;
+    std::mutex wakeup_mutex;
+    std::mutex timers_mutex;
+    TimerWheel timers{current_tick()};  // protected by timers_mutex
+    UniquePtr<event, EventDeleter> timer_event;
+    Callback<> timer_cb;
+    uint64_t timer_event_expiry = 0;    // protected by timers_mutex
+    std::atomic_bool instrumented{false};
+    std::atomic<size_t> pending_polls{0};
+    ReactorStats stats;
     std::recursive_mutex data_usage_mutex;
     DataUsage data_usage;
+    std::mutex stop_mutex;
+    std::vector<UniqueCallback<>> stop_callbacks; // protected by stop_mutex
     Worker worker;
 };
 
@@ -213,7 +445,18 @@ class LibeventReactor : public Reactor, public NonCopyable, public NonMovable {
 
 // ## C linkage callbacks
 
+static inline void mk_call_soon_cb(evutil_socket_t, short, void *opaque) {
+    auto cbp = static_cast<mk::UniqueCallback<> *>(opaque);
+    // See the comment in pollfd_cb() regarding exceptions.
+    (*cbp)();
+    delete cbp;
+}
+
 static inline void mk_pollfd_cb(evutil_socket_t, short evflags, void *opaque) {
     mk::LibeventReactor<>::pollfd_cb(evflags, opaque);
 }
+
+static inline void mk_event_cb(evutil_socket_t, short, void *opaque) {
+    (*static_cast<mk::Callback<> *>(opaque))();
+}
 #endif
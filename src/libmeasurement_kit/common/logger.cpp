@@ -9,11 +9,21 @@
 #include <assert.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <string.h>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <cstdint>
 #include <fstream>
 #include <list>
+#include <map>
+#include <memory>
 #include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include "src/libmeasurement_kit/common/callback.hpp"
 #include "src/libmeasurement_kit/common/delegate.hpp"
@@ -25,6 +35,219 @@
 
 namespace mk {
 
+static constexpr size_t log_buffer_size = 32768;
+
+// Formats a log message into buffer, which is log_buffer_size bytes long,
+// and returns the level with which the message should be logged.
+static uint32_t format_log_message(
+        char *buffer, uint32_t level, const char *fmt, va_list ap) {
+    int res = vsnprintf(buffer, log_buffer_size, fmt, ap);
+
+    // Once we know that res is non-negative we make it unsigned,
+    // which allows the compiler to promote the smaller of res and
+    // sizeof (buffer) to the correct size if needed.
+
+    if (res < 0) {
+        res = snprintf(buffer, log_buffer_size,
+            "logger: cannot format message with level %d "
+            "and format string '%s' (vsnprintf() returned: %d)",
+            level, fmt, res);
+        if (res < 0 || (unsigned int)res >= log_buffer_size) {
+            static const char eb[] = "logger: cannot format message";
+            static_assert(
+                log_buffer_size >= sizeof(eb), "buffer too short");
+            memcpy(buffer, eb, sizeof(eb));
+            // FALLTHROUGH
+        }
+        level = MK_LOG_WARNING;
+
+    } else if ((unsigned int)res >= log_buffer_size) {
+        static_assert(log_buffer_size >= 4, "buffer too short");
+        buffer[log_buffer_size - 1] = '\0';
+        buffer[log_buffer_size - 2] = '.';
+        buffer[log_buffer_size - 3] = '.';
+        buffer[log_buffer_size - 4] = '.';
+
+    } else {
+        /* NOTHING */;
+    }
+
+    return level;
+}
+
+// LogRing is a bounded single-producer single-consumer ring of log lines.
+// The producer is the thread owning the ring, while the consumer is any
+// thread draining the rings with the logger mutex held. Each line is copied
+// into the ring after a small header, hence queueing it does not allocate.
+class LogRing : public NonCopyable, public NonMovable {
+  public:
+    static constexpr size_t capacity = 65536;
+
+    // Depending on where the free space begins, larger records may not fit
+    // even when the ring is empty.
+    static constexpr size_t max_record_size = capacity / 2;
+
+    // record_size returns the bytes used by a line of len bytes.
+    static size_t record_size(size_t len) {
+        return (sizeof(Header) + len + 1 + sizeof(Header) - 1) &
+               ~(sizeof(Header) - 1);
+    }
+
+    LogRing() : buffer_{new Header[capacity / sizeof(Header)]} {}
+
+    // try_push copies the line s of len bytes into the ring. Returns false
+    // if there is no room for it. Only the producer may call it.
+    bool try_push(uint32_t level, const char *s, size_t len) {
+        size_t size = record_size(len);
+        assert(size <= max_record_size);
+        size_t tail = tail_.pos.load(std::memory_order_relaxed);
+        size_t offset = tail & (capacity - 1);
+        // A record never wraps around: if it does not fit before the end of
+        // the buffer, we mark the rest of the buffer as unused.
+        size_t skip = (capacity - offset < size) ? capacity - offset : 0;
+        size_t used = tail - head_.pos.load(std::memory_order_acquire);
+        if (used + skip + size > capacity) {
+            return false;
+        }
+        if (skip > 0) {
+            at(offset)->size = wrap;
+            tail += skip;
+            offset = 0;
+        }
+        Header *header = at(offset);
+        header->size = (uint32_t)len;
+        header->level = level;
+        char *line = reinterpret_cast<char *>(header + 1);
+        memcpy(line, s, len);
+        line[len] = '\0';
+        tail_.pos.store(tail + size, std::memory_order_release);
+        return true;
+    }
+
+    // try_pop calls func with the level and the oldest line, which is only
+    // valid during the call, and then removes the line. Returns false if
+    // the ring is empty. Only the consumer may call it.
+    template <typename Func> bool try_pop(Func &&func) {
+        size_t head = head_.pos.load(std::memory_order_relaxed);
+        if (head == tail_.pos.load(std::memory_order_acquire)) {
+            return false;
+        }
+        size_t offset = head & (capacity - 1);
+        if (at(offset)->size == wrap) {
+            head += capacity - offset;
+            offset = 0;
+        }
+        Header *header = at(offset);
+        func(header->level, reinterpret_cast<const char *>(header + 1));
+        head_.pos.store(head + record_size(header->size),
+                        std::memory_order_release);
+        return true;
+    }
+
+    // size_approx returns the number of bytes in use. The value may
+    // already be stale when it is returned, hence the name.
+    size_t size_approx() const {
+        size_t tail = tail_.pos.load(std::memory_order_relaxed);
+        size_t head = head_.pos.load(std::memory_order_relaxed);
+        return (tail > head) ? tail - head : 0;
+    }
+
+  private:
+    class Header {
+      public:
+        uint32_t size;
+        uint32_t level;
+    };
+
+    static constexpr uint32_t wrap = UINT32_MAX;
+
+    Header *at(size_t offset) {
+        return reinterpret_cast<Header *>(
+                reinterpret_cast<char *>(buffer_.get()) + offset);
+    }
+
+    // See MpmcQueue for why we use padding to avoid false sharing.
+    static constexpr size_t cacheline_size = 64;
+
+    class Position {
+      public:
+        char before[cacheline_size];
+        std::atomic<size_t> pos{0};
+        char after[cacheline_size];
+    };
+
+    std::unique_ptr<Header[]> buffer_;
+    Position head_;
+    Position tail_;
+};
+
+constexpr size_t LogRing::capacity;
+constexpr size_t LogRing::max_record_size;
+constexpr uint32_t LogRing::wrap;
+
+// AsyncLogState is the state of asynchronous logging. Each thread that logs
+// pushes records into its own ring, so that producers do not contend with
+// each other, and the flusher thread drains all rings in batches, when
+// woken up or when the flush interval expires. Lines logged by the same
+// thread are written in order, while lines logged by different threads
+// may be written in a different order than they were logged.
+class AsyncLogState : public NonCopyable, public NonMovable {
+  public:
+    AsyncLogState() : id{++last_id} {}
+
+    // ring returns the ring of the calling thread, creating it if needed.
+    // Rings are keyed by thread id, so a new thread reusing the id of a
+    // thread that has exited also reuses its ring.
+    LogRing *ring() {
+        // Cache the last ring used by this thread, such that, in the common
+        // case, we do not lock. We use id rather than this as the key
+        // because another state may be allocated at the same address.
+        static thread_local uint64_t cached_id = 0;
+        static thread_local LogRing *cached_ring = nullptr;
+        if (cached_id != id) {
+            std::unique_lock<std::mutex> _{rings_mutex};
+            auto &ring = rings[std::this_thread::get_id()];
+            if (!ring) {
+                ring.reset(new LogRing);
+            }
+            cached_ring = ring.get();
+            cached_id = id;
+        }
+        return cached_ring;
+    }
+
+    // Calls func for each ring. Rings are never removed, therefore func
+    // can safely access them after we have unlocked.
+    template <typename Func> void for_each_ring(Func &&func) {
+        std::vector<LogRing *> snapshot;
+        {
+            std::unique_lock<std::mutex> _{rings_mutex};
+            for (auto &kv : rings) {
+                snapshot.push_back(kv.second.get());
+            }
+        }
+        for (auto ring : snapshot) {
+            func(ring);
+        }
+    }
+
+    std::condition_variable cond;
+    const uint64_t id;
+    double interval = 0.25;            // protected by mutex
+    std::mutex mutex;
+    std::atomic_bool on_warning{true};
+    std::map<std::thread::id, std::unique_ptr<LogRing>> rings;
+    std::mutex rings_mutex;
+    bool stop = false;                 // protected by mutex
+    std::thread thread;
+    std::atomic_bool wakeup{false};
+
+  private:
+    static std::atomic<uint64_t> last_id;
+};
+
+std::atomic<uint64_t> AsyncLogState::last_id{0};
+
 class DefaultLogger : public Logger, public NonCopyable, public NonMovable {
   public:
     DefaultLogger() {
@@ -53,47 +276,28 @@ class DefaultLogger : public Logger, public NonCopyable, public NonMovable {
     }
 
     void logv(uint32_t level, const char *fmt, va_list ap) override {
+        {
+            AsyncProducer producer{this};
+            if (producer.state != nullptr) {
+                // Format in a per-thread buffer, so we don't need to lock.
+                static thread_local char buffer[log_buffer_size];
+                level = format_log_message(buffer, level, fmt, ap);
+                enqueue_(producer.state, level, buffer);
+                return;
+            }
+        }
+
         std::unique_lock<std::recursive_mutex> _{mutex_};
 
         if (!consumer_ and !ofile_) {
             return;
         }
 
-        int res = vsnprintf(buffer_, sizeof(buffer_), fmt, ap);
-
-        // Once we know that res is non-negative we make it unsigned,
-        // which allows the compiler to promote the smaller of res and
-        // sizeof (buffer) to the correct size if needed.
-
-        if (res < 0) {
-            res = snprintf(buffer_, sizeof(buffer_),
-                "logger: cannot format message with level %d "
-                "and format string '%s' (vsnprintf() returned: %d)",
-                level, fmt, res);
-            if (res < 0 || (unsigned int)res >= sizeof(buffer_)) {
-                static const char eb[] = "logger: cannot format message";
-                static_assert(
-                    sizeof(buffer_) >= sizeof(eb), "buffer_ too short");
-                memcpy(buffer_, eb, sizeof(eb));
-                // FALLTHROUGH
-            }
-            level = MK_LOG_WARNING;
-
-        } else if ((unsigned int)res >= sizeof(buffer_)) {
-            static_assert(sizeof(buffer_) >= 4, "buffer_ too short");
-            buffer_[sizeof(buffer_) - 1] = '\0';
-            buffer_[sizeof(buffer_) - 2] = '.';
-            buffer_[sizeof(buffer_) - 3] = '.';
-            buffer_[sizeof(buffer_) - 4] = '.';
-
-        } else {
-            /* NOTHING */;
-        }
-
+        level = format_log_message(buffer_, level, fmt, ap);
         logs_unlocked_(level, buffer_);
     }
 
-    void logs_unlocked_(uint32_t level, const char *s) {
+    void logs_unlocked_(uint32_t level, const char *s, bool flush = true) {
         if (!s) {
             return;
         }
@@ -115,25 +319,136 @@ class DefaultLogger : public Logger, public NonCopyable, public NonMovable {
             }
         }
         if (ofile_) {
-            // FIX: use `std::endl` rather than `\n` to make sure we flush
-            // after each line. Fixes TheTorProject/ooniprobe-ios#80.
-            *ofile_ << s << std::endl;
+            *ofile_ << s << "\n";
+            if (flush) {
+                // FIX: make sure we flush after each line when logging
+                // synchronously. Fixes TheTorProject/ooniprobe-ios#80.
+                ofile_->flush();
+            }
             // TODO: suppose here write fails... what do we want to do?
         }
     }
 
-    void logs(uint32_t level, const char *s) override {
+    // Queues a log line for the flusher thread. If our ring is full, we
+    // write the queued lines ourselves, which slows down the thread that is
+    // logging too much rather than dropping lines.
+    void enqueue_(AsyncLogState *state, uint32_t level, const char *s) {
+        size_t len = strlen(s);
+        if (LogRing::record_size(len) > LogRing::max_record_size) {
+            // Too long for the ring, so write it now, after the lines that
+            // are already queued, to keep the lines of a thread in order.
+            std::unique_lock<std::recursive_mutex> _{mutex_};
+            drain_();
+            logs_unlocked_(level, s, false);
+            return;
+        }
+        LogRing *ring = state->ring();
+        while (!ring->try_push(level, s, len)) {
+            drain_();
+        }
+        if ((state->on_warning &&
+             (level & MK_LOG_VERBOSITY_MASK) <= MK_LOG_WARNING) ||
+            ring->size_approx() >= LogRing::capacity / 2) {
+            // Until the flusher runs, the ring stays over the threshold,
+            // hence make sure we only pay for waking it up once.
+            if (!state->wakeup.exchange(true)) {
+                {
+                    // Lock to avoid racing with the flusher that has just
+                    // checked wakeup but is not yet waiting.
+                    std::unique_lock<std::mutex> _{state->mutex};
+                }
+                state->cond.notify_one();
+            }
+        }
+    }
+
+    // Writes all the queued log lines, if any, and flushes the logfile.
+    void drain_() {
         std::unique_lock<std::recursive_mutex> _{mutex_};
-        if ((level & MK_LOG_VERBOSITY_MASK) <= verbosity_) {
-            logs_unlocked_(level, s);
+        if (async_state_) {
+            auto write = [this](uint32_t level, const char *s) {
+                logs_unlocked_(level, s, false);
+            };
+            async_state_->for_each_ring([&](LogRing *ring) {
+                while (ring->try_pop(write)) {
+                    /* nothing */;
+                }
+            });
+        }
+        if (ofile_) {
+            ofile_->flush();
         }
     }
 
-    void logsv(uint32_t level, const std::vector<std::string> &v) override {
+    void flusher_loop_(AsyncLogState *state) {
+        std::unique_lock<std::mutex> lock{state->mutex};
+        for (;;) {
+            auto interval = std::chrono::duration<double>(
+                    std::max(state->interval, 0.001));
+            state->cond.wait_for(lock, interval,
+                    [state]() { return state->stop || state->wakeup; });
+            if (state->stop) {
+                // The final drain is up to stop_flusher_().
+                break;
+            }
+            state->wakeup = false;
+            lock.unlock();
+            drain_();
+            lock.lock();
+        }
+    }
+
+    // Stops the flusher thread, if running, and writes the queued lines.
+    void stop_flusher_() {
+        AsyncLogState *state = async_.exchange(nullptr);
+        if (state != nullptr) {
+            {
+                std::unique_lock<std::mutex> _{state->mutex};
+                state->stop = true;
+            }
+            state->cond.notify_one();
+            state->thread.join();
+        }
+        // Note: a thread may have loaded async_ before we cleared it and
+        // still be pushing a line, so wait for all such threads to be done
+        // and then drain. That is also why we keep async_state_ around
+        // when asynchronous logging is disabled.
+        while (async_producers_ > 0) {
+            std::this_thread::yield();
+        }
+        drain_();
+    }
+
+    void logs(uint32_t level, const char *s) override {
+        if ((level & MK_LOG_VERBOSITY_MASK) > verbosity_) {
+            return;
+        }
+        {
+            AsyncProducer producer{this};
+            if (producer.state != nullptr) {
+                if (s != nullptr) {
+                    enqueue_(producer.state, level, s);
+                }
+                return;
+            }
+        }
         std::unique_lock<std::recursive_mutex> _{mutex_};
-        if ((level & MK_LOG_VERBOSITY_MASK) <= verbosity_) {
-            for (auto &s : v) logs_unlocked_(level, s.c_str());
+        logs_unlocked_(level, s);
+    }
+
+    void logsv(uint32_t level, const std::vector<std::string> &v) override {
+        if ((level & MK_LOG_VERBOSITY_MASK) > verbosity_) {
+            return;
+        }
+        {
+            AsyncProducer producer{this};
+            if (producer.state != nullptr) {
+                for (auto &s : v) enqueue_(producer.state, level, s.c_str());
+                return;
+            }
         }
+        std::unique_lock<std::recursive_mutex> _{mutex_};
+        for (auto &s : v) logs_unlocked_(level, s.c_str());
     }
 
 #define XX(_logger_, _level_)                                                  \
@@ -160,21 +475,19 @@ class DefaultLogger : public Logger, public NonCopyable, public NonMovable {
     void debug2(const char *fmt, ...) override { XX(this, MK_LOG_DEBUG2); }
 
     void set_verbosity(uint32_t v) override {
-        std::unique_lock<std::recursive_mutex> _{mutex_};
         verbosity_ = (v & MK_LOG_VERBOSITY_MASK);
     }
 
     void increase_verbosity() override {
-        std::unique_lock<std::recursive_mutex> _{mutex_};
-        if (verbosity_ < MK_LOG_VERBOSITY_MASK) {
-            ++verbosity_;
+        uint32_t v = verbosity_;
+        while (v < MK_LOG_VERBOSITY_MASK &&
+               !verbosity_.compare_exchange_weak(v, v + 1)) {
+            /* nothing */;
         }
     }
 
-    uint32_t get_verbosity() override {
-        std::unique_lock<std::recursive_mutex> _{mutex_};
-        return verbosity_;
-    }
+    // Note: this is called each time we log, hence it does not lock.
+    uint32_t get_verbosity() override { return verbosity_; }
 
     void on_log(Callback<uint32_t, const char *> &&fn) override {
         std::unique_lock<std::recursive_mutex> _{mutex_};
@@ -183,7 +496,7 @@ class DefaultLogger : public Logger, public NonCopyable, public NonMovable {
 
     void on_eof(Callback<> &&f) override {
         std::unique_lock<std::recursive_mutex> _{mutex_};
-        eof_handlers_.push_back(std::move(f));
+        eof_handlers_.emplace_back(std::move(f));
     }
 
     void on_event(Callback<const char *> &&f) override {
@@ -208,6 +521,27 @@ class DefaultLogger : public Logger, public NonCopyable, public NonMovable {
         // TODO: what to do if we cannot open the logfile? return error?
     }
 
+    void set_async(bool enabled, LogFlushPolicy policy) override {
+        std::unique_lock<std::mutex> _{async_mutex_};
+        stop_flusher_();
+        if (!enabled) {
+            return;
+        }
+        if (!async_state_) {
+            std::unique_lock<std::recursive_mutex> _{mutex_};
+            async_state_.reset(new AsyncLogState);
+        }
+        AsyncLogState *state = async_state_.get();
+        state->interval = policy.interval;
+        state->on_warning = policy.on_warning;
+        state->stop = false;
+        state->wakeup = false;
+        state->thread = std::thread{[this, state]() { flusher_loop_(state); }};
+        async_ = state;
+    }
+
+    void flush() override { drain_(); }
+
     void progress(double prog, const char *s) override {
         std::unique_lock<std::recursive_mutex> _{mutex_};
         prog = prog * progress_scale_ + progress_offset_;
@@ -282,7 +616,11 @@ class DefaultLogger : public Logger, public NonCopyable, public NonMovable {
     }
 
     ~DefaultLogger() override {
-        for (auto f : eof_handlers_) {
+        {
+            std::unique_lock<std::mutex> _{async_mutex_};
+            stop_flusher_();
+        }
+        for (auto &f : eof_handlers_) {
             try {
                 f();
             } catch (const std::exception &) {
@@ -292,9 +630,34 @@ class DefaultLogger : public Logger, public NonCopyable, public NonMovable {
     }
 
   private:
+    // Counts a thread as a producer while it may be queueing log lines into
+    // the state it loaded from async_, so stop_flusher_() can wait for it.
+    // We count before loading, so that stop_flusher_() either sees the count
+    // or the thread sees the cleared async_ and logs synchronously.
+    class AsyncProducer {
+      public:
+        explicit AsyncProducer(DefaultLogger *logger) : logger_{logger} {
+            ++logger_->async_producers_;
+            state = logger_->async_.load();
+        }
+        ~AsyncProducer() { --logger_->async_producers_; }
+        AsyncProducer(const AsyncProducer &) = delete;
+        AsyncProducer &operator=(const AsyncProducer &) = delete;
+        AsyncLogState *state = nullptr;
+
+      private:
+        DefaultLogger *logger_;
+    };
+
+    std::atomic<AsyncLogState *> async_{nullptr};
+    std::atomic<int> async_producers_{0};
+    std::mutex async_mutex_;
+    // Note: we set async_state_ with both async_mutex_ and mutex_ locked,
+    // so holding either is enough to read it.
+    std::unique_ptr<AsyncLogState> async_state_;
     Delegate<uint32_t, const char *> consumer_;
-    uint32_t verbosity_ = MK_LOG_WARNING;
-    char buffer_[32768];
+    std::atomic<uint32_t> verbosity_{MK_LOG_WARNING};
+    char buffer_[log_buffer_size];
     std::recursive_mutex mutex_;
     SharedPtr<std::ofstream> ofile_;
     std::list<Delegate<>> eof_handlers_;
@@ -26,6 +26,19 @@
 
 namespace mk {
 
+/// \brief `LogFlushPolicy` controls when an asynchronous logger writes the
+/// queued log lines. See Logger::set_async().
+class LogFlushPolicy {
+  public:
+    /// `interval` is the maximum number of seconds a log line waits in
+    /// queue before being written.
+    double interval = 0.25;
+
+    /// `on_warning` tells the logger to write the queued log lines as soon
+    /// as a warning or an error is logged, rather than waiting.
+    bool on_warning = true;
+};
+
 /// \brief `Logger` specifies how logs are processed. It is an abstract class
 /// usually accessed through SharedPtr, because there can be different
 /// implementations of the logger.
@@ -163,6 +176,25 @@ class Logger {
     /// `set_logfile()` sets the file where to write logs.
     virtual void set_logfile(std::string fpath) = 0;
 
+    /// \brief `set_async()` enables or disables asynchronous logging. By
+    /// default logging is synchronous: log lines are written into the
+    /// logfile, flushing it, and passed to the log handler by the thread
+    /// that logs them. When asynchronous logging is enabled, such thread
+    /// only formats the log line and queues it, and a background thread
+    /// writes queued lines in batches according to \p policy. Hence, the
+    /// log handler and the MK_LOG_EVENT handler are called by the background
+    /// thread. Lines logged by a thread are written in order, but lines
+    /// logged by different threads may be interleaved differently than
+    /// they were logged. Disabling asynchronous logging, and destroying
+    /// the logger, writes all the queued log lines, including the ones of
+    /// threads that are logging meanwhile. Hence, do not call this method
+    /// from within the log handler.
+    virtual void set_async(bool enabled, LogFlushPolicy policy) = 0;
+
+    /// \brief `flush()` writes all the queued log lines, when logging is
+    /// asynchronous, and flushes the logfile.
+    virtual void flush() = 0;
+
     /// `emit_event_ex()` emits an event as a JSON.
     virtual void emit_event_ex(std::string key, nlohmann::json &&value) = 0;
 
@@ -0,0 +1,132 @@
+// Part of Measurement Kit <https://measurement-kit.github.io/>.
+// Measurement Kit is free software under the BSD license. See AUTHORS
+// and LICENSE for more information on the copying conditions.
+#ifndef SRC_LIBMEASUREMENT_KIT_COMMON_MPMC_QUEUE_HPP
+#define SRC_LIBMEASUREMENT_KIT_COMMON_MPMC_QUEUE_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+
+#include "src/libmeasurement_kit/common/non_copyable.hpp"
+#include "src/libmeasurement_kit/common/non_movable.hpp"
+
+namespace mk {
+
+// MpmcQueue is a bounded, lock-free, multi-producer multi-consumer queue. It
+// implements Dmitry Vyukov's algorithm: each cell carries a sequence number
+// telling producers and consumers whether it is their turn to use it, such
+// that enqueue and dequeue only cost a CAS on the shared position plus one
+// store on the cell sequence. The capacity is rounded up to a power of two.
+//
+// See <http://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue>.
+template <typename Type> class MpmcQueue : public NonCopyable, public NonMovable {
+  public:
+    explicit MpmcQueue(size_t capacity) {
+        size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+            if (size == 0) {
+                throw std::length_error("MpmcQueue: capacity too large");
+            }
+        }
+        mask_ = size - 1;
+        cells_.reset(new Cell[size]);
+        for (size_t i = 0; i < size; ++i) {
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    // try_push moves value into the queue. Returns false, without touching
+    // value, if the queue is full.
+    bool try_push(Type &value) {
+        Cell *cell = nullptr;
+        size_t pos = enqueue_.pos.load(std::memory_order_relaxed);
+        for (;;) {
+            cell = &cells_[pos & mask_];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0) {
+                if (enqueue_.pos.compare_exchange_weak(
+                            pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = enqueue_.pos.load(std::memory_order_relaxed);
+            }
+        }
+        cell->value = std::move(value);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // try_pop moves the oldest value into value. Returns false if the
+    // queue is empty.
+    bool try_pop(Type &value) {
+        Cell *cell = nullptr;
+        size_t pos = dequeue_.pos.load(std::memory_order_relaxed);
+        for (;;) {
+            cell = &cells_[pos & mask_];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+            if (diff == 0) {
+                if (dequeue_.pos.compare_exchange_weak(
+                            pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = dequeue_.pos.load(std::memory_order_relaxed);
+            }
+        }
+        value = std::move(cell->value);
+        cell->value = Type{}; // release resources held by the moved-from value
+        cell->sequence.store(pos + mask_ + 1, std::memory_order_release);
+        return true;
+    }
+
+    // capacity returns the real capacity of the queue.
+    size_t capacity() const { return mask_ + 1; }
+
+    // size_approx returns the number of queued elements. The value may
+    // already be stale when it is returned, hence the name.
+    size_t size_approx() const {
+        size_t enq = enqueue_.pos.load(std::memory_order_relaxed);
+        size_t deq = dequeue_.pos.load(std::memory_order_relaxed);
+        return (enq > deq) ? enq - deq : 0;
+    }
+
+  private:
+    class Cell {
+      public:
+        std::atomic<size_t> sequence{0};
+        Type value{};
+    };
+
+    // Keep the positions on different cache lines to avoid false sharing
+    // between producers and consumers. We use padding rather than alignas
+    // because C++14 operator new does not honour extended alignment.
+    static constexpr size_t cacheline_size = 64;
+
+    class Position {
+      public:
+        char before[cacheline_size];
+        std::atomic<size_t> pos{0};
+        char after[cacheline_size];
+    };
+
+    std::unique_ptr<Cell[]> cells_;
+    size_t mask_ = 0;
+    Position enqueue_;
+    Position dequeue_;
+};
+
+} // namespace mk
+#endif
@@ -8,59 +8,115 @@
 
 #include "src/libmeasurement_kit/common/continuation.hpp"
 #include "src/libmeasurement_kit/common/error.hpp"
+#include "src/libmeasurement_kit/common/non_copyable.hpp"
+#include "src/libmeasurement_kit/common/non_movable.hpp"
+
+#include <atomic>
+#include <stdexcept>
+#include <utility>
+#include <vector>
 
 namespace mk {
 
-static inline void run(size_t idx, std::vector<Continuation<Error>> input,
-                       Callback<Error> cb, SharedPtr<Error> overall,
-                       SharedPtr<size_t> completed, size_t parallelism) {
-    if (idx < input.size()) {
-        input[idx]([=](Error error) {
-            // XXX: code not thread safe, to make thread safe we could
-            // share a mutex or use call_later() to serialize
-            if (error && *overall == NoError()) {
-                static const Error template_error = ParallelOperationError();
-                overall->code = template_error.code;
-                overall->reason = template_error.reason;
-                // FALLTHROUGH
-            }
-            overall->child_errors[idx] = error;
-            *completed += 1;
-            if (*completed == input.size()) {
-                cb(*overall);
-                return;
-            }
-            if (*completed > input.size()) {
-                // Use exception, not assert, so it cannot be disabled using
-                // compiler flags and we always make this check
-                throw std::runtime_error("unexpected *complete value");
-            }
-            run(idx + parallelism, input, cb, overall, completed, parallelism);
-        });
+// ParallelState is the state shared by the lanes of a parallel operation.
+//
+// Lanes pick the next operation to run using a shared cursor, so a lane
+// that completes early immediately starts another operation rather than
+// waiting for operations statically assigned to it. Each slot of `input`
+// and of `overall.child_errors` is only accessed by the lane that claimed
+// its index, and `completed` is atomic, so operations can complete in any
+// thread. The final callback is called exactly once, by the lane whose
+// completion brings `completed` to the number of operations.
+class ParallelState : public NonCopyable, public NonMovable {
+  public:
+    ParallelState(std::vector<Continuation<Error>> &&i, Callback<Error> &&c,
+                  bool ff)
+        : input{std::move(i)}, callback{std::move(c)}, fail_fast{ff} {
+        overall.child_errors.resize(input.size(), NoError());
+    }
+
+    std::vector<Continuation<Error>> input;
+    Callback<Error> callback;
+    Error overall = NoError();
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> completed{0};
+    std::atomic_bool failed{false};
+    bool fail_fast = false;
+};
+
+static inline void parallel_complete(SharedPtr<ParallelState> state,
+                                     size_t count) {
+    size_t total = state->input.size();
+    size_t completed = state->completed.fetch_add(count) + count;
+    if (completed > total) {
+        // Use exception, not assert, so it cannot be disabled using
+        // compiler flags and we always make this check
+        throw std::runtime_error("unexpected completed value");
     }
+    if (completed == total) {
+        if (state->failed) {
+            static const Error template_error = ParallelOperationError();
+            state->overall.code = template_error.code;
+            state->overall.reason = template_error.reason;
+        }
+        Callback<Error> callback = std::move(state->callback);
+        callback(state->overall);
+    }
+}
+
+static inline void parallel_run_next(SharedPtr<ParallelState> state) {
+    size_t idx = state->next.fetch_add(1);
+    if (idx >= state->input.size()) {
+        return;
+    }
+    // Move the operation out of the vector, so that what it captured is
+    // released as soon as it completes rather than at the end.
+    Continuation<Error> func = std::move(state->input[idx]);
+    func([state, idx](Error error) {
+        size_t count = 1;
+        state->overall.child_errors[idx] = error;
+        if (error) {
+            state->failed = true;
+            if (state->fail_fast) {
+                // Claim all the operations not started yet so that no
+                // lane will start them and account for them here.
+                size_t total = state->input.size();
+                size_t first = state->next.exchange(total);
+                for (size_t i = first; i < total; ++i) {
+                    state->overall.child_errors[i] = OperationCancelledError();
+                    state->input[i] = nullptr;
+                    ++count;
+                }
+            }
+        }
+        parallel_complete(state, count);
+        parallel_run_next(state);
+    });
 }
 
+// parallel runs the operations in `input` with at most `parallelism` of
+// them running at any time (all of them if `parallelism` is zero), and
+// calls `cb` once all of them have completed. The error passed to `cb` is
+// ParallelOperationError if any operation failed, and its child errors
+// contain the result of each operation in the order of `input`.
+//
+// If `fail_fast` is true, the first failure prevents the operations not
+// started yet from running, and their child error is OperationCancelledError.
+// Operations already running are not interrupted.
 static inline void parallel(std::vector<Continuation<Error>> input,
-                            Callback<Error> cb, size_t parallelism = 0) {
-    SharedPtr<Error> overall(new Error(NoError()));
+                            Callback<Error> cb, size_t parallelism = 0,
+                            bool fail_fast = false) {
     if (input.size() <= 0) {
-        cb(*overall);
+        cb(NoError());
         return;
     }
-    overall->child_errors.resize(input.size(), NoError());
-    SharedPtr<size_t> completed(new size_t(0));
-    if (parallelism <= 0) {
+    if (parallelism <= 0 || parallelism > input.size()) {
         parallelism = input.size();
     }
-    /*
-     * Possible improvement: use an atomic shared integer as opposed to
-     * using a counter to speed up the parallel process at the end, when
-     * some "threads" could terminate earlier than others.
-     *
-     * Enhancement suggested by @AntonioLangiu.
-     */
-    for (size_t idx = 0; idx < parallelism; ++idx) {
-        run(idx, input, cb, overall, completed, parallelism);
+    SharedPtr<ParallelState> state{
+            new ParallelState{std::move(input), std::move(cb), fail_fast}};
+    for (size_t lane = 0; lane < parallelism; ++lane) {
+        parallel_run_next(state);
     }
 }
 
@@ -13,7 +13,7 @@ namespace mk {
 
 Reactor::~Reactor() {}
 
-void Reactor::run_with_initial_event(Callback<> &&cb) {
+void Reactor::run_with_initial_event(UniqueCallback<> &&cb) {
     call_soon(std::move(cb));
     run();
 }
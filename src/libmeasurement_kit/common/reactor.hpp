@@ -8,15 +8,54 @@
 #include "src/libmeasurement_kit/common/logger.hpp"
 #include "src/libmeasurement_kit/common/callback.hpp"
 #include "src/libmeasurement_kit/common/error.hpp"
+#include "src/libmeasurement_kit/common/histogram.hpp"
 
 #include <measurement_kit/common/data_usage.hpp>
 #include <measurement_kit/common/logger.hpp>
 #include <measurement_kit/common/shared_ptr.hpp>
 
+#include <stdint.h>
+
 struct event_base;
 
 namespace mk {
 
+/// \brief `TimerHandle` identifies a callback scheduled using
+/// Reactor::call_later(). A default constructed handle is not valid.
+class TimerHandle {
+  public:
+    uint64_t id = 0;
+
+    /// `valid()` returns true if the handle refers to a callback.
+    bool valid() const { return id != 0; }
+};
+
+/// \brief `ReactorStats` contains the statistics collected by a Reactor
+/// when instrumentation is enabled. Times are in microseconds.
+class ReactorStats {
+  public:
+    /// `callback_time` is the wall time spent running each callback in
+    /// the I/O thread. Long callbacks block the event loop.
+    Histogram callback_time;
+
+    /// `loop_lag` is the time between when a call_soon() or call_later()
+    /// callback was due and when it actually started running. A high lag
+    /// means that the event loop is busy or blocked.
+    Histogram loop_lag;
+
+    /// `pending_timers` is the number of pending call_later() callbacks,
+    /// sampled each time a delayed callback runs.
+    Histogram pending_timers;
+
+    /// `pending_polls` is the number of pending pollin_once() and
+    /// pollout_once() calls, sampled each time one of them is issued.
+    Histogram pending_polls;
+
+    /// `worker_queue_depth` is the number of callbacks waiting for a
+    /// background thread, sampled each time call_in_thread() is called.
+    Histogram worker_queue_depth;
+};
+
 /// \brief `Reactor` reacts to I/O events and manages delayed calls. Most MK
 /// objects reference a specific Reactor.
 ///
@@ -49,11 +88,11 @@ class Reactor {
     virtual ~Reactor();
 
     /// \brief `call_in_thread()` schedules the execution of \p cb
-    /// inside a background thread created on demand. A maximum
-    /// of three such threads can be active at any time. Additionally
-    /// scheduled callback will wait for a thread to be ready to
-    /// serve them. When there are no further callbacks to execute,
-    /// background threads will exit, to save resources.
+    /// inside a background thread. Threads are created on demand, up
+    /// to the number of cores (but at least three), and then persist
+    /// for the lifetime of the reactor, sleeping when idle. Additionally
+    /// scheduled callbacks wait in a bounded queue for a thread to be
+    /// ready to serve them.
     ///
     /// The \p logger parameter is the logger to be used.
     ///
@@ -61,7 +100,8 @@ class Reactor {
     /// possible to create a background thread or schedule the callback.
     ///
     /// If \p cb throws an exception, this exception propagates.
-    virtual void call_in_thread(SharedPtr<Logger> logger, Callback<> &&cb) = 0;
+    virtual void call_in_thread(
+            SharedPtr<Logger> logger, UniqueCallback<> &&cb) = 0;
 
     /// \brief `call_soon() schedules the execution of \p cb in the
     /// I/O thread as soon as possible.
@@ -71,13 +111,28 @@ class Reactor {
     ///
     /// \bug Any exception thrown by the callback will not be swallowed
     /// and will thus cause the stack to unwind.
-    virtual void call_soon(Callback<> &&cb) = 0;
+    virtual void call_soon(UniqueCallback<> &&cb) = 0;
 
     /// \brief `call_later()` is like `call_soon()` except that the callback
     /// is scheduled `time` seconds in the future.
     ///
+    /// \return a handle that you can pass to cancel() to prevent the
+    /// callback from being called. You can ignore the handle if you don't
+    /// need to cancel the callback.
+    ///
     /// \bug if \p time is negative, the callback will never be called.
-    virtual void call_later(double time, Callback<> &&cb) = 0;
+    virtual TimerHandle call_later(double time, UniqueCallback<> &&cb) = 0;
+
+    /// \brief `cancel()` cancels the callback identified by \p handle, which
+    /// will not be called, and destroys it. It is cheap to cancel callbacks,
+    /// so you should cancel timeouts that are not needed anymore.
+    ///
+    /// \return true if the callback was cancelled, false if it has already
+    /// been called, or cancelled, or if \p handle is not valid.
+    ///
+    /// \note You should call `cancel()` from the I/O thread, otherwise the
+    /// callback may be running concurrently when cancel() returns false.
+    virtual bool cancel(TimerHandle handle) = 0;
 
     // Design note: I prefer separate pollin_once() and pollout_once()
     // operations to a single function call (previously it was called pollfd())
@@ -104,11 +159,11 @@ class Reactor {
     /// \param cb is the callback to be called. The Error argument will
     /// be TimeoutError if the timeout expired, NoError otherwise.
     virtual void pollin_once(
-            socket_t sockfd, double timeout, Callback<Error> &&cb) = 0;
+            socket_t sockfd, double timeout, UniqueCallback<Error> &&cb) = 0;
 
     /// `pollout_once()` is like pollin_once() but for writability.
     virtual void pollout_once(
-            socket_t sockfd, double timeout, Callback<Error> &&cb) = 0;
+            socket_t sockfd, double timeout, UniqueCallback<Error> &&cb) = 0;
 
     /// \brief `get_event_base()` returns libevent's event base.
     /// \throw std::exception (or a derived class) if the backend is not
@@ -119,7 +174,7 @@ class Reactor {
 
     /// \brief `run_with_initial_event` is syntactic sugar for calling
     /// call_soon() immediately followed by run().
-    void run_with_initial_event(Callback<> &&cb);
+    void run_with_initial_event(UniqueCallback<> &&cb);
 
     /// \brief `run()` blocks processing I/O events and delayed calls.
     /// \throw std::exception (or a derived class) if it is not possible
@@ -137,6 +192,22 @@ class Reactor {
     /// to stop the reactor.
     virtual void stop() = 0;
 
+    /// \brief `on_stop()` registers \p cb to be called once, in the I/O
+    /// thread, when run() returns. Callbacks that have not been called
+    /// yet are called when the reactor is destroyed. Use this function to
+    /// release resources bound to the event base, e.g. pooled ones.
+    virtual void on_stop(UniqueCallback<> &&cb) = 0;
+
+    /// \brief `set_instrumentation()` enables or disables collecting the
+    /// statistics returned by instrumentation_stats(). It is disabled by
+    /// default. When enabled, the overhead is a couple of clock readings
+    /// and a few atomic increments per callback.
+    virtual void set_instrumentation(bool enabled) = 0;
+
+    /// `instrumentation_stats()` returns a snapshot of the statistics
+    /// collected while instrumentation was enabled.
+    virtual ReactorStats instrumentation_stats() = 0;
+
     // `with_current_data_usage` invokes the specified callback immediately in
     // a context in which it is safe to read/write the current data usage as
     // seen by this reactor so far. Data usage is reported by networking level
@@ -37,16 +37,29 @@ class Scalar : public std::string {
     /// \return the converted value otherwise.
     template <typename Type, typename = typename std::enable_if<
                     std::is_arithmetic<Type>::value>::type> Type as() const {
-        std::stringstream ss{c_str()};
         Type value{};
+        const char *reason = try_as(value);
+        if (reason != nullptr) {
+            throw std::runtime_error(reason);
+        }
+        return value;
+    }
+
+    /// \brief `try_as()` is like as() but, rather than throwing on error,
+    /// returns the reason why the conversion failed. \return nullptr on
+    /// success, in which case \p value is the converted value.
+    template <typename Type, typename = typename std::enable_if<
+                    std::is_arithmetic<Type>::value>::type>
+    const char *try_as(Type &value) const {
+        std::stringstream ss{c_str()};
         ss >> value;
         if (!ss.eof()) {
-            throw std::runtime_error("not_all_input_was_converted");
+            return "not_all_input_was_converted";
         }
         if (ss.fail()) {
-            throw std::runtime_error("wrong_input_format");
+            return "wrong_input_format";
         }
-        return value;
+        return nullptr;
     }
 
     std::string as_string() const { return c_str(); }
@@ -0,0 +1,181 @@
+// Part of Measurement Kit <https://measurement-kit.github.io/>.
+// Measurement Kit is free software under the BSD license. See AUTHORS
+// and LICENSE for more information on the copying conditions.
+
+#include "src/libmeasurement_kit/common/secure_random.hpp"
+
+#include <string.h>
+
+#include <atomic>
+#include <mutex>
+#include <stdexcept>
+
+#include <event2/util.h>
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+namespace mk {
+
+static inline uint32_t rotl32(uint32_t v, int c) {
+    return (v << c) | (v >> (32 - c));
+}
+
+#define QUARTERROUND(a, b, c, d)                                               \
+    a += b;                                                                    \
+    d = rotl32(d ^ a, 16);                                                     \
+    c += d;                                                                    \
+    b = rotl32(b ^ c, 12);                                                     \
+    a += b;                                                                    \
+    d = rotl32(d ^ a, 8);                                                      \
+    c += d;                                                                    \
+    b = rotl32(b ^ c, 7);
+
+void chacha20_block(const uint32_t key[8], uint64_t counter, uint64_t nonce,
+                    uint8_t out[64]) {
+    uint32_t input[16] = {
+            0x61707865, 0x3320646e, 0x79622d32, 0x6b206574, // "expand 32-byte k"
+            key[0], key[1], key[2], key[3],
+            key[4], key[5], key[6], key[7],
+            (uint32_t)counter, (uint32_t)(counter >> 32),
+            (uint32_t)nonce, (uint32_t)(nonce >> 32),
+    };
+    uint32_t x[16];
+    memcpy(x, input, sizeof(x));
+    for (int i = 0; i < 10; ++i) {
+        QUARTERROUND(x[0], x[4], x[8], x[12]);
+        QUARTERROUND(x[1], x[5], x[9], x[13]);
+        QUARTERROUND(x[2], x[6], x[10], x[14]);
+        QUARTERROUND(x[3], x[7], x[11], x[15]);
+        QUARTERROUND(x[0], x[5], x[10], x[15]);
+        QUARTERROUND(x[1], x[6], x[11], x[12]);
+        QUARTERROUND(x[2], x[7], x[8], x[13]);
+        QUARTERROUND(x[3], x[4], x[9], x[14]);
+    }
+    for (int i = 0; i < 16; ++i) {
+        uint32_t v = x[i] + input[i];
+        // Serialize as little endian regardless of the host byte order
+        out[4 * i + 0] = (uint8_t)v;
+        out[4 * i + 1] = (uint8_t)(v >> 8);
+        out[4 * i + 2] = (uint8_t)(v >> 16);
+        out[4 * i + 3] = (uint8_t)(v >> 24);
+    }
+}
+
+#undef QUARTERROUND
+
+// Incremented in the child after fork(), so that each thread notices that
+// it must not continue producing the same stream as the parent.
+static std::atomic<unsigned> fork_generation{0};
+
+#ifndef _WIN32
+static void on_fork_child() { fork_generation += 1; }
+#endif
+
+/*static*/ constexpr size_t SecureRandom::buffered_blocks;
+/*static*/ constexpr uint64_t SecureRandom::reseed_interval;
+
+void SecureRandom::reseed() {
+#ifndef _WIN32
+    static std::once_flag once;
+    std::call_once(once, []() {
+        if (pthread_atfork(nullptr, nullptr, on_fork_child) != 0) {
+            throw std::runtime_error("pthread_atfork");
+        }
+    });
+#endif
+    generation_ = fork_generation.load();
+    // This is libevent's arc4random, which is seeded from the system
+    evutil_secure_rng_get_bytes(key_, sizeof(key_));
+    counter_ = 0;
+    offset_ = sizeof(buffer_);
+    seeded_ = true;
+}
+
+void SecureRandom::generate(uint8_t *out, size_t blocks) {
+    if (!seeded_ || counter_ >= reseed_interval ||
+        generation_ != fork_generation.load(std::memory_order_relaxed)) {
+        reseed();
+    }
+    for (size_t i = 0; i < blocks; ++i) {
+        chacha20_block(key_, counter_++, 0, out + 64 * i);
+    }
+}
+
+void SecureRandom::fill(void *buffer, size_t count) {
+    uint8_t *p = static_cast<uint8_t *>(buffer);
+    // First use what is left in the buffer
+    size_t n = sizeof(buffer_) - offset_;
+    if (n > count) {
+        n = count;
+    }
+    memcpy(p, buffer_ + offset_, n);
+    offset_ += n;
+    p += n;
+    count -= n;
+    // Then write whole blocks directly into the output
+    size_t blocks = count / 64;
+    if (blocks > 0) {
+        generate(p, blocks);
+        p += 64 * blocks;
+        count -= 64 * blocks;
+    }
+    // Finally refill the buffer and use it for the tail
+    if (count > 0) {
+        generate(buffer_, buffered_blocks);
+        memcpy(p, buffer_, count);
+        offset_ = count;
+    }
+}
+
+SecureRandom::result_type SecureRandom::operator()() {
+    result_type value = 0;
+    fill(&value, sizeof(value));
+    return value;
+}
+
+uint64_t SecureRandom::uniform(uint64_t bound) {
+    if (bound == 0) {
+        throw std::runtime_error("uniform_with_zero_bound");
+    }
+    // Reject the values below 2**64 % bound, so that the remaining range
+    // is a multiple of bound (see OpenBSD's arc4random_uniform).
+    uint64_t min = (0 - bound) % bound;
+    for (;;) {
+        uint64_t value = (*this)();
+        if (value >= min) {
+            return value % bound;
+        }
+    }
+}
+
+SecureRandom &secure_random() {
+    static thread_local SecureRandom instance;
+    return instance;
+}
+
+void secure_random_bytes(void *buffer, size_t count) {
+    secure_random().fill(buffer, count);
+}
+
+std::string secure_random_uuid4() {
+    static const char digits[] = "0123456789abcdef";
+    uint8_t b[16];
+    secure_random_bytes(b, sizeof(b));
+    // See <https://tools.ietf.org/html/rfc4122#section-4.4>
+    b[6] = (uint8_t)((b[6] & 0x0f) | 0x40);
+    b[8] = (uint8_t)((b[8] & 0x3f) | 0x80);
+    char s[36];
+    char *p = s;
+    for (size_t i = 0; i < sizeof(b); ++i) {
+        if (i == 4 || i == 6 || i == 8 || i == 10) {
+            *p++ = '-';
+        }
+        *p++ = digits[b[i] >> 4];
+        *p++ = digits[b[i] & 0x0f];
+    }
+    return std::string(s, sizeof(s));
+}
+
+} // namespace mk
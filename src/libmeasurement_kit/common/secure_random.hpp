@@ -0,0 +1,76 @@
+// Part of Measurement Kit <https://measurement-kit.github.io/>.
+// Measurement Kit is free software under the BSD license. See AUTHORS
+// and LICENSE for more information on the copying conditions.
+#ifndef SRC_LIBMEASUREMENT_KIT_COMMON_SECURE_RANDOM_HPP
+#define SRC_LIBMEASUREMENT_KIT_COMMON_SECURE_RANDOM_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+
+#include "src/libmeasurement_kit/common/non_copyable.hpp"
+#include "src/libmeasurement_kit/common/non_movable.hpp"
+
+namespace mk {
+
+// chacha20_block computes the ChaCha20 block for `key`, `counter` and
+// `nonce` (RFC 7539 with the original 64 bit counter and 64 bit nonce
+// layout) and writes the resulting 64 bytes of keystream into `out`.
+void chacha20_block(const uint32_t key[8], uint64_t counter, uint64_t nonce,
+                    uint8_t out[64]);
+
+// SecureRandom is a cryptographically secure pseudorandom generator using
+// the ChaCha20 keystream as output. It is seeded from the operating system
+// on first use, reseeded periodically and after fork(), and produces many
+// blocks at a time, so generating random data is mostly a memcpy().
+//
+// SecureRandom is not thread safe. Use secure_random(), which returns an
+// instance private to the calling thread. It models the standard library
+// UniformRandomBitGenerator concept, so it can be used with std::shuffle().
+class SecureRandom : public NonCopyable, public NonMovable {
+  public:
+    using result_type = uint64_t;
+
+    // Number of blocks produced at a time.
+    static constexpr size_t buffered_blocks = 4;
+
+    // Number of blocks after which we fetch a new key from the system.
+    static constexpr uint64_t reseed_interval = 1 << 16;
+
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return UINT64_MAX; }
+
+    result_type operator()();
+
+    // fill writes `count` random bytes into `buffer`.
+    void fill(void *buffer, size_t count);
+
+    // uniform returns a random number in [0, `bound`) without modulo bias.
+    // Throws std::runtime_error if `bound` is zero.
+    uint64_t uniform(uint64_t bound);
+
+  private:
+    void generate(uint8_t *out, size_t blocks);
+    void reseed();
+
+    uint32_t key_[8] = {};
+    uint64_t counter_ = 0;
+    unsigned generation_ = 0;
+    bool seeded_ = false;
+    size_t offset_ = sizeof(buffer_);
+    uint8_t buffer_[64 * buffered_blocks] = {};
+};
+
+// secure_random returns the SecureRandom instance of the calling thread.
+SecureRandom &secure_random();
+
+// secure_random_bytes writes `count` random bytes into `buffer`.
+void secure_random_bytes(void *buffer, size_t count);
+
+// secure_random_uuid4 returns a new random (version 4) UUID formatted as
+// a lowercase string, e.g. "c5ba0c08-2f4e-4f18-9b5f-1bd2bd7e6e9e".
+std::string secure_random_uuid4();
+
+} // namespace mk
+#endif
@@ -6,24 +6,262 @@
 
 #include "src/libmeasurement_kit/common/scalar.hpp"
 
+#include <initializer_list>
+#include <limits>
 #include <map>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <utility>
 
 namespace mk {
 
+/// \brief `SettingsValue` is a Scalar stored into Settings. When it is
+/// constructed, it also parses itself as an integer and as a double, so that
+/// Settings::get() usually converts it without parsing.
+class SettingsValue : public Scalar {
+  public:
+    SettingsValue() { parse(); }
+
+    SettingsValue(const Scalar &value) : Scalar{value} { parse(); }
+
+    SettingsValue(Scalar &&value) : Scalar{std::move(value)} { parse(); }
+
+    template <typename Type> SettingsValue(Type value) : Scalar{value} {
+        parse();
+    }
+
+    /// \brief `parse()` parses the value again. Call it after modifying the
+    /// value using the methods of Scalar.
+    void parse() {
+        integer_error_ = try_as(integer_);
+        real_error_ = try_as(real_);
+    }
+
+    /// \brief `as_parsed()` is like as() but, for the types that are usually
+    /// read from Settings, it uses the value parsed by parse().
+    /// \throw std::runtime_error if the conversion is not possible.
+    template <typename Type> Type as_parsed() const {
+        return as_parsed_(static_cast<Type *>(nullptr));
+    }
+
+  private:
+    // The standard library reads bool, short and int as a long and then
+    // checks the range, hence we can derive them from the parsed integer.
+    template <typename Type>
+    using Parsed = std::integral_constant<bool,
+            std::is_same<Type, bool>::value ||
+            std::is_same<Type, short>::value ||
+            std::is_same<Type, int>::value ||
+            std::is_same<Type, long>::value ||
+            std::is_same<Type, long long>::value>;
+
+    template <typename Type>
+    using Unsigned = std::integral_constant<bool,
+            std::is_same<Type, unsigned short>::value ||
+            std::is_same<Type, unsigned int>::value ||
+            std::is_same<Type, unsigned long>::value ||
+            std::is_same<Type, unsigned long long>::value>;
+
+    template <typename Type>
+    typename std::enable_if<Parsed<Type>::value, Type>::type
+    as_parsed_(Type *) const {
+        if (integer_error_ != nullptr) {
+            throw std::runtime_error(integer_error_);
+        }
+        if (integer_ < std::numeric_limits<Type>::min() ||
+            integer_ > std::numeric_limits<Type>::max()) {
+            throw std::runtime_error("wrong_input_format");
+        }
+        return static_cast<Type>(integer_);
+    }
+
+    // Negative values, which num_get wraps around, and values larger than
+    // the largest integer are not parsed in advance.
+    template <typename Type>
+    typename std::enable_if<Unsigned<Type>::value, Type>::type
+    as_parsed_(Type *) const {
+        if (integer_error_ != nullptr || integer_ < 0 ||
+            (unsigned long long)integer_ > std::numeric_limits<Type>::max()) {
+            return as<Type>();
+        }
+        return static_cast<Type>(integer_);
+    }
+
+    double as_parsed_(double *) const {
+        if (real_error_ != nullptr) {
+            throw std::runtime_error(real_error_);
+        }
+        return real_;
+    }
+
+    template <typename Type>
+    typename std::enable_if<!Parsed<Type>::value && !Unsigned<Type>::value,
+            Type>::type
+    as_parsed_(Type *) const {
+        return as<Type>();
+    }
+
+    long long integer_ = 0;
+    const char *integer_error_ = nullptr;
+    double real_ = 0.0;
+    const char *real_error_ = nullptr;
+};
+
 /// \brief `Settings` maps a key string to a Scalar value. This class is used
 /// throughout MK to pass around settings. We generally pass Settings around by
 /// value, so each function has its private copy.
 ///
-/// Settings is a derived class of std::map<std::string, Scalar>. As such
-/// it has all the methods of a standard std::map.
+/// Settings is copy-on-write: copies share the same immutable storage until
+/// one of them is modified, hence copying Settings usually only costs a
+/// reference count increment.
+///
+/// Settings has the read-only methods of std::map<std::string, Scalar>,
+/// and its iterators are always const. Entries are added or modified using
+/// operator[], insert() and emplace(), which take a private copy of the
+/// storage if it is shared with other objects. Since the reference returned
+/// by operator[] may be used to modify the entry later, after operator[] has
+/// been called the storage is not shared anymore and copying the object makes
+/// a deep copy. The copy itself can again be copied cheaply.
+///
+/// Entries are parsed when they are added and when they are deep copied, so
+/// get() does not need to parse them. Only the entries of an object on which
+/// operator[] has been called are parsed again by get(), since they may have
+/// been modified through the returned reference.
 ///
 /// \since v0.1.0.
 ///
 /// Support for mapping from string to any scalar type (rather than to
 /// just strings) was added in MK v0.2.0.
-class Settings : public std::map<std::string, Scalar> {
+///
+/// Settings used to derive from std::map<std::string, Scalar>, so each
+/// copy was a deep copy; it became copy-on-write after MK v0.10.11.
+class Settings {
   public:
-    using std::map<std::string, Scalar>::map;
+    using key_type = std::string;
+    using mapped_type = SettingsValue;
+    using Map = std::map<std::string, SettingsValue>;
+    using value_type = Map::value_type;
+    using size_type = Map::size_type;
+    using const_iterator = Map::const_iterator;
+    using iterator = const_iterator;
+
+    /// \brief The default constructor constructs empty settings without
+    /// allocating any storage.
+    Settings() {}
+
+    Settings(const Settings &other) { *this = other; }
+
+    Settings(Settings &&other) noexcept
+        : data_{std::move(other.data_)}, unshareable_{other.unshareable_} {
+        other.unshareable_ = false;
+    }
+
+    /// \brief The copy assignment shares the storage of \p other unless a
+    /// reference to one of the entries of \p other may still be around.
+    Settings &operator=(const Settings &other) {
+        if (this != &other) {
+            if (other.unshareable_) {
+                data_ = std::make_shared<Map>(*other.data_);
+                for (auto &entry : *data_) {
+                    entry.second.parse();
+                }
+            } else {
+                data_ = other.data_;
+            }
+            unshareable_ = false;
+        }
+        return *this;
+    }
+
+    Settings &operator=(Settings &&other) noexcept {
+        if (this != &other) {
+            data_ = std::move(other.data_);
+            unshareable_ = other.unshareable_;
+            other.unshareable_ = false;
+        }
+        return *this;
+    }
+
+    /// \brief The constructor with initializer list initializes settings
+    /// with the specified key, value pairs.
+    Settings(std::initializer_list<value_type> il) {
+        if (il.size() > 0) {
+            data_ = std::make_shared<Map>(il);
+        }
+    }
+
+    /// \brief The constructor with iterators initializes settings with
+    /// the key, value pairs in the [\p first, \p last) range.
+    template <typename Iterator> Settings(Iterator first, Iterator last) {
+        if (first != last) {
+            data_ = std::make_shared<Map>(first, last);
+        }
+    }
+
+    const_iterator begin() const noexcept { return entries().begin(); }
+    const_iterator end() const noexcept { return entries().end(); }
+    const_iterator cbegin() const noexcept { return begin(); }
+    const_iterator cend() const noexcept { return end(); }
+
+    bool empty() const noexcept { return entries().empty(); }
+    size_type size() const noexcept { return entries().size(); }
+
+    const_iterator find(const std::string &key) const {
+        return entries().find(key);
+    }
+
+    size_type count(const std::string &key) const {
+        return entries().count(key);
+    }
+
+    /// \brief `at()` returns the value of \p key.
+    /// \throw std::out_of_range if \p key is not set.
+    const Scalar &at(const std::string &key) const {
+        return entries().at(key);
+    }
+
+    /// \brief `operator[]` returns a reference to the value of \p key,
+    /// inserting an empty value if \p key is not set. From now on, copies
+    /// of this object will not share its storage.
+    Scalar &operator[](const std::string &key) {
+        Scalar &value = mutable_entries()[key];
+        unshareable_ = true;
+        return value;
+    }
+
+    Scalar &operator[](std::string &&key) {
+        Scalar &value = mutable_entries()[std::move(key)];
+        unshareable_ = true;
+        return value;
+    }
+
+    std::pair<const_iterator, bool> insert(const value_type &value) {
+        return mutable_entries().insert(value);
+    }
+
+    template <typename... Args>
+    std::pair<const_iterator, bool> emplace(Args &&... args) {
+        return mutable_entries().emplace(std::forward<Args>(args)...);
+    }
+
+    size_type erase(const std::string &key) {
+        if (count(key) <= 0) {
+            return 0;
+        }
+        return mutable_entries().erase(key);
+    }
+
+    void clear() noexcept {
+        data_.reset();
+        unshareable_ = false;
+    }
+
+    bool operator==(const Settings &other) const {
+        return data_ == other.data_ || entries() == other.entries();
+    }
+
+    bool operator!=(const Settings &other) const { return !(*this == other); }
 
     /// \brief `get()` returns the specified \p key if set; otherwise it
     /// returns the default value \p def_value.
@@ -31,33 +269,57 @@ class Settings : public std::map<std::string, Scalar> {
     /// converted to the specified type.
     template <typename Type, typename = typename std::enable_if<
                     std::is_arithmetic<Type>::value>::type>
-             Type get(std::string key, Type def_value) const {
-        if (find(key) == end()) {
+             Type get(const std::string &key, Type def_value) const {
+        auto it = find(key);
+        if (it == end()) {
             return def_value;
         }
-        return at(key).as<Type>();
+        if (unshareable_) {
+            return it->second.as<Type>();
+        }
+        return it->second.as_parsed<Type>();
     }
 
-    std::string get(std::string key, std::string def_value) const {
-        if (find(key) == end()) {
+    std::string get(const std::string &key, std::string def_value) const {
+        auto it = find(key);
+        if (it == end()) {
             return def_value;
         }
-        return at(key).as_string();
+        return it->second.as_string();
     }
 
     /// `get_noexcept` is like `get()` but returns Error rather than throwing.
     template <typename Type>
-    ErrorOr<Type> get_noexcept(std::string key, Type def_value) const {
-        if (find(key) == end()) {
-            return {NoError(), def_value};
+    ErrorOr<Type> get_noexcept(const std::string &key, Type def_value) const {
+        try {
+            return {NoError(), get(key, def_value)};
+        } catch (const std::exception &e) {
+            return {ValueError{e.what()}, {}};
         }
-        return at(key).as_noexcept<Type>();
     }
 
-  protected:
   private:
-    // NO ATTRIBUTES HERE BY DESIGN. DO NOT ADD ATTRIBUTES HERE BECAUSE
-    // DOING THAT CREATES THE RISK OF OBJECT SLICING.
+    const Map &entries() const noexcept {
+        static const Map no_entries;
+        return (data_) ? *data_ : no_entries;
+    }
+
+    // Makes sure we are the only owner of data_ before modifying it. If we
+    // own data_ no other thread could be copying it, so use_count is safe.
+    Map &mutable_entries() {
+        if (!data_) {
+            data_ = std::make_shared<Map>();
+        } else if (data_.use_count() > 1) {
+            data_ = std::make_shared<Map>(*data_);
+        }
+        return *data_;
+    }
+
+    std::shared_ptr<Map> data_;
+
+    // Set when a reference to an entry escapes through operator[]; while
+    // it is set data_ is never shared, so use_count is always one.
+    bool unshareable_ = false;
 };
 
 } // namespace mk
@@ -0,0 +1,261 @@
+// Part of Measurement Kit <https://measurement-kit.github.io/>.
+// Measurement Kit is free software under the BSD license. See AUTHORS
+// and LICENSE for more information on the copying conditions.
+
+#include "src/libmeasurement_kit/common/timer_wheel.hpp"
+
+#include <cassert>
+#include <stdexcept>
+#include <utility>
+
+namespace mk {
+
+constexpr unsigned TimerWheel::level_bits;
+constexpr unsigned TimerWheel::levels;
+constexpr uint64_t TimerWheel::slots;
+constexpr uint64_t TimerWheel::max_delay;
+constexpr TimerWheel::Index TimerWheel::nil;
+constexpr unsigned TimerWheel::words;
+
+static unsigned count_trailing_zeros(uint64_t x) {
+    assert(x != 0);
+#if defined __GNUC__
+    return (unsigned)__builtin_ctzll(x);
+#else
+    unsigned n = 0;
+    while ((x & 1) == 0) {
+        x >>= 1;
+        ++n;
+    }
+    return n;
+#endif
+}
+
+// Returns the distance in [1, words * 64] from `pos` to the first bit set
+// after it in the bitmap, wrapping around, or zero if no bit is set. If
+// only the bit at `pos` is set, the distance is a whole rotation.
+static uint64_t next_set_bit(const uint64_t *bitmap, unsigned words,
+                             uint64_t pos) {
+    uint64_t nbits = words * 64;
+    uint64_t begin = (pos + 1) % nbits;
+    for (unsigned i = 0; i <= words; ++i) {
+        unsigned w = (unsigned)((begin / 64 + i) % words);
+        uint64_t word = bitmap[w];
+        if (i == 0) {
+            word &= ~uint64_t{0} << (begin % 64); // bits from begin on
+        } else if (i == words) {
+            word &= ~(~uint64_t{0} << (begin % 64)); // bits before begin
+        }
+        if (word != 0) {
+            uint64_t bit = w * 64 + count_trailing_zeros(word);
+            return (bit + nbits - begin) % nbits + 1;
+        }
+    }
+    return 0;
+}
+
+TimerWheel::TimerWheel(uint64_t now) : current_{now} {
+    for (auto &head : wheel_) {
+        head = nil;
+    }
+    for (auto &level : bitmap_) {
+        for (auto &word : level) {
+            word = 0;
+        }
+    }
+}
+
+TimerWheel::Id TimerWheel::schedule(uint64_t delay, UniqueCallback<> &&func,
+                                    uint64_t deadline) {
+    if (delay == 0) {
+        delay = 1;
+    } else if (delay > max_delay) {
+        delay = max_delay;
+    }
+    Index idx = allocate();
+    Node &node = nodes_[idx];
+    node.func = std::move(func);
+    node.expiry = current_ + delay;
+    node.deadline = deadline;
+    place(idx);
+    ++scheduled_;
+    ++size_;
+    return (Id{node.generation} << 32) | (idx + 1);
+}
+
+bool TimerWheel::cancel(Id id) {
+    if ((id & 0xffffffff) == 0) {
+        return false;
+    }
+    Index idx = (Index)((id & 0xffffffff) - 1);
+    if (idx >= nodes_.size() || nodes_[idx].list == nullptr ||
+        nodes_[idx].generation != (uint32_t)(id >> 32)) {
+        return false;
+    }
+    if (nodes_[idx].list != &expired_) {
+        --scheduled_;
+    }
+    unlink(idx);
+    release(idx);
+    --size_;
+    return true;
+}
+
+void TimerWheel::advance(uint64_t now) {
+    while (current_ < now) {
+        uint64_t next = next_expiry();
+        if (next == 0 || next > now) {
+            // Nothing happens until `now`, so we can jump there. This
+            // does not break the wheel invariants because all the slots
+            // that we skip are empty.
+            current_ = now;
+            break;
+        }
+        current_ = next;
+        // When a level wraps around, move down the timers in the current
+        // slot of the next level, and so on recursively.
+        for (unsigned level = 1; level < levels; ++level) {
+            uint64_t mask = (uint64_t{1} << (level * level_bits)) - 1;
+            if ((current_ & mask) != 0) {
+                break;
+            }
+            cascade(level);
+        }
+        Index *head = &wheel_[current_ % slots];
+        while (*head != nil) {
+            Index idx = *head;
+            unlink(idx);
+            link(idx, &expired_);
+            --scheduled_;
+        }
+    }
+}
+
+bool TimerWheel::pop_expired(UniqueCallback<> &func, uint64_t *deadline) {
+    if (expired_ == nil) {
+        return false;
+    }
+    Index idx = expired_;
+    unlink(idx);
+    func = std::move(nodes_[idx].func);
+    if (deadline != nullptr) {
+        *deadline = nodes_[idx].deadline;
+    }
+    release(idx);
+    --size_;
+    return true;
+}
+
+uint64_t TimerWheel::next_expiry() const {
+    if (scheduled_ <= 0) {
+        return 0;
+    }
+    uint64_t best = 0;
+    for (unsigned level = 0; level < levels; ++level) {
+        unsigned shift = level * level_bits;
+        uint64_t base = current_ >> shift;
+        uint64_t distance =
+                next_set_bit(bitmap_[level], words, base % slots);
+        if (distance == 0) {
+            continue;
+        }
+        // For level zero this is the exact expiry. For upper levels, it is
+        // when the slot is moved to lower levels, which is not later than
+        // the expiry of any timer in the slot.
+        uint64_t expiry = (base + distance) << shift;
+        if (best == 0 || expiry < best) {
+            best = expiry;
+        }
+    }
+    assert(best != 0);
+    return best;
+}
+
+TimerWheel::Index TimerWheel::allocate() {
+    if (free_head_ != nil) {
+        Index idx = free_head_;
+        free_head_ = nodes_[idx].next;
+        return idx;
+    }
+    if (nodes_.size() >= nil) {
+        throw std::runtime_error("timer_wheel: too many timers");
+    }
+    nodes_.emplace_back();
+    return (Index)(nodes_.size() - 1);
+}
+
+void TimerWheel::release(Index idx) {
+    Node &node = nodes_[idx];
+    node.func = nullptr;
+    ++node.generation; // invalidate outstanding ids
+    node.next = free_head_;
+    node.prev = nil;
+    node.list = nullptr;
+    free_head_ = idx;
+}
+
+void TimerWheel::link(Index idx, Index *head) {
+    Node &node = nodes_[idx];
+    node.list = head;
+    if (*head == nil) {
+        node.next = node.prev = idx;
+        *head = idx;
+        return;
+    }
+    Index tail = nodes_[*head].prev;
+    node.next = *head;
+    node.prev = tail;
+    nodes_[tail].next = idx;
+    nodes_[*head].prev = idx;
+}
+
+void TimerWheel::unlink(Index idx) {
+    Node &node = nodes_[idx];
+    Index *head = node.list;
+    assert(head != nullptr);
+    if (node.next == idx) {
+        *head = nil;
+        if (head != &expired_) {
+            size_t slot = (size_t)(head - wheel_);
+            bitmap_[slot / slots][(slot % slots) / 64] &=
+                    ~(uint64_t{1} << (slot % 64));
+        }
+    } else {
+        nodes_[node.prev].next = node.next;
+        nodes_[node.next].prev = node.prev;
+        if (*head == idx) {
+            *head = node.next;
+        }
+    }
+    node.next = node.prev = nil;
+    node.list = nullptr;
+}
+
+void TimerWheel::place(Index idx) {
+    uint64_t expiry = nodes_[idx].expiry;
+    // Note: when cascading, the expiry may be equal to the current time,
+    // in which case it ends up in the level zero slot that is processed
+    // right after cascading.
+    uint64_t delta = (expiry > current_) ? expiry - current_ : 0;
+    unsigned level = 0;
+    while (level < levels - 1 &&
+           delta >= (uint64_t{1} << ((level + 1) * level_bits))) {
+        ++level;
+    }
+    uint64_t index = (expiry >> (level * level_bits)) % slots;
+    size_t slot = level * slots + index;
+    link(idx, &wheel_[slot]);
+    bitmap_[level][index / 64] |= uint64_t{1} << (index % 64);
+}
+
+void TimerWheel::cascade(unsigned level) {
+    Index *head = &wheel_[level * slots +
+                          (current_ >> (level * level_bits)) % slots];
+    while (*head != nil) {
+        Index idx = *head;
+        unlink(idx);
+        place(idx);
+    }
+}
+
+} // namespace mk
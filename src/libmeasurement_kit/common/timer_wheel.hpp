@@ -0,0 +1,118 @@
+// Part of Measurement Kit <https://measurement-kit.github.io/>.
+// Measurement Kit is free software under the BSD license. See AUTHORS
+// and LICENSE for more information on the copying conditions.
+#ifndef SRC_LIBMEASUREMENT_KIT_COMMON_TIMER_WHEEL_HPP
+#define SRC_LIBMEASUREMENT_KIT_COMMON_TIMER_WHEEL_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include "src/libmeasurement_kit/common/callback.hpp"
+#include "src/libmeasurement_kit/common/non_copyable.hpp"
+#include "src/libmeasurement_kit/common/non_movable.hpp"
+
+namespace mk {
+
+// TimerWheel is a hierarchical timing wheel. Time is measured in ticks,
+// whose duration is decided by the user (LibeventReactor uses milliseconds).
+// Timers are stored in intrusive lists hanging from the wheel slots, hence
+// scheduling and cancelling are O(1). Timers further in the future than one
+// rotation of a level are kept in the next level and are moved down when
+// the lower level wraps around, so advancing time is O(1) amortized.
+//
+// Timer nodes are pooled and are identified by an id that also contains a
+// generation counter, so that cancelling a timer that already fired, or
+// whose node was reused, is a harmless no-op.
+//
+// TimerWheel is not thread safe. Callbacks are not invoked by the wheel but
+// are returned by pop_expired() such that the caller can run them without
+// holding any lock protecting the wheel.
+class TimerWheel : public NonCopyable, public NonMovable {
+  public:
+    // Id identifies a scheduled timer. Zero never identifies a timer.
+    using Id = uint64_t;
+
+    static constexpr unsigned level_bits = 8;
+    static constexpr unsigned levels = 4;
+    static constexpr uint64_t slots = 1 << level_bits;
+
+    // max_delay is the longest delay we can represent. Longer delays
+    // are silently truncated to it.
+    static constexpr uint64_t max_delay =
+            (uint64_t{1} << (level_bits * levels)) - 1;
+
+    // TimerWheel constructs an empty wheel whose current time is now.
+    explicit TimerWheel(uint64_t now);
+
+    // schedule arranges for func to expire `delay` ticks after the current
+    // time of the wheel. A zero delay is rounded up to one tick, since the
+    // current tick has already been processed. The wheel does not use
+    // `deadline`, which pop_expired() returns, so the caller can keep with
+    // the timer when it was due with a finer resolution than ticks.
+    Id schedule(uint64_t delay, UniqueCallback<> &&func,
+                uint64_t deadline = 0);
+
+    // cancel removes the timer identified by id, releasing the callback,
+    // and returns true. If the timer has already expired, has already been
+    // cancelled, or never existed, it returns false.
+    bool cancel(Id id);
+
+    // advance moves the current time up to now, moving the timers that
+    // expire in the meanwhile to the list of expired timers.
+    void advance(uint64_t now);
+
+    // pop_expired moves into func the callback of the oldest expired timer
+    // and returns true, or returns false if there are no expired timers. If
+    // deadline is not null, it is set to the deadline passed to schedule().
+    bool pop_expired(UniqueCallback<> &func, uint64_t *deadline = nullptr);
+
+    // next_expiry returns a tick not later than the earliest expiry of
+    // the scheduled timers. This is the tick at which it is next useful to
+    // call advance(). When there are no scheduled timers, it returns zero.
+    uint64_t next_expiry() const;
+
+    // now returns the current time of the wheel.
+    uint64_t now() const { return current_; }
+
+    // size returns the number of timers that are scheduled or expired.
+    size_t size() const { return size_; }
+
+  private:
+    using Index = uint32_t;
+    static constexpr Index nil = ~Index{0};
+    static constexpr unsigned words = slots / 64;
+
+    class Node {
+      public:
+        UniqueCallback<> func;
+        uint64_t expiry = 0;
+        uint64_t deadline = 0;
+        uint32_t generation = 0;
+        Index next = nil;
+        Index prev = nil;
+        Index *list = nullptr; // head of the list we're in, if any
+    };
+
+    // Lists are circular and doubly linked, such that appending and
+    // removing are O(1) and we run expired timers in FIFO order.
+    Index allocate();
+    void release(Index idx);
+    void link(Index idx, Index *head);
+    void unlink(Index idx);
+    void place(Index idx);
+    void cascade(unsigned level);
+
+    uint64_t current_ = 0;
+    Index expired_ = nil;
+    Index free_head_ = nil;
+    std::vector<Node> nodes_;
+    size_t scheduled_ = 0;
+    size_t size_ = 0;
+    Index wheel_[levels * slots];
+    uint64_t bitmap_[levels][words];
+};
+
+} // namespace mk
+#endif
@@ -0,0 +1,200 @@
+// Part of Measurement Kit <https://measurement-kit.github.io/>.
+// Measurement Kit is free software under the BSD license. See AUTHORS
+// and LICENSE for more information on the copying conditions.
+#ifndef SRC_LIBMEASUREMENT_KIT_COMMON_UNIQUE_FUNCTION_HPP
+#define SRC_LIBMEASUREMENT_KIT_COMMON_UNIQUE_FUNCTION_HPP
+
+#include <stddef.h>
+
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace mk {
+
+template <typename Signature> class UniqueFunction;
+
+// Returns true if Callable can be stored inside Storage.
+template <typename Callable, typename Storage>
+constexpr bool unique_function_fits_inline() {
+    return sizeof(Callable) <= sizeof(Storage) &&
+           alignof(Storage) % alignof(Callable) == 0 &&
+           std::is_nothrow_move_constructible<Callable>::value;
+}
+
+// UniqueFunction is a move-only replacement for std::function. Since it
+// does not need to be copyable, it can wrap move-only callables, and moving
+// it around never copies (and never bumps the reference counts of) what the
+// callable has captured. Callables up to inline_size bytes, which is enough
+// for lambdas capturing a handful of SharedPtr, are stored inline rather
+// than on the heap. By comparison, std::function implementations typically
+// store inline only callables not larger than two pointers.
+//
+// Calling an empty UniqueFunction throws std::bad_function_call.
+template <typename Result, typename... Args>
+class UniqueFunction<Result(Args...)> {
+  public:
+    static constexpr size_t inline_size = 8 * sizeof(void *);
+
+    UniqueFunction() noexcept {}
+
+    UniqueFunction(std::nullptr_t) noexcept {}
+
+    template <typename Func,
+              typename = typename std::enable_if<!std::is_same<
+                      typename std::decay<Func>::type,
+                      UniqueFunction>::value>::type>
+    UniqueFunction(Func &&func) {
+        using Callable = typename std::decay<Func>::type;
+        if (is_null(func)) {
+            return;
+        }
+        Handler<Callable>::create(&storage_, std::forward<Func>(func));
+        invoke_ = &Handler<Callable>::invoke;
+        manage_ = &Handler<Callable>::manage;
+    }
+
+    UniqueFunction(UniqueFunction &&other) noexcept { take(other); }
+
+    UniqueFunction &operator=(UniqueFunction &&other) noexcept {
+        if (this != &other) {
+            reset();
+            take(other);
+        }
+        return *this;
+    }
+
+    UniqueFunction &operator=(std::nullptr_t) noexcept {
+        reset();
+        return *this;
+    }
+
+    template <typename Func,
+              typename = typename std::enable_if<!std::is_same<
+                      typename std::decay<Func>::type,
+                      UniqueFunction>::value>::type>
+    UniqueFunction &operator=(Func &&func) {
+        return *this = UniqueFunction{std::forward<Func>(func)};
+    }
+
+    UniqueFunction(const UniqueFunction &) = delete;
+    UniqueFunction &operator=(const UniqueFunction &) = delete;
+
+    ~UniqueFunction() { reset(); }
+
+    explicit operator bool() const noexcept { return invoke_ != nullptr; }
+
+    Result operator()(Args... args) {
+        if (invoke_ == nullptr) {
+            throw std::bad_function_call();
+        }
+        return invoke_(&storage_, std::forward<Args>(args)...);
+    }
+
+    // heap_allocated returns true if the callable did not fit the inline
+    // buffer and hence has been allocated on the heap.
+    bool heap_allocated() const noexcept {
+        return manage_ != nullptr &&
+               manage_(Operation::heap, nullptr, nullptr);
+    }
+
+  private:
+    using Storage = typename std::aligned_storage<inline_size>::type;
+
+    enum class Operation { move, destroy, heap };
+
+    // Handler knows how to create, invoke, move and destroy a Callable
+    // stored inline in a Storage.
+    template <typename Callable,
+              bool = unique_function_fits_inline<Callable, Storage>()>
+    class Handler {
+      public:
+        static Callable *get(Storage *s) {
+            return reinterpret_cast<Callable *>(s);
+        }
+        template <typename Func> static void create(Storage *s, Func &&func) {
+            new (s) Callable(std::forward<Func>(func));
+        }
+        static Result invoke(Storage *s, Args &&... args) {
+            return (*get(s))(std::forward<Args>(args)...);
+        }
+        static bool manage(Operation op, Storage *s, Storage *to) noexcept {
+            if (op == Operation::move) {
+                new (to) Callable(std::move(*get(s)));
+                get(s)->~Callable();
+            } else if (op == Operation::destroy) {
+                get(s)->~Callable();
+            }
+            return false;
+        }
+    };
+
+    // Specialization for a Callable stored on the heap, whose pointer is
+    // stored in the Storage.
+    template <typename Callable> class Handler<Callable, false> {
+      public:
+        static Callable *get(Storage *s) {
+            return *reinterpret_cast<Callable **>(s);
+        }
+        template <typename Func> static void create(Storage *s, Func &&func) {
+            *reinterpret_cast<Callable **>(s) =
+                    new Callable(std::forward<Func>(func));
+        }
+        static Result invoke(Storage *s, Args &&... args) {
+            return (*get(s))(std::forward<Args>(args)...);
+        }
+        static bool manage(Operation op, Storage *s, Storage *to) noexcept {
+            if (op == Operation::move) {
+                *reinterpret_cast<Callable **>(to) = get(s);
+            } else if (op == Operation::destroy) {
+                delete get(s);
+            }
+            return true;
+        }
+    };
+
+    template <typename Func> static bool is_null(const Func &) {
+        return false;
+    }
+
+    template <typename Signature>
+    static bool is_null(const std::function<Signature> &func) {
+        return !func;
+    }
+
+    template <typename Signature> static bool is_null(Signature *func) {
+        return func == nullptr;
+    }
+
+    void take(UniqueFunction &other) noexcept {
+        if (other.manage_ != nullptr) {
+            other.manage_(Operation::move, &other.storage_, &storage_);
+            invoke_ = other.invoke_;
+            manage_ = other.manage_;
+            other.invoke_ = nullptr;
+            other.manage_ = nullptr;
+        }
+    }
+
+    void reset() noexcept {
+        if (manage_ != nullptr) {
+            // Clear first, in case the destructor of the callable ends up
+            // accessing this object, e.g. to reassign it.
+            auto manage = manage_;
+            invoke_ = nullptr;
+            manage_ = nullptr;
+            manage(Operation::destroy, &storage_, nullptr);
+        }
+    }
+
+    Storage storage_;
+    Result (*invoke_)(Storage *, Args &&...) = nullptr;
+    bool (*manage_)(Operation, Storage *, Storage *) = nullptr;
+};
+
+template <typename Result, typename... Args>
+constexpr size_t UniqueFunction<Result(Args...)>::inline_size;
+
+} // namespace mk
+#endif
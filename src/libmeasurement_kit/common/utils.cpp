@@ -3,6 +3,7 @@
 // and LICENSE for more information on the copying conditions.
 
 #include "src/libmeasurement_kit/common/mock.hpp"
+#include "src/libmeasurement_kit/common/secure_random.hpp"
 #include "src/libmeasurement_kit/common/utils.hpp"
 #include <cctype>
 #include <cmath>
@@ -51,17 +52,38 @@ timeval *timeval_init(timeval *tv, double delta) {
 }
 
 std::string random_within_charset(const std::string charset, size_t length) {
-    // See <http://stackoverflow.com/questions/440133/>
     if (charset.size() < 1) {
         throw std::runtime_error("random_within_charset_with_empty_charset");
     }
-    auto randchar = [&charset]() {
-        int rand = 0;
-        evutil_secure_rng_get_bytes(&rand, sizeof (rand));
-        return charset[rand % charset.size()];
-    };
+    SecureRandom &rng = secure_random();
     std::string str(length, 0);
-    std::generate_n(str.begin(), length, randchar);
+    if (charset.size() > 256) {
+        for (auto &c : str) {
+            c = charset[rng.uniform(charset.size())];
+        }
+        return str;
+    }
+    // Map random bytes to characters using a table, discarding the bytes
+    // above the largest multiple of the charset size to avoid modulo bias.
+    // The inner loop has no branches, so the compiler can vectorize it. It
+    // also reads the entries above the limit, which must be initialized.
+    char table[256] = {};
+    size_t limit = 256 - 256 % charset.size();
+    for (size_t i = 0; i < limit; ++i) {
+        table[i] = charset[i % charset.size()];
+    }
+    uint8_t chunk[512];
+    size_t off = 0;
+    while (off < length) {
+        // Consume at most as many bytes as missing characters, such that
+        // `off` cannot go past the end of the string
+        size_t n = std::min(sizeof(chunk), length - off);
+        rng.fill(chunk, n);
+        for (size_t i = 0; i < n; ++i) {
+            str[off] = table[chunk[i]];
+            off += (chunk[i] < limit);
+        }
+    }
     return str;
 }
 
@@ -159,17 +181,16 @@ bool endswith(std::string s, std::string p) {
 }
 
 std::string random_choice(std::vector<std::string> inputs) {
-    std::random_device rd;
-    std::mt19937 g(rd());
-    std::shuffle(inputs.begin(), inputs.end(), g);
-    return inputs[0];
+    if (inputs.size() <= 0) {
+        throw std::runtime_error("random_choice_with_empty_inputs");
+    }
+    return inputs[secure_random().uniform(inputs.size())];
 }
 
 std::string randomly_capitalize(std::string input) {
-    std::random_device rd;
-    std::mt19937 g(rd());
+    SecureRandom &rng = secure_random();
     for (auto &c: input) {
-        if (g() % 2 == 0) {
+        if (rng.uniform(2) == 0) {
             c = toupper(c);
         } else {
             c = tolower(c);
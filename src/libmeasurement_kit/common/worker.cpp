@@ -9,87 +9,198 @@
 #include <measurement_kit/common/logger.hpp>
 #include <measurement_kit/common/shared_ptr.hpp>
 
+#include <algorithm>
 #include <cassert>
 #include <chrono>
 #include <functional>
-#include <list>
 #include <memory>
 #include <mutex>
+#include <stdexcept>
 #include <thread>
 #include <utility>
 
 namespace mk {
 
-Worker::Worker() {}
+constexpr size_t Worker::default_queue_capacity;
 
-Worker::Worker(short p) { state->parallelism = p; }
-
-void Worker::call_in_thread(SharedPtr<Logger> logger, Callback<> &&func) {
-    std::unique_lock<std::mutex> _{state->mutex};
+template <typename Type>
+static void atomic_update_max(std::atomic<Type> &max, Type value) {
+    Type prev = max.load();
+    while (value > prev && !max.compare_exchange_weak(prev, value)) {
+        /* nothing */;
+    }
+}
 
-    // Move function such that the running-in-background thread
-    // has unique ownership and controls its lifecycle.
-    state->queue.push_back(std::move(func));
+static void run_job(Worker::State *S, Worker::Job &job) {
+    auto wait = std::chrono::steady_clock::now() - job.queued_at;
+    int64_t wait_ns =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(wait).count();
+    S->total_wait_ns += wait_ns;
+    atomic_update_max(S->max_wait_ns, wait_ns);
+    ++S->running;
+    // Exceptions are fatal in measurement-kit. If we get an unhandled
+    // one here is a bug that must be fixed. Make sure it is logged
+    // using the current logger and bail.
+    try {
+        job.func();
+    } catch (const std::exception &exc) {
+        job.logger->warn("worker: unhandled exception: %s", exc.what());
+        std::rethrow_exception(std::current_exception());
+    } catch (...) {
+        job.logger->warn("worker: unhandled unknown exception");
+        std::rethrow_exception(std::current_exception());
+    }
+    // Release the resources bound to the callback before declaring it as
+    // complete, such that who waits on pending() sees them released.
+    job = Worker::Job{};
+    --S->running;
+    ++S->completed;
+    --S->pending;
+    std::unique_lock<std::mutex> _{S->hook_mutex};
+    if (S->on_complete) {
+        S->on_complete();
+    }
+}
 
-    if (state->active >= state->parallelism) {
-        return;
+// Returns true if the calling thread should exit because the worker has
+// too many threads. If so, the thread has already been accounted for.
+static bool maybe_retire(Worker::State *S) {
+    size_t threads = S->threads.load();
+    while (threads > S->parallelism.load()) {
+        if (S->threads.compare_exchange_weak(threads, threads - 1)) {
+            return true;
+        }
     }
+    return false;
+}
 
-    // Note: pass only the internal state, so that the thread can possibly
-    // continue to work even when the external object is gone.
-    auto task = [S = state, logger]() {
-        for (;;) {
-            Callback<> func = [&]() {
-                std::unique_lock<std::mutex> _{S->mutex};
-                // Initialize inside the lock such that there is only
-                // one critical section in which we could be
-                if (S->queue.size() <= 0) {
-                    --S->active;
-                    return Callback<>{};
-                }
-                auto front = S->queue.front();
-                S->queue.pop_front();
-                return front;
-            }();
-            if (!func) {
-                break;
+// Note: pass only the internal state, so that the thread can possibly
+// continue to work even when the external object is gone.
+static void worker_loop(SharedPtr<Worker::State> S) {
+    Worker::Job job;
+    for (;;) {
+        if (S->queue.try_pop(job)) {
+            run_job(S.get(), job);
+            if (maybe_retire(S.get())) {
+                return;
             }
-            // Exceptions are fatal in measurement-kit. If we get an unhandled
-            // one here is a bug that must be fixed. Make sure it is logged
-            // using the current logger and bail.
-            try {
-                func();
-            } catch (const std::exception &exc) {
-                logger->warn("worker: unhandled exception: %s", exc.what());
-                std::rethrow_exception(std::current_exception());
-            } catch (...) {
-                logger->warn("worker: unhandled unknown exception");
-                std::rethrow_exception(std::current_exception());
+            continue;
+        }
+        std::unique_lock<std::mutex> lock{S->mutex};
+        // Declare ourselves as sleeping before checking the queue again. A
+        // producer that pushes after our check sees `sleepers > 0` and must
+        // take the mutex to notify us, which it can only do once we're
+        // waiting. Hence, no wakeup can be lost.
+        ++S->sleepers;
+        while (!S->queue.try_pop(job)) {
+            if (S->stopped || maybe_retire(S.get())) {
+                --S->sleepers;
+                if (S->stopped) {
+                    --S->threads;
+                }
+                return;
             }
+            S->cond.wait(lock);
         }
-    };
+        --S->sleepers;
+        lock.unlock();
+        run_job(S.get(), job);
+    }
+}
 
-    std::thread{task}.detach();
-    ++state->active;
+/*static*/ unsigned short Worker::default_parallelism() {
+    unsigned int cores = std::thread::hardware_concurrency();
+    return (unsigned short)std::min(std::max(cores, 3U), 64U);
+}
+
+Worker::Worker() : Worker(default_parallelism()) {}
+
+Worker::Worker(short p, size_t queue_capacity)
+    : state{std::make_shared<State>(p, queue_capacity)} {}
+
+Worker::~Worker() {
+    {
+        std::unique_lock<std::mutex> _{state->mutex};
+        state->stopped = true;
+    }
+    state->cond.notify_all();
+}
+
+void Worker::call_in_thread(
+        SharedPtr<Logger> logger, UniqueCallback<> &&func) {
+    // Move function such that the running-in-background thread
+    // has unique ownership and controls its lifecycle.
+    Job job;
+    job.func = std::move(func);
+    job.logger = logger;
+    job.queued_at = std::chrono::steady_clock::now();
+    ++state->pending;
+    if (!state->queue.try_push(job)) {
+        --state->pending;
+        throw std::runtime_error("worker: queue is full");
+    }
+    atomic_update_max(state->max_queue_depth, state->queue.size_approx());
+    if (state->sleepers.load() > 0) {
+        // Lock to make sure the sleeper is waiting. See worker_loop().
+        std::unique_lock<std::mutex> _{state->mutex};
+        state->cond.notify_one();
+        return;
+    }
+    maybe_start_thread();
+}
+
+void Worker::maybe_start_thread() {
+    size_t threads = state->threads.load();
+    do {
+        if (threads >= state->parallelism.load()) {
+            return; // Running threads will eventually pick up the job
+        }
+    } while (!state->threads.compare_exchange_weak(threads, threads + 1));
+    try {
+        std::thread{worker_loop, state}.detach();
+    } catch (...) {
+        --state->threads;
+        throw;
+    }
 }
 
 unsigned short Worker::parallelism() const {
-    std::unique_lock<std::mutex> _{state->mutex};
     return state->parallelism;
 }
 
 void Worker::set_parallelism(unsigned short newval) const {
-    std::unique_lock<std::mutex> _{state->mutex};
     state->parallelism = newval;
+    // Wake up sleepers so that extra threads notice they should exit.
+    std::unique_lock<std::mutex> _{state->mutex};
+    state->cond.notify_all();
+}
+
+void Worker::on_complete(Callback<> &&func) const {
+    std::unique_lock<std::mutex> _{state->hook_mutex};
+    state->on_complete = std::move(func);
 }
 
 unsigned short Worker::concurrency() const {
-    std::unique_lock<std::mutex> _{state->mutex};
-    return state->active;
+    return (unsigned short)state->running.load();
+}
+
+size_t Worker::pending() const {
+    return state->pending;
+}
+
+Worker::Stats Worker::stats() const {
+    Stats stats;
+    stats.queue_depth = state->queue.size_approx();
+    stats.max_queue_depth = state->max_queue_depth;
+    stats.threads = state->threads;
+    stats.completed = state->completed;
+    stats.total_wait_time = state->total_wait_ns / 1e09;
+    stats.max_wait_time = state->max_wait_ns / 1e09;
+    return stats;
 }
 
 void Worker::wait_empty_() const {
-    while (concurrency() > 0) {
+    while (pending() > 0) {
         std::this_thread::sleep_for(std::chrono::seconds(1));
     }
     std::this_thread::sleep_for(std::chrono::seconds(1));
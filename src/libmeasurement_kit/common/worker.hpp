@@ -7,10 +7,14 @@
 #include <measurement_kit/common/logger.hpp>
 #include <measurement_kit/common/shared_ptr.hpp>
 
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
 #include <cassert>
 #include <chrono>
+#include <condition_variable>
 #include <functional>
-#include <list>
 #include <memory>
 #include <mutex>
 #include <thread>
@@ -18,41 +22,109 @@
 
 #include "src/libmeasurement_kit/common/callback.hpp"
 #include "src/libmeasurement_kit/common/logger.hpp"
+#include "src/libmeasurement_kit/common/mpmc_queue.hpp"
 #include "src/libmeasurement_kit/common/non_copyable.hpp"
 #include "src/libmeasurement_kit/common/non_movable.hpp"
 
 namespace mk {
 
-class Worker {
+// Worker is a pool of background threads. Threads are created on demand,
+// up to parallelism(), and then live as long as the Worker, sleeping when
+// there is no work, so that we don't pay for thread creation each time we
+// need to run a blocking function (e.g. getaddrinfo()). Callbacks are
+// passed to the threads using a bounded lock-free queue.
+class Worker : public NonCopyable, public NonMovable {
   public:
+    // Job is a callback waiting in queue to be run.
+    class Job {
+      public:
+        UniqueCallback<> func;
+        SharedPtr<Logger> logger;
+        std::chrono::steady_clock::time_point queued_at;
+    };
+
+    // Stats contains counters describing the worker. Wait times measure
+    // how long callbacks wait in queue before a thread runs them.
+    class Stats {
+      public:
+        size_t queue_depth = 0;
+        size_t max_queue_depth = 0;
+        size_t threads = 0;
+        uint64_t completed = 0;
+        double total_wait_time = 0.0;
+        double max_wait_time = 0.0;
+    };
+
     class State : public NonCopyable, public NonMovable {
       public:
-        unsigned short active = 0;
+        State(unsigned short parallelism, size_t queue_capacity)
+            : parallelism{parallelism}, queue{queue_capacity} {}
+
+        std::atomic<uint64_t> completed{0};
+        std::condition_variable cond;
+        std::mutex hook_mutex;
+        std::atomic<size_t> max_queue_depth{0};
+        std::atomic<int64_t> max_wait_ns{0};
         std::mutex mutex;
-        unsigned short parallelism = 3;
-        std::list<Callback<>> queue;
+        Callback<> on_complete; // protected by hook_mutex
+        std::atomic<unsigned short> parallelism;
+        std::atomic<size_t> pending{0};
+        MpmcQueue<Job> queue;
+        std::atomic<size_t> running{0};
+        std::atomic<size_t> sleepers{0};
+        bool stopped = false; // protected by mutex
+        std::atomic<size_t> threads{0};
+        std::atomic<int64_t> total_wait_ns{0};
     };
 
+    // default_parallelism returns the default number of threads, which
+    // is the number of cores but not less than three. Most of the work we
+    // do in background is blocking I/O, therefore having fewer threads
+    // than that on single core devices would only increase latency.
+    static unsigned short default_parallelism();
+
+    static constexpr size_t default_queue_capacity = 4096;
+
     Worker();
 
-    Worker(short parallelism);
+    Worker(short parallelism, size_t queue_capacity = default_queue_capacity);
 
-    void call_in_thread(SharedPtr<Logger> logger, Callback<> &&func);
+    // ~Worker tells background threads to exit once they have run all
+    // the callbacks that are still queued.
+    ~Worker();
+
+    // call_in_thread schedules func to run in a background thread. Throws
+    // std::runtime_error if the queue is full or we cannot create a thread.
+    void call_in_thread(SharedPtr<Logger> logger, UniqueCallback<> &&func);
 
     unsigned short parallelism() const;
 
+    // set_parallelism changes the maximum number of background threads. When
+    // the value is lowered, extra threads exit after their current callback.
     void set_parallelism(unsigned short newval) const;
 
+    // concurrency returns the number of callbacks that are running.
     unsigned short concurrency() const;
 
+    // pending returns the number of callbacks that are either queued or
+    // running. The reactor uses it to know whether there is outstanding
+    // background work that will eventually call back into the I/O thread.
+    size_t pending() const;
+
+    // stats returns a snapshot of the worker counters.
+    Stats stats() const;
+
+    // on_complete sets the function that background threads call each
+    // time they complete a callback, after having updated pending(). It is
+    // used to wake up the I/O thread. Passing an empty function removes
+    // the hook and waits for pending calls of the old hook to return.
+    void on_complete(Callback<> &&func) const;
+
     // Implementation note: this method is meant to be used in regress
     // tests, where we don't want the test to exit until the background
-    // thread has exited, so to clear thread-local storage. Othrwise,
-    // Valgrind will complain about leaked thread-local storage.
-    //
-    // We expect the caller to issue a blocking command using a Worker
-    // and then to call this method such that we keep the main thread
-    // alive for longer, so that background threads can exit.
+    // work has completed. We expect the caller to issue a blocking command
+    // using a Worker and then to call this method such that we keep the
+    // main thread alive until all the callbacks have run.
     //
     // Since this is meant for internal-only usage, as explained above,
     // it has been given a name terminating with `_`.
@@ -65,7 +137,9 @@ class Worker {
     static SharedPtr<Worker> default_tasks_queue();
 
   private:
-    SharedPtr<State> state{std::make_shared<State>()};
+    void maybe_start_thread();
+
+    SharedPtr<State> state;
 };
 
 } // namespace mk
@@ -0,0 +1,166 @@
+// Part of Measurement Kit <https://measurement-kit.github.io/>.
+// Measurement Kit is free software under the BSD license. See AUTHORS
+// and LICENSE for more information on the copying conditions.
+
+#include "src/libmeasurement_kit/dns/bulk_query.hpp"
+
+#include "src/libmeasurement_kit/common/utils.hpp"
+
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+
+namespace mk {
+namespace dns {
+
+std::string bulk_window_key(const Settings &settings) {
+    if (settings.find("dns/nameserver") != settings.end()) {
+        return "nameserver=" +
+               settings.get("dns/nameserver", std::string{}) + " port=" +
+               settings.get("dns/port", std::string{"53"});
+    }
+    if (settings.get("dns/engine", std::string{"system"}) == "system") {
+        return "system";
+    }
+    // Both libevent and native engines then use resolv.conf
+    return "resolv_conf=" + settings.get("dns/resolv_conf",
+                                         std::string{"/etc/resolv.conf"});
+}
+
+// Queries waiting for their turn to use a set of nameservers
+class BulkWindow {
+  public:
+    size_t limit = 0;
+    size_t in_flight = 0;
+    std::deque<std::function<void()>> waiting;
+};
+
+// One window per reactor and nameservers, like EvdnsBasePool. Queries in
+// flight keep their window alive after the reactor stops.
+static std::mutex bulk_windows_mutex;
+static std::map<Reactor *, std::map<std::string, SharedPtr<BulkWindow>>>
+        bulk_windows;
+
+static SharedPtr<BulkWindow> bulk_window(SharedPtr<Reactor> reactor,
+                                         const std::string &key,
+                                         size_t limit) {
+    Reactor *p = reactor.get();
+    bool first = false;
+    SharedPtr<BulkWindow> window;
+    {
+        std::unique_lock<std::mutex> _{bulk_windows_mutex};
+        first = (bulk_windows.count(p) == 0);
+        SharedPtr<BulkWindow> &entry = bulk_windows[p][key];
+        if (!entry) {
+            entry = SharedPtr<BulkWindow>{std::make_shared<BulkWindow>()};
+        }
+        // The most recent batch decides how wide the window is
+        entry->limit = limit;
+        window = entry;
+    }
+    if (first) {
+        reactor->on_stop([p]() {
+            std::unique_lock<std::mutex> _{bulk_windows_mutex};
+            bulk_windows.erase(p);
+        });
+    }
+    return window;
+}
+
+size_t bulk_in_flight(SharedPtr<Reactor> reactor, const std::string &key) {
+    std::unique_lock<std::mutex> _{bulk_windows_mutex};
+    auto rit = bulk_windows.find(reactor.get());
+    if (rit == bulk_windows.end()) {
+        return 0;
+    }
+    auto it = rit->second.find(key);
+    return (it != rit->second.end()) ? it->second->in_flight : 0;
+}
+
+class BulkState {
+  public:
+    std::vector<BulkResult> results;
+    size_t remaining = 0;
+    Callback<const BulkResult &> on_result;
+    Callback<std::vector<BulkResult>> on_complete;
+};
+
+static void bulk_done(SharedPtr<BulkState> state, size_t index) {
+    if (state->on_result) {
+        state->on_result(state->results[index]);
+    }
+    if (--state->remaining == 0) {
+        state->on_complete(std::move(state->results));
+    }
+}
+
+// Starts the next waiting query, if the window has room for it
+static void bulk_next(SharedPtr<BulkWindow> window) {
+    while (!window->waiting.empty() && window->in_flight < window->limit) {
+        std::function<void()> start = window->waiting.front();
+        window->waiting.pop_front();
+        window->in_flight += 1;
+        start();
+    }
+}
+
+void bulk_query(std::vector<BulkQuery> queries,
+                Callback<const BulkResult &> on_result,
+                Callback<std::vector<BulkResult>> on_complete,
+                Settings settings, SharedPtr<Reactor> reactor,
+                SharedPtr<Logger> logger) {
+    SharedPtr<BulkState> state{std::make_shared<BulkState>()};
+    state->remaining = queries.size();
+    state->on_result = on_result;
+    state->on_complete = on_complete;
+    for (size_t i = 0; i < queries.size(); ++i) {
+        BulkResult result;
+        result.index = i;
+        result.query = queries[i];
+        state->results.push_back(result);
+    }
+    ErrorOr<int> limit = settings.get_noexcept("dns/max_in_flight", 16);
+    if (queries.empty() || !limit || *limit <= 0) {
+        // Like query(), never call back immediately
+        size_t count = queries.size();
+        reactor->call_soon([=]() {
+            if (count == 0) {
+                state->on_complete({});
+                return;
+            }
+            for (size_t i = 0; i < count; ++i) {
+                state->results[i].error = ValueError();
+                bulk_done(state, i);
+            }
+        });
+        return;
+    }
+    std::string key = bulk_window_key(settings);
+    SharedPtr<BulkWindow> window = bulk_window(reactor, key, (size_t)*limit);
+    double now = time_now();
+    logger->debug("dns: bulk: %zu queries via %s", queries.size(),
+                  key.c_str());
+    for (size_t i = 0; i < queries.size(); ++i) {
+        window->waiting.push_back([=]() {
+            double begin = time_now();
+            state->results[i].queued = begin - now;
+            BulkQuery &q = state->results[i].query;
+            query(q.qclass, q.type, q.name,
+                  [=](Error error, SharedPtr<Message> message) {
+                      BulkResult &result = state->results[i];
+                      result.elapsed = time_now() - begin;
+                      result.error = error;
+                      result.message = message;
+                      window->in_flight -= 1;
+                      bulk_done(state, i);
+                      bulk_next(window);
+                  },
+                  settings, reactor, logger);
+        });
+    }
+    bulk_next(window);
+}
+
+} // namespace dns
+} // namespace mk
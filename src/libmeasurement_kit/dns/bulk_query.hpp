@@ -0,0 +1,62 @@
+// Part of Measurement Kit <https://measurement-kit.github.io/>.
+// Measurement Kit is free software under the BSD license. See AUTHORS
+// and LICENSE for more information on the copying conditions.
+#ifndef SRC_LIBMEASUREMENT_KIT_DNS_BULK_QUERY_HPP
+#define SRC_LIBMEASUREMENT_KIT_DNS_BULK_QUERY_HPP
+
+#include "src/libmeasurement_kit/dns/query.hpp"
+
+#include <string>
+#include <vector>
+
+namespace mk {
+namespace dns {
+
+class BulkQuery {
+  public:
+    QueryType type;
+    QueryClass qclass = MK_DNS_CLASS_IN;
+    std::string name;
+};
+
+class BulkResult {
+  public:
+    size_t index = 0; ///< Index of the query in the batch
+    BulkQuery query;
+    Error error;
+    SharedPtr<Message> message;
+    double queued = 0.0;  ///< Seconds the query waited for its turn
+    double elapsed = 0.0; ///< Seconds from sending to the result
+};
+
+/// Returns a string identifying the nameservers used with \p settings, so
+/// that batches using the same nameservers share the in-flight window.
+std::string bulk_window_key(const Settings &settings);
+
+/*!
+    \brief Runs many queries with bounded concurrency.
+
+    Runs \p queries using query() and calls \p on_result with the result
+    of each query as soon as it is available (if \p on_result is not
+    empty), then \p on_complete with all the results ordered like \p
+    queries. Works with all the engines, which are selected as usual
+    using the `dns/engine` setting.
+
+    At most `dns/max_in_flight` queries (default: 16) are in flight at any
+    time in a reactor for the nameservers configured in \p settings (see
+    bulk_window_key()), including those of other batches. If the setting
+    is not a positive number, all queries fail with ValueError.
+*/
+void bulk_query(std::vector<BulkQuery> queries,
+                Callback<const BulkResult &> on_result,
+                Callback<std::vector<BulkResult>> on_complete,
+                Settings settings, SharedPtr<Reactor> reactor,
+                SharedPtr<Logger> logger);
+
+/// Returns the number of queries of \p reactor in flight through the
+/// window identified by \p key.
+size_t bulk_in_flight(SharedPtr<Reactor> reactor, const std::string &key);
+
+} // namespace dns
+} // namespace mk
+#endif
@@ -49,6 +49,9 @@ MK_DEFINE_ERR(MK_ERR_DNS(28), NotSupportedAISocktypeError,
 //Was: MK_DEFINE_ERR(MK_ERR_DNS(29), InetNtopFailureError,
 //                   "dns_inet_ntop_failure")
 
+MK_DEFINE_ERR(MK_ERR_DNS(30), InvalidDnsCacheError, "dns_invalid_cache")
+MK_DEFINE_ERR(MK_ERR_DNS(31), MalformedMessageError, "dns_malformed_message")
+
 } // namespace dns
 } // namespace mk
 #endif
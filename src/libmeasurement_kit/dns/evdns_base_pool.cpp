@@ -0,0 +1,111 @@
+// Part of Measurement Kit <https://measurement-kit.github.io/>.
+// Measurement Kit is free software under the BSD license. See AUTHORS
+// and LICENSE for more information on the copying conditions.
+
+#include "src/libmeasurement_kit/dns/evdns_base_pool.hpp"
+
+#include <event2/dns.h>
+
+#include <sstream>
+#include <vector>
+
+namespace mk {
+namespace dns {
+
+std::string evdns_base_key(const Settings &settings) {
+    std::stringstream ss;
+    // Settings used by create_evdns_base()
+    for (auto name : {"dns/nameserver", "dns/port", "dns/attempts",
+                      "dns/timeout", "dns/randomize_case"}) {
+        auto it = settings.find(name);
+        if (it != settings.end()) {
+            ss << " " << name << "=" << it->second;
+        }
+    }
+    return ss.str();
+}
+
+/*static*/ EvdnsBasePool &EvdnsBasePool::global() {
+    static EvdnsBasePool pool;
+    return pool;
+}
+
+evdns_base *EvdnsBasePool::acquire(SharedPtr<Reactor> reactor,
+                                   const Settings &settings,
+                                   std::function<evdns_base *()> create) {
+    std::string key = evdns_base_key(settings);
+    {
+        std::unique_lock<std::mutex> _{mutex_};
+        auto rit = all_.find(reactor.get());
+        if (rit != all_.end()) {
+            auto it = rit->second.find(key);
+            if (it != rit->second.end()) {
+                entries_[it->second].queries += 1;
+                return it->second;
+            }
+        }
+    }
+    // Note: we create the base with the mutex unlocked because `create`
+    // may throw and in general we don't know what it does
+    evdns_base *base = create();
+    bool first = false;
+    {
+        std::unique_lock<std::mutex> _{mutex_};
+        first = (all_.count(reactor.get()) == 0);
+        all_[reactor.get()][key] = base;
+        entries_[base].queries += 1;
+    }
+    if (first) {
+        Reactor *p = reactor.get();
+        reactor->on_stop([this, p]() { retire(p); });
+    }
+    return base;
+}
+
+void EvdnsBasePool::release(evdns_base *base) {
+    {
+        std::unique_lock<std::mutex> _{mutex_};
+        auto it = entries_.find(base);
+        if (it == entries_.end()) {
+            throw std::runtime_error("evdns_base not in pool");
+        }
+        if (--it->second.queries > 0 || !it->second.retired) {
+            return;
+        }
+        entries_.erase(it);
+    }
+    evdns_base_free(base, 0);
+}
+
+size_t EvdnsBasePool::size(SharedPtr<Reactor> reactor) {
+    std::unique_lock<std::mutex> _{mutex_};
+    auto rit = all_.find(reactor.get());
+    return (rit != all_.end()) ? rit->second.size() : 0;
+}
+
+void EvdnsBasePool::retire(Reactor *reactor) {
+    std::vector<evdns_base *> idle;
+    {
+        std::unique_lock<std::mutex> _{mutex_};
+        auto rit = all_.find(reactor);
+        if (rit == all_.end()) {
+            return;
+        }
+        for (auto &kv : rit->second) {
+            auto it = entries_.find(kv.second);
+            if (it->second.queries > 0) {
+                it->second.retired = true; // Freed by the last release()
+                continue;
+            }
+            entries_.erase(it);
+            idle.push_back(kv.second);
+        }
+        all_.erase(rit);
+    }
+    for (evdns_base *base : idle) {
+        evdns_base_free(base, 0);
+    }
+}
+
+} // namespace dns
+} // namespace mk
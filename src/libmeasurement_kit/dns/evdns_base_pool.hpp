@@ -0,0 +1,73 @@
+// Part of Measurement Kit <https://measurement-kit.github.io/>.
+// Measurement Kit is free software under the BSD license. See AUTHORS
+// and LICENSE for more information on the copying conditions.
+#ifndef SRC_LIBMEASUREMENT_KIT_DNS_EVDNS_BASE_POOL_HPP
+#define SRC_LIBMEASUREMENT_KIT_DNS_EVDNS_BASE_POOL_HPP
+
+#include "src/libmeasurement_kit/common/non_copyable.hpp"
+#include "src/libmeasurement_kit/common/non_movable.hpp"
+#include "src/libmeasurement_kit/common/reactor.hpp"
+#include "src/libmeasurement_kit/common/settings.hpp"
+
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+
+struct evdns_base;
+
+namespace mk {
+namespace dns {
+
+/// Returns a string identifying the settings used to create an evdns_base
+/// (see create_evdns_base()).
+std::string evdns_base_key(const Settings &settings);
+
+/*!
+    \brief evdns_base objects shared by the queries of the libevent engine.
+
+    Creating a base parses the nameserver address, applies the options and
+    opens a new UDP socket. Hence, we keep one base per reactor and settings
+    (see evdns_base_key()), shared by concurrent queries. Idle bases do not
+    keep Reactor::run() from returning and are freed when it returns (see
+    Reactor::on_stop()). A base still in use at that time is removed from
+    the pool and freed when its last query completes.
+
+    \remark You SHOULD use the process-wide pool returned by global(),
+    while you can create other instances for testing. All methods MUST
+    be called from the I/O thread of the reactor passed as argument.
+*/
+class EvdnsBasePool : public NonCopyable, public NonMovable {
+  public:
+    /// Returns the process-wide pool.
+    static EvdnsBasePool &global();
+
+    /// Returns the base of \p reactor for \p settings, using \p create to
+    /// create it if needed. Exceptions thrown by \p create propagate. The
+    /// caller MUST call release() when the query using the base is done.
+    evdns_base *acquire(SharedPtr<Reactor> reactor, const Settings &settings,
+                        std::function<evdns_base *()> create);
+
+    /// Tells the pool that a query using \p base is done.
+    void release(evdns_base *base);
+
+    /// Returns the number of bases pooled for \p reactor.
+    size_t size(SharedPtr<Reactor> reactor);
+
+  private:
+    class Entry {
+      public:
+        size_t queries = 0;
+        bool retired = false;
+    };
+
+    void retire(Reactor *reactor);
+
+    std::mutex mutex_;
+    std::map<Reactor *, std::map<std::string, evdns_base *>> all_;
+    std::map<evdns_base *, Entry> entries_;
+};
+
+} // namespace dns
+} // namespace mk
+#endif
@@ -8,6 +8,7 @@
 #include "src/libmeasurement_kit/common/non_copyable.hpp"
 #include "src/libmeasurement_kit/common/non_movable.hpp"
 #include "src/libmeasurement_kit/common/utils.hpp"
+#include "src/libmeasurement_kit/dns/evdns_base_pool.hpp"
 #include "src/libmeasurement_kit/dns/utils.hpp"
 #include "../net/utils.hpp"
 
@@ -109,7 +110,7 @@ class QueryContext : public NonMovable, public NonCopyable {
   public:
     ~QueryContext() {
         if (base != nullptr) {
-            evdns_base_free(base, 0);
+            EvdnsBasePool::global().release(base);
         }
     }
 
@@ -157,7 +158,11 @@ create_evdns_base(Settings settings, SharedPtr<Reactor> reactor) {
 
     event_base *evb = reactor->get_event_base();
     const int initialize_nameservers = settings.count("dns/nameserver") ? 0 : 1;
-    evdns_base_uptr base(evdns_base_new(evb, initialize_nameservers));
+    int flags = initialize_nameservers ? EVDNS_BASE_INITIALIZE_NAMESERVERS : 0;
+    // Bases are pooled (see EvdnsBasePool) and idle ones must not keep
+    // the reactor running because of their UDP socket
+    flags |= EVDNS_BASE_DISABLE_WHEN_INACTIVE;
+    evdns_base_uptr base(evdns_base_new(evb, flags));
     if (!base) {
         throw std::bad_alloc();
     }
@@ -338,8 +343,8 @@ static inline void dns_callback(int code, char type, int count, int ttl,
     delete context;
 }
 
-template <MK_MOCK(evdns_base_free), MK_MOCK(evdns_base_resolve_ipv4),
-          MK_MOCK(evdns_base_resolve_ipv6), MK_MOCK(evdns_base_resolve_reverse),
+template <MK_MOCK(evdns_base_resolve_ipv4), MK_MOCK(evdns_base_resolve_ipv6),
+          MK_MOCK(evdns_base_resolve_reverse),
           MK_MOCK(evdns_base_resolve_reverse_ipv6), MK_MOCK(inet_pton)>
 void libevent_query(QueryClass dns_class, QueryType dns_type, std::string name,
            Callback<Error, SharedPtr<Message>> cb, Settings settings,
@@ -362,21 +367,7 @@ void libevent_query(QueryClass dns_class, QueryType dns_type, std::string name,
         return;
     }
 
-    SharedPtr<Message> message{std::make_shared<Message>()};
-    Query query;
-    evdns_base *base;
-
-    try {
-        base = create_evdns_base(settings, reactor);
-    } catch (std::runtime_error &) {
-        cb(GenericError(), {}); // TODO: refine error thrown here
-        return;
-    } catch (std::bad_alloc &) {
-        throw; // Let this propagate as we can do nothing
-    }
-
     if (dns_class != MK_DNS_CLASS_IN) {
-        evdns_base_free(base, 1);
         cb(UnsupportedClassError(), {});
         return;
     }
@@ -391,12 +382,43 @@ void libevent_query(QueryClass dns_class, QueryType dns_type, std::string name,
             dns_type = MK_DNS_TYPE_REVERSE_AAAA;
             name = s;
         } else {
-            evdns_base_free(base, 1);
             cb(InvalidNameForPTRError(), {});
             return;
         }
     }
 
+    // Validate the query before taking a base from the pool
+    in_addr netaddr4;
+    in6_addr netaddr6;
+    if (dns_type == MK_DNS_TYPE_REVERSE_A) {
+        if (inet_pton(AF_INET, name.c_str(), &netaddr4) != 1) {
+            cb(InvalidIPv4AddressError(), {});
+            return;
+        }
+    } else if (dns_type == MK_DNS_TYPE_REVERSE_AAAA) {
+        if (inet_pton(AF_INET6, name.c_str(), &netaddr6) != 1) {
+            cb(InvalidIPv6AddressError(), {});
+            return;
+        }
+    } else if (dns_type != MK_DNS_TYPE_A && dns_type != MK_DNS_TYPE_AAAA) {
+        cb(UnsupportedTypeError(), {});
+        return;
+    }
+
+    evdns_base *base;
+    try {
+        base = EvdnsBasePool::global().acquire(reactor, settings, [&]() {
+            return create_evdns_base(settings, reactor);
+        });
+    } catch (std::runtime_error &) {
+        cb(GenericError(), {}); // TODO: refine error thrown here
+        return;
+    } catch (std::bad_alloc &) {
+        throw; // Let this propagate as we can do nothing
+    }
+
+    SharedPtr<Message> message{std::make_shared<Message>()};
+    Query query;
     query.type = dns_type;
     query.qclass = dns_class;
     query.name = name;
@@ -418,75 +440,36 @@ void libevent_query(QueryClass dns_class, QueryType dns_type, std::string name,
     // cancel pending evdns requests and uses the `cancelled`
     // variable to keep track of cancelled requests.
     //
+    // The context releases the base when it is deleted.
+    //
+    QueryContext *context = new QueryContext(base, cb, message,
+            logger, reactor);
+    evdns_request *request = nullptr;
     if (dns_type == MK_DNS_TYPE_A) {
         logger->debug("dns query: IN A %s", name.c_str());
-        QueryContext *context = new QueryContext(base, cb, message,
-                logger, reactor);
-        if (evdns_base_resolve_ipv4(base, name.c_str(), DNS_QUERY_NO_SEARCH,
-                                    mk_evdns_handle_resolve,
-                                    context) == nullptr) {
-            delete context;
-            cb(ResolverError(), {});
-        }
-        return;
-    }
-
-    if (dns_type == MK_DNS_TYPE_AAAA) {
+        request = evdns_base_resolve_ipv4(base, name.c_str(),
+                                          DNS_QUERY_NO_SEARCH,
+                                          mk_evdns_handle_resolve, context);
+    } else if (dns_type == MK_DNS_TYPE_AAAA) {
         logger->debug("dns query: IN AAAA %s", name.c_str());
-        QueryContext *context = new QueryContext(base, cb, message,
-                logger, reactor);
-        if (evdns_base_resolve_ipv6(base, name.c_str(), DNS_QUERY_NO_SEARCH,
-                                    mk_evdns_handle_resolve,
-                                    context) == nullptr) {
-            delete context;
-            cb(ResolverError(), {});
-        }
-        return;
-    }
-
-    if (dns_type == MK_DNS_TYPE_REVERSE_A) {
+        request = evdns_base_resolve_ipv6(base, name.c_str(),
+                                          DNS_QUERY_NO_SEARCH,
+                                          mk_evdns_handle_resolve, context);
+    } else if (dns_type == MK_DNS_TYPE_REVERSE_A) {
         logger->debug("dns query: IN REVERSE_A %s", name.c_str());
-        in_addr netaddr;
-        if (inet_pton(AF_INET, name.c_str(), &netaddr) != 1) {
-            evdns_base_free(base, 1);
-            cb(InvalidIPv4AddressError(), {});
-            return;
-        }
-
-        QueryContext *context = new QueryContext(base, cb, message,
-                logger, reactor);
-        if (evdns_base_resolve_reverse(base, &netaddr, DNS_QUERY_NO_SEARCH,
-                                       mk_evdns_handle_resolve,
-                                       context) == nullptr) {
-            delete context;
-            cb(ResolverError(), {});
-        }
-        return;
-    }
-
-    if (dns_type == MK_DNS_TYPE_REVERSE_AAAA) {
+        request = evdns_base_resolve_reverse(base, &netaddr4,
+                                             DNS_QUERY_NO_SEARCH,
+                                             mk_evdns_handle_resolve, context);
+    } else {
         logger->debug("dns query: IN REVERSE_AAAA %s", name.c_str());
-        in6_addr netaddr;
-        if (inet_pton(AF_INET6, name.c_str(), &netaddr) != 1) {
-            evdns_base_free(base, 1);
-            cb(InvalidIPv6AddressError(), {});
-            return;
-        }
-
-        QueryContext *context = new QueryContext(base, cb, message,
-                logger, reactor);
-        if (evdns_base_resolve_reverse_ipv6(base, &netaddr, DNS_QUERY_NO_SEARCH,
-                                            mk_evdns_handle_resolve,
-                                            context) == nullptr) {
-            delete context;
-            cb(ResolverError(), {});
-            return;
-        }
-        return;
+        request = evdns_base_resolve_reverse_ipv6(
+                base, &netaddr6, DNS_QUERY_NO_SEARCH, mk_evdns_handle_resolve,
+                context);
+    }
+    if (request == nullptr) {
+        delete context;
+        cb(ResolverError(), {});
     }
-
-    evdns_base_free(base, 1);
-    cb(UnsupportedTypeError(), {});
 }
 
 } // namespace dns
@@ -0,0 +1,690 @@
+// Part of Measurement Kit <https://measurement-kit.github.io/>.
+// Measurement Kit is free software under the BSD license. See AUTHORS
+// and LICENSE for more information on the copying conditions.
+
+#include "src/libmeasurement_kit/dns/native_query.hpp"
+
+#include "src/libmeasurement_kit/common/enable_shared_from_this.hpp"
+#include "src/libmeasurement_kit/common/lexical_cast.hpp"
+#include "src/libmeasurement_kit/common/non_copyable.hpp"
+#include "src/libmeasurement_kit/common/non_movable.hpp"
+#include "src/libmeasurement_kit/common/secure_random.hpp"
+#include "src/libmeasurement_kit/common/utils.hpp"
+#include "src/libmeasurement_kit/dns/evdns_base_pool.hpp"
+#include "src/libmeasurement_kit/dns/libevent_query.hpp"
+#include "src/libmeasurement_kit/dns/nameser.h"
+#include "src/libmeasurement_kit/net/connect.hpp"
+
+#include <event2/dns.h>
+#include <event2/event.h>
+#include <event2/util.h>
+
+#include <errno.h>
+#include <string.h>
+
+#include <deque>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+
+extern "C" {
+
+static void mk_native_socket_readable(evutil_socket_t, short, void *);
+
+} // extern "C"
+
+namespace mk {
+namespace dns {
+
+/*
+ * Configuration
+ */
+
+ResolvConf parse_resolv_conf(const std::string &data) {
+    ResolvConf conf;
+    std::stringstream input{data};
+    std::string line;
+    while (std::getline(input, line)) {
+        std::stringstream words{line};
+        std::string keyword;
+        if (!(words >> keyword)) {
+            continue;
+        }
+        if (keyword == "nameserver") {
+            Nameserver ns;
+            if (words >> ns.address) {
+                conf.nameservers.push_back(ns);
+            }
+        } else if (keyword == "options") {
+            std::string option;
+            while (words >> option) {
+                // Values out of range are ignored like glibc does
+                if (startswith(option, "timeout:")) {
+                    ErrorOr<int> v = lexical_cast_noexcept<int>(
+                            option.substr(strlen("timeout:")));
+                    if (v && *v >= 1 && *v <= 30) {
+                        conf.timeout = *v;
+                    }
+                } else if (startswith(option, "attempts:")) {
+                    ErrorOr<int> v = lexical_cast_noexcept<int>(
+                            option.substr(strlen("attempts:")));
+                    if (v && *v >= 1 && *v <= 5) {
+                        conf.attempts = *v;
+                    }
+                }
+            }
+        }
+    }
+    return conf;
+}
+
+ErrorOr<ResolvConf> native_resolv_conf(const Settings &settings) {
+    ResolvConf conf;
+    if (settings.find("dns/nameserver") != settings.end()) {
+        Nameserver ns;
+        ns.address = settings.get("dns/nameserver", std::string{});
+        ErrorOr<int> port = settings.get_noexcept("dns/port", 53);
+        if (!port || *port <= 0 || *port > 65535) {
+            return {ValueError(), {}};
+        }
+        ns.port = *port;
+        conf.nameservers.push_back(ns);
+    } else {
+        ErrorOr<std::string> data = slurp(settings.get(
+                "dns/resolv_conf", std::string{"/etc/resolv.conf"}));
+        if (!data) {
+            return {data.as_error(), {}};
+        }
+        conf = parse_resolv_conf(*data);
+        if (conf.nameservers.empty()) {
+            return {ResolverError(), {}};
+        }
+    }
+    ErrorOr<double> timeout = settings.get_noexcept("dns/timeout",
+                                                    conf.timeout);
+    ErrorOr<int> attempts = settings.get_noexcept("dns/attempts",
+                                                  conf.attempts);
+    if (!timeout || *timeout <= 0.0 || !attempts || *attempts <= 0) {
+        return {ValueError(), {}};
+    }
+    conf.timeout = *timeout;
+    conf.attempts = *attempts;
+    return {NoError(), conf};
+}
+
+/*
+ * Wire format
+ */
+
+std::string serialize_query(uint16_t id, const std::string &name,
+                            uint16_t type, uint16_t qclass, uint16_t edns0) {
+    if (name.empty()) {
+        throw std::runtime_error("empty name");
+    }
+    WireMessage query;
+    query.id = id;
+    query.flags = 0x0100; // Recursion desired
+    query.add_question(name, type, qclass);
+    if (edns0 != 0) {
+        query.add_edns0(edns0);
+    }
+    return query.serialize();
+}
+
+bool is_reply_to(const std::string &packet, const std::string &query) {
+    // The query is well formed because we serialized it
+    size_t end = NS_HFIXEDSZ;
+    while (query[end] != '\0') {
+        end += (uint8_t)query[end] + 1;
+    }
+    end += 1 + NS_QFIXEDSZ;
+    return packet.size() >= end && packet.compare(0, 2, query, 0, 2) == 0 &&
+           ((uint8_t)packet[2] & 0x80) != 0 /* QR */ &&
+           packet[4] == 0 && packet[5] == 1 /* QDCOUNT */ &&
+           packet.compare(NS_HFIXEDSZ, end - NS_HFIXEDSZ, query, NS_HFIXEDSZ,
+                          end - NS_HFIXEDSZ) == 0;
+}
+
+static Answer make_answer(const WireMessage &reply, const WireRecord &record) {
+    Answer answer;
+    answer.name = reply.str(record.name);
+    answer.type = query_type_from_wire(record.type);
+    // QueryClassId follows the wire values
+    answer.qclass = (record.qclass <= MK_DNS_CLASS_HS)
+                            ? (QueryClassId)record.qclass
+                            : MK_DNS_CLASS_INVALID;
+    answer.ttl = record.ttl;
+    switch (record.type) {
+    case MK_DNS_WIRE_TYPE_A:
+        answer.ipv4 = reply.address(record);
+        break;
+    case MK_DNS_WIRE_TYPE_AAAA:
+        answer.ipv6 = reply.address(record);
+        break;
+    case MK_DNS_WIRE_TYPE_NS:
+    case MK_DNS_WIRE_TYPE_CNAME:
+    case MK_DNS_WIRE_TYPE_PTR:
+        answer.hostname = reply.str(record.target);
+        break;
+    case MK_DNS_WIRE_TYPE_SOA:
+        answer.hostname = reply.str(record.mname);
+        answer.responsible_name = reply.str(record.rname);
+        answer.serial_number = record.serial;
+        answer.refresh_interval = record.refresh;
+        answer.retry_interval = record.retry;
+        answer.expiration_limit = record.expire;
+        answer.minimum_ttl = record.minimum;
+        break;
+    }
+    return answer;
+}
+
+static bool has_answer_fields(uint16_t type) {
+    return type == MK_DNS_WIRE_TYPE_A || type == MK_DNS_WIRE_TYPE_AAAA ||
+           type == MK_DNS_WIRE_TYPE_NS || type == MK_DNS_WIRE_TYPE_CNAME ||
+           type == MK_DNS_WIRE_TYPE_PTR || type == MK_DNS_WIRE_TYPE_SOA;
+}
+
+Error parse_reply(const std::string &packet, Message &message) {
+    SharedPtr<WireMessage> reply{std::make_shared<WireMessage>()};
+    std::vector<Answer> answers;
+    int code = DNS_ERR_NONE;
+    if (reply->parse(packet) != NoError()) {
+        // Like evdns, report malformed replies as truncated
+        code = DNS_ERR_TRUNCATED;
+        reply = nullptr;
+    } else if (reply->tc()) {
+        code = DNS_ERR_TRUNCATED;
+    } else if (reply->rcode() != 0) {
+        // The evdns codes of RFC 1035 errors are the RCODEs
+        code = (reply->rcode() <= DNS_ERR_REFUSED) ? reply->rcode()
+                                                   : DNS_ERR_UNKNOWN;
+    } else if (reply->answers.empty()) {
+        code = DNS_ERR_NODATA;
+    } else {
+        for (auto &record : reply->answers) {
+            // The other records are only available in message.wire
+            if (has_answer_fields(record.type)) {
+                answers.push_back(make_answer(*reply, record));
+            }
+        }
+    }
+    message.error_code = code;
+    message.answers = std::move(answers);
+    message.wire = reply;
+    return dns_error(code);
+}
+
+/*
+ * Engine
+ */
+
+class NativeResolver;
+class NativeSocket;
+
+class NativeQueryContext : public NonCopyable, public NonMovable {
+  public:
+    std::string name;
+    uint16_t type = 0;
+    uint16_t qclass = 0;
+    uint16_t edns0 = 0;
+    std::string packet;
+    uint16_t id = 0;
+    size_t tries = 0;
+    NativeSocket *socket = nullptr;
+    TimerHandle timer;
+    double begin = 0.0;
+    SharedPtr<Message> message;
+    Callback<Error, SharedPtr<Message>> callback;
+    SharedPtr<NativeResolver> resolver;
+    SharedPtr<Reactor> reactor;
+    SharedPtr<Logger> logger;
+};
+
+class NativeSocket : public EnableSharedFromThis<NativeSocket>,
+                     public NonCopyable,
+                     public NonMovable {
+  public:
+    ~NativeSocket() {
+        if (ev != nullptr) {
+            event_free(ev);
+        }
+        if (fd != -1) {
+            evutil_closesocket(fd);
+        }
+    }
+
+    evutil_socket_t fd = -1;
+    event *ev = nullptr;
+    size_t sent = 0;
+    std::map<uint16_t, SharedPtr<NativeQueryContext>> pending;
+    NativeResolver *resolver = nullptr;
+};
+
+// Sockets of a reactor for a set of nameservers. The sockets are only
+// polled when there are queries waiting for a response, so idle ones do
+// not keep Reactor::run() from returning.
+class NativeResolver : public EnableSharedFromThis<NativeResolver>,
+                       public NonCopyable,
+                       public NonMovable {
+  public:
+    // After this number of queries we open a new socket, so that the
+    // source port changes every now and then
+    static constexpr size_t queries_per_socket = 256;
+
+    // Like evdns's default `max-inflight`, further queries wait in line
+    // rather than flooding the nameservers
+    static constexpr size_t max_inflight = 64;
+
+    static SharedPtr<NativeResolver> make(ResolvConf conf, event_base *evb);
+
+    void send(SharedPtr<NativeQueryContext> ctx, size_t nameserver);
+    void forget(NativeQueryContext *ctx);
+    void on_readable(NativeSocket *socket);
+
+    ResolvConf conf;
+    size_t inflight = 0;
+    std::deque<SharedPtr<NativeQueryContext>> waiting;
+
+  private:
+    SharedPtr<NativeSocket> open(size_t nameserver);
+
+    event_base *evb = nullptr;
+    std::vector<sockaddr_storage> addresses;
+    std::vector<socklen_t> lengths;
+    std::vector<SharedPtr<NativeSocket>> current;
+    std::map<NativeSocket *, SharedPtr<NativeSocket>> draining;
+};
+
+/*static*/ SharedPtr<NativeResolver> NativeResolver::make(ResolvConf conf,
+                                                          event_base *evb) {
+    SharedPtr<NativeResolver> resolver{std::make_shared<NativeResolver>()};
+    for (auto &ns : conf.nameservers) {
+        // Like create_evdns_base(), use getaddrinfo() to also parse
+        // link-local IPv6 addresses with a scope
+        evutil_addrinfo hints = {};
+        hints.ai_family = PF_UNSPEC;
+        hints.ai_flags = EVUTIL_AI_NUMERICSERV | EVUTIL_AI_NUMERICHOST;
+        hints.ai_socktype = SOCK_DGRAM;
+        evutil_addrinfo *res = nullptr;
+        if (evutil_getaddrinfo(ns.address.c_str(),
+                               std::to_string(ns.port).c_str(), &hints,
+                               &res) != 0) {
+            throw std::runtime_error("Cannot parse server address");
+        }
+        evaddrinfo_uptr ai{res};
+        sockaddr_storage storage = {};
+        memcpy(&storage, ai->ai_addr, ai->ai_addrlen);
+        resolver->addresses.push_back(storage);
+        resolver->lengths.push_back((socklen_t)ai->ai_addrlen);
+    }
+    resolver->current.resize(conf.nameservers.size());
+    resolver->conf = conf;
+    resolver->evb = evb;
+    return resolver;
+}
+
+SharedPtr<NativeSocket> NativeResolver::open(size_t nameserver) {
+    SharedPtr<NativeSocket> socket{std::make_shared<NativeSocket>()};
+    socket->resolver = this;
+    sockaddr_storage &peer = addresses[nameserver];
+    socket->fd = ::socket(peer.ss_family, SOCK_DGRAM, 0);
+    if (socket->fd == -1) {
+        throw std::runtime_error("socket");
+    }
+    if (evutil_make_socket_nonblocking(socket->fd) != 0 ||
+        evutil_make_socket_closeonexec(socket->fd) != 0) {
+        throw std::runtime_error("cannot configure socket");
+    }
+    // Choose the source port ourselves, because not all systems pick a
+    // random ephemeral port. If we're unlucky, let the kernel choose.
+    sockaddr_storage local = {};
+    local.ss_family = peer.ss_family;
+    for (int i = 0; i < 8; ++i) {
+        uint16_t port = htons((uint16_t)(1024 + secure_random().uniform(
+                                                        65536 - 1024)));
+        if (peer.ss_family == AF_INET) {
+            ((sockaddr_in *)&local)->sin_port = port;
+        } else {
+            ((sockaddr_in6 *)&local)->sin6_port = port;
+        }
+        if (::bind(socket->fd, (sockaddr *)&local,
+                   lengths[nameserver]) == 0) {
+            break;
+        }
+    }
+    // Connecting means that the kernel drops datagrams from other peers
+    if (::connect(socket->fd, (sockaddr *)&peer, lengths[nameserver]) != 0) {
+        throw std::runtime_error("connect");
+    }
+    socket->ev = event_new(evb, socket->fd, EV_READ | EV_PERSIST,
+                           mk_native_socket_readable, socket.get());
+    if (socket->ev == nullptr) {
+        throw std::runtime_error("event_new");
+    }
+    return socket;
+}
+
+void NativeResolver::send(SharedPtr<NativeQueryContext> ctx,
+                          size_t nameserver) {
+    SharedPtr<NativeSocket> &socket = current[nameserver];
+    if (!socket || socket->sent >= queries_per_socket) {
+        if (socket && !socket->pending.empty()) {
+            draining[socket.get()] = socket;
+        }
+        socket = open(nameserver);
+    }
+    // IDs must be unique among the queries waiting on a socket
+    do {
+        ctx->id = (uint16_t)secure_random().uniform(65536);
+    } while (socket->pending.count(ctx->id) != 0);
+    ctx->packet[0] = (char)(ctx->id >> 8);
+    ctx->packet[1] = (char)(ctx->id & 0xff);
+    if (socket->pending.empty() && event_add(socket->ev, nullptr) != 0) {
+        throw std::runtime_error("event_add");
+    }
+    socket->pending[ctx->id] = ctx;
+    socket->sent += 1;
+    ctx->socket = socket.get();
+    // If sending fails, the attempt times out like a lost datagram
+    if (::send(socket->fd, ctx->packet.data(), ctx->packet.size(), 0) < 0) {
+        ctx->logger->debug("dns: native: send failed: %s", strerror(errno));
+    }
+}
+
+void NativeResolver::forget(NativeQueryContext *ctx) {
+    NativeSocket *socket = ctx->socket;
+    if (socket == nullptr) {
+        return;
+    }
+    ctx->socket = nullptr;
+    socket->pending.erase(ctx->id);
+    if (socket->pending.empty()) {
+        event_del(socket->ev);
+        draining.erase(socket);
+    }
+}
+
+static void native_reply(SharedPtr<NativeQueryContext> ctx,
+                         std::string packet);
+
+void NativeResolver::on_readable(NativeSocket *socket) {
+    // Keep both alive: the last reply may release the resolver and close
+    // a socket we were draining
+    SharedPtr<NativeResolver> self = shared_from_this();
+    SharedPtr<NativeSocket> keep = socket->shared_from_this();
+    char buffer[65536];
+    // Do not starve the other events if the socket is flooded
+    for (int i = 0; i < 64 && !socket->pending.empty(); ++i) {
+        ssize_t n = ::recv(socket->fd, buffer, sizeof(buffer), 0);
+        if (n < 0) {
+            // Including ECONNREFUSED caused by an earlier ICMP error,
+            // which we cannot map to a specific query
+            break;
+        }
+        if ((size_t)n < NS_HFIXEDSZ) {
+            continue;
+        }
+        std::string packet{buffer, (size_t)n};
+        uint16_t id = (uint16_t)(((uint8_t)buffer[0] << 8) |
+                                 (uint8_t)buffer[1]);
+        auto it = socket->pending.find(id);
+        if (it == socket->pending.end() ||
+            !is_reply_to(packet, it->second->packet)) {
+            continue; // Late, unexpected or possibly spoofed
+        }
+        SharedPtr<NativeQueryContext> ctx = it->second;
+        forget(ctx.get());
+        native_reply(ctx, std::move(packet));
+    }
+}
+
+// One resolver per reactor and settings, like EvdnsBasePool. The pool
+// forgets the resolvers of a reactor when it stops, and queries still
+// in flight keep their resolver alive.
+static std::mutex native_resolvers_mutex;
+static std::map<Reactor *, std::map<std::string, SharedPtr<NativeResolver>>>
+        native_resolvers;
+
+static SharedPtr<NativeResolver> native_resolver(SharedPtr<Reactor> reactor,
+                                                 const Settings &settings,
+                                                 const ResolvConf &conf) {
+    std::string key = evdns_base_key(settings) + " dns/resolv_conf=" +
+                      settings.get("dns/resolv_conf", std::string{});
+    Reactor *p = reactor.get();
+    {
+        std::unique_lock<std::mutex> _{native_resolvers_mutex};
+        auto rit = native_resolvers.find(p);
+        if (rit != native_resolvers.end()) {
+            auto it = rit->second.find(key);
+            if (it != rit->second.end()) {
+                return it->second;
+            }
+        }
+    }
+    // Note: make() throws if the nameservers are not valid
+    SharedPtr<NativeResolver> resolver = NativeResolver::make(
+            conf, reactor->get_event_base());
+    bool first = false;
+    {
+        std::unique_lock<std::mutex> _{native_resolvers_mutex};
+        first = (native_resolvers.count(p) == 0);
+        native_resolvers[p][key] = resolver;
+    }
+    if (first) {
+        reactor->on_stop([p]() {
+            std::unique_lock<std::mutex> _{native_resolvers_mutex};
+            native_resolvers.erase(p);
+        });
+    }
+    return resolver;
+}
+
+static void native_send(SharedPtr<NativeQueryContext> ctx);
+
+static void native_finish(SharedPtr<NativeQueryContext> ctx, Error error) {
+    ctx->reactor->cancel(ctx->timer);
+    SharedPtr<NativeResolver> resolver = ctx->resolver;
+    resolver->forget(ctx.get());
+    ctx->resolver = nullptr;
+    resolver->inflight -= 1;
+    if (!resolver->waiting.empty()) {
+        SharedPtr<NativeQueryContext> next = resolver->waiting.front();
+        resolver->waiting.pop_front();
+        resolver->inflight += 1;
+        // Start the next query after the callback of this one
+        ctx->reactor->call_soon([next]() {
+            next->begin = mk::time_now();
+            native_send(next);
+        });
+    }
+    if (ctx->message->error_code == DNS_ERR_TIMEOUT ||
+        ctx->message->error_code == DNS_ERR_UNKNOWN) {
+        ctx->message->rtt = 0.0;
+    } else {
+        ctx->message->rtt = mk::time_now() - ctx->begin;
+    }
+    try {
+        ctx->callback(error, ctx->message);
+    } catch (const Error &) {
+        // Like libevent_query(), do not let Error exceptions escape
+    }
+}
+
+static void native_timeout(SharedPtr<NativeQueryContext> ctx) {
+    ctx->resolver->forget(ctx.get());
+    const ResolvConf &conf = ctx->resolver->conf;
+    if (ctx->tries < conf.nameservers.size() * (size_t)conf.attempts) {
+        native_send(ctx);
+        return;
+    }
+    ctx->message->error_code = DNS_ERR_TIMEOUT;
+    native_finish(ctx, TimeoutError());
+}
+
+static void native_send(SharedPtr<NativeQueryContext> ctx) {
+    const ResolvConf &conf = ctx->resolver->conf;
+    size_t nameserver = ctx->tries++ % conf.nameservers.size();
+    try {
+        ctx->resolver->send(ctx, nameserver);
+    } catch (const std::runtime_error &exc) {
+        ctx->logger->warn("dns: native: %s", exc.what());
+        ctx->message->error_code = DNS_ERR_UNKNOWN;
+        native_finish(ctx, GenericError());
+        return;
+    }
+    ctx->reactor->with_current_data_usage(
+            [&](DataUsage &du) { du.up += ctx->packet.size(); });
+    ctx->timer = ctx->reactor->call_later(
+            conf.timeout, [ctx]() { native_timeout(ctx); });
+}
+
+static void native_tcp(SharedPtr<NativeQueryContext> ctx) {
+    ctx->reactor->cancel(ctx->timer);
+    ctx->logger->debug("dns: native: truncated reply, retrying over TCP");
+    const ResolvConf &conf = ctx->resolver->conf;
+    const Nameserver &ns =
+            conf.nameservers[(ctx->tries - 1) % conf.nameservers.size()];
+    auto fail = [ctx](Error error, SharedPtr<net::Transport> txp) {
+        if (txp) {
+            txp->close(nullptr);
+        }
+        ctx->message->error_code = DNS_ERR_UNKNOWN;
+        native_finish(ctx, error);
+    };
+    net::connect(ns.address, ns.port,
+        [ctx, fail](Error error, SharedPtr<net::Transport> txp) {
+            if (error) {
+                fail(error, txp);
+                return;
+            }
+            net::Buffer query;
+            query.write_uint16((uint16_t)ctx->packet.size());
+            query.write(ctx->packet);
+            net::write(txp, query, [ctx, fail, txp](Error error) {
+                if (error) {
+                    fail(error, txp);
+                    return;
+                }
+                SharedPtr<net::Buffer> buff = net::Buffer::make();
+                net::readn(txp, buff, NS_INT16SZ, [=](Error error) {
+                    if (error) {
+                        fail(error, txp);
+                        return;
+                    }
+                    size_t length = *buff->read_uint16();
+                    net::readn(txp, buff, length, [=](Error error) {
+                        if (error) {
+                            fail(error, txp);
+                            return;
+                        }
+                        std::string packet = buff->readn(length);
+                        txp->close(nullptr);
+                        ctx->reactor->with_current_data_usage(
+                                [&](DataUsage &du) {
+                                    du.up += ctx->packet.size() + 2;
+                                    du.down += packet.size() + 2;
+                                });
+                        if (!is_reply_to(packet, ctx->packet)) {
+                            ctx->message->error_code = DNS_ERR_UNKNOWN;
+                            native_finish(ctx, UnknownError());
+                            return;
+                        }
+                        native_finish(ctx, parse_reply(packet, *ctx->message));
+                    }, ctx->reactor);
+                }, ctx->reactor);
+            });
+        },
+        {{"net/timeout", conf.timeout}}, ctx->reactor, ctx->logger);
+}
+
+static void native_reply(SharedPtr<NativeQueryContext> ctx,
+                         std::string packet) {
+    ctx->reactor->with_current_data_usage(
+            [&](DataUsage &du) { du.down += packet.size(); });
+    Error error = parse_reply(packet, *ctx->message);
+    if (error == FormatError() && ctx->edns0 != 0) {
+        // Old servers may reject queries with an OPT record
+        ctx->logger->debug("dns: native: FORMERR, retrying without EDNS0");
+        ctx->reactor->cancel(ctx->timer);
+        ctx->edns0 = 0;
+        ctx->packet = serialize_query(0, ctx->name, ctx->type, ctx->qclass, 0);
+        ctx->tries -= 1;
+        native_send(ctx);
+        return;
+    }
+    if (error == TruncatedError()) {
+        native_tcp(ctx);
+        return;
+    }
+    native_finish(ctx, error);
+}
+
+void native_query(QueryClass dns_class, QueryType dns_type, std::string name,
+                  Callback<Error, SharedPtr<Message>> cb, Settings settings,
+                  SharedPtr<Reactor> reactor, SharedPtr<Logger> logger) {
+    if (dns_class == MK_DNS_CLASS_INVALID) {
+        cb(UnsupportedClassError(), {});
+        return;
+    }
+    uint16_t type = wire_query_type(dns_type);
+    if (type == 0) {
+        cb(UnsupportedTypeError(), {});
+        return;
+    }
+    ErrorOr<int> edns0 = settings.get_noexcept("dns/edns0_payload_size", 1232);
+    ErrorOr<bool> randomize = settings.get_noexcept("dns/randomize_case",
+                                                    false);
+    if (!edns0 || (*edns0 != 0 && (*edns0 < 512 || *edns0 > 65535)) ||
+        !randomize) {
+        cb(ValueError(), {});
+        return;
+    }
+    ErrorOr<ResolvConf> conf = native_resolv_conf(settings);
+    if (!conf) {
+        cb(conf.as_error(), {});
+        return;
+    }
+
+    SharedPtr<NativeQueryContext> ctx{std::make_shared<NativeQueryContext>()};
+    // With 0x20 encoding, the reply must preserve the letter case
+    // (see is_reply_to()), which makes spoofing harder
+    ctx->name = *randomize ? randomly_capitalize(name) : name;
+    ctx->type = type;
+    ctx->qclass = (uint16_t)(QueryClassId)dns_class;
+    ctx->edns0 = (uint16_t)*edns0;
+    try {
+        ctx->packet = serialize_query(0, ctx->name, ctx->type, ctx->qclass,
+                                      ctx->edns0);
+        ctx->resolver = native_resolver(reactor, settings, *conf);
+    } catch (const std::runtime_error &) {
+        cb(ValueError(), {});
+        return;
+    }
+    Query query;
+    query.type = dns_type;
+    query.qclass = dns_class;
+    query.name = name;
+    ctx->message = SharedPtr<Message>{std::make_shared<Message>()};
+    ctx->message->queries.push_back(query);
+    ctx->callback = cb;
+    ctx->reactor = reactor;
+    ctx->logger = logger;
+    ctx->begin = mk::time_now();
+    logger->debug("dns: native: query %s", name.c_str());
+    if (ctx->resolver->inflight >= NativeResolver::max_inflight) {
+        ctx->resolver->waiting.push_back(ctx);
+        return;
+    }
+    ctx->resolver->inflight += 1;
+    native_send(ctx);
+}
+
+} // namespace dns
+} // namespace mk
+
+static void mk_native_socket_readable(evutil_socket_t, short, void *opaque) {
+    auto socket = static_cast<mk::dns::NativeSocket *>(opaque);
+    socket->resolver->on_readable(socket);
+}
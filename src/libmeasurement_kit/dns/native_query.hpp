@@ -0,0 +1,83 @@
+// Part of Measurement Kit <https://measurement-kit.github.io/>.
+// Measurement Kit is free software under the BSD license. See AUTHORS
+// and LICENSE for more information on the copying conditions.
+#ifndef SRC_LIBMEASUREMENT_KIT_DNS_NATIVE_QUERY_HPP
+#define SRC_LIBMEASUREMENT_KIT_DNS_NATIVE_QUERY_HPP
+
+#include "src/libmeasurement_kit/dns/query.hpp"
+#include "src/libmeasurement_kit/dns/wire.hpp"
+
+#include <string>
+#include <vector>
+
+namespace mk {
+namespace dns {
+
+/// A nameserver used by the native engine.
+class Nameserver {
+  public:
+    std::string address;
+    int port = 53;
+};
+
+/// Configuration of the native engine.
+class ResolvConf {
+  public:
+    std::vector<Nameserver> nameservers;
+    double timeout = 5.0;
+    int attempts = 2;
+};
+
+/// Parses the content of resolv.conf(5). We only use the `nameserver`
+/// lines and the `timeout:n` and `attempts:n` options.
+ResolvConf parse_resolv_conf(const std::string &data);
+
+/// Returns the configuration of the native engine. The `dns/nameserver`,
+/// `dns/port`, `dns/timeout` and `dns/attempts` settings override what we
+/// read from the `dns/resolv_conf` file (by default /etc/resolv.conf).
+ErrorOr<ResolvConf> native_resolv_conf(const Settings &settings);
+
+/// Serializes a recursive query for \p name. If \p edns0 is not zero, the
+/// query includes an OPT record advertising \p edns0 bytes as the maximum
+/// UDP payload size. Throws std::runtime_error if \p name is not valid.
+std::string serialize_query(uint16_t id, const std::string &name,
+                            uint16_t type, uint16_t qclass, uint16_t edns0);
+
+/// Returns true if \p packet is a response to \p query, i.e. if it has the
+/// same ID and repeats the same question, letter case included.
+bool is_reply_to(const std::string &packet, const std::string &query);
+
+/// Parses the response \p packet and adds the answers that Answer can
+/// represent to \p message, which also gets the whole response as
+/// message.wire. Also sets message.error_code using evdns's error codes.
+/// Returns the error corresponding to the response code, NoDataError if
+/// the response has no answer records, or TruncatedError if the response
+/// was truncated or is malformed (like evdns does). Records that Answer
+/// cannot represent (e.g. TXT and MX) are only in message.wire, hence
+/// message.answers may be empty also when this returns NoError.
+Error parse_reply(const std::string &packet, Message &message);
+
+/*!
+    \brief The `native` DNS engine.
+
+    It builds the queries itself and sends them over non-blocking UDP
+    sockets bound to random ports, with random IDs. Queries running in the
+    same reactor with the same nameservers share the sockets, so many of
+    them can be outstanding on a single socket. Like evdns, at most 64
+    queries per resolver are in flight and the others wait. We move to a
+    new socket every so often to also randomize the source port. If the
+    response is truncated, we repeat the query over TCP.
+
+    Each attempt tries all the nameservers in turn, waiting `timeout`
+    seconds for each one of them. The EDNS0 UDP payload size that we
+    advertise is `dns/edns0_payload_size` (default: 1232, zero disables
+    EDNS0). If `dns/randomize_case` is true, we randomize the letter case
+    of the name and require responses to preserve it.
+*/
+void native_query(QueryClass dns_class, QueryType dns_type, std::string name,
+                  Callback<Error, SharedPtr<Message>> cb, Settings settings,
+                  SharedPtr<Reactor> reactor, SharedPtr<Logger> logger);
+
+} // namespace dns
+} // namespace mk
+#endif
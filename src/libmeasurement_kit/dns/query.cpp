@@ -3,6 +3,8 @@
 // and LICENSE for more information on the copying conditions.
 
 #include "src/libmeasurement_kit/dns/libevent_query.hpp"
+#include "src/libmeasurement_kit/dns/native_query.hpp"
+#include "src/libmeasurement_kit/dns/resolve_cache.hpp"
 #include "src/libmeasurement_kit/dns/system_resolver.hpp"
 #include "src/libmeasurement_kit/dns/resolve_hostname.hpp"
 
@@ -21,6 +23,9 @@ void query(QueryClass dns_class, QueryType dns_type, std::string name,
         if (engine == "libevent") {
             libevent_query(
                     dns_class, dns_type, name, cb, settings, reactor, logger);
+        } else if (engine == "native") {
+            native_query(
+                    dns_class, dns_type, name, cb, settings, reactor, logger);
         } else if (engine == "system") {
             system_resolver(
                     dns_class, dns_type, name, settings, reactor, logger, cb);
@@ -60,8 +65,36 @@ void resolve_hostname(std::string hostname, Callback<ResolveHostnameResult> cb,
         return;
     }
 
-    logger->debug("resolve_hostname: ipv4...");
+    // Infrastructure lookups may opt into the cache (see ResolveCache)
+    if (settings.get("dns/cache", std::string{}) != "") {
+        Settings uncached = settings;
+        uncached.erase("dns/cache");
+        ResolveCache::global().resolve(
+                hostname, cb, settings, reactor, logger,
+                [=](Callback<ResolveHostnameResult> cb) {
+                    resolve_hostname(hostname, cb, uncached, reactor, logger);
+                });
+        return;
+    }
 
+    // Query A and AAAA concurrently and call back when both are done. We
+    // still list IPv4 addresses first, so the order does not depend on
+    // which reply comes first; net::connect decides which family to try
+    // first. Both callbacks run in the I/O thread, so no locking is needed.
+    SharedPtr<std::vector<std::string>> ipv6_addresses{
+            std::make_shared<std::vector<std::string>>()};
+    SharedPtr<int> pending{std::make_shared<int>(2)};
+    auto maybe_done = [=]() {
+        if (--*pending > 0) {
+            return;
+        }
+        result->addresses.insert(result->addresses.end(),
+                                 ipv6_addresses->begin(),
+                                 ipv6_addresses->end());
+        cb(*result);
+    };
+
+    logger->debug("resolve_hostname: ipv4...");
     dns::query("IN", "A", hostname,
                [=](Error err, SharedPtr<dns::Message> resp) {
                    logger->debug("resolve_hostname: ipv4... done");
@@ -75,24 +108,25 @@ void resolve_hostname(std::string hostname, Callback<ResolveHostnameResult> cb,
                            }
                        }
                    }
-                   logger->debug("resolve_hostname: ipv6...");
-                   dns::query(
-                       "IN", "AAAA", hostname,
-                       [=](Error err, SharedPtr<dns::Message> resp) {
-                           logger->debug("resolve_hostname: ipv6... done");
-                           result->ipv6_err = err;
-                           if (!err) {
-                               result->ipv6_reply = *resp;
-                               for (dns::Answer answer : resp->answers) {
-                                   // Don't connect using pure CNAME answers.
-                                   if (answer.ipv6 != "") {
-                                       result->addresses.push_back(answer.ipv6);
-                                   }
-                               }
+                   maybe_done();
+               },
+               settings, reactor, logger);
+
+    logger->debug("resolve_hostname: ipv6...");
+    dns::query("IN", "AAAA", hostname,
+               [=](Error err, SharedPtr<dns::Message> resp) {
+                   logger->debug("resolve_hostname: ipv6... done");
+                   result->ipv6_err = err;
+                   if (!err) {
+                       result->ipv6_reply = *resp;
+                       for (dns::Answer answer : resp->answers) {
+                           // Don't connect using pure CNAME answers.
+                           if (answer.ipv6 != "") {
+                               ipv6_addresses->push_back(answer.ipv6);
                            }
-                           cb(*result);
-                       },
-                       settings, reactor, logger);
+                       }
+                   }
+                   maybe_done();
                },
                settings, reactor, logger);
 }
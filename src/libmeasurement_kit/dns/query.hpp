@@ -9,6 +9,7 @@
 #include "src/libmeasurement_kit/dns/error.hpp"
 #include "src/libmeasurement_kit/dns/query_class.hpp"
 #include "src/libmeasurement_kit/dns/query_type.hpp"
+#include "src/libmeasurement_kit/dns/wire.hpp"
 
 #include <measurement_kit/common.hpp>
 
@@ -49,6 +50,7 @@ class Message {
     int error_code = 66 /* This is evdns's generic error */;
     std::vector<Answer> answers;
     std::vector<Query> queries;
+    SharedPtr<WireMessage> wire; ///< The response, if the engine has it
 };
 
 void query(
@@ -29,7 +29,8 @@ namespace dns {
     XX(TXT)                                                                    \
     XX(AAAA)                                                                   \
     XX(REVERSE_A /* nonstandard */)                                            \
-    XX(REVERSE_AAAA /* nonstandard */)
+    XX(REVERSE_AAAA /* nonstandard */)                                         \
+    XX(HTTPS)
 
 #define XX(_name) MK_DNS_TYPE_##_name,
 enum QueryTypeId { MK_DNS_TYPE_IDS };
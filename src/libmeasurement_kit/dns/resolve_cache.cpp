@@ -0,0 +1,169 @@
+// Part of Measurement Kit <https://measurement-kit.github.io/>.
+// Measurement Kit is free software under the BSD license. See AUTHORS
+// and LICENSE for more information on the copying conditions.
+
+#include "src/libmeasurement_kit/dns/resolve_cache.hpp"
+
+#include "src/libmeasurement_kit/common/utils.hpp"
+#include "src/libmeasurement_kit/dns/evdns_base_pool.hpp"
+
+namespace mk {
+namespace dns {
+
+std::string resolve_cache_key(const std::string &hostname,
+                              const Settings &settings) {
+    // Lookups of the same name using different engines or nameservers may
+    // legitimately return different addresses
+    return hostname + " dns/engine=" +
+           settings.get("dns/engine", std::string{"system"}) +
+           evdns_base_key(settings);
+}
+
+double resolve_cache_ttl(const ResolveHostnameResult &r,
+                         const Settings &settings) {
+    if (r.addresses.empty()) {
+        return settings.get("dns/cache_negative_ttl", 5.0);
+    }
+    if (settings.get("dns/engine", std::string{"system"}) == "system") {
+        return settings.get("dns/cache_system_ttl", 60.0);
+    }
+    bool found = false;
+    uint32_t ttl = 0;
+    for (auto reply : {&r.ipv4_reply, &r.ipv6_reply}) {
+        for (auto &answer : reply->answers) {
+            // Like resolve_hostname(), ignore pure CNAME answers
+            if (answer.ipv4 == "" && answer.ipv6 == "") {
+                continue;
+            }
+            if (!found || answer.ttl < ttl) {
+                ttl = answer.ttl;
+                found = true;
+            }
+        }
+    }
+    return (double)ttl;
+}
+
+/*static*/ ResolveCache &ResolveCache::global() {
+    static ResolveCache cache;
+    return cache;
+}
+
+void ResolveCache::resolve(
+        std::string hostname, Callback<ResolveHostnameResult> cb,
+        Settings settings, SharedPtr<Reactor> reactor,
+        SharedPtr<Logger> logger,
+        std::function<void(Callback<ResolveHostnameResult>)> lookup) {
+    std::string scope_name = settings.get("dns/cache", std::string{});
+    Reactor *scope = nullptr;
+    if (scope_name == "reactor") {
+        scope = reactor.get();
+    } else if (scope_name != "process") {
+        reactor->call_soon([=]() {
+            ResolveHostnameResult result;
+            result.ipv4_err = InvalidDnsCacheError();
+            result.ipv6_err = InvalidDnsCacheError();
+            cb(result);
+        });
+        return;
+    }
+    std::string key = resolve_cache_key(hostname, settings);
+    double now = time_now();
+    bool first = false;
+    bool cached = false;
+    ResolveHostnameResult result;
+    SharedPtr<Waiters> waiters;
+    {
+        std::unique_lock<std::mutex> _{mutex_};
+        first = reactors_.insert(reactor.get()).second;
+        auto sit = cached_.find(scope);
+        if (sit != cached_.end()) {
+            auto it = sit->second.find(key);
+            if (it != sit->second.end() && it->second.expires > now) {
+                result = it->second.result;
+                cached = true;
+            } else if (it != sit->second.end()) {
+                sit->second.erase(it);
+            }
+        }
+        if (!cached) {
+            SharedPtr<Waiters> &flight = flights_[reactor.get()][key];
+            if (!flight) {
+                flight = SharedPtr<Waiters>{std::make_shared<Waiters>()};
+                waiters = flight;
+            }
+            flight->push_back(cb);
+        }
+    }
+    Reactor *p = reactor.get();
+    if (first) {
+        reactor->on_stop([this, p]() { retire(p); });
+    }
+    if (cached) {
+        logger->debug("resolve_hostname: %s: cached", hostname.c_str());
+        reactor->call_soon([=]() { cb(result); });
+        return;
+    }
+    if (!waiters) {
+        logger->debug("resolve_hostname: %s: in flight", hostname.c_str());
+        return;
+    }
+    lookup([=](ResolveHostnameResult r) {
+        complete(p, scope, key, waiters, r, resolve_cache_ttl(r, settings));
+    });
+}
+
+size_t ResolveCache::size() { return size((Reactor *)nullptr); }
+
+size_t ResolveCache::size(SharedPtr<Reactor> reactor) {
+    return size(reactor.get());
+}
+
+size_t ResolveCache::size(Reactor *scope) {
+    std::unique_lock<std::mutex> _{mutex_};
+    auto sit = cached_.find(scope);
+    return (sit != cached_.end()) ? sit->second.size() : 0;
+}
+
+size_t ResolveCache::in_flight(SharedPtr<Reactor> reactor) {
+    std::unique_lock<std::mutex> _{mutex_};
+    auto rit = flights_.find(reactor.get());
+    return (rit != flights_.end()) ? rit->second.size() : 0;
+}
+
+void ResolveCache::complete(Reactor *reactor, Reactor *scope,
+                            const std::string &key, SharedPtr<Waiters> waiters,
+                            ResolveHostnameResult result, double ttl) {
+    {
+        std::unique_lock<std::mutex> _{mutex_};
+        auto rit = flights_.find(reactor);
+        if (rit != flights_.end()) {
+            auto it = rit->second.find(key);
+            // The flight is not there anymore if the reactor stopped
+            if (it != rit->second.end() && it->second == waiters) {
+                rit->second.erase(it);
+            }
+        }
+        // Do not cache results in the scope of a reactor that stopped
+        if (ttl > 0.0 && (scope == nullptr || reactors_.count(scope) > 0)) {
+            Entry &entry = cached_[scope][key];
+            entry.result = result;
+            entry.expires = time_now() + ttl;
+        }
+    }
+    for (auto &cb : *waiters) {
+        cb(result);
+    }
+}
+
+void ResolveCache::retire(Reactor *reactor) {
+    std::unique_lock<std::mutex> _{mutex_};
+    // Callbacks of lookups in flight keep their waiters alive, so they are
+    // still called if the lookup completes when the reactor runs again
+    flights_.erase(reactor);
+    cached_.erase(reactor);
+    reactors_.erase(reactor);
+}
+
+} // namespace dns
+} // namespace mk
@@ -0,0 +1,98 @@
+// Part of Measurement Kit <https://measurement-kit.github.io/>.
+// Measurement Kit is free software under the BSD license. See AUTHORS
+// and LICENSE for more information on the copying conditions.
+#ifndef SRC_LIBMEASUREMENT_KIT_DNS_RESOLVE_CACHE_HPP
+#define SRC_LIBMEASUREMENT_KIT_DNS_RESOLVE_CACHE_HPP
+
+#include "src/libmeasurement_kit/common/non_copyable.hpp"
+#include "src/libmeasurement_kit/common/non_movable.hpp"
+#include "src/libmeasurement_kit/dns/resolve_hostname.hpp"
+
+#include <functional>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace mk {
+namespace dns {
+
+/// Returns the string identifying the lookup of \p hostname with \p settings
+/// in the resolve_hostname() cache.
+std::string resolve_cache_key(const std::string &hostname,
+                              const Settings &settings);
+
+/// Returns for how many seconds the result \p r of a lookup performed
+/// with \p settings can be cached (see ResolveCache).
+double resolve_cache_ttl(const ResolveHostnameResult &r,
+                         const Settings &settings);
+
+/*!
+    \brief Cache of resolve_hostname() results.
+
+    resolve_hostname() uses it when the `dns/cache` setting is `reactor`,
+    to share results among lookups running in the same reactor, or
+    `process`, to share them among all the reactors. By default it is not
+    used, and we only enable it for infrastructure lookups (bouncer,
+    collector, mlab-ns and test helpers). Measurements never use it.
+
+    A result is cached for the smallest TTL of the answers we used. Since
+    getaddrinfo() does not tell us the TTLs, results of the `system` engine
+    are cached for `dns/cache_system_ttl` seconds (default: 60). Results
+    without addresses are cached for `dns/cache_negative_ttl` seconds
+    (default: 5). Identical lookups started while a lookup is in flight in
+    the same reactor wait for its result rather than hitting the network.
+
+    \remark You SHOULD use the process-wide cache returned by global(),
+    while you can create other instances for testing. Results scoped to a
+    reactor are forgotten when Reactor::run() returns. All methods MUST be
+    called from the I/O thread of the reactor passed as argument.
+*/
+class ResolveCache : public NonCopyable, public NonMovable {
+  public:
+    /// Returns the process-wide cache.
+    static ResolveCache &global();
+
+    /// Calls \p cb with the cached result of resolving \p hostname, if
+    /// any, otherwise uses \p lookup to resolve it. The `dns/cache` setting
+    /// selects the scope of the result (see above).
+    void resolve(std::string hostname, Callback<ResolveHostnameResult> cb,
+                 Settings settings, SharedPtr<Reactor> reactor,
+                 SharedPtr<Logger> logger,
+                 std::function<void(Callback<ResolveHostnameResult>)> lookup);
+
+    /// Returns the number of results cached in the process-wide scope.
+    size_t size();
+
+    /// Returns the number of results cached in the scope of \p reactor.
+    size_t size(SharedPtr<Reactor> reactor);
+
+    /// Returns the number of lookups in flight in \p reactor.
+    size_t in_flight(SharedPtr<Reactor> reactor);
+
+  private:
+    size_t size(Reactor *scope);
+
+    class Entry {
+      public:
+        ResolveHostnameResult result;
+        double expires = 0.0;
+    };
+
+    using Waiters = std::vector<Callback<ResolveHostnameResult>>;
+
+    void complete(Reactor *reactor, Reactor *scope, const std::string &key,
+                  SharedPtr<Waiters> waiters, ResolveHostnameResult result,
+                  double ttl);
+    void retire(Reactor *reactor);
+
+    std::mutex mutex_;
+    std::map<Reactor *, std::map<std::string, Entry>> cached_;
+    std::map<Reactor *, std::map<std::string, SharedPtr<Waiters>>> flights_;
+    std::set<Reactor *> reactors_;
+};
+
+} // namespace dns
+} // namespace mk
+#endif
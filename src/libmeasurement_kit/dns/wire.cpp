@@ -0,0 +1,487 @@
+// Part of Measurement Kit <https://measurement-kit.github.io/>.
+// Measurement Kit is free software under the BSD license. See AUTHORS
+// and LICENSE for more information on the copying conditions.
+
+#include "src/libmeasurement_kit/dns/wire.hpp"
+
+#include "src/libmeasurement_kit/dns/nameser.h"
+
+#include <event2/util.h>
+
+#include <algorithm>
+#include <map>
+#include <stdexcept>
+
+namespace mk {
+namespace dns {
+
+uint16_t wire_query_type(QueryType type) {
+    // QueryTypeId follows the wire values up to TXT
+    if (type == MK_DNS_TYPE_AAAA) {
+        return MK_DNS_WIRE_TYPE_AAAA;
+    }
+    if (type == MK_DNS_TYPE_HTTPS) {
+        return MK_DNS_WIRE_TYPE_HTTPS;
+    }
+    if (type == MK_DNS_TYPE_INVALID || type > MK_DNS_TYPE_TXT) {
+        return 0;
+    }
+    return (uint16_t)(QueryTypeId)type;
+}
+
+QueryType query_type_from_wire(uint16_t type) {
+    if (type == MK_DNS_WIRE_TYPE_AAAA) {
+        return MK_DNS_TYPE_AAAA;
+    }
+    if (type == MK_DNS_WIRE_TYPE_HTTPS) {
+        return MK_DNS_TYPE_HTTPS;
+    }
+    if (type > MK_DNS_TYPE_TXT) {
+        return MK_DNS_TYPE_INVALID;
+    }
+    return (QueryTypeId)type;
+}
+
+/*
+ * Parsing
+ */
+
+// Like the other functions reading the packet, it throws if we would
+// read past `end`, which is the end of the packet within the arena
+static uint16_t get_uint16(const std::string &s, size_t end, size_t off) {
+    if (off + NS_INT16SZ > end) {
+        throw std::runtime_error("truncated message");
+    }
+    return (uint16_t)(((uint8_t)s[off] << 8) | (uint8_t)s[off + 1]);
+}
+
+static uint32_t get_uint32(const std::string &s, size_t end, size_t off) {
+    return ((uint32_t)get_uint16(s, end, off) << 16) |
+           get_uint16(s, end, off + 2);
+}
+
+// Reads the possibly compressed name at `off`, appends it to the arena
+// and moves `off` past it
+WireSlice WireMessage::get_name(size_t &off) {
+    char name[NS_MAXDNAME];
+    size_t length = 0;
+    size_t pos = off;
+    bool jumped = false;
+    // Each pointer must go backwards, so we cannot loop forever
+    size_t limit = pos;
+    for (;;) {
+        if (pos >= packet_size_) {
+            throw std::runtime_error("truncated name");
+        }
+        uint8_t count = (uint8_t)arena_[pos];
+        if ((count & 0xc0) == 0xc0) {
+            size_t ptr = get_uint16(arena_, packet_size_, pos) & 0x3fff;
+            if (ptr >= limit) {
+                throw std::runtime_error("invalid compression pointer");
+            }
+            if (!jumped) {
+                off = pos + NS_INT16SZ;
+                jumped = true;
+            }
+            pos = limit = ptr;
+            continue;
+        }
+        if ((count & 0xc0) != 0) {
+            throw std::runtime_error("invalid label type");
+        }
+        if (count == 0) {
+            break;
+        }
+        if (pos + 1 + count > packet_size_) {
+            throw std::runtime_error("truncated label");
+        }
+        // The wire format limits names to 255 bytes, that is 253 bytes in
+        // presentation format without the trailing dot
+        if (length + (length != 0) + count > NS_MAXCDNAME - 2) {
+            throw std::runtime_error("name too long");
+        }
+        if (length != 0) {
+            name[length++] = '.';
+        }
+        arena_.copy(name + length, count, pos + 1);
+        length += count;
+        pos += 1 + count;
+    }
+    if (!jumped) {
+        off = pos + 1;
+    }
+    WireSlice slice;
+    slice.offset = (uint32_t)arena_.size();
+    slice.length = (uint32_t)length;
+    arena_.append(name, length);
+    return slice;
+}
+
+WireRecord WireMessage::get_record(size_t &off) {
+    WireRecord record;
+    record.name = get_name(off);
+    record.type = get_uint16(arena_, packet_size_, off);
+    record.qclass = get_uint16(arena_, packet_size_, off + 2);
+    record.ttl = get_uint32(arena_, packet_size_, off + 4);
+    size_t rdlength = get_uint16(arena_, packet_size_, off + 8);
+    size_t pos = off + NS_RRFIXEDSZ;
+    size_t end = pos + rdlength;
+    if (end > packet_size_) {
+        throw std::runtime_error("truncated rdata");
+    }
+    record.rdata.offset = (uint32_t)pos;
+    record.rdata.length = (uint32_t)rdlength;
+    off = end;
+    switch (record.type) {
+    case MK_DNS_WIRE_TYPE_A:
+        if (rdlength != NS_INADDRSZ) {
+            throw std::runtime_error("invalid A record");
+        }
+        return record;
+    case MK_DNS_WIRE_TYPE_AAAA:
+        if (rdlength != NS_IN6ADDRSZ) {
+            throw std::runtime_error("invalid AAAA record");
+        }
+        return record;
+    case MK_DNS_WIRE_TYPE_NS:
+    case MK_DNS_WIRE_TYPE_CNAME:
+    case MK_DNS_WIRE_TYPE_PTR:
+    case MK_DNS_WIRE_TYPE_DNAME:
+        record.target = get_name(pos);
+        break;
+    case MK_DNS_WIRE_TYPE_MX:
+        record.priority = get_uint16(arena_, end, pos);
+        pos += NS_INT16SZ;
+        record.target = get_name(pos);
+        break;
+    case MK_DNS_WIRE_TYPE_SOA:
+        record.mname = get_name(pos);
+        record.rname = get_name(pos);
+        record.serial = get_uint32(arena_, end, pos);
+        record.refresh = get_uint32(arena_, end, pos + 4);
+        record.retry = get_uint32(arena_, end, pos + 8);
+        record.expire = get_uint32(arena_, end, pos + 12);
+        record.minimum = get_uint32(arena_, end, pos + 16);
+        pos += 5 * NS_INT32SZ;
+        break;
+    case MK_DNS_WIRE_TYPE_TXT:
+        while (pos < end) {
+            pos += 1 + (uint8_t)arena_[pos];
+        }
+        break;
+    case MK_DNS_WIRE_TYPE_SVCB:
+    case MK_DNS_WIRE_TYPE_HTTPS:
+        record.priority = get_uint16(arena_, end, pos);
+        pos += NS_INT16SZ;
+        record.target = get_name(pos);
+        if (pos > end) {
+            break;
+        }
+        record.params.offset = (uint32_t)pos;
+        record.params.length = (uint32_t)(end - pos);
+        pos = end;
+        break;
+    default:
+        return record;
+    }
+    // Names and character-strings must exactly fill the RDATA
+    if (pos != end) {
+        throw std::runtime_error("invalid rdata");
+    }
+    return record;
+}
+
+Error WireMessage::parse(std::string packet) {
+    clear();
+    arena_ = std::move(packet);
+    packet_size_ = arena_.size();
+    // Decompressed names are usually shorter than the packet
+    arena_.reserve(2 * packet_size_);
+    try {
+        id = get_uint16(arena_, packet_size_, 0);
+        flags = get_uint16(arena_, packet_size_, 2);
+        size_t qdcount = get_uint16(arena_, packet_size_, 4);
+        size_t counts[] = {get_uint16(arena_, packet_size_, 6),
+                           get_uint16(arena_, packet_size_, 8),
+                           get_uint16(arena_, packet_size_, 10)};
+        std::vector<WireRecord> *sections[] = {&answers, &authority,
+                                               &additional};
+        size_t off = NS_HFIXEDSZ;
+        // A record takes at least 11 bytes, so a large count in a short
+        // packet fails before we allocate much memory
+        questions.reserve(std::min(qdcount, packet_size_ / 5));
+        for (size_t i = 0; i < qdcount; ++i) {
+            WireQuestion question;
+            question.name = get_name(off);
+            question.type = get_uint16(arena_, packet_size_, off);
+            question.qclass = get_uint16(arena_, packet_size_, off + 2);
+            off += NS_QFIXEDSZ;
+            questions.push_back(question);
+        }
+        for (size_t j = 0; j < 3; ++j) {
+            sections[j]->reserve(std::min(counts[j], packet_size_ / 11));
+            for (size_t i = 0; i < counts[j]; ++i) {
+                sections[j]->push_back(get_record(off));
+            }
+        }
+        if (off != packet_size_) {
+            throw std::runtime_error("trailing garbage");
+        }
+    } catch (const std::runtime_error &) {
+        clear();
+        return MalformedMessageError();
+    }
+    return NoError();
+}
+
+void WireMessage::clear() {
+    id = 0;
+    flags = 0;
+    questions.clear();
+    answers.clear();
+    authority.clear();
+    additional.clear();
+    arena_.clear();
+    packet_size_ = 0;
+}
+
+int WireMessage::rcode() const {
+    const WireRecord *record = opt();
+    int extended = (record != nullptr) ? (int)(record->ttl >> 24) : 0;
+    return (extended << 4) | (flags & 0x000f);
+}
+
+const WireRecord *WireMessage::opt() const {
+    for (auto &record : additional) {
+        if (record.type == MK_DNS_WIRE_TYPE_OPT) {
+            return &record;
+        }
+    }
+    return nullptr;
+}
+
+std::string WireMessage::address(const WireRecord &record) const {
+    char address[128];
+    int family = 0;
+    if (record.type == MK_DNS_WIRE_TYPE_A &&
+        record.rdata.length == NS_INADDRSZ) {
+        family = AF_INET;
+    } else if (record.type == MK_DNS_WIRE_TYPE_AAAA &&
+               record.rdata.length == NS_IN6ADDRSZ) {
+        family = AF_INET6;
+    } else {
+        return "";
+    }
+    if (evutil_inet_ntop(family, data(record.rdata), address,
+                         sizeof(address)) == nullptr) {
+        return "";
+    }
+    return address;
+}
+
+std::vector<WireSlice> WireMessage::strings(const WireRecord &record) const {
+    std::vector<WireSlice> result;
+    if (record.type != MK_DNS_WIRE_TYPE_TXT) {
+        return result;
+    }
+    size_t pos = record.rdata.offset;
+    size_t end = pos + record.rdata.length;
+    while (pos < end) {
+        WireSlice slice;
+        slice.length = (uint8_t)arena_[pos];
+        slice.offset = (uint32_t)pos + 1;
+        if (pos + 1 + slice.length > end) {
+            break; // Can only happen if the record was not parsed
+        }
+        result.push_back(slice);
+        pos += 1 + slice.length;
+    }
+    return result;
+}
+
+/*
+ * Building
+ */
+
+WireSlice WireMessage::intern(const std::string &data) {
+    WireSlice slice;
+    slice.offset = (uint32_t)arena_.size();
+    slice.length = (uint32_t)data.size();
+    arena_ += data;
+    return slice;
+}
+
+// Accepts both `example.com` and `example.com.`
+static std::string without_trailing_dot(const std::string &name) {
+    if (!name.empty() && name.back() == '.') {
+        return name.substr(0, name.size() - 1);
+    }
+    return name;
+}
+
+WireQuestion &WireMessage::add_question(const std::string &name,
+                                        uint16_t type, uint16_t qclass) {
+    WireQuestion question;
+    question.name = intern(without_trailing_dot(name));
+    question.type = type;
+    question.qclass = qclass;
+    questions.push_back(question);
+    return questions.back();
+}
+
+WireRecord &WireMessage::add_record(std::vector<WireRecord> &section,
+                                    const std::string &name, uint16_t type,
+                                    uint16_t qclass, uint32_t ttl) {
+    WireRecord record;
+    record.name = intern(without_trailing_dot(name));
+    record.type = type;
+    record.qclass = qclass;
+    record.ttl = ttl;
+    section.push_back(record);
+    return section.back();
+}
+
+void WireMessage::add_edns0(uint16_t payload_size) {
+    add_record(additional, "", MK_DNS_WIRE_TYPE_OPT, payload_size, 0);
+}
+
+/*
+ * Serialization
+ */
+
+namespace {
+
+class Writer {
+  public:
+    void put_uint16(uint16_t v) {
+        out += (char)(v >> 8);
+        out += (char)(v & 0xff);
+    }
+
+    void put_uint32(uint32_t v) {
+        put_uint16((uint16_t)(v >> 16));
+        put_uint16((uint16_t)(v & 0xffff));
+    }
+
+    void put_count(size_t count) {
+        if (count > 0xffff) {
+            throw std::runtime_error("too many entries");
+        }
+        put_uint16((uint16_t)count);
+    }
+
+    // Writes the name in `data`, compressing it if `compress` is true
+    void put_name(const char *data, size_t size, bool compress) {
+        std::string name{data, size};
+        if (!name.empty() && name.back() == '.') {
+            name.pop_back();
+        }
+        if (name.size() > NS_MAXCDNAME - 2) {
+            throw std::runtime_error("name too long");
+        }
+        size_t begin = 0;
+        while (begin < name.size()) {
+            // The letter case must be preserved, so we only compress
+            // using suffixes with the same case
+            std::string suffix = name.substr(begin);
+            if (compress) {
+                auto it = suffixes.find(suffix);
+                if (it != suffixes.end()) {
+                    put_uint16((uint16_t)(0xc000 | it->second));
+                    return;
+                }
+            }
+            if (out.size() < 0x4000) {
+                suffixes.insert({suffix, (uint16_t)out.size()});
+            }
+            size_t end = name.find('.', begin);
+            if (end == std::string::npos) {
+                end = name.size();
+            }
+            size_t length = end - begin;
+            if (length == 0 || length > NS_MAXLABEL) {
+                throw std::runtime_error("invalid label");
+            }
+            out += (char)length;
+            out.append(name, begin, length);
+            begin = end + 1;
+        }
+        out += '\0';
+    }
+
+    std::string out;
+    std::map<std::string, uint16_t> suffixes;
+};
+
+} // namespace
+
+std::string WireMessage::serialize() const {
+    Writer w;
+    w.out.reserve(NS_PACKETSZ);
+    w.put_uint16(id);
+    w.put_uint16(flags);
+    w.put_count(questions.size());
+    w.put_count(answers.size());
+    w.put_count(authority.size());
+    w.put_count(additional.size());
+    for (auto &question : questions) {
+        w.put_name(data(question.name), question.name.length, true);
+        w.put_uint16(question.type);
+        w.put_uint16(question.qclass);
+    }
+    for (auto section : {&answers, &authority, &additional}) {
+        for (auto &record : *section) {
+            w.put_name(data(record.name), record.name.length, true);
+            w.put_uint16(record.type);
+            w.put_uint16(record.qclass);
+            w.put_uint32(record.ttl);
+            size_t rdlength = w.out.size();
+            w.put_uint16(0); // Filled below
+            size_t begin = w.out.size();
+            switch (record.type) {
+            case MK_DNS_WIRE_TYPE_NS:
+            case MK_DNS_WIRE_TYPE_CNAME:
+            case MK_DNS_WIRE_TYPE_PTR:
+                w.put_name(data(record.target), record.target.length, true);
+                break;
+            case MK_DNS_WIRE_TYPE_DNAME:
+                // RFC 6672 forbids compressing the target
+                w.put_name(data(record.target), record.target.length, false);
+                break;
+            case MK_DNS_WIRE_TYPE_MX:
+                w.put_uint16(record.priority);
+                w.put_name(data(record.target), record.target.length, true);
+                break;
+            case MK_DNS_WIRE_TYPE_SOA:
+                w.put_name(data(record.mname), record.mname.length, true);
+                w.put_name(data(record.rname), record.rname.length, true);
+                w.put_uint32(record.serial);
+                w.put_uint32(record.refresh);
+                w.put_uint32(record.retry);
+                w.put_uint32(record.expire);
+                w.put_uint32(record.minimum);
+                break;
+            case MK_DNS_WIRE_TYPE_SVCB:
+            case MK_DNS_WIRE_TYPE_HTTPS:
+                // RFC 9460 forbids compressing the target
+                w.put_uint16(record.priority);
+                w.put_name(data(record.target), record.target.length, false);
+                w.out.append(data(record.params), record.params.length);
+                break;
+            default:
+                w.out.append(data(record.rdata), record.rdata.length);
+                break;
+            }
+            size_t length = w.out.size() - begin;
+            if (length > 0xffff) {
+                throw std::runtime_error("rdata too long");
+            }
+            w.out[rdlength] = (char)(length >> 8);
+            w.out[rdlength + 1] = (char)(length & 0xff);
+        }
+    }
+    return w.out;
+}
+
+} // namespace dns
+} // namespace mk
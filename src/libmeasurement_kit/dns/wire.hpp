@@ -0,0 +1,183 @@
+// Part of Measurement Kit <https://measurement-kit.github.io/>.
+// Measurement Kit is free software under the BSD license. See AUTHORS
+// and LICENSE for more information on the copying conditions.
+#ifndef SRC_LIBMEASUREMENT_KIT_DNS_WIRE_HPP
+#define SRC_LIBMEASUREMENT_KIT_DNS_WIRE_HPP
+
+#include "src/libmeasurement_kit/common/error.hpp"
+#include "src/libmeasurement_kit/dns/error.hpp"
+#include "src/libmeasurement_kit/dns/query_class.hpp"
+#include "src/libmeasurement_kit/dns/query_type.hpp"
+
+#include <measurement_kit/common.hpp>
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+namespace mk {
+namespace dns {
+
+/// Values of the RR types on the wire that WireMessage knows about.
+enum WireTypeId : uint16_t {
+    MK_DNS_WIRE_TYPE_A = 1,
+    MK_DNS_WIRE_TYPE_NS = 2,
+    MK_DNS_WIRE_TYPE_CNAME = 5,
+    MK_DNS_WIRE_TYPE_SOA = 6,
+    MK_DNS_WIRE_TYPE_PTR = 12,
+    MK_DNS_WIRE_TYPE_MX = 15,
+    MK_DNS_WIRE_TYPE_TXT = 16,
+    MK_DNS_WIRE_TYPE_AAAA = 28,
+    MK_DNS_WIRE_TYPE_DNAME = 39,
+    MK_DNS_WIRE_TYPE_OPT = 41,
+    MK_DNS_WIRE_TYPE_SVCB = 64,
+    MK_DNS_WIRE_TYPE_HTTPS = 65,
+};
+
+/// Returns the value of \p type on the wire, or zero if \p type is not a
+/// real RR type (e.g. MK_DNS_TYPE_REVERSE_A).
+uint16_t wire_query_type(QueryType type);
+
+/// Returns the QueryType corresponding to the wire value \p type, or
+/// MK_DNS_TYPE_INVALID if QueryType does not have it.
+QueryType query_type_from_wire(uint16_t type);
+
+/// Bytes in the arena of a WireMessage.
+class WireSlice {
+  public:
+    uint32_t offset = 0;
+    uint32_t length = 0;
+};
+
+class WireQuestion {
+  public:
+    WireSlice name;
+    uint16_t type = 0;
+    uint16_t qclass = 0;
+};
+
+/// A resource record. Besides the raw RDATA, we decode the fields of the
+/// RR types that contain names, because names may be compressed.
+class WireRecord {
+  public:
+    WireSlice name;
+    uint16_t type = 0;
+    uint16_t qclass = 0; ///< For OPT, the UDP payload size
+    uint32_t ttl = 0;    ///< For OPT, extended RCODE, version and flags
+    WireSlice rdata;
+    WireSlice target;      ///< NS, CNAME, PTR, DNAME, MX, SVCB and HTTPS
+    uint16_t priority = 0; ///< MX preference, SVCB and HTTPS priority
+    WireSlice params;      ///< SVCB and HTTPS parameters
+    WireSlice mname;       ///< For SOA records
+    WireSlice rname;       ///< For SOA records
+    uint32_t serial = 0;   ///< For SOA records
+    uint32_t refresh = 0;  ///< For SOA records
+    uint32_t retry = 0;    ///< For SOA records
+    uint32_t expire = 0;   ///< For SOA records
+    uint32_t minimum = 0;  ///< For SOA records
+};
+
+/*!
+    \brief A DNS message in wire format (RFC 1035).
+
+    parse() keeps the packet as the beginning of the message's arena, so
+    the raw RDATA of records is not copied. Decompressed names, like any
+    other data added when building a message, are appended to the arena.
+    Questions and records refer to arena bytes using WireSlice, and you
+    use str() and friends to access them.
+
+    Names are stored in presentation format without the trailing dot,
+    hence the root is the empty string. We do not escape dots and other
+    special characters within labels.
+
+    serialize() compresses the owner names and the names in the RDATA of
+    NS, CNAME, PTR, MX and SOA records. It builds the RDATA of the RR types
+    that contain names from the decoded fields and copies the raw RDATA of
+    the other RR types.
+*/
+class WireMessage {
+  public:
+    uint16_t id = 0;
+    uint16_t flags = 0;
+    std::vector<WireQuestion> questions;
+    std::vector<WireRecord> answers;
+    std::vector<WireRecord> authority;
+    std::vector<WireRecord> additional;
+
+    /// Parses \p packet. Returns MalformedMessageError if \p packet is not
+    /// a valid DNS message, in which case the message is left empty.
+    Error parse(std::string packet);
+
+    /// Serializes the message. Throws std::runtime_error if names are not
+    /// valid or there are more than 65535 entries in a section.
+    std::string serialize() const;
+
+    /// Empties the message but keeps the allocated memory.
+    void clear();
+
+    bool qr() const { return (flags & 0x8000) != 0; }
+    int opcode() const { return (flags >> 11) & 0x0f; }
+    bool aa() const { return (flags & 0x0400) != 0; }
+    bool tc() const { return (flags & 0x0200) != 0; }
+    bool rd() const { return (flags & 0x0100) != 0; }
+    bool ra() const { return (flags & 0x0080) != 0; }
+    bool ad() const { return (flags & 0x0020) != 0; }
+    bool cd() const { return (flags & 0x0010) != 0; }
+
+    /// Returns the response code, including the EDNS0 extended bits.
+    int rcode() const;
+
+    /// Returns the OPT record, or nullptr if the message has no EDNS0.
+    const WireRecord *opt() const;
+
+    /// Returns the bytes of the packet we parsed, if any.
+    std::string packet() const { return arena_.substr(0, packet_size_); }
+
+    std::string str(WireSlice slice) const {
+        return arena_.substr(slice.offset, slice.length);
+    }
+
+    const char *data(WireSlice slice) const {
+        return arena_.data() + slice.offset;
+    }
+
+    bool equals(WireSlice slice, const std::string &s) const {
+        return arena_.compare(slice.offset, slice.length, s) == 0;
+    }
+
+    /// Returns the address of an A or AAAA record in presentation format,
+    /// or the empty string for other records.
+    std::string address(const WireRecord &record) const;
+
+    /// Returns the character-strings of a TXT record.
+    std::vector<WireSlice> strings(const WireRecord &record) const;
+
+    /// Copies \p data into the arena.
+    WireSlice intern(const std::string &data);
+
+    /// Adds a question for \p name.
+    WireQuestion &add_question(const std::string &name, uint16_t type,
+                               uint16_t qclass);
+
+    /// Adds a record to \p section. The caller then fills the RDATA or
+    /// the decoded fields using intern().
+    WireRecord &add_record(std::vector<WireRecord> &section,
+                           const std::string &name, uint16_t type,
+                           uint16_t qclass, uint32_t ttl);
+
+    /// Adds an OPT record advertising \p payload_size as the maximum UDP
+    /// payload size (RFC 6891).
+    void add_edns0(uint16_t payload_size);
+
+  private:
+    WireSlice get_name(size_t &off);
+    WireRecord get_record(size_t &off);
+
+    std::string arena_;
+    size_t packet_size_ = 0;
+};
+
+} // namespace dns
+} // namespace mk
+#endif
@@ -34,10 +34,12 @@
 #include "src/libmeasurement_kit/common/error.hpp"
 #include "src/libmeasurement_kit/common/logger.hpp"
 #include <measurement_kit/common/nlohmann/json.hpp>
+#include "src/libmeasurement_kit/common/reactor.hpp"
 #include "src/libmeasurement_kit/common/settings.hpp"
 #include <measurement_kit/common/shared_ptr.hpp>
 
 #include "src/libmeasurement_kit/engine/task.hpp"
+#include "src/libmeasurement_kit/http/http.hpp"
 #include "src/libmeasurement_kit/nettests/runnable.hpp"
 
 namespace mk {
@@ -94,6 +96,23 @@ static nlohmann::json make_log_event(uint32_t log_level, const char *message) {
     return object;
 }
 
+// Note: the reactor measures times in microseconds but we emit seconds for
+// consistency with the other events.
+static nlohmann::json make_reactor_stats_event(const ReactorStats &stats) {
+    return {
+        {"callbacks", (int64_t)stats.callback_time.count()},
+        {"callback_time_max", stats.callback_time.max() / 1e06},
+        {"callback_time_p50", stats.callback_time.percentile(0.50) / 1e06},
+        {"callback_time_p99", stats.callback_time.percentile(0.99) / 1e06},
+        {"loop_lag_max", stats.loop_lag.max() / 1e06},
+        {"loop_lag_p50", stats.loop_lag.percentile(0.50) / 1e06},
+        {"loop_lag_p99", stats.loop_lag.percentile(0.99) / 1e06},
+        {"max_pending_polls", (int64_t)stats.pending_polls.max()},
+        {"max_pending_timers", (int64_t)stats.pending_timers.max()},
+        {"max_worker_queue_depth", (int64_t)stats.worker_queue_depth.max()},
+    };
+}
+
 static nlohmann::json make_failure_event(const Error &error) {
     nlohmann::json object;
     object["key"] = "failure.startup";
@@ -119,6 +138,7 @@ static bool is_event_key_valid(const std::string &str) {
         (str == "status.geoip_lookup") ||
         (str == "status.progress") ||
         (str == "status.queued") ||
+        (str == "status.reactor_stats") ||
         (str == "status.measurement_start") ||
         (str == "status.measurement_submission") ||
         (str == "status.measurement_done") ||
@@ -244,6 +264,29 @@ nlohmann::json possibly_validate_event(nlohmann::json &&event) {
             assert(event.at("value").at("message").is_string());
             break;
         }
+        if (event.at("key") == "status.reactor_stats") {
+            assert(event.at("value").count("callbacks") == 1);
+            assert(event.at("value").at("callbacks").is_number_integer());
+            assert(event.at("value").count("callback_time_max") == 1);
+            assert(event.at("value").at("callback_time_max").is_number_float());
+            assert(event.at("value").count("callback_time_p50") == 1);
+            assert(event.at("value").at("callback_time_p50").is_number_float());
+            assert(event.at("value").count("callback_time_p99") == 1);
+            assert(event.at("value").at("callback_time_p99").is_number_float());
+            assert(event.at("value").count("loop_lag_max") == 1);
+            assert(event.at("value").at("loop_lag_max").is_number_float());
+            assert(event.at("value").count("loop_lag_p50") == 1);
+            assert(event.at("value").at("loop_lag_p50").is_number_float());
+            assert(event.at("value").count("loop_lag_p99") == 1);
+            assert(event.at("value").at("loop_lag_p99").is_number_float());
+            assert(event.at("value").count("max_pending_polls") == 1);
+            assert(event.at("value").at("max_pending_polls").is_number_integer());
+            assert(event.at("value").count("max_pending_timers") == 1);
+            assert(event.at("value").at("max_pending_timers").is_number_integer());
+            assert(event.at("value").count("max_worker_queue_depth") == 1);
+            assert(event.at("value").at("max_worker_queue_depth").is_number_integer());
+            break;
+        }
         if (event.at("key") == "status.measurement_start") {
             assert(event.at("value").count("idx") == 1);
             assert(event.at("value").at("idx").is_number_integer());
@@ -317,6 +360,7 @@ static nlohmann::json known_events() {
     json.push_back("status.geoip_lookup");
     json.push_back("status.progress");
     json.push_back("status.queued");
+    json.push_back("status.reactor_stats");
     json.push_back("status.measurement_start");
     json.push_back("status.measurement_submission");
     json.push_back("status.measurement_done");
@@ -508,6 +552,14 @@ static bool validate_known_settings_shallow(
         emit_settings_warning(task, ss.str().data());
         rv = false;
     }
+    // Make sure that priority has the correct type
+    if (settings.count("priority") > 0 && !settings.at("priority").is_number_integer()) {
+        std::stringstream ss;
+        ss << "found setting 'priority' with invalid type (fyi: "
+           << "priority should be a number_integer)";
+        emit_settings_warning(task, ss.str().data());
+        rv = false;
+    }
 
     return rv;
 }
@@ -526,6 +578,7 @@ static void remove_unknown_settings_and_warn(
     expected.insert("name");
     expected.insert("options");
     expected.insert("output_filepath");
+    expected.insert("priority");
     for (auto it : settings.items()) {
         const auto &key = it.key();
         if (expected.count(key) <= 0) {
@@ -758,6 +811,54 @@ void task_run_legacy(Task *task, TaskImpl *pimpl, nlohmann::json &settings) {
                         }
                         break;
                     }
+                    if (key == "log_async") {
+                        found = true;
+                        if (!value.is_boolean()) {
+                            std::stringstream ss;
+                            ss << "Found " << key << " option which has the "
+                               << "wrong type (fyi: it should be a "
+                               << "boolean)";
+                            emit_settings_warning(task, ss.str().data());
+                            // FALLTHROUGH
+                        }
+                        break;
+                    }
+                    if (key == "log_flush_interval") {
+                        found = true;
+                        if (!value.is_number_float()) {
+                            std::stringstream ss;
+                            ss << "Found " << key << " option which has the "
+                               << "wrong type (fyi: it should be a "
+                               << "number_float)";
+                            emit_settings_warning(task, ss.str().data());
+                            // FALLTHROUGH
+                        }
+                        break;
+                    }
+                    if (key == "log_flush_on_exit") {
+                        found = true;
+                        if (!value.is_boolean()) {
+                            std::stringstream ss;
+                            ss << "Found " << key << " option which has the "
+                               << "wrong type (fyi: it should be a "
+                               << "boolean)";
+                            emit_settings_warning(task, ss.str().data());
+                            // FALLTHROUGH
+                        }
+                        break;
+                    }
+                    if (key == "log_flush_on_warning") {
+                        found = true;
+                        if (!value.is_boolean()) {
+                            std::stringstream ss;
+                            ss << "Found " << key << " option which has the "
+                               << "wrong type (fyi: it should be a "
+                               << "boolean)";
+                            emit_settings_warning(task, ss.str().data());
+                            // FALLTHROUGH
+                        }
+                        break;
+                    }
                     if (key == "max_runtime") {
                         found = true;
                         if (!value.is_number_integer()) {
@@ -854,6 +955,54 @@ void task_run_legacy(Task *task, TaskImpl *pimpl, nlohmann::json &settings) {
                         }
                         break;
                     }
+                    if (key == "net/connect_many_parallelism") {
+                        found = true;
+                        if (!value.is_number_integer()) {
+                            std::stringstream ss;
+                            ss << "Found " << key << " option which has the "
+                               << "wrong type (fyi: it should be a "
+                               << "number_integer)";
+                            emit_settings_warning(task, ss.str().data());
+                            // FALLTHROUGH
+                        }
+                        break;
+                    }
+                    if (key == "net/happy_eyeballs_delay") {
+                        found = true;
+                        if (!value.is_number_float()) {
+                            std::stringstream ss;
+                            ss << "Found " << key << " option which has the "
+                               << "wrong type (fyi: it should be a "
+                               << "number_float)";
+                            emit_settings_warning(task, ss.str().data());
+                            // FALLTHROUGH
+                        }
+                        break;
+                    }
+                    if (key == "net/happy_eyeballs_preference") {
+                        found = true;
+                        if (!value.is_string()) {
+                            std::stringstream ss;
+                            ss << "Found " << key << " option which has the "
+                               << "wrong type (fyi: it should be a "
+                               << "string)";
+                            emit_settings_warning(task, ss.str().data());
+                            // FALLTHROUGH
+                        }
+                        break;
+                    }
+                    if (key == "net/ssl_resume_sessions") {
+                        found = true;
+                        if (!value.is_boolean()) {
+                            std::stringstream ss;
+                            ss << "Found " << key << " option which has the "
+                               << "wrong type (fyi: it should be a "
+                               << "boolean)";
+                            emit_settings_warning(task, ss.str().data());
+                            // FALLTHROUGH
+                        }
+                        break;
+                    }
                     if (key == "net/timeout") {
                         found = true;
                         if (!value.is_number_float()) {
@@ -866,6 +1015,18 @@ void task_run_legacy(Task *task, TaskImpl *pimpl, nlohmann::json &settings) {
                         }
                         break;
                     }
+                    if (key == "net/zero_copy") {
+                        found = true;
+                        if (!value.is_boolean()) {
+                            std::stringstream ss;
+                            ss << "Found " << key << " option which has the "
+                               << "wrong type (fyi: it should be a "
+                               << "boolean)";
+                            emit_settings_warning(task, ss.str().data());
+                            // FALLTHROUGH
+                        }
+                        break;
+                    }
                     if (key == "no_bouncer") {
                         found = true;
                         if (!value.is_boolean()) {
@@ -998,6 +1159,18 @@ void task_run_legacy(Task *task, TaskImpl *pimpl, nlohmann::json &settings) {
                         }
                         break;
                     }
+                    if (key == "reactor_instrumentation") {
+                        found = true;
+                        if (!value.is_boolean()) {
+                            std::stringstream ss;
+                            ss << "Found " << key << " option which has the "
+                               << "wrong type (fyi: it should be a "
+                               << "boolean)";
+                            emit_settings_warning(task, ss.str().data());
+                            // FALLTHROUGH
+                        }
+                        break;
+                    }
                     if (key == "save_real_probe_asn") {
                         found = true;
                         if (!value.is_boolean()) {
@@ -1307,8 +1480,23 @@ void task_run_legacy(Task *task, TaskImpl *pimpl, nlohmann::json &settings) {
         (void)possibly_validate_event(std::move(event));
     });
 
+    // see whether we should write logs from a background thread
+    if (runnable->options.get("log_async", false)) {
+        LogFlushPolicy policy;
+        policy.interval = runnable->options.get(
+            "log_flush_interval", policy.interval);
+        policy.on_warning = runnable->options.get(
+            "log_flush_on_warning", policy.on_warning);
+        runnable->logger->set_async(true, policy);
+    }
+
     runnable->logger->emit_event_ex("status.started", nlohmann::json::object());
 
+    // see whether we should collect statistics about the event loop
+    bool reactor_instrumentation =
+        runnable->options.get("reactor_instrumentation", false);
+    pimpl->reactor->set_instrumentation(reactor_instrumentation);
+
     // start the task (reactor and interrupted are MT safe)
     Error error = GenericError();
     pimpl->reactor->run_with_initial_event([&]() {
@@ -1325,10 +1513,25 @@ void task_run_legacy(Task *task, TaskImpl *pimpl, nlohmann::json &settings) {
         });
     });
 
+    // Close the connections kept open for reuse (e.g. to the collector).
+    // This closes all the idle connections of the reactor, so we do it here
+    // rather than in Runnable::end(), since we own the reactor.
+    pimpl->reactor->run_with_initial_event([&]() {
+        http::close_idle_connections(pimpl->reactor, nullptr);
+    });
+
     DataUsage du;
     runnable->reactor->with_current_data_usage([&](DataUsage &x) {
         du = x;
     });
+    if (runnable->options.get("log_flush_on_exit", true)) {
+        // Make sure queued logs are emitted before "status.end"
+        runnable->logger->flush();
+    }
+    if (reactor_instrumentation) {
+        runnable->logger->emit_event_ex("status.reactor_stats",
+            make_reactor_stats_event(pimpl->reactor->instrumentation_stats()));
+    }
     runnable->logger->emit_event_ex("status.end", {
         {"downloaded_kb", du.down / 1024.0},
         {"failure", error.reason},
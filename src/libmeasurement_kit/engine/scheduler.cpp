@@ -0,0 +1,90 @@
+// Part of Measurement Kit <https://measurement-kit.github.io/>.
+// Measurement Kit is free software under the BSD license. See AUTHORS
+// and LICENSE for more information on the copying conditions.
+
+#include "src/libmeasurement_kit/engine/scheduler.hpp"
+
+#include <assert.h>
+
+namespace mk {
+namespace engine {
+
+constexpr size_t TaskScheduler::default_max_concurrency;
+
+/*static*/ TaskScheduler &TaskScheduler::global() {
+    // Intentionally leaked so that it survives task threads that are still
+    // running while static objects are destroyed at exit.
+    static TaskScheduler *scheduler = new TaskScheduler;
+    return *scheduler;
+}
+
+bool TaskScheduler::acquire(
+        int64_t priority, const std::atomic_bool &interrupted) {
+    std::unique_lock<std::mutex> lock{mutex_};
+    Ticket ticket{priority, next_seqno_++};
+    queue_.insert(ticket);
+    cond_.wait(lock, [&]() {
+        return interrupted || can_admit_unlocked(ticket);
+    });
+    queue_.erase(ticket);
+    bool admitted = !interrupted;
+    if (admitted) {
+        ++active_;
+    }
+    // The head of the queue has changed, hence wake up the others such
+    // that the next task in line gets a chance to run if there's room.
+    lock.unlock();
+    cond_.notify_all();
+    return admitted;
+}
+
+void TaskScheduler::release() {
+    {
+        std::unique_lock<std::mutex> _{mutex_};
+        assert(active_ > 0);
+        --active_;
+    }
+    cond_.notify_all();
+}
+
+void TaskScheduler::wakeup() {
+    // Lock to avoid racing with a waiter that has just checked the
+    // interrupted flag but is not yet blocked on the condition variable.
+    {
+        std::unique_lock<std::mutex> _{mutex_};
+    }
+    cond_.notify_all();
+}
+
+void TaskScheduler::set_max_concurrency(size_t value) {
+    {
+        std::unique_lock<std::mutex> _{mutex_};
+        max_concurrency_ = (value > 0) ? value : default_max_concurrency;
+    }
+    cond_.notify_all();
+}
+
+size_t TaskScheduler::max_concurrency() const {
+    std::unique_lock<std::mutex> _{mutex_};
+    return max_concurrency_;
+}
+
+size_t TaskScheduler::active() const {
+    std::unique_lock<std::mutex> _{mutex_};
+    return active_;
+}
+
+size_t TaskScheduler::queued() const {
+    std::unique_lock<std::mutex> _{mutex_};
+    return queue_.size();
+}
+
+bool TaskScheduler::can_admit_unlocked(const Ticket &ticket) const {
+    // Only the task at the head of the queue can be admitted, such that
+    // higher priority tasks are never overtaken by lower priority ones.
+    return active_ < max_concurrency_ && !queue_.empty() &&
+           *queue_.begin() == ticket;
+}
+
+} // namespace engine
+} // namespace mk
@@ -0,0 +1,93 @@
+// Part of Measurement Kit <https://measurement-kit.github.io/>.
+// Measurement Kit is free software under the BSD license. See AUTHORS
+// and LICENSE for more information on the copying conditions.
+#ifndef SRC_LIBMEASUREMENT_KIT_ENGINE_SCHEDULER_HPP
+#define SRC_LIBMEASUREMENT_KIT_ENGINE_SCHEDULER_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <set>
+#include <utility>
+
+#include "src/libmeasurement_kit/common/non_copyable.hpp"
+#include "src/libmeasurement_kit/common/non_movable.hpp"
+
+namespace mk {
+namespace engine {
+
+// TaskScheduler decides when a Task is allowed to run. At most
+// max_concurrency() tasks run at the same time. Tasks that cannot run
+// yet wait in a queue and are admitted by decreasing priority and,
+// among tasks with the same priority, in FIFO order.
+//
+// Each task runs in its own thread with its own reactor, so admitting
+// more than one task lets independent tasks overlap. The default limit
+// is one, because concurrent tasks may create network noise that
+// impacts onto other tasks' measurements.
+class TaskScheduler : public NonCopyable, public NonMovable {
+  public:
+    // default_max_concurrency is the default concurrency limit.
+    static constexpr size_t default_max_concurrency = 1;
+
+    // global returns the process-wide scheduler used by Task.
+    static TaskScheduler &global();
+
+    // acquire blocks until the caller is allowed to run or until the
+    // interrupted flag becomes true. Returns true in the former case, in
+    // which the caller owns a slot that MUST be freed with release(), and
+    // false in the latter case, in which the caller does not own a slot.
+    bool acquire(int64_t priority, const std::atomic_bool &interrupted);
+
+    // release frees a slot obtained with acquire().
+    void release();
+
+    // wakeup forces queued tasks to check again whether they have been
+    // interrupted. Call it after setting a task's interrupted flag.
+    void wakeup();
+
+    // set_max_concurrency sets the maximum number of tasks that can run at
+    // the same time. Zero means default_max_concurrency. Lowering the limit
+    // does not stop running tasks; it just delays admitting new ones.
+    void set_max_concurrency(size_t value);
+
+    // max_concurrency returns the maximum number of concurrent tasks.
+    size_t max_concurrency() const;
+
+    // active returns the number of tasks that are currently running.
+    size_t active() const;
+
+    // queued returns the number of tasks waiting to run.
+    size_t queued() const;
+
+  private:
+    // Ticket identifies a queued task by priority and sequence number.
+    using Ticket = std::pair<int64_t, uint64_t>;
+
+    // TicketOrder sorts tickets by decreasing priority and then by
+    // increasing sequence number, such that the first ticket in the set
+    // is the next task to admit.
+    class TicketOrder {
+      public:
+        bool operator()(const Ticket &a, const Ticket &b) const {
+            return (a.first != b.first) ? a.first > b.first
+                                        : a.second < b.second;
+        }
+    };
+
+    bool can_admit_unlocked(const Ticket &ticket) const;
+
+    size_t active_ = 0;
+    std::condition_variable cond_;
+    size_t max_concurrency_ = default_max_concurrency;
+    mutable std::mutex mutex_;
+    uint64_t next_seqno_ = 0;
+    std::set<Ticket, TicketOrder> queue_;
+};
+
+} // namespace engine
+} // namespace mk
+#endif
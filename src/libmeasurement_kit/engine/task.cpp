@@ -5,6 +5,7 @@
 #include "src/libmeasurement_kit/engine/task.hpp"
 
 #include <assert.h>
+#include <stdint.h>
 
 #include <atomic>
 #include <condition_variable>
@@ -20,6 +21,7 @@
 #include <measurement_kit/common/shared_ptr.hpp>
 
 #include "src/libmeasurement_kit/engine/autoapi.hpp"
+#include "src/libmeasurement_kit/engine/scheduler.hpp"
 
 namespace mk {
 namespace engine {
@@ -41,13 +43,25 @@ void Task::emit(nlohmann::json event) {
     pimpl_->cond.notify_all();
 }
 
+// task_priority returns the priority of a task. Settings are validated
+// later by the task thread, so here we just ignore invalid values.
+static int64_t task_priority(const nlohmann::json &settings) {
+    if (settings.is_object() && settings.count("priority") != 0 &&
+            settings.at("priority").is_number_integer()) {
+        return settings.at("priority").get<int64_t>();
+    }
+    return 0;
+}
+
 Task::Task(nlohmann::json &&settings) {
     pimpl_ = std::make_unique<TaskImpl>();
+    int64_t priority = task_priority(settings);
     // The purpose of `barrier` is to wait in the constructor until the
     // thread for running the test is up and running.
     std::promise<void> barrier;
     std::future<void> started = barrier.get_future();
-    pimpl_->thread = std::thread([this, &barrier, settings = std::move(settings)]() mutable {
+    pimpl_->thread = std::thread([this, &barrier, priority,
+                                  settings = std::move(settings)]() mutable {
         pimpl_->running = true;
         barrier.set_value();
         {
@@ -56,9 +70,13 @@ Task::Task(nlohmann::json &&settings) {
             event["value"] = nlohmann::json::object();
             emit(std::move(event));
         }
-        static std::mutex semaphore;
-        std::unique_lock<std::mutex> _{semaphore};  // prevent concurrent tasks
-        task_run_legacy(this, pimpl_.get(), settings);
+        // Wait for our turn. If we're interrupted while queued, we
+        // terminate without running and without emitting more events.
+        auto &scheduler = TaskScheduler::global();
+        if (scheduler.acquire(priority, pimpl_->interrupted)) {
+            task_run_legacy(this, pimpl_.get(), settings);
+            scheduler.release();
+        }
         pimpl_->running = false;
         pimpl_->cond.notify_all(); // tell the readers we're done
     });
@@ -77,6 +95,11 @@ void Task::interrupt() {
     // both variables are safe to use in a MT context
     pimpl_->reactor->stop();
     pimpl_->interrupted = true;
+    TaskScheduler::global().wakeup(); // in case we're still queued
+}
+
+/*static*/ void Task::set_max_concurrency(size_t value) {
+    TaskScheduler::global().set_max_concurrency(value);
 }
 
 nlohmann::json Task::wait_for_next_event() {
@@ -87,3 +87,7 @@ void mk_task_interrupt(mk_task_t *task) noexcept {
 void mk_task_destroy(mk_task_t *task) noexcept {
     delete task; // handles nullptr
 }
+
+void mk_task_set_max_concurrency(size_t max_concurrency) noexcept {
+    mk::engine::Task::set_max_concurrency(max_concurrency);
+}
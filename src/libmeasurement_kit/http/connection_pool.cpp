@@ -0,0 +1,129 @@
+// Part of Measurement Kit <https://measurement-kit.github.io/>.
+// Measurement Kit is free software under the BSD license. See AUTHORS
+// and LICENSE for more information on the copying conditions.
+
+#include "src/libmeasurement_kit/http/connection_pool.hpp"
+
+namespace mk {
+namespace http {
+
+/*static*/ ConnectionPool &ConnectionPool::global() {
+    static ConnectionPool pool;
+    return pool;
+}
+
+void ConnectionPool::put(SharedPtr<Reactor> reactor, const std::string &key,
+                         SharedPtr<net::Transport> txp, size_t max_idle,
+                         SharedPtr<Logger> logger) {
+    Idle idle;
+    idle.txp = txp;
+    idle.since = time_now();
+    idle.closed = SharedPtr<bool>::make(false);
+    // Note: the handler must not keep a reference to `txp` as otherwise
+    // it would keep itself alive after close().
+    txp->on_error([closed = idle.closed](Error) { *closed = true; });
+    std::deque<SharedPtr<net::Transport>> evicted;
+    {
+        std::unique_lock<std::mutex> _{mutex_};
+        auto &idles = all_[reactor.get()][key];
+        idles.push_back(std::move(idle));
+        while (idles.size() > max_idle) {
+            evicted.push_back(std::move(idles.front().txp));
+            idles.pop_front();
+        }
+        auto rit = all_.find(reactor.get());
+        prune_locked(rit, rit->second.find(key));
+    }
+    if (!evicted.empty()) {
+        logger->debug("http: too many idle connections to %s", key.c_str());
+    }
+    close_all(std::move(evicted), nullptr);
+}
+
+void ConnectionPool::close_idle(SharedPtr<Reactor> reactor, Callback<> cb) {
+    std::deque<SharedPtr<net::Transport>> txps;
+    {
+        std::unique_lock<std::mutex> _{mutex_};
+        auto rit = all_.find(reactor.get());
+        if (rit != all_.end()) {
+            for (auto &kv : rit->second) {
+                for (auto &idle : kv.second) {
+                    txps.push_back(std::move(idle.txp));
+                }
+            }
+            all_.erase(rit);
+        }
+    }
+    close_all(std::move(txps), std::move(cb));
+}
+
+size_t ConnectionPool::size(SharedPtr<Reactor> reactor) {
+    std::unique_lock<std::mutex> _{mutex_};
+    size_t count = 0;
+    auto rit = all_.find(reactor.get());
+    if (rit != all_.end()) {
+        for (auto &kv : rit->second) {
+            count += kv.second.size();
+        }
+    }
+    return count;
+}
+
+void ConnectionPool::expire_locked(
+        Reactor *reactor, double deadline,
+        std::deque<SharedPtr<net::Transport>> &expired) {
+    auto rit = all_.find(reactor);
+    if (rit == all_.end()) {
+        return;
+    }
+    for (auto it = rit->second.begin(); it != rit->second.end();) {
+        // Connections are sorted from the least recently used
+        auto &idles = it->second;
+        while (!idles.empty() && idles.front().since < deadline) {
+            expired.push_back(std::move(idles.front().txp));
+            idles.pop_front();
+        }
+        if (idles.empty()) {
+            it = rit->second.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    if (rit->second.empty()) {
+        all_.erase(rit);
+    }
+}
+
+void ConnectionPool::prune_locked(
+        std::map<Reactor *, Connections>::iterator rit,
+        Connections::iterator it) {
+    // Erase empty entries, such that the map does not keep pointers to
+    // reactors that may have been destroyed in the meanwhile.
+    if (it != rit->second.end() && it->second.empty()) {
+        rit->second.erase(it);
+    }
+    if (rit->second.empty()) {
+        all_.erase(rit);
+    }
+}
+
+/*static*/ void ConnectionPool::close_all(
+        std::deque<SharedPtr<net::Transport>> &&txps, Callback<> cb) {
+    if (txps.empty()) {
+        if (cb) {
+            cb();
+        }
+        return;
+    }
+    auto pending = SharedPtr<size_t>::make(txps.size());
+    for (auto &txp : txps) {
+        txp->close([pending, cb]() {
+            if (--*pending == 0 && cb) {
+                cb();
+            }
+        });
+    }
+}
+
+} // namespace http
+} // namespace mk
@@ -0,0 +1,166 @@
+// Part of Measurement Kit <https://measurement-kit.github.io/>.
+// Measurement Kit is free software under the BSD license. See AUTHORS
+// and LICENSE for more information on the copying conditions.
+#ifndef SRC_LIBMEASUREMENT_KIT_HTTP_CONNECTION_POOL_HPP
+#define SRC_LIBMEASUREMENT_KIT_HTTP_CONNECTION_POOL_HPP
+
+#include "src/libmeasurement_kit/common/mock.hpp"
+#include "src/libmeasurement_kit/common/non_copyable.hpp"
+#include "src/libmeasurement_kit/common/non_movable.hpp"
+#include "src/libmeasurement_kit/common/utils.hpp"
+#include "src/libmeasurement_kit/net/transport.hpp"
+
+#include <event2/bufferevent.h>
+#include <event2/util.h>
+
+#include <errno.h>
+
+#include <deque>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+
+namespace mk {
+namespace http {
+
+/*
+ * Returns false if we can tell that the peer has closed an idle connection,
+ * or has sent data we did not ask for. We peek at the socket because idle
+ * connections do not read, so that they don't keep the reactor running.
+ */
+template <MK_MOCK(recv)>
+bool idle_connection_is_alive(SharedPtr<net::Transport> txp) {
+    bufferevent *bev = nullptr;
+    try {
+        bev = txp->get_bufferevent();
+    } catch (const std::runtime_error &) {
+        return true; // Not attached to a socket, we cannot tell
+    }
+    evutil_socket_t fd = bufferevent_getfd(bev);
+    if (fd == -1) {
+        return true;
+    }
+    char ch = 0;
+    if (recv(fd, &ch, 1, MSG_PEEK) >= 0) {
+        return false; // Either EOF or unexpected data
+    }
+#ifdef _WIN32
+    return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+    return errno == EAGAIN || errno == EWOULDBLOCK;
+#endif
+}
+
+/*!
+    \brief Idle HTTP connections kept open for reuse (HTTP keep-alive).
+
+    Connections are indexed by reactor, since a connection can only be used
+    by the reactor that owns it, and then by a key identifying the server
+    and the connection settings (see request_connect_impl()).
+
+    Idle connections are not polled and there are no timers, so that they
+    do not prevent Reactor::run() from returning. Rather, expired and closed
+    connections are discarded lazily when we look for a connection. Since
+    an idle connection keeps its reactor alive, the code owning a reactor
+    MUST call close_idle() when done with it (see
+    http::close_idle_connections()).
+
+    \remark You SHOULD use the process-wide pool returned by global(),
+    while you can create other instances for testing. All methods MUST
+    be called from the I/O thread of the reactor passed as argument.
+*/
+class ConnectionPool : public NonCopyable, public NonMovable {
+  public:
+    /// Returns the process-wide pool.
+    static ConnectionPool &global();
+
+    /*!
+        \brief Returns the most recently used connection of \p reactor for
+        \p key that has been idle less than \p idle_timeout seconds and is
+        still alive, or an empty pointer. Closes the connections of \p
+        reactor that have expired or that the peer has closed.
+    */
+    template <MK_MOCK_AS(idle_connection_is_alive<>, is_alive)>
+    SharedPtr<net::Transport> take(SharedPtr<Reactor> reactor,
+                                   const std::string &key,
+                                   double idle_timeout,
+                                   SharedPtr<Logger> logger) {
+        std::deque<SharedPtr<net::Transport>> expired;
+        SharedPtr<net::Transport> txp;
+        {
+            std::unique_lock<std::mutex> _{mutex_};
+            expire_locked(reactor.get(), time_now() - idle_timeout, expired);
+            auto rit = all_.find(reactor.get());
+            if (rit != all_.end()) {
+                auto it = rit->second.find(key);
+                while (it != rit->second.end() && !it->second.empty()) {
+                    Idle idle = std::move(it->second.back());
+                    it->second.pop_back();
+                    if (!*idle.closed && is_alive(idle.txp)) {
+                        txp = std::move(idle.txp);
+                        break;
+                    }
+                    expired.push_back(std::move(idle.txp));
+                }
+                prune_locked(rit, it);
+            }
+        }
+        if (!expired.empty()) {
+            logger->debug("http: closing %d stale idle connection(s)",
+                          (int)expired.size());
+        }
+        close_all(std::move(expired), nullptr);
+        if (txp) {
+            txp->on_error(nullptr);
+            logger->debug("http: reusing idle connection to %s", key.c_str());
+        }
+        return txp;
+    }
+
+    /*!
+        \brief Keeps \p txp, which is connected as described by \p key, for
+        later reuse. If \p reactor already has \p max_idle connections idle
+        for \p key, the least recently used one is closed.
+    */
+    void put(SharedPtr<Reactor> reactor, const std::string &key,
+             SharedPtr<net::Transport> txp, size_t max_idle,
+             SharedPtr<Logger> logger);
+
+    /*!
+        \brief Closes all the idle connections of \p reactor, whoever opened
+        them, and calls \p cb once they are closed. Since closing is
+        asynchronous, \p reactor should keep running until \p cb is called.
+    */
+    void close_idle(SharedPtr<Reactor> reactor, Callback<> cb);
+
+    /// Returns the number of idle connections of \p reactor.
+    size_t size(SharedPtr<Reactor> reactor);
+
+  private:
+    class Idle {
+      public:
+        SharedPtr<net::Transport> txp;
+        double since = 0.0;
+        // Set if the connection reports an error while idle, which may
+        // happen for connections that keep reading (e.g. SOCKS5)
+        SharedPtr<bool> closed;
+    };
+
+    using Connections = std::map<std::string, std::deque<Idle>>;
+
+    void expire_locked(Reactor *reactor, double deadline,
+                       std::deque<SharedPtr<net::Transport>> &expired);
+
+    void prune_locked(std::map<Reactor *, Connections>::iterator rit,
+                      Connections::iterator it);
+
+    static void close_all(std::deque<SharedPtr<net::Transport>> &&txps,
+                          Callback<> cb);
+
+    std::mutex mutex_;
+    std::map<Reactor *, Connections> all_;
+};
+
+} // namespace http
+} // namespace mk
+#endif
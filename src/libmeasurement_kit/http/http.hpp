@@ -175,6 +175,27 @@ void request_maybe_sendrecv(ErrorOr<SharedPtr<Request>>, SharedPtr<net::Transpor
                             Callback<Error, SharedPtr<Response>>,
                             Settings, SharedPtr<Reactor>, SharedPtr<Logger>);
 
+/*
+ * HTTP keep-alive. When `http/keep_alive` is true, request_connect() reuses
+ * an idle connection to the same server made with the same connection
+ * settings, if any, and request_close() keeps the connection open for later
+ * reuse, unless the last response did not allow that. Connections are only
+ * shared by code using the same reactor. Keep-alive is disabled by default
+ * because measurements usually want to use fresh connections.
+ *
+ * The code owning the reactor MUST call close_idle_connections() when it
+ * is done with the reactor, because idle connections keep the reactor alive.
+ * This closes all the idle connections of the reactor, including those
+ * opened by other code using the same reactor, so it is not meant to be
+ * called when a single operation completes. Closing is asynchronous: the
+ * callback is called once all connections are closed.
+ */
+
+void request_close(SharedPtr<net::Transport>, Settings, Callback<>,
+                   SharedPtr<Reactor>, SharedPtr<Logger>);
+
+void close_idle_connections(SharedPtr<Reactor>, Callback<>);
+
 /*
  * For settings the following options are defined:
  *
@@ -184,8 +205,14 @@ void request_maybe_sendrecv(ErrorOr<SharedPtr<Request>>, SharedPtr<net::Transpor
  *       {"http/ignore_body", boolean},
  *       {"http/method", "GET|DELETE|PUT|POST|HEAD|..."},
  *       {"http/http_version", "HTTP/1.1"},
- *       {"http/path", by default is taken from the url}
+ *       {"http/path", by default is taken from the url},
+ *       {"http/keep_alive", boolean (default is false)},
+ *       {"http/keep_alive_idle_timeout", seconds (default is 15.0)},
+ *       {"http/keep_alive_max_per_host", integer (default is 4)}
  *     }
+ *
+ * where `http/keep_alive_max_per_host` is the maximum number of idle
+ * connections kept for each server.
  */
 
 void request(Settings, Headers, std::string, Callback<Error, SharedPtr<Response>>,
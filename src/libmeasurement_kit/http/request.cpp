@@ -9,6 +9,7 @@
 
 #include <deque>
 #include <set>
+#include <sstream>
 
 namespace mk {
 namespace http {
@@ -104,11 +105,80 @@ void Request::serialize(net::Buffer &buff, SharedPtr<Logger> logger) {
          |___/
 */
 
+ErrorOr<Url> request_connect_prepare(Settings &settings) {
+    if (settings.find("http/url") == settings.end()) {
+        return {MissingUrlError(), {}};
+    }
+    ErrorOr<Url> url = parse_url_noexcept(settings.at("http/url"));
+    if (!url) {
+        return url;
+    }
+    if (url->schema == "httpo") {
+        // tor_socks_port takes precedence because it's more specific
+        if (settings.find("net/tor_socks_port") != settings.end()) {
+            // XXX The following is a violation of layers because we are
+            // setting a variable that NET code should set for itself; we
+            // should do nothing in this case, lower layer should do
+            std::string proxy = "127.0.0.1:";
+            proxy += settings["net/tor_socks_port"];
+            settings["net/socks5_proxy"] = proxy;
+        } else if (settings.find("net/socks5_proxy") == settings.end()) {
+            settings["net/socks5_proxy"] = "127.0.0.1:9050";
+        }
+        // Tor reads the connect request sent along with the greeting
+        if (settings.find("net/socks5_optimistic") == settings.end()) {
+            settings["net/socks5_optimistic"] = true;
+        }
+    } else if (url->schema == "https") {
+        settings["net/ssl"] = true;
+    }
+    return url;
+}
+
+std::string request_connect_key(const Url &url, const Settings &settings) {
+    std::stringstream ss;
+    ss << url.schema << "://" << url.address << ":" << url.port;
+    // Settings that change how we connect, see net::connect()
+    for (auto name : {"net/allow_ssl23", "net/ca_bundle_path",
+                      "net/dumb_transport", "net/socks5_proxy", "net/ssl",
+                      "net/ssl_allow_dirty_shutdown"}) {
+        auto it = settings.find(name);
+        if (it != settings.end()) {
+            ss << " " << name << "=" << it->second;
+        }
+    }
+    return ss.str();
+}
+
 void request_connect(Settings settings, Callback<Error, SharedPtr<Transport>> txp,
                      SharedPtr<Reactor> reactor, SharedPtr<Logger> logger) {
     request_connect_impl(settings, txp, reactor, logger);
 }
 
+void request_close(SharedPtr<Transport> txp, Settings settings, Callback<> cb,
+                   SharedPtr<Reactor> reactor, SharedPtr<Logger> logger) {
+    ErrorOr<bool> keep_alive = settings.get_noexcept("http/keep_alive", false);
+    ErrorOr<int> max_per_host = settings.get_noexcept(
+        "http/keep_alive_max_per_host", 4);
+    ErrorOr<Url> url = request_connect_prepare(settings);
+    if (!keep_alive || !*keep_alive || !max_per_host || *max_per_host <= 0 ||
+        !url || !txp->reusable()) {
+        txp->close(cb);
+        return;
+    }
+    ConnectionPool::global().put(reactor, request_connect_key(*url, settings),
+                                 txp, (size_t)*max_per_host, logger);
+    reactor->call_soon([cb]() {
+        if (cb) {
+            cb();
+        }
+    });
+}
+
+void close_idle_connections(SharedPtr<Reactor> reactor, Callback<> cb) {
+    ConnectionPool::global().close_idle(reactor, cb);
+}
+
 void request_send(SharedPtr<Transport> txp, Settings settings, Headers headers,
                   std::string body, SharedPtr<Logger> logger,
                   Callback<Error, SharedPtr<Request>> callback) {
@@ -125,6 +195,8 @@ void request_maybe_send(ErrorOr<SharedPtr<Request>> request, SharedPtr<Transport
     }
     Buffer buff;
     (*request)->serialize(buff, logger);
+    // Until we have received the whole response
+    txp->set_reusable_(false);
     net::write(txp, buff, [=](Error err) {
         callback(err, *request);
     });
@@ -169,7 +241,21 @@ void request_recv_response(SharedPtr<Transport> txp,
     request_recv_response_start(std::move(ctx));
 }
 
+// Returns true if the server allows us to send another request using the
+// same connection after `response`, according to RFC 7230 Sect. 6.3.
+static bool response_allows_keep_alive(const Response &response) {
+    std::string connection = headers_find_first(response.headers, "Connection");
+    if (strcasecmp(connection.c_str(), "close") == 0) {
+        return false;
+    }
+    if (response.http_major == 1 && response.http_minor == 0) {
+        return strcasecmp(connection.c_str(), "keep-alive") == 0;
+    }
+    return response.http_major == 1;
+}
+
 static void request_recv_response_start(SharedPtr<RequestRecvResponse> ctx) {
+    ctx->txp->set_reusable_(false);
 
     ErrorOr<bool> ignore_body = ctx->settings.get_noexcept(
             "http/ignore_body", false);
@@ -216,6 +302,9 @@ static void request_recv_response_loop(SharedPtr<RequestRecvResponse> ctx) {
             request_recv_response_loop(std::move(ctx));
             return; // basically: continue reading
         }
+        // Here, if there is no error, the response ended before EOF
+        bool reusable = (err == NoError() &&
+                         response_allows_keep_alive(*ctx->response));
         ctx->logger->debug("http: received error %d on connection", err.code);
         if (err == EofError() && ctx->valid_response == true) {
             // Assume there was no error. The parser will tell us if that
@@ -230,8 +319,9 @@ static void request_recv_response_loop(SharedPtr<RequestRecvResponse> ctx) {
                 // FALLTHRU
             }
         }
-        ctx->reactor->call_soon([ctx, err]() {
+        ctx->reactor->call_soon([ctx, err, reusable]() {
             ctx->logger->debug2("http: end of closure");
+            ctx->txp->set_reusable_(reusable);
             // Completely reset all fields of the context, moving out all that
             // we don't need in this context so to avoid reference loops.
             ctx->buff.reset();
@@ -274,6 +364,11 @@ void request_maybe_sendrecv(ErrorOr<SharedPtr<Request>> request, SharedPtr<Trans
                 return;
             }
             response->request = request;
+            if (strcasecmp(headers_find_first(request->headers,
+                                              "Connection").c_str(),
+                           "close") == 0) {
+                txp->set_reusable_(false);
+            }
             callback(error, response);
         }, settings, reactor, logger);
     });
@@ -316,18 +411,19 @@ ErrorOr<Url> redirect(const Url &orig_url, const std::string &location) {
     return parse_url_noexcept(ss.str());
 }
 
-void request(Settings settings, Headers headers, std::string body,
-             Callback<Error, SharedPtr<Response>> callback, SharedPtr<Reactor> reactor,
-             SharedPtr<Logger> logger, SharedPtr<Response> previous, int num_redirs) {
-    dump_settings(settings, "request", logger);
-    ErrorOr<int> max_redirects = settings.get_noexcept(
-        "http/max_redirects", 0
-    );
-    if (!max_redirects) {
-        callback(InvalidMaxRedirectsError(max_redirects.as_error()), {});
-        return;
-    }
-    request_connect(
+// Connects, possibly reusing an idle connection, and sends the request. The
+// transport is empty if we could not connect. When a reused connection fails
+// before we receive any response, most likely because the server closed it
+// in the meanwhile, we try again once using a new connection. Since the
+// server may have processed the request anyway, we only do that for GET and
+// HEAD, which are safe to repeat (RFC 7230 Sect. 6.3.1). For example, we
+// must not submit a measurement to the collector twice.
+static void request_connect_sendrecv(
+        Settings settings, Headers headers, std::string body,
+        Callback<Error, SharedPtr<Transport>, SharedPtr<Response>> callback,
+        SharedPtr<Reactor> reactor, SharedPtr<Logger> logger,
+        bool allow_reuse = true) {
+    request_connect_impl(
         settings,
         [=](Error err, SharedPtr<Transport> txp) {
             if (err) {
@@ -342,118 +438,156 @@ void request(Settings settings, Headers headers, std::string body,
                     logger->warn("http: cannot serialize request: %s",
                                  maybe_request.as_error().what());
                 }
-                callback(err, std::move(response));
+                callback(err, {}, std::move(response));
                 return;
             }
+            std::string method = settings.get("http/method", std::string("GET"));
+            bool retry = txp->reusable() &&
+                         (method == "GET" || method == "HEAD");
             request_sendrecv(
                 txp, settings, headers, body,
                 [=](Error error, SharedPtr<Response> response) {
-                    txp->close([=]() {
-                        if (error) {
-                            callback(error, response);
-                            return;
+                    if (error && error != TimeoutError() && retry &&
+                        (!response || response->status_code == 0)) {
+                        logger->debug("http: reused connection failed; "
+                                      "retrying with a new connection");
+                        txp->close([=]() {
+                            request_connect_sendrecv(settings, headers, body,
+                                                     callback, reactor,
+                                                     logger, false);
+                        });
+                        return;
+                    }
+                    callback(error, txp, response);
+                },
+                reactor, logger);
+        },
+        reactor, logger, allow_reuse);
+}
+
+void request(Settings settings, Headers headers, std::string body,
+             Callback<Error, SharedPtr<Response>> callback, SharedPtr<Reactor> reactor,
+             SharedPtr<Logger> logger, SharedPtr<Response> previous, int num_redirs) {
+    dump_settings(settings, "request", logger);
+    ErrorOr<int> max_redirects = settings.get_noexcept(
+        "http/max_redirects", 0
+    );
+    if (!max_redirects) {
+        callback(InvalidMaxRedirectsError(max_redirects.as_error()), {});
+        return;
+    }
+    request_connect_sendrecv(
+        settings, headers, body,
+        [=](Error error, SharedPtr<Transport> txp,
+            SharedPtr<Response> response) {
+            if (!txp) {
+                callback(error, response);
+                return;
+            }
+            request_close(txp, settings, [=]() {
+                if (error) {
+                    callback(error, response);
+                    return;
+                }
+                response->previous = previous;
+                if (response->status_code / 100 == 3 and
+                    *max_redirects > 0) {
+                    logger->debug("following redirect...");
+                    std::string loc = headers_find_first(
+                        response->headers, "Location");
+                    if (loc == "") {
+                        callback(EmptyLocationError(), response);
+                        return;
+                    }
+                    ErrorOr<Url> url = redirect(
+                        response->request->url,
+                        loc
+                    );
+                    if (!url) {
+                        callback(InvalidRedirectUrlError(
+                                 url.as_error()), response);
+                        return;
+                    }
+                    Settings new_settings = settings;
+                    new_settings["http/url"] = url->str();
+                    logger->debug("redir url: %s", url->str().c_str());
+                    if (num_redirs >= *max_redirects) {
+                        callback(TooManyRedirectsError(), response);
+                        return;
+                    }
+                    // Basic attempt at honouring cookies when we
+                    // follow redirects. It does not really process
+                    // the cookie and does not check domain and/or
+                    // path, which makes us look a bit stupid.
+                    //
+                    // Step 1: build a set of cookies from the cookies
+                    // that were present in the response.
+                    std::set<std::string> cookies;
+                    for (auto &h : response->headers) {
+                        if (strcasecmp(h.key.c_str(), "Set-Cookie") != 0) {
+                            continue;
                         }
-                        response->previous = previous;
-                        if (response->status_code / 100 == 3 and
-                            *max_redirects > 0) {
-                            logger->debug("following redirect...");
-                            std::string loc = headers_find_first(
-                                response->headers, "Location");
-                            if (loc == "") {
-                                callback(EmptyLocationError(), response);
-                                return;
-                            }
-                            ErrorOr<Url> url = redirect(
-                                response->request->url,
-                                loc
-                            );
-                            if (!url) {
-                                callback(InvalidRedirectUrlError(
-                                         url.as_error()), response);
-                                return;
-                            }
-                            Settings new_settings = settings;
-                            new_settings["http/url"] = url->str();
-                            logger->debug("redir url: %s", url->str().c_str());
-                            if (num_redirs >= *max_redirects) {
-                                callback(TooManyRedirectsError(), response);
-                                return;
-                            }
-                            // Basic attempt at honouring cookies when we
-                            // follow redirects. It does not really process
-                            // the cookie and does not check domain and/or
-                            // path, which makes us look a bit stupid.
-                            //
-                            // Step 1: build a set of cookies from the cookies
-                            // that were present in the response.
-                            std::set<std::string> cookies;
-                            for (auto &h : response->headers) {
-                                if (strcasecmp(h.key.c_str(), "Set-Cookie") != 0) {
-                                    continue;
-                                }
-                                std::string s;
-                                size_t idx = h.value.find(";");
-                                if (idx == 0) {
-                                    continue;  // Does not follow syntax
-                                }
-                                if (idx != std::string::npos) {
-                                    s = h.value.substr(0, idx - 1);
-                                } else {
-                                    s = h.value;
-                                }
-                                cookies.insert(std::move(s));
-                            }
-                            // Again cookies, step 2. Now we want to consult
-                            // the original request and insert into the set
-                            // also the cookies that were in there. Note that
-                            // one SHOULD NOT send multiple cookie headers
-                            // however the code doesn't assume that.
-                            for (auto &h : headers) {
-                                if (strcasecmp(h.key.c_str(), "Cookie") != 0) {
-                                    continue;
-                                }
-                                // So, RFC6265 sect. 4.2.1 provides this
-                                // syntax `cookie-pair *( ";" SP cookie-pair )`
-                                // and for this reason here I'm including a
-                                // space. However, a SP could also be something
-                                // different from a space. TODO(bassosimone):
-                                // we should improve this code part.
-                                auto d = mk::split<std::deque<std::string>>(
-                                    h.value, "; ");
-                                while (!d.empty()) {
-                                    std::string s = std::move(d.front());
-                                    d.pop_front();
-                                    cookies.insert(std::move(s));
-                                }
-                            }
-                            std::string cookiestring;
-                            if (!cookies.empty()) {
-                                std::deque<std::string> d{
-                                    cookies.begin(), cookies.end()};
-                                while (!d.empty()) {
-                                    if (!cookiestring.empty()) {
-                                      cookiestring += "; ";
-                                    }
-                                    cookiestring += d.front();
-                                    d.pop_front();
-                                }
-                            }
-                            // And again cookies, now at step 3. Here we want
-                            // to replace the original header in the vector.
-                            Headers new_headers = headers;
+                        std::string s;
+                        size_t idx = h.value.find(";");
+                        if (idx == 0) {
+                            continue;  // Does not follow syntax
+                        }
+                        if (idx != std::string::npos) {
+                            s = h.value.substr(0, idx - 1);
+                        } else {
+                            s = h.value;
+                        }
+                        cookies.insert(std::move(s));
+                    }
+                    // Again cookies, step 2. Now we want to consult
+                    // the original request and insert into the set
+                    // also the cookies that were in there. Note that
+                    // one SHOULD NOT send multiple cookie headers
+                    // however the code doesn't assume that.
+                    for (auto &h : headers) {
+                        if (strcasecmp(h.key.c_str(), "Cookie") != 0) {
+                            continue;
+                        }
+                        // So, RFC6265 sect. 4.2.1 provides this
+                        // syntax `cookie-pair *( ";" SP cookie-pair )`
+                        // and for this reason here I'm including a
+                        // space. However, a SP could also be something
+                        // different from a space. TODO(bassosimone):
+                        // we should improve this code part.
+                        auto d = mk::split<std::deque<std::string>>(
+                            h.value, "; ");
+                        while (!d.empty()) {
+                            std::string s = std::move(d.front());
+                            d.pop_front();
+                            cookies.insert(std::move(s));
+                        }
+                    }
+                    std::string cookiestring;
+                    if (!cookies.empty()) {
+                        std::deque<std::string> d{
+                            cookies.begin(), cookies.end()};
+                        while (!d.empty()) {
                             if (!cookiestring.empty()) {
-                                headers_push_back(new_headers, "Cookie", cookiestring);
+                              cookiestring += "; ";
                             }
-                            reactor->call_soon([=]() {
-                                request(new_settings, new_headers, body, callback,
-                                    reactor, logger, response, num_redirs + 1);
-                            });
-                            return;
+                            cookiestring += d.front();
+                            d.pop_front();
                         }
-                        callback(NoError(), response);
+                    }
+                    // And again cookies, now at step 3. Here we want
+                    // to replace the original header in the vector.
+                    Headers new_headers = headers;
+                    if (!cookiestring.empty()) {
+                        headers_push_back(new_headers, "Cookie", cookiestring);
+                    }
+                    reactor->call_soon([=]() {
+                        request(new_settings, new_headers, body, callback,
+                            reactor, logger, response, num_redirs + 1);
                     });
-                },
-                reactor, logger);
+                    return;
+                }
+                callback(NoError(), response);
+            }, reactor, logger);
         },
         reactor, logger);
 }
@@ -7,6 +7,7 @@
 #include <measurement_kit/common/nlohmann/json.hpp>
 
 #include "src/libmeasurement_kit/common/mock.hpp"
+#include "src/libmeasurement_kit/http/connection_pool.hpp"
 #include "src/libmeasurement_kit/http/response_parser.hpp"
 #include "src/libmeasurement_kit/http/http.hpp"
 #include "src/libmeasurement_kit/net/connect.hpp"
@@ -16,33 +17,45 @@ namespace http {
 
 // TODO: mock more functions in request.cpp
 
-template <MK_MOCK_AS(net::connect, net_connect)>
+// Parses the `http/url` setting and adjusts the connection settings for it.
+ErrorOr<Url> request_connect_prepare(Settings &settings);
+
+// Returns the key of connections to `url` made using `settings`, which
+// must have been adjusted by request_connect_prepare(), in ConnectionPool.
+std::string request_connect_key(const Url &url, const Settings &settings);
+
+template <MK_MOCK_AS(net::connect, net_connect),
+          MK_MOCK_AS(ConnectionPool::global, connection_pool)>
 void request_connect_impl(Settings settings, Callback<Error, SharedPtr<Transport>> cb,
                           SharedPtr<Reactor> reactor,
-                          SharedPtr<Logger> logger) {
-    if (settings.find("http/url") == settings.end()) {
-        cb(MissingUrlError(), {});
-        return;
-    }
-    ErrorOr<Url> url = parse_url_noexcept(settings.at("http/url"));
+                          SharedPtr<Logger> logger, bool allow_reuse = true) {
+    ErrorOr<Url> url = request_connect_prepare(settings);
     if (!url) {
         cb(url.as_error(), {});
         return;
     }
-    if (url->schema == "httpo") {
-        // tor_socks_port takes precedence because it's more specific
-        if (settings.find("net/tor_socks_port") != settings.end()) {
-            // XXX The following is a violation of layers because we are
-            // setting a variable that NET code should set for itself; we
-            // should do nothing in this case, lower layer should do
-            std::string proxy = "127.0.0.1:";
-            proxy += settings["net/tor_socks_port"];
-            settings["net/socks5_proxy"] = proxy;
-        } else if (settings.find("net/socks5_proxy") == settings.end()) {
-            settings["net/socks5_proxy"] = "127.0.0.1:9050";
+    ErrorOr<bool> keep_alive = settings.get_noexcept("http/keep_alive", false);
+    if (!keep_alive) {
+        cb(keep_alive.as_error(), {});
+        return;
+    }
+    if (*keep_alive && allow_reuse) {
+        ErrorOr<double> idle_timeout = settings.get_noexcept(
+            "http/keep_alive_idle_timeout", 15.0);
+        if (!idle_timeout) {
+            cb(idle_timeout.as_error(), {});
+            return;
+        }
+        // Note: a connection taken from the pool is still marked as
+        // reusable until we start reading the next response
+        SharedPtr<Transport> txp = connection_pool().take(
+            reactor, request_connect_key(*url, settings), *idle_timeout,
+            logger);
+        if (txp) {
+            txp->set_timeout(settings.get("net/timeout", 30.0));
+            reactor->call_soon([=]() { cb(NoError(), txp); });
+            return;
         }
-    } else if (url->schema == "https") {
-        settings["net/ssl"] = true;
     }
     net_connect(url->address, url->port, cb, settings, reactor, logger);
 }
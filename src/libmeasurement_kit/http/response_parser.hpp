@@ -11,6 +11,8 @@
 #include "src/libmeasurement_kit/common/non_movable.hpp"
 #include "src/libmeasurement_kit/http/http.hpp"
 
+#include <event2/buffer.h>
+
 #include <type_traits>
 
 namespace mk {
@@ -35,20 +37,28 @@ class ResponseParserNg : public NonCopyable, public NonMovable {
 
     void on_end(std::function<void()> fn) { end_fn_ = fn; }
 
+    // Parses the content of \p data in place and consumes it
     void feed(Buffer &data) {
-        buffer_ << data;
-        parse();
+        // Peek a few segments at a time, so we don't need to allocate
+        // room for all of them, and drain them once they are parsed
+        evbuffer_iovec iov[8];
+        evbuffer *evbuf = data.evbuf.get();
+        for (;;) {
+            int count = evbuffer_peek(evbuf, -1, nullptr, iov, 8);
+            if (count <= 0) {
+                break;
+            }
+            size_t total = 0;
+            for (int i = 0; i < count && i < 8; ++i) {
+                total += parser_execute(iov[i].iov_base, iov[i].iov_len);
+            }
+            data.discard(total);
+        }
     }
 
-    void feed(std::string data) {
-        buffer_ << data;
-        parse();
-    }
+    void feed(std::string data) { parser_execute(data.data(), data.size()); }
 
-    void feed(const char c) {
-        buffer_.write((const void *)&c, 1);
-        parse();
-    }
+    void feed(const char c) { parser_execute(&c, 1); }
 
     void eof() { parser_execute(nullptr, 0); }
 
@@ -138,7 +148,6 @@ class ResponseParserNg : public NonCopyable, public NonMovable {
     SharedPtr<Logger> logger_;
     http_parser parser_;
     http_parser_settings settings_;
-    Buffer buffer_;
 
     // Variables used during parsing
     Response response_;
@@ -171,15 +180,6 @@ class ResponseParserNg : public NonCopyable, public NonMovable {
         prev_ = cur;
     }
 
-    void parse() {
-        size_t total = 0;
-        buffer_.for_each([&](const void *p, size_t n) {
-            total += parser_execute(p, n);
-            return true;
-        });
-        buffer_.discard(total);
-    }
-
     size_t parser_execute(const void *p, size_t n) {
         size_t x =
             http_parser_execute(&parser_, &settings_, (const char *)p, n);
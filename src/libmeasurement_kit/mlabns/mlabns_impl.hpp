@@ -99,6 +99,12 @@ void query_impl(std::string tool, Callback<Error, Reply> callback,
     url += *query;
     logger->debug("query mlabns for tool %s", tool.c_str());
     logger->debug("mlabns url: %s", url.c_str());
+    if (settings.find("dns/cache") == settings.end()) {
+        settings["dns/cache"] = "process";
+    }
+    if (settings.find("net/happy_eyeballs_delay") == settings.end()) {
+        settings["net/happy_eyeballs_delay"] = 0.25;
+    }
     request_json_no_body("GET", url, make_headers(settings),
         [callback, logger](Error error, SharedPtr<http::Response> /*response*/,
                            nlohmann::json node) {
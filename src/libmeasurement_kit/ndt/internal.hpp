@@ -18,6 +18,8 @@
 
 #include "src/libmeasurement_kit/net/connect.hpp"
 #include "src/libmeasurement_kit/net/error.hpp"
+#include "src/libmeasurement_kit/net/framing.hpp"
+#include "src/libmeasurement_kit/net/payload.hpp"
 #include "src/libmeasurement_kit/net/transport.hpp"
 
 #include "measurement_kit/ndt.hpp"
@@ -130,6 +132,10 @@ struct Context {
     int test_suite = TEST_STATUS | TEST_META;
     double timeout = NDT_TIMEOUT;
     SharedPtr<Transport> txp;
+    // Reads control messages from `txp` and passes the next one to
+    // `read_ll_callback` (see messages::read_ll())
+    SharedPtr<FramedReader> reader;
+    Callback<Error, uint8_t, std::string> read_ll_callback;
 };
 
 /*
@@ -296,6 +302,24 @@ inline void log_speed(SharedPtr<Logger> logger, std::string type, int num_stream
     });
 }
 
+// Appends a TCP_INFO sample of `txp`, one of the streams of a test, to the
+// `tcp_info` array of `entry`. Together with the speed samples, this lets
+// us tell client-limited runs from network-limited ones.
+inline void record_tcp_info(SharedPtr<nlohmann::json> entry,
+                            SharedPtr<Transport> txp, int stream,
+                            double elapsed, SharedPtr<Logger> logger) {
+    ErrorOr<TcpInfo> info = txp->tcp_info();
+    if (!info) {
+        logger->debug2("ndt: cannot sample TCP_INFO: %s",
+                       info.as_error().what());
+        return;
+    }
+    nlohmann::json sample = *info;
+    sample["elapsed"] = elapsed;
+    sample["stream"] = stream;
+    (*entry)["tcp_info"].push_back(sample);
+}
+
 } // namespace mk
 } // namespace ndt
 #endif
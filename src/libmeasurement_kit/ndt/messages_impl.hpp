@@ -15,8 +15,6 @@
 
 #include "src/libmeasurement_kit/ndt/internal.hpp"
 
-#include <assert.h>
-
 namespace mk {
 namespace ndt {
 namespace messages {
@@ -26,38 +24,47 @@ namespace messages {
     | type (1) | length (2) | payload (0-65535) |
     +----------+------------+-------------------+
 */
-template <MK_MOCK_AS(net::readn, net_readn_first),
-          MK_MOCK_AS(net::readn, net_readn_second)>
-void read_ll_impl(SharedPtr<Context> ctx,
-                  Callback<Error, uint8_t, std::string> callback,
-                  SharedPtr<Reactor> reactor) {
-
-    // Receive message type (1 byte) and length (2 bytes)
-    net_readn_first(ctx->txp, ctx->buff, 3, [=](Error err) mutable {
-        if (err) {
-            callback(ReadingMessageTypeLengthError(std::move(err)), 0, "");
-            return;
-        }
-        ErrorOr<uint8_t> type = ctx->buff->read_uint8();
-        ErrorOr<uint16_t> length = ctx->buff->read_uint16();
-        // Note: we don't check for `type` and `length` true-ness because
-        // we are after a readn() which should ensure enough space is there,
-        // hence, if that's not the case, we'll see an exception
+static inline SharedPtr<Framing> message_framing() {
+    return Framing::length_prefixed(3, [](const std::string &header) {
+        return (size_t)(((uint8_t)header[1] << 8) | (uint8_t)header[2]);
+    }, 3 + UINT16_MAX);
+}
 
-        // Now read the message payload (`*length` bytes in total)
-        net_readn_second(ctx->txp, ctx->buff, *length, [=](Error err) mutable {
+static inline void read_ll_impl(SharedPtr<Context> ctx,
+                                Callback<Error, uint8_t, std::string> callback,
+                                SharedPtr<Reactor> reactor) {
+    // The reader is attached once and paused after each message, so that
+    // the next call to read_ll() receives the next message
+    if (!ctx->reader) {
+        ctx->reader = FramedReader::make(ctx->txp, message_framing(), ctx->buff,
+                                         reactor);
+        // Note: this creates a reference cycle that is broken when we
+        // disconnect (see protocol::disconnect_and_callback())
+        ctx->reader->on_frame([ctx](Error err, Buffer frame) {
+            ctx->reader->pause();
+            Callback<Error, uint8_t, std::string> callback;
+            std::swap(callback, ctx->read_ll_callback);
             if (err) {
+                // Bytes left in the buffer tell whether we had read the
+                // message type and length already
+                if (ctx->buff->length() < 3) {
+                    callback(ReadingMessageTypeLengthError(std::move(err)),
+                             0, "");
+                    return;
+                }
                 callback(ReadingMessagePayloadError(std::move(err)), 0, "");
                 return;
             }
-            std::string s = ctx->buff->readn(*length);
-            // TODO: rather than using assert() here we should modify readn()
-            // to return ErrorOr<> (exceptions are better than asserts)
-            assert(s.size() == *length);
-            ctx->logger->debug("< [%d]: (%d) %s", *length, *type, s.c_str());
-            callback(NoError(), *type, s);
-        }, reactor);
-    }, reactor);
+            // The framing guarantees that the whole message is there
+            uint8_t type = *frame.read_uint8();
+            uint16_t length = *frame.read_uint16();
+            std::string s = frame.read();
+            ctx->logger->debug("< [%d]: (%d) %s", length, type, s.c_str());
+            callback(NoError(), type, std::move(s));
+        });
+    }
+    ctx->read_ll_callback = std::move(callback);
+    ctx->reader->resume();
 }
 
 // Like `read_ll()` but decode the payload using JSON
@@ -285,6 +285,7 @@ void wait_close_impl(SharedPtr<Context> ctx, Callback<Error> callback) {
 }
 
 static inline void disconnect_and_callback_impl(SharedPtr<Context> ctx, Error err) {
+    ctx->reader = {};
     if (ctx->txp) {
         SharedPtr<Transport> txp = ctx->txp;
         ctx->txp = {};
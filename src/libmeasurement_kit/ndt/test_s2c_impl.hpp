@@ -51,13 +51,21 @@ void coroutine_impl(SharedPtr<nlohmann::json> report_entry, std::string address,
                 (*report_entry)["params"]["num_streams"] = params.num_streams;
                 (*report_entry)["params"]["snaps_delay"] = params.snaps_delay;
 
+                int stream = 0;
                 for (auto txp : txp_list) {
                     txp->set_timeout(timeout);
+                    // Each stream samples TCP_INFO on its own
+                    SharedPtr<MeasureSpeed> stream_snaps{
+                          std::make_shared<MeasureSpeed>(0.5)};
 
                     txp->on_data([=](Buffer data) {
                         average->total += data.length();
                         snaps->total += data.length();
                         double ct = time_now();
+                        stream_snaps->maybe_speed(ct, [&](double el, double) {
+                            record_tcp_info(report_entry, txp, stream, el,
+                                            logger);
+                        });
                         // Note: we stop printing the speed when at least
                         // one connection has terminated the test
                         if (*num_completed == 0) {
@@ -96,6 +104,7 @@ void coroutine_impl(SharedPtr<nlohmann::json> report_entry, std::string address,
                             cb((num_flows == 1) ? err : NoError(), speed);
                         });
                     });
+                    ++stream;
                 }
             });
         },
@@ -207,6 +216,7 @@ void run_impl(SharedPtr<Context> ctx, Callback<Error> callback) {
         (*cur_entry)["web100_data"] = nlohmann::json::object();
         (*cur_entry)["params"] = nlohmann::json::object();
         (*cur_entry)["receiver_data"] = nlohmann::json::array();
+        (*cur_entry)["tcp_info"] = nlohmann::json::array();
 
         // We connect to the port and wait for coroutine to pause
         ctx->logger->debug("ndt: start s2c coroutine ...");
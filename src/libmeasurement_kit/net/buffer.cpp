@@ -2,12 +2,15 @@
 // Measurement Kit is free software under the BSD license. See AUTHORS
 // and LICENSE for more information on the copying conditions.
 
+#include "src/libmeasurement_kit/common/secure_random.hpp"
 #include "src/libmeasurement_kit/net/evbuffer.hpp"
 #include "src/libmeasurement_kit/net/error.hpp"
 #include "src/libmeasurement_kit/net/buffer.hpp"
 
 #include <event2/buffer.h>
 
+#include <algorithm>
+
 namespace mk {
 namespace net {
 
@@ -79,20 +82,16 @@ void Buffer::discard(size_t count) {
 }
 
 std::string Buffer::readpeek(bool ispeek, size_t upto) {
-    size_t nbytes = 0;
-    std::string out;
-    for_each([&nbytes, &out, &upto](const void *p, size_t n) {
-        if (upto < n) n = upto;
-        out.append((const char *)p, n);
-        upto -= n;
-        nbytes += n;
-        return (upto > 0);
-    });
     /*
-     * We do this after for_each() because we are not supposed
-     * to modify the underlying `evbuf` during for_each().
+     * Size the string in advance and copy directly into it, such that
+     * each byte is copied once and the string is never reallocated.
      */
-    if (!ispeek) discard(nbytes);
+    std::string out(std::min(upto, length()), '\0');
+    if (out.empty()) return out;
+    auto rv = (ispeek) ? evbuffer_copyout(evbuf.get(), &out[0], out.size())
+                       : evbuffer_remove(evbuf.get(), &out[0], out.size());
+    if (rv < 0 || (size_t)rv != out.size())
+        throw std::runtime_error("evbuffer_copyout failed");
     return out;
 }
 
@@ -122,6 +121,27 @@ ErrorOr<std::string> Buffer::readline(size_t maxline) {
     return {NoError(), read(len)};
 }
 
+void Buffer::remove(void *dest, size_t count) {
+    if (evbuffer_remove(evbuf.get(), dest, count) != (int)count)
+        throw std::runtime_error("evbuffer_remove failed");
+}
+
+void Buffer::write_copy(Buffer &source) {
+    if (source.evbuf.get() == evbuf.get())
+        throw std::runtime_error("cannot copy buffer into itself");
+    /*
+     * Share the memory chunks of `source` where possible. Libevent
+     * refuses to do that in some cases, e.g. when `source` itself
+     * contains shared chunks, and in such case we copy.
+     */
+    if (evbuffer_add_buffer_reference(evbuf.get(), source.evbuf.get()) == 0)
+        return;
+    source.for_each([this](const void *p, size_t n) {
+        write(p, n);
+        return true;
+    });
+}
+
 void Buffer::write(const void *buf, size_t count) {
     if (buf == nullptr) throw std::runtime_error("buf is nullptr");
     if (evbuffer_add(evbuf.get(), buf, count) != 0)
@@ -133,8 +153,7 @@ ErrorOr<uint8_t> Buffer::read_uint8() {
     if (length() < sizeof (value)) {
         return {NotEnoughDataError(), {}};
     }
-    std::string str = read(sizeof (value));
-    memcpy(&value, str.data(), sizeof (value));
+    remove(&value, sizeof (value));
     return {NoError(), value};
 }
 
@@ -145,8 +164,7 @@ ErrorOr<uint16_t> Buffer::read_uint16() {
     if (length() < sizeof (value)) {
         return {NotEnoughDataError(), {}};
     }
-    std::string str = read(sizeof (value));
-    memcpy(&value, str.data(), sizeof (value));
+    remove(&value, sizeof (value));
     value = ntohs(value);
     return {NoError(), value};
 }
@@ -161,8 +179,7 @@ ErrorOr<uint32_t> Buffer::read_uint32() {
     if (length() < sizeof (value)) {
         return {NotEnoughDataError(), {}};
     }
-    std::string str = read(sizeof (value));
-    memcpy(&value, str.data(), sizeof (value));
+    remove(&value, sizeof (value));
     value = ntohl(value);
     return {NoError(), value};
 }
@@ -175,7 +192,7 @@ void Buffer::write_uint32(uint32_t num) {
 void Buffer::write_rand(size_t count) {
     if (count == 0) return;
     char *p = new char[count];
-    evutil_secure_rng_get_bytes(p, count);
+    secure_random_bytes(p, count);
     auto ctrl = evbuffer_add_reference(
         evbuf.get(), p, count, [](const void *, size_t, void *p) {
             delete[] static_cast<char *>(p);
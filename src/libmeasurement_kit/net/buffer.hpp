@@ -77,6 +77,12 @@ class Buffer {
 
     ErrorOr<std::string> readline(size_t maxline);
 
+    /*
+     * Remove exactly `count` bytes copying them into `dest`. Throws if
+     * there are less than `count` bytes available.
+     */
+    void remove(void *dest, size_t count);
+
     /*
      * Wrappers for write, including a handy wrapper for sending
      * random bytes to the output stream.
@@ -101,6 +107,12 @@ class Buffer {
 
     void write(const void *buf, size_t count);
 
+    /*
+     * Append the content of `source` without draining it. Where possible
+     * the memory is shared with `source` rather than copied.
+     */
+    void write_copy(Buffer &source);
+
     ErrorOr<uint8_t> read_uint8();
 
     void write_uint8(uint8_t);
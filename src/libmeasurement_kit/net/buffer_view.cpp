@@ -0,0 +1,174 @@
+// Part of Measurement Kit <https://measurement-kit.github.io/>.
+// Measurement Kit is free software under the BSD license. See AUTHORS
+// and LICENSE for more information on the copying conditions.
+
+#include "src/libmeasurement_kit/net/buffer_view.hpp"
+
+#include <string.h>
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace mk {
+namespace net {
+
+/*static*/ constexpr size_t BufferView::npos;
+
+BufferView::BufferView(Buffer &buffer, size_t upto) {
+    upto = std::min(upto, buffer.length());
+    if (upto <= 0) {
+        return;
+    }
+    evbuffer *evbuf = buffer.evbuf.get();
+    auto required = evbuffer_peek(evbuf, (ev_ssize_t)upto, nullptr, nullptr, 0);
+    if (required <= 0) {
+        throw std::runtime_error("unexpected error");
+    }
+    segments_.resize((size_t)required);
+    auto used = evbuffer_peek(evbuf, (ev_ssize_t)upto, nullptr,
+                              segments_.data(), required);
+    if (used != required) {
+        throw std::runtime_error("unexpected error");
+    }
+    // The last segment may extend past `upto`
+    size_t total = 0;
+    for (auto &iov : segments_) {
+        iov.iov_len = std::min(iov.iov_len, upto - total);
+        total += iov.iov_len;
+    }
+    length_ = total;
+}
+
+size_t BufferView::locate(size_t offset, size_t *skip) const {
+    size_t idx = 0;
+    for (; idx < segments_.size(); ++idx) {
+        if (offset < segments_[idx].iov_len) {
+            break;
+        }
+        offset -= segments_[idx].iov_len;
+    }
+    *skip = offset;
+    return idx;
+}
+
+uint8_t BufferView::at(size_t offset) const {
+    size_t skip = 0;
+    size_t idx = locate(offset, &skip);
+    if (idx >= segments_.size()) {
+        throw std::out_of_range("BufferView::at");
+    }
+    return ((const uint8_t *)segments_[idx].iov_base)[skip];
+}
+
+size_t BufferView::find(char c, size_t from) const {
+    size_t skip = 0;
+    size_t idx = locate(from, &skip);
+    size_t base = from - skip;
+    for (; idx < segments_.size(); ++idx) {
+        auto p = (const char *)segments_[idx].iov_base;
+        auto n = segments_[idx].iov_len;
+        auto found = (const char *)memchr(p + skip, c, n - skip);
+        if (found != nullptr) {
+            return base + (size_t)(found - p);
+        }
+        base += n;
+        skip = 0;
+    }
+    return npos;
+}
+
+size_t BufferView::find(const std::string &needle, size_t from) const {
+    if (needle.empty()) {
+        return (from <= length_) ? from : npos;
+    }
+    while (from < length_ && length_ - from >= needle.size()) {
+        size_t pos = find(needle[0], from);
+        if (pos == npos || length_ - pos < needle.size()) {
+            break;
+        }
+        if (compare(pos, needle.size(), needle) == 0) {
+            return pos;
+        }
+        from = pos + 1;
+    }
+    return npos;
+}
+
+int BufferView::compare(size_t offset, size_t count,
+                        const std::string &s) const {
+    if (offset > length_) {
+        throw std::out_of_range("BufferView::compare");
+    }
+    count = std::min(count, length_ - offset);
+    size_t skip = 0;
+    size_t idx = locate(offset, &skip);
+    size_t done = 0;
+    size_t limit = std::min(count, s.size());
+    for (; idx < segments_.size() && done < limit; ++idx) {
+        size_t n = std::min(segments_[idx].iov_len - skip, limit - done);
+        int rv = memcmp((const char *)segments_[idx].iov_base + skip,
+                        s.data() + done, n);
+        if (rv != 0) {
+            return rv;
+        }
+        done += n;
+        skip = 0;
+    }
+    if (count < s.size()) {
+        return -1;
+    }
+    if (count > s.size()) {
+        return 1;
+    }
+    return 0;
+}
+
+size_t BufferView::copy(void *dest, size_t count, size_t offset) const {
+    if (offset > length_) {
+        throw std::out_of_range("BufferView::copy");
+    }
+    count = std::min(count, length_ - offset);
+    size_t skip = 0;
+    size_t idx = locate(offset, &skip);
+    size_t done = 0;
+    for (; idx < segments_.size() && done < count; ++idx) {
+        size_t n = std::min(segments_[idx].iov_len - skip, count - done);
+        memcpy((char *)dest + done,
+               (const char *)segments_[idx].iov_base + skip, n);
+        done += n;
+        skip = 0;
+    }
+    return done;
+}
+
+BufferView BufferView::slice(size_t offset, size_t count) const {
+    if (offset > length_) {
+        throw std::out_of_range("BufferView::slice");
+    }
+    BufferView view;
+    count = std::min(count, length_ - offset);
+    size_t skip = 0;
+    size_t idx = locate(offset, &skip);
+    for (; idx < segments_.size() && view.length_ < count; ++idx) {
+        evbuffer_iovec iov = segments_[idx];
+        iov.iov_base = (char *)iov.iov_base + skip;
+        iov.iov_len = std::min(iov.iov_len - skip, count - view.length_);
+        view.segments_.push_back(iov);
+        view.length_ += iov.iov_len;
+        skip = 0;
+    }
+    return view;
+}
+
+std::string BufferView::str() const {
+    std::string out;
+    out.reserve(length_);
+    for_each([&out](const char *p, size_t n) {
+        out.append(p, n);
+        return true;
+    });
+    return out;
+}
+
+} // namespace net
+} // namespace mk
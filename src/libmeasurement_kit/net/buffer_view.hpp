@@ -0,0 +1,96 @@
+// Part of Measurement Kit <https://measurement-kit.github.io/>.
+// Measurement Kit is free software under the BSD license. See AUTHORS
+// and LICENSE for more information on the copying conditions.
+#ifndef SRC_LIBMEASUREMENT_KIT_NET_BUFFER_VIEW_HPP
+#define SRC_LIBMEASUREMENT_KIT_NET_BUFFER_VIEW_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include <event2/buffer.h>
+
+#include "src/libmeasurement_kit/net/buffer.hpp"
+
+namespace mk {
+namespace net {
+
+/*
+ * BufferView is a read-only, non-owning view of (the beginning of) the
+ * content of a Buffer. It refers directly to the memory segments of the
+ * underlying evbuffer, so parsers can inspect the data without copying
+ * it into a std::string first. Once done, the parser consumes what it
+ * has used by calling Buffer::discard().
+ *
+ * A view is invalidated by any change to the underlying Buffer, including
+ * discard(), so it must be created after each change. Creating a view
+ * does not change the Buffer.
+ */
+class BufferView {
+  public:
+    static constexpr size_t npos = SIZE_MAX;
+
+    BufferView() {}
+
+    // Creates a view of the first `upto` bytes of `buffer`.
+    explicit BufferView(Buffer &buffer, size_t upto = npos);
+
+    size_t length() const { return length_; }
+
+    bool empty() const { return length_ == 0; }
+
+    // Returns the byte at `offset`, or throws std::out_of_range.
+    uint8_t at(size_t offset) const;
+
+    // Returns the offset of the first occurrence of `c` at or after
+    // `from`, or npos if not found.
+    size_t find(char c, size_t from = 0) const;
+
+    // Returns the offset of the first occurrence of `needle` at or after
+    // `from`, or npos if not found. Works across segment boundaries.
+    size_t find(const std::string &needle, size_t from = 0) const;
+
+    // Compares `count` bytes starting at `offset` (or less if the view is
+    // shorter) with `s`. Returns an integer less than, equal to or greater
+    // than zero, like std::string::compare().
+    int compare(size_t offset, size_t count, const std::string &s) const;
+
+    // Returns true if the view begins with `s`.
+    bool starts_with(const std::string &s) const {
+        return compare(0, s.size(), s) == 0;
+    }
+
+    // Copies at most `count` bytes starting at `offset` into `dest` and
+    // returns the number of bytes copied, like std::string::copy().
+    size_t copy(void *dest, size_t count, size_t offset = 0) const;
+
+    // Returns a view of at most `count` bytes starting at `offset`.
+    BufferView slice(size_t offset, size_t count = npos) const;
+
+    // Calls `fn(const char *base, size_t size)` for each segment of the
+    // view, in order, until `fn` returns false.
+    template <typename Func> void for_each(Func &&fn) const {
+        for (auto &iov : segments_) {
+            if (!fn((const char *)iov.iov_base, (size_t)iov.iov_len)) {
+                break;
+            }
+        }
+    }
+
+    // Returns the content of the view as a string (this copies).
+    std::string str() const;
+
+  private:
+    // Returns the index of the segment containing `offset` and sets
+    // `*skip` to the offset within it, or returns segments_.size().
+    size_t locate(size_t offset, size_t *skip) const;
+
+    std::vector<evbuffer_iovec> segments_;
+    size_t length_ = 0;
+};
+
+} // namespace net
+} // namespace mk
+#endif
@@ -57,34 +57,151 @@ void mk_bufferevent_on_event(bufferevent *bev, short what, void *ptr) {
 namespace mk {
 namespace net {
 
+class ConnectRaceCtx {
+  public:
+    SharedPtr<ConnectResult> result;
+    int port = 0;
+    ConnectFirstOfCb cb;
+    double timeout = 0.0;
+    double delay = 0.0;
+    SharedPtr<Reactor> reactor;
+    SharedPtr<Logger> logger;
+    std::vector<std::string> addresses; // In the order we will try them
+    std::vector<std::function<void()>> aborts; // Of attempts in progress
+    std::vector<ConnectAttempt> attempts;
+    size_t pending = 0;
+    double begin = 0.0;
+    TimerHandle timer;
+    bool done = false;
+};
+
+static void connect_race_finish(SharedPtr<ConnectRaceCtx> ctx,
+                                bufferevent *bev) {
+    ctx->done = true;
+    ctx->reactor->cancel(ctx->timer);
+    std::vector<Error> errors;
+    for (size_t i = 0; i < ctx->attempts.size(); ++i) {
+        if (ctx->aborts[i]) {
+            ctx->logger->debug("connect_first_of: abandon attempt to %s",
+                               ctx->attempts[i].address.c_str());
+            ctx->aborts[i]();
+            ctx->aborts[i] = nullptr;
+            ctx->attempts[i].error = OperationCancelledError();
+            ctx->attempts[i].elapsed = mk::time_now() - ctx->begin -
+                                       ctx->attempts[i].start;
+        }
+        errors.push_back(ctx->attempts[i].error);
+    }
+    ctx->result->connect_attempts = ctx->attempts;
+    ctx->cb(errors, bev);
+}
+
+static void connect_race_next(SharedPtr<ConnectRaceCtx> ctx) {
+    ctx->reactor->cancel(ctx->timer);
+    ctx->timer = TimerHandle{};
+    size_t index = ctx->attempts.size();
+    assert(index < ctx->addresses.size());
+    ConnectAttempt attempt;
+    attempt.address = ctx->addresses[index];
+    attempt.start = mk::time_now() - ctx->begin;
+    ctx->attempts.push_back(attempt);
+    ctx->pending += 1;
+    ctx->logger->debug("connect_first_of: attempt #%lu to %s at %f",
+                       (unsigned long)index, attempt.address.c_str(),
+                       attempt.start);
+    if (ctx->delay > 0.0 && index + 1 < ctx->addresses.size()) {
+        ctx->timer = ctx->reactor->call_later(ctx->delay, [ctx]() {
+            ctx->timer = TimerHandle{};
+            connect_race_next(ctx);
+        });
+    }
+    // Note: `ctx->aborts` is presized, so `&ctx->aborts[index]` remains
+    // valid even if the callback is called and starts another attempt.
+    connect_base(
+        attempt.address, ctx->port, ctx->timeout, ctx->reactor, ctx->logger,
+        [ctx, index](Error err, bufferevent *bev, double connect_time) {
+            ctx->aborts[index] = nullptr;
+            ctx->pending -= 1;
+            ConnectAttempt &current = ctx->attempts[index];
+            current.error = err;
+            current.elapsed = mk::time_now() - ctx->begin - current.start;
+            if (ctx->done) {
+                // Should not happen, since we abort other attempts
+                if (bev != nullptr) {
+                    bufferevent_free(bev);
+                }
+                return;
+            }
+            if (!err) {
+                ctx->logger->debug2("connect_first_of success");
+                ctx->result->connect_time = connect_time;
+                connect_race_finish(ctx, bev);
+                return;
+            }
+            ctx->logger->debug2("connect_first_of failure");
+            if (ctx->attempts.size() < ctx->addresses.size()) {
+                connect_race_next(ctx);
+                return;
+            }
+            if (ctx->pending == 0) {
+                ctx->logger->debug2("connect_first_of all addresses failed");
+                connect_race_finish(ctx, nullptr);
+            }
+        },
+        &ctx->aborts[index]);
+}
+
 void connect_first_of(SharedPtr<ConnectResult> result, int port,
                       ConnectFirstOfCb cb, Settings settings,
-                      SharedPtr<Reactor> reactor, SharedPtr<Logger> logger, size_t index,
-                      SharedPtr<std::vector<Error>> errors) {
+                      SharedPtr<Reactor> reactor, SharedPtr<Logger> logger) {
     logger->debug2("connect_first_of begin");
-    if (!errors) {
-        errors.reset(new std::vector<Error>());
+    ErrorOr<double> delay =
+            settings.get_noexcept("net/happy_eyeballs_delay", -1.0);
+    if (!delay) {
+        cb({delay.as_error()}, nullptr);
+        return;
+    }
+    std::string preference = settings.get(
+            "net/happy_eyeballs_preference", std::string("ipv4"));
+    if (preference != "ipv4" && preference != "ipv6") {
+        cb({ValueError()}, nullptr);
+        return;
+    }
+
+    // Interleave the two families, as recommended by RFC 8305 Sect. 4,
+    // keeping the order in which addresses of each family were resolved.
+    // When Happy Eyeballs is disabled, keep the order of resolution.
+    std::vector<std::string> preferred, other;
+    for (auto &address : result->resolve_result.addresses) {
+        bool is_preferred = *delay < 0.0 ||
+                            is_ipv6_addr(address) == (preference == "ipv6");
+        (is_preferred ? preferred : other).push_back(address);
     }
-    if (index >= result->resolve_result.addresses.size()) {
+    SharedPtr<ConnectRaceCtx> ctx{std::make_shared<ConnectRaceCtx>()};
+    for (size_t i = 0; i < preferred.size() || i < other.size(); ++i) {
+        if (i < preferred.size()) {
+            ctx->addresses.push_back(preferred[i]);
+        }
+        if (i < other.size()) {
+            ctx->addresses.push_back(other[i]);
+        }
+    }
+    if (ctx->addresses.empty()) {
         logger->debug2("connect_first_of all addresses failed");
-        cb(*errors, nullptr);
+        cb({}, nullptr);
         return;
     }
-    double timeout = settings.get("net/timeout", 30.0);
-    connect_base(result->resolve_result.addresses[index], port,
-                 timeout, reactor, logger,
-                 [=](Error err, bufferevent *bev, double connect_time) {
-                     errors->push_back(err);
-                     if (err) {
-                         logger->debug2("connect_first_of failure");
-                         connect_first_of(result, port, cb, settings,
-                                          reactor, logger, index + 1, errors);
-                         return;
-                     }
-                     logger->debug2("connect_first_of success");
-                     result->connect_time = connect_time;
-                     cb(*errors, bev);
-                 });
+    ctx->result = result;
+    ctx->port = port;
+    ctx->cb = cb;
+    ctx->timeout = settings.get("net/timeout", 30.0);
+    ctx->delay = *delay;
+    ctx->reactor = reactor;
+    ctx->logger = logger;
+    ctx->aborts.resize(ctx->addresses.size());
+    ctx->attempts.reserve(ctx->addresses.size());
+    ctx->begin = mk::time_now();
+    connect_race_next(ctx);
 }
 
 void connect_logic(std::string hostname, int port,
@@ -207,8 +324,16 @@ void connect(std::string address, int port,
                     return;
                 }
                 cbp = settings.at("net/ca_bundle_path");
+                ErrorOr<bool> resume =
+                    settings.get_noexcept("net/ssl_resume_sessions", true);
+                if (!resume) {
+                    bufferevent_free(r->connected_bev);
+                    callback(resume.as_error(), make_txp<Emitter>(
+                        timeout, r, reactor, logger));
+                    return;
+                }
                 ErrorOr<SSL *> cssl = libssl::Cache<>::thread_local_instance()
-                    ->get_client_ssl(cbp, address, logger);
+                    ->get_client_ssl(cbp, address, port, *resume, logger);
                 if (!cssl) {
                     Error err = cssl.as_error();
                     bufferevent_free(r->connected_bev);
@@ -26,17 +26,33 @@ class ConnectResult {
   public:
     dns::ResolveHostnameResult resolve_result;
     std::vector<Error> connect_result;
+    std::vector<ConnectAttempt> connect_attempts;
     double connect_time = 0.0;
     bufferevent *connected_bev = nullptr;
 };
 
 typedef std::function<void(std::vector<Error>, bufferevent *)> ConnectFirstOfCb;
 
+// Connects to one of the addresses in `result->resolve_result`. By default,
+// addresses are tried one after the other, in the order in which they were
+// resolved, as tests measuring connectivity expect.
+//
+// Setting "net/happy_eyeballs_delay" to zero or more enables Happy Eyeballs
+// (RFC 8305). Addresses are then tried alternating families, starting with
+// the one selected by "net/happy_eyeballs_preference" ("ipv4", the default,
+// or "ipv6"). A new attempt starts when the previous one fails or after the
+// delay has passed without it completing; a delay of zero tries addresses
+// sequentially. The first successful attempt wins and the others are
+// abandoned, failing with OperationCancelledError. This is meant for
+// control-plane requests (bouncer, collector, mlabns), which enable it
+// unless the setting is already set.
+//
+// The callback receives the error of each started attempt, in the order in
+// which they were started, and `result->connect_attempts` records their
+// timing.
 void connect_first_of(SharedPtr<ConnectResult> result, int port,
                       ConnectFirstOfCb cb, Settings settings,
-                      SharedPtr<Reactor> reactor,
-                      SharedPtr<Logger> logger, size_t index = 0,
-                      SharedPtr<std::vector<Error>> errors = nullptr);
+                      SharedPtr<Reactor> reactor, SharedPtr<Logger> logger);
 
 void connect_logic(std::string hostname, int port,
                    Callback<Error, SharedPtr<ConnectResult>> cb,
@@ -52,6 +68,7 @@ using ConnectManyCb = Callback<Error, std::vector<SharedPtr<Transport>>>;
 class ConnectManyCtx {
   public:
     int left = 0; // Signed to detect programmer errors
+    size_t parallelism = 0; // Zero means all connections at once
     ConnectManyCb callback;
     std::vector<SharedPtr<Transport>> connections;
     std::string address;
@@ -67,6 +84,11 @@ void connect(std::string address, int port,
              SharedPtr<Reactor> reactor,
              SharedPtr<Logger> logger);
 
+// Opens `num` connections to `address` and `port` concurrently, at most
+// "net/connect_many_parallelism" at a time (all of them by default). On
+// success the callback receives the connections in order. On failure the
+// connections already opened are closed, and the callback receives the
+// error and the transport of the first attempt that failed.
 void connect_many(std::string address, int port, int num,
         ConnectManyCb callback, Settings settings,
         SharedPtr<Reactor> reactor,
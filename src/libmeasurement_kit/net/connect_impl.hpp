@@ -5,6 +5,7 @@
 #define SRC_LIBMEASUREMENT_KIT_NET_CONNECT_IMPL_HPP
 
 #include "src/libmeasurement_kit/common/mock.hpp"
+#include "src/libmeasurement_kit/common/parallel.hpp"
 #include "src/libmeasurement_kit/common/utils.hpp"
 
 #include "src/libmeasurement_kit/net/connect.hpp"
@@ -31,7 +32,8 @@ template <MK_MOCK(make_sockaddr), MK_MOCK(bufferevent_socket_new),
           MK_MOCK(bufferevent_socket_connect)>
 void connect_base(std::string address, uint16_t port, double timeout,
                   SharedPtr<Reactor> reactor, SharedPtr<Logger> logger,
-                  Callback<Error, bufferevent *, double> &&cb) {
+                  Callback<Error, bufferevent *, double> &&cb,
+                  std::function<void()> *abort = nullptr) {
 
     std::string endpoint = [&address, &port]() {
         Endpoint endpoint;
@@ -101,9 +103,8 @@ void connect_base(std::string address, uint16_t port, double timeout,
 
     // WARNING: set callbacks after connect() otherwise we free `bev` twice
     // NOTE: In case of `new` failure we let the stack unwind
-    bufferevent_setcb(
-        bev, nullptr, nullptr, mk_bufferevent_on_event,
-        new Callback<Error, bufferevent *>([=](Error err, bufferevent *bev) {
+    auto cbarg = new Callback<Error, bufferevent *>(
+        [=](Error err, bufferevent *bev) {
             if (err) {
                 logger->warn("connect() for %s failed in its callback",
                              endpoint.c_str());
@@ -115,29 +116,65 @@ void connect_base(std::string address, uint16_t port, double timeout,
             double elapsed = mk::time_now() - begin;
             logger->debug("connect time: %f", elapsed);
             cb(err, bev, elapsed);
-        }));
+        });
+    bufferevent_setcb(bev, nullptr, nullptr, mk_bufferevent_on_event, cbarg);
+
+    // When requested, give the caller a way to abandon the attempt while
+    // it is in progress; `cb` is then destroyed without being called. The
+    // caller must forget about `*abort` as soon as `cb` is called.
+    if (abort != nullptr) {
+        *abort = [bev, cbarg]() {
+            bufferevent_setcb(bev, nullptr, nullptr, nullptr, nullptr);
+            bufferevent_free(bev);
+            delete cbarg;
+        };
+    }
 }
 
 template <MK_MOCK_AS(net::connect, net_connect)>
 void connect_many_impl(SharedPtr<ConnectManyCtx> ctx) {
-    // Implementation note: this function connects sequentially, which
-    // is slower but also much simpler to implement and verify
     if (ctx->left <= 0) {
         Error err = NoError();
         ctx->callback(err, ctx->connections);
         return;
     }
-    net_connect(ctx->address, ctx->port,
-                [=](Error err, SharedPtr<Transport> txp) {
-                    ctx->connections.push_back(std::move(txp));
-                    if (err) {
-                        ctx->callback(err, ctx->connections);
-                        return;
-                    }
-                    --ctx->left;
-                    connect_many_impl<net_connect>(ctx);
-                },
-                ctx->settings, ctx->reactor, ctx->logger);
+    // Connections are established concurrently, at most `parallelism` at
+    // a time, and each one is stored in its own slot so that the results
+    // stay in order regardless of the order in which connections complete.
+    ctx->connections.resize((size_t)ctx->left);
+    std::vector<Continuation<Error>> input;
+    for (size_t i = 0; i < (size_t)ctx->left; ++i) {
+        input.push_back([ctx, i](Callback<Error> cb) {
+            net_connect(ctx->address, ctx->port,
+                        [ctx, i, cb](Error err, SharedPtr<Transport> txp) {
+                            ctx->connections[i] = std::move(txp);
+                            cb(err);
+                        },
+                        ctx->settings, ctx->reactor, ctx->logger);
+        });
+    }
+    parallel(std::move(input), [ctx](Error err) {
+        if (!err) {
+            ctx->callback(err, ctx->connections);
+            return;
+        }
+        // On failure, close what we have opened and pass back the error
+        // and the transport of the first failed attempt (which records
+        // what went wrong), like we did when connecting sequentially.
+        std::vector<SharedPtr<Transport>> failed;
+        Error first_error;
+        for (size_t i = 0; i < err.child_errors.size(); ++i) {
+            Error &child = err.child_errors[i];
+            if (!child) {
+                ctx->connections[i]->close(nullptr);
+            } else if (!first_error && child != OperationCancelledError()) {
+                first_error = child;
+                failed.push_back(ctx->connections[i]);
+            }
+        }
+        ctx->connections = failed;
+        ctx->callback(first_error, ctx->connections);
+    }, ctx->parallelism, true);
 }
 
 static inline SharedPtr<ConnectManyCtx>
@@ -146,6 +183,8 @@ connect_many_make(std::string address, int port, int count,
                   SharedPtr<Reactor> reactor, SharedPtr<Logger> logger) {
     SharedPtr<ConnectManyCtx> ctx(new ConnectManyCtx);
     ctx->left = count;
+    int parallelism = settings.get("net/connect_many_parallelism", 0);
+    ctx->parallelism = (parallelism > 0) ? (size_t)parallelism : 0;
     ctx->callback = callback;
     ctx->address = address;
     ctx->port = port;
@@ -163,6 +202,7 @@ static inline SharedPtr<Transport> make_txp(SharedPtr<Transport> txp, double tim
     if (!!r) {
         txp->set_connect_time_(r->connect_time);
         txp->set_connect_errors_(r->connect_result);
+        txp->set_connect_attempts_(r->connect_attempts);
         txp->set_dns_result_(r->resolve_result);
     }
     return txp;
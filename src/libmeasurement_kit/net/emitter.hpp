@@ -6,6 +6,7 @@
 
 #include "src/libmeasurement_kit/common/delegate.hpp"
 #include "src/libmeasurement_kit/dns/resolve_hostname.hpp"
+#include "src/libmeasurement_kit/net/payload.hpp"
 #include "src/libmeasurement_kit/net/transport.hpp"
 
 #include <sstream>
@@ -51,7 +52,7 @@ class EmitterBase : public Transport {
             return;
         }
         if (do_record_received_data) {
-            received_data_record.write(data.peek());
+            received_data_record.write_copy(data);
         }
         if (!do_data) {
             logger->debug2("emitter: no handler set; ignoring");
@@ -93,7 +94,7 @@ class EmitterBase : public Transport {
     void on_connect(std::function<void()> fn) override {
         logger->debug2("emitter: %sregister 'connect' handler",
                     (fn != nullptr) ? "" : "un");
-        do_connect = fn;
+        do_connect = std::move(fn);
     }
 
     void on_data(std::function<void(Buffer)> fn) override {
@@ -108,19 +109,19 @@ class EmitterBase : public Transport {
         } else {
             stop_reading();
         }
-        do_data = fn;
+        do_data = std::move(fn);
     }
 
     void on_flush(std::function<void()> fn) override {
         logger->debug2("emitter: %sregister 'flush' handler",
                     (fn != nullptr) ? "" : "un");
-        do_flush = fn;
+        do_flush = std::move(fn);
     }
 
     void on_error(std::function<void(Error)> fn) override {
         logger->debug2("emitter: %sregister 'error' handler",
                     (fn != nullptr) ? "" : "un");
-        do_error = fn;
+        do_error = std::move(fn);
     }
 
     void close(Callback<> cb) override;
@@ -173,7 +174,7 @@ class EmitterBase : public Transport {
     void write(Buffer data) override {
         logger->debug2("emitter: send buffer");
         if (do_record_sent_data) {
-            sent_data_record.write(data.peek());
+            sent_data_record.write_copy(data);
         }
         reactor->with_current_data_usage([&data](DataUsage &du) {
             du.up += data.length();
@@ -186,6 +187,21 @@ class EmitterBase : public Transport {
         start_writing();
     }
 
+    void write(SharedPtr<Payload> payload) override {
+        logger->debug2("emitter: send payload");
+        if (do_record_sent_data) {
+            payload->add_to(sent_data_record);
+        }
+        reactor->with_current_data_usage([&payload](DataUsage &du) {
+            du.up += payload->size();
+        });
+        if (close_pending) {
+            logger->debug2("emitter: already closed; ignoring");
+            return;
+        }
+        start_writing_payload(payload);
+    }
+
     /*
      * TransportSocks5
      */
@@ -215,6 +231,20 @@ class EmitterBase : public Transport {
         throw std::runtime_error("not_attached");
     }
 
+    void pause_reading() override {
+        if (close_pending) {
+            return;
+        }
+        stop_reading();
+    }
+
+    void resume_reading() override {
+        if (close_pending || !do_data) {
+            return;
+        }
+        start_reading();
+    }
+
     // Protected methods of TransportPollable: not implemented
 
     /*
@@ -231,6 +261,13 @@ class EmitterBase : public Transport {
         saved_connect_errors = x;
     }
 
+    std::vector<ConnectAttempt> connect_attempts() override {
+        return saved_connect_attempts;
+    }
+    void set_connect_attempts_(std::vector<ConnectAttempt> x) override {
+        saved_connect_attempts = x;
+    }
+
     dns::ResolveHostnameResult dns_result() override {
         return saved_dns_result;
     }
@@ -238,10 +275,25 @@ class EmitterBase : public Transport {
         saved_dns_result = x;
     }
 
+    bool reusable() override { return saved_reusable; }
+    void set_reusable_(bool x) override { saved_reusable = x; }
+
     Endpoint sockname() override { return {}; }
     Endpoint peername() override { return {}; }
 
+    ErrorOr<TcpInfo> tcp_info() override {
+        return {NotImplementedError(), {}};
+    }
+
   protected:
+    // Appends `payload` to the output and starts writing. Transports that
+    // write directly to a socket override this to bypass `output_buff`, so
+    // that the kernel can send file backed payloads with sendfile().
+    virtual void start_writing_payload(SharedPtr<Payload> payload) {
+        payload->add_to(output_buff);
+        start_writing();
+    }
+
     // TODO: it would probably better to have accessors
     SharedPtr<Reactor> reactor;
     SharedPtr<Logger> logger;
@@ -260,7 +312,9 @@ class EmitterBase : public Transport {
     bool close_pending = false;
     double saved_connect_time = 0.0;
     std::vector<Error> saved_connect_errors;
+    std::vector<ConnectAttempt> saved_connect_attempts;
     dns::ResolveHostnameResult saved_dns_result;
+    bool saved_reusable = false;
 };
 
 class Emitter : public EmitterBase {
@@ -49,6 +49,7 @@ MK_DEFINE_ERR(MK_ERR_NET(28), SslCtxLoadVerifyMemError, "ssl_ctx_load_verify_mem
 
 MK_DEFINE_ERR(MK_ERR_NET(58), SslDirtyShutdownError, "ssl_dirty_shutdown")
 MK_DEFINE_ERR(MK_ERR_NET(59), SslMissingHostnameError, "ssl_missing_hostname")
+MK_DEFINE_ERR(MK_ERR_NET(60), FrameTooLargeError, "frame_too_large")
 
 /*
  * Mapping between errno (Unix) / WSAGetLastError (Windows) values and
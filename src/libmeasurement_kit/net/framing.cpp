@@ -0,0 +1,224 @@
+// Part of Measurement Kit <https://measurement-kit.github.io/>.
+// Measurement Kit is free software under the BSD license. See AUTHORS
+// and LICENSE for more information on the copying conditions.
+
+#include "src/libmeasurement_kit/net/error.hpp"
+#include "src/libmeasurement_kit/net/framing.hpp"
+
+#include <event2/buffer.h>
+
+#include <stdexcept>
+
+namespace mk {
+namespace net {
+
+class ExactFraming : public Framing {
+  public:
+    ExactFraming(size_t n) : n{n} {}
+
+    ErrorOr<size_t> frame_length(Buffer &buff) override {
+        return {NoError(), (buff.length() >= n) ? n : 0};
+    }
+
+  private:
+    size_t n = 0;
+};
+
+class DelimitedFraming : public Framing {
+  public:
+    DelimitedFraming(std::string delimiter, size_t max_frame)
+        : delimiter{std::move(delimiter)}, max_frame{max_frame} {}
+
+    ErrorOr<size_t> frame_length(Buffer &buff) override {
+        evbuffer *evbuf = buff.evbuf.get();
+        size_t length = buff.length();
+        // Do not search again the bytes we searched when we were called
+        // last time, except for those that may start the delimiter
+        size_t start = 0;
+        if (searched >= delimiter.size() && searched <= length) {
+            start = searched - delimiter.size() + 1;
+        }
+        evbuffer_ptr pos;
+        if (evbuffer_ptr_set(evbuf, &pos, start, EVBUFFER_PTR_SET) != 0) {
+            throw std::runtime_error("evbuffer_ptr_set failed");
+        }
+        pos = evbuffer_search(evbuf, delimiter.data(), delimiter.size(), &pos);
+        if (pos.pos < 0) {
+            if (length >= max_frame) {
+                return {FrameTooLargeError(), 0};
+            }
+            searched = length;
+            return {NoError(), 0};
+        }
+        // Cast safe because we know that `pos.pos` is non-negative
+        size_t frame = (size_t)pos.pos + delimiter.size();
+        if (frame > max_frame) {
+            return {FrameTooLargeError(), 0};
+        }
+        // The caller will consume the frame, so the next search must start
+        // again from the beginning of the buffer
+        searched = 0;
+        return {NoError(), frame};
+    }
+
+  private:
+    std::string delimiter;
+    size_t max_frame = 0;
+    size_t searched = 0;
+};
+
+class LengthPrefixedFraming : public Framing {
+  public:
+    LengthPrefixedFraming(
+            size_t header_size,
+            std::function<size_t(const std::string &)> body_length,
+            size_t max_frame)
+        : header_size{header_size}, body_length{std::move(body_length)},
+          max_frame{max_frame} {}
+
+    ErrorOr<size_t> frame_length(Buffer &buff) override {
+        size_t length = buff.length();
+        if (length < header_size) {
+            return {NoError(), 0};
+        }
+        size_t body = body_length(buff.peek(header_size));
+        if (body > max_frame - header_size) {
+            return {FrameTooLargeError(), 0};
+        }
+        size_t frame = header_size + body;
+        return {NoError(), (length >= frame) ? frame : 0};
+    }
+
+  private:
+    size_t header_size = 0;
+    std::function<size_t(const std::string &)> body_length;
+    size_t max_frame = 0;
+};
+
+/*static*/ SharedPtr<Framing> Framing::exact(size_t n) {
+    if (n == 0) {
+        throw std::runtime_error("invalid frame size");
+    }
+    return SharedPtr<Framing>{std::make_shared<ExactFraming>(n)};
+}
+
+/*static*/ SharedPtr<Framing> Framing::delimited(std::string delimiter,
+                                                 size_t max_frame) {
+    if (delimiter.empty() || max_frame < delimiter.size()) {
+        throw std::runtime_error("invalid delimiter or frame size");
+    }
+    return SharedPtr<Framing>{
+            std::make_shared<DelimitedFraming>(std::move(delimiter), max_frame)};
+}
+
+/*static*/ SharedPtr<Framing> Framing::length_prefixed(
+        size_t header_size,
+        std::function<size_t(const std::string &)> body_length,
+        size_t max_frame) {
+    if (header_size == 0 || max_frame < header_size || !body_length) {
+        throw std::runtime_error("invalid header or frame size");
+    }
+    return SharedPtr<Framing>{std::make_shared<LengthPrefixedFraming>(
+            header_size, std::move(body_length), max_frame)};
+}
+
+Framing::~Framing() {}
+
+/*static*/ SharedPtr<FramedReader> FramedReader::make(
+        SharedPtr<Transport> txp, SharedPtr<Framing> framing,
+        SharedPtr<Buffer> buff, SharedPtr<Reactor> reactor) {
+    SharedPtr<FramedReader> reader{std::shared_ptr<FramedReader>{
+            new FramedReader}};
+    reader->txp = txp;
+    reader->framing = framing;
+    reader->buff = buff;
+    reader->reactor = reactor;
+    return reader;
+}
+
+FramedReader::~FramedReader() {}
+
+void FramedReader::pause() {
+    if (paused) {
+        return;
+    }
+    paused = true;
+    txp->pause_reading();
+}
+
+void FramedReader::resume() {
+    if (!paused) {
+        return;
+    }
+    paused = false;
+    SharedPtr<FramedReader> self = shared_from_this();
+    if (!attached) {
+        attached = true;
+        txp->on_data([self](Buffer data) {
+            *self->buff << data;
+            self->process();
+        });
+    } else {
+        txp->resume_reading();
+    }
+    txp->on_error([self](Error error) { self->fail(error); });
+    if ((buff->length() > 0 || pending_error) && !scheduled) {
+        // Like readn(), do not call back immediately to avoid O(N) stack
+        // consumption when the callback resumes the reader
+        scheduled = true;
+        reactor->call_soon([self]() {
+            self->scheduled = false;
+            self->process();
+        });
+    }
+}
+
+void FramedReader::detach() {
+    if (!attached) {
+        return;
+    }
+    attached = false;
+    paused = true;
+    txp->on_data(nullptr);
+    txp->on_error(nullptr);
+}
+
+void FramedReader::process() {
+    while (attached && !paused) {
+        ErrorOr<size_t> length = framing->frame_length(*buff);
+        if (!length) {
+            fail(length.as_error());
+            return;
+        }
+        if (*length == 0) {
+            if (pending_error) {
+                Error error = pending_error;
+                pending_error = NoError();
+                fail(error);
+            }
+            return;
+        }
+        Buffer frame;
+        if (evbuffer_remove_buffer(buff->evbuf.get(), frame.evbuf.get(),
+                                   *length) != (int)*length) {
+            throw std::runtime_error("evbuffer_remove_buffer failed");
+        }
+        do_frame(NoError(), frame);
+    }
+}
+
+void FramedReader::fail(Error error) {
+    if (paused) {
+        // Deliver the error after the frames received before it, when
+        // the reader is resumed
+        if (!pending_error) {
+            pending_error = error;
+        }
+        return;
+    }
+    detach();
+    do_frame(error, Buffer{});
+}
+
+} // namespace net
+} // namespace mk
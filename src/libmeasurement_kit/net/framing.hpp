@@ -0,0 +1,112 @@
+// Part of Measurement Kit <https://measurement-kit.github.io/>.
+// Measurement Kit is free software under the BSD license. See AUTHORS
+// and LICENSE for more information on the copying conditions.
+#ifndef SRC_LIBMEASUREMENT_KIT_NET_FRAMING_HPP
+#define SRC_LIBMEASUREMENT_KIT_NET_FRAMING_HPP
+
+#include "src/libmeasurement_kit/common/delegate.hpp"
+#include "src/libmeasurement_kit/common/enable_shared_from_this.hpp"
+#include "src/libmeasurement_kit/common/non_copyable.hpp"
+#include "src/libmeasurement_kit/common/non_movable.hpp"
+#include "src/libmeasurement_kit/net/transport.hpp"
+
+#include <functional>
+
+namespace mk {
+namespace net {
+
+/*!
+    \brief Policy that splits the bytes read from a stream into frames.
+
+    Framings may keep state between calls (e.g. how much of the buffer
+    has already been searched for a delimiter), hence each FramedReader
+    needs its own instance.
+*/
+class Framing {
+  public:
+    /// Frames of exactly \p n bytes.
+    static SharedPtr<Framing> exact(size_t n);
+
+    /// Frames ending with \p delimiter, which is part of the frame, of at
+    /// most \p max_frame bytes. Use "\r\n" to read CRLF terminated lines.
+    static SharedPtr<Framing> delimited(std::string delimiter,
+                                        size_t max_frame);
+
+    /// Frames consisting of a \p header_size bytes header followed by a
+    /// body whose length \p body_length extracts from the header. Frames
+    /// are at most \p max_frame bytes, header included.
+    static SharedPtr<Framing> length_prefixed(
+            size_t header_size,
+            std::function<size_t(const std::string &)> body_length,
+            size_t max_frame);
+
+    virtual ~Framing();
+
+    /// Returns the length of the frame at the beginning of \p buff, zero
+    /// if \p buff does not contain a whole frame yet, or FrameTooLargeError
+    /// if the frame would be larger than the maximum frame size.
+    virtual ErrorOr<size_t> frame_length(Buffer &buff) = 0;
+};
+
+/*!
+    \brief Reads frames from a transport.
+
+    Unlike readn() and read(), which register new handlers on each call,
+    a FramedReader registers its 'data' handler once and passes each
+    complete frame to the same callback.
+
+    The reader owns the 'data' handler of the transport from the first
+    resume() until detach(), the first error, which it passes to the
+    callback, or closing the transport. Since helpers like write() take
+    over the 'error' handler, resume() registers it again.
+*/
+class FramedReader : public EnableSharedFromThis<FramedReader>,
+                     public NonCopyable,
+                     public NonMovable {
+  public:
+    /// Attaches a paused reader to \p txp. Bytes already read are in
+    /// \p buff, which also holds the data not yet consumed as frames.
+    static SharedPtr<FramedReader> make(SharedPtr<Transport> txp,
+                                        SharedPtr<Framing> framing,
+                                        SharedPtr<Buffer> buff,
+                                        SharedPtr<Reactor> reactor);
+
+    ~FramedReader();
+
+    /// Sets the callback receiving frames and the final error.
+    void on_frame(Callback<Error, Buffer> cb) { do_frame = std::move(cb); }
+
+    /// Stops delivering frames and reading from the transport. It can be
+    /// called from the frame callback to receive one frame at a time. An
+    /// error occurring while paused is delivered after resume().
+    void pause();
+
+    /// Starts reading again. Frames that are already buffered are passed
+    /// to the callback from the next reactor iteration.
+    void resume();
+
+    /// Unregisters the handlers of the transport.
+    void detach();
+
+    /// Returns the number of bytes received but not yet consumed.
+    size_t buffered() { return buff->length(); }
+
+  private:
+    FramedReader() {}
+    void process();
+    void fail(Error error);
+
+    SharedPtr<Transport> txp;
+    SharedPtr<Framing> framing;
+    SharedPtr<Buffer> buff;
+    SharedPtr<Reactor> reactor;
+    Delegate<Error, Buffer> do_frame;
+    Error pending_error;
+    bool attached = false;
+    bool paused = true;
+    bool scheduled = false;
+};
+
+} // namespace net
+} // namespace mk
+#endif
@@ -98,6 +98,14 @@ class LibeventEmitter : public EmitterBase, public NonMovable, public NonCopyabl
         output_buff >> bufferevent_get_output(bev);
     }
 
+    void start_writing_payload(SharedPtr<Payload> payload) override {
+        // Libevent uses sendfile() only for segments added directly to
+        // the output of a socket bufferevent, otherwise it maps them
+        evbuffer *output = bufferevent_get_output(bev);
+        output_buff >> output;
+        payload->add_to(output);
+    }
+
     void start_reading() override {
         if (bufferevent_enable(this->bev, EV_READ) != 0) {
             throw std::runtime_error("cannot enable read");
@@ -147,6 +155,15 @@ class LibeventEmitter : public EmitterBase, public NonMovable, public NonCopyabl
 
     Endpoint peername() override { return sockname_peername_<::getpeername>(); }
 
+    ErrorOr<TcpInfo> tcp_info() override {
+        assert(bev != nullptr);
+        auto fd = bufferevent_getfd(bev);
+        if (fd == -1) {
+            return {NotImplementedError(), {}};
+        }
+        return tcp_info_for_socket(fd);
+    }
+
   public:
     // They MUST be public because they're called by C code
 
@@ -20,13 +20,17 @@
 #include "src/libmeasurement_kit/common/non_movable.hpp"
 #include "src/libmeasurement_kit/common/mock.hpp"
 #include <cassert>
+#include <ctime>
+#include <deque>
 #include <map>
+#include <mutex>
 #include <measurement_kit/common/logger.hpp>
 #include "src/libmeasurement_kit/net/error.hpp"
 #include <openssl/err.h>
 #include <openssl/ssl.h>
 #include <openssl/x509v3.h>
 #include <string>
+#include <sys/stat.h>
 
 namespace mk {
 namespace net {
@@ -49,6 +53,317 @@ static inline void libssl_init_once(SharedPtr<Logger> logger) {
     });
 }
 
+/// Increments the reference count of \p session.
+static inline void session_up_ref(SSL_SESSION *session) {
+#if OPENSSL_VERSION_NUMBER < 0x10100000L && !defined(LIBRESSL_VERSION_NUMBER)
+    CRYPTO_add(&session->references, 1, CRYPTO_LOCK_SSL_SESSION);
+#else
+    SSL_SESSION_up_ref(session);
+#endif
+}
+
+/// Returns true if \p session is a TLS 1.3 session, whose tickets should
+/// be used only once (see RFC 8446 Sect. C.4).
+static inline bool session_is_single_use(SSL_SESSION *session) {
+#ifdef TLS1_3_VERSION
+    return SSL_SESSION_get_protocol_version(session) == TLS1_3_VERSION;
+#else
+    (void)session;
+    return false;
+#endif
+}
+
+/// Returns true if \p session can still be used to resume.
+static inline bool session_is_usable(SSL_SESSION *session) {
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L && !defined(LIBRESSL_VERSION_NUMBER)
+    if (!SSL_SESSION_is_resumable(session)) {
+        return false;
+    }
+#endif
+    long expires = SSL_SESSION_get_time(session) +
+                   SSL_SESSION_get_timeout(session);
+    return expires > (long)time(nullptr);
+}
+
+/*!
+    \brief Client side cache of TLS sessions (including TLS 1.3 tickets),
+    used to resume sessions when we connect again to the same server.
+
+    Sessions are indexed by a key that identifies the server and how we
+    validate it (see Cache::get_client_ssl()). We keep at most
+    `max_sessions` sessions per key and at most `max_keys` keys, evicting
+    the least recently used key when full. Expired sessions are dropped
+    when found. Since TLS 1.3 tickets should not be reused, taking one
+    removes it from the cache, while TLS 1.2 sessions stay in the cache
+    and can be taken many times.
+
+    SessionCache is thread safe.
+*/
+class SessionCache : public NonCopyable, public NonMovable {
+  public:
+    /// Maximum number of servers for which we keep sessions.
+    static constexpr size_t max_keys = 128;
+
+    /// Maximum number of sessions that we keep for each server.
+    static constexpr size_t max_sessions = 4;
+
+    /// Returns a session to resume for \p key, or nullptr. The caller
+    /// owns a reference to the returned session.
+    SSL_SESSION *take(const std::string &key) {
+        std::unique_lock<std::mutex> _{mutex_};
+        auto it = all_.find(key);
+        if (it == all_.end()) {
+            return nullptr;
+        }
+        auto &sessions = it->second.sessions;
+        while (!sessions.empty() && !session_is_usable(sessions.back())) {
+            SSL_SESSION_free(sessions.back());
+            sessions.pop_back();
+        }
+        if (sessions.empty()) {
+            all_.erase(it);
+            return nullptr;
+        }
+        it->second.last_used = ++clock_;
+        SSL_SESSION *session = sessions.back();
+        if (session_is_single_use(session)) {
+            sessions.pop_back();
+        } else {
+            session_up_ref(session);
+        }
+        return session;
+    }
+
+    /// Adds \p session for \p key, taking ownership of the reference.
+    void put(const std::string &key, SSL_SESSION *session) {
+        std::unique_lock<std::mutex> _{mutex_};
+        if (all_.count(key) == 0 && all_.size() >= max_keys) {
+            auto lru = all_.begin();
+            for (auto it = all_.begin(); it != all_.end(); ++it) {
+                if (it->second.last_used < lru->second.last_used) {
+                    lru = it;
+                }
+            }
+            all_.erase(lru);
+        }
+        Entry &entry = all_[key];
+        entry.last_used = ++clock_;
+        entry.sessions.push_back(session);
+        if (entry.sessions.size() > max_sessions) {
+            SSL_SESSION_free(entry.sessions.front());
+            entry.sessions.pop_front();
+        }
+    }
+
+    /// Removes all the sessions.
+    void clear() {
+        std::unique_lock<std::mutex> _{mutex_};
+        all_.clear();
+    }
+
+    /// Returns the number of sessions for \p key.
+    size_t count(const std::string &key) {
+        std::unique_lock<std::mutex> _{mutex_};
+        auto it = all_.find(key);
+        return (it != all_.end()) ? it->second.sessions.size() : 0;
+    }
+
+    /// Returns the number of keys for which we have sessions.
+    size_t size() {
+        std::unique_lock<std::mutex> _{mutex_};
+        return all_.size();
+    }
+
+    /// Arranges for the sessions established by \p ssl, which must have
+    /// been created from a Context, to be added to \p cache for \p key.
+    static void track(SharedPtr<SessionCache> cache, SSL *ssl,
+                      std::string key) {
+        SSL_set_ex_data(ssl, tag_index(), new Tag{cache, key});
+    }
+
+    /// Callback for SSL_CTX_sess_set_new_cb(). We save our own reference
+    /// to the session, hence we always return zero.
+    static int on_new_session(SSL *ssl, SSL_SESSION *session) {
+        auto tag = static_cast<Tag *>(SSL_get_ex_data(ssl, tag_index()));
+        if (tag == nullptr) {
+            return 0; // Not tracked
+        }
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L && !defined(LIBRESSL_VERSION_NUMBER)
+        // Save a copy, because when the SSL is freed without a clean
+        // shutdown (as it often happens) its current session, which may
+        // be `session`, is marked as not resumable.
+        session = SSL_SESSION_dup(session);
+        if (session == nullptr) {
+            return 0;
+        }
+#else
+        session_up_ref(session);
+#endif
+        tag->cache->put(tag->key, session);
+        return 0;
+    }
+
+  private:
+    class Entry : public NonCopyable, public NonMovable {
+      public:
+        ~Entry() {
+            for (auto session : sessions) {
+                SSL_SESSION_free(session);
+            }
+        }
+        std::deque<SSL_SESSION *> sessions;
+        uint64_t last_used = 0;
+    };
+
+    // Attached to a SSL to remember where to save its sessions
+    class Tag {
+      public:
+        SharedPtr<SessionCache> cache;
+        std::string key;
+    };
+
+    static void free_tag(void *, void *ptr, CRYPTO_EX_DATA *, int, long,
+                         void *) {
+        delete static_cast<Tag *>(ptr);
+    }
+
+    static int tag_index() {
+        static int index =
+                SSL_get_ex_new_index(0, nullptr, nullptr, nullptr, free_tag);
+        return index;
+    }
+
+    std::mutex mutex_;
+    std::map<std::string, Entry> all_;
+    uint64_t clock_ = 0;
+};
+
+/*!
+    \brief Immutable trust store (`X509_STORE *`) loaded from a CA bundle.
+
+    Parsing a CA bundle takes many milliseconds, because it contains hundreds
+    of certificates, so we parse each bundle once and share the resulting
+    `X509_STORE *` among all the `SSL_CTX *` using it, in all threads. This
+    is safe because we never modify a store after loading it and OpenSSL
+    locks a store internally when using it to verify certificates.
+*/
+class TrustStore : public NonCopyable, public NonMovable {
+  public:
+    /// Returns the wrapped `X509_STORE *`.
+    X509_STORE *x509_store() const { return store_; }
+
+    /// Returns true if the CA bundle has changed after we loaded it. If
+    /// the CA bundle cannot be accessed anymore, we keep using the store.
+    bool is_stale() const {
+        struct stat st;
+        if (stat(path_.c_str(), &st) != 0) {
+            return false;
+        }
+        return st.st_mtime != mtime_ || st.st_size != size_;
+    }
+
+    /// Destructor.
+    ~TrustStore() { X509_STORE_free(store_); }
+
+    /*!
+        \brief Loads a trust store from \p ca_bundle_path.
+
+        \return An error on failure or a `SharedPtr` wrapping a
+        TrustStore instance on success.
+    */
+    template <MK_MOCK(X509_STORE_load_locations)>
+    static ErrorOr<SharedPtr<TrustStore>> load(
+            std::string ca_bundle_path, SharedPtr<Logger> logger) {
+        logger->debug("ssl: loading trust store from: '%s'",
+                ca_bundle_path.c_str());
+        SharedPtr<TrustStore> trust_store{new TrustStore};
+        trust_store->path_ = ca_bundle_path;
+        struct stat st;
+        if (stat(ca_bundle_path.c_str(), &st) != 0) {
+            logger->warn("ssl: cannot stat: '%s'", ca_bundle_path.c_str());
+            return {SslCtxLoadVerifyLocationsError(), {}};
+        }
+        trust_store->mtime_ = st.st_mtime;
+        trust_store->size_ = st.st_size;
+        trust_store->store_ = X509_STORE_new();
+        if (trust_store->store_ == nullptr) {
+            logger->warn("ssl: failed to create X509_STORE");
+            return {SslCtxLoadVerifyLocationsError(), {}};
+        }
+        if (!X509_STORE_load_locations(
+                    trust_store->store_, ca_bundle_path.c_str(), nullptr)) {
+            logger->warn("ssl: failed to load verify location");
+            return {SslCtxLoadVerifyLocationsError(), {}};
+        }
+        return {NoError(), trust_store};
+    }
+
+  private:
+    TrustStore() {}
+    X509_STORE *store_ = nullptr;
+    std::string path_;
+    time_t mtime_ = 0;
+    off_t size_ = 0;
+};
+
+/*!
+    \brief Thread-safe registry of trust stores, indexed by CA bundle path.
+
+    \remark You SHOULD use the process-wide registry returned by global(),
+    while you can create other instances for testing.
+*/
+class TrustStoreRegistry : public NonCopyable, public NonMovable {
+  public:
+    /// Returns the process-wide registry.
+    static TrustStoreRegistry &global() {
+        static TrustStoreRegistry registry;
+        return registry;
+    }
+
+    /*!
+        \brief Returns the trust store for \p ca_bundle_path, loading it
+        if we did not load it before or if the CA bundle has changed (i.e.
+        its modification time or size is different) after we loaded it.
+
+        \remark Since we hold the lock while loading, threads needing the
+        same CA bundle wait for the first one to load it, rather than
+        loading it concurrently.
+    */
+    template <MK_MOCK(X509_STORE_load_locations)>
+    ErrorOr<SharedPtr<TrustStore>> get(
+            std::string ca_bundle_path, SharedPtr<Logger> logger) {
+        std::unique_lock<std::mutex> _{mutex_};
+        auto it = all_.find(ca_bundle_path);
+        if (it != all_.end() && !it->second->is_stale()) {
+            return {NoError(), it->second};
+        }
+        ErrorOr<SharedPtr<TrustStore>> maybe_store =
+                TrustStore::load<X509_STORE_load_locations>(
+                        ca_bundle_path, logger);
+        if (!maybe_store) {
+            return maybe_store;
+        }
+        all_[ca_bundle_path] = *maybe_store;
+        return maybe_store;
+    }
+
+    /// Returns the number of trust stores.
+    size_t size() {
+        std::unique_lock<std::mutex> _{mutex_};
+        return all_.size();
+    }
+
+  private:
+    std::mutex mutex_;
+    std::map<std::string, SharedPtr<TrustStore>> all_;
+};
+
+/// Returns the process-wide trust store for \p ca_bundle_path.
+static inline ErrorOr<SharedPtr<TrustStore>> get_trust_store(
+        std::string ca_bundle_path, SharedPtr<Logger> logger) {
+    return TrustStoreRegistry::global().get(ca_bundle_path, logger);
+}
+
 /*!
     \brief Wrapper for SSL context (`SSL_CTX *`).
 
@@ -125,7 +440,7 @@ class Context : public NonCopyable, public NonMovable {
         false in a boolean context) or a `SharedPtr` shared pointer wrapping a
         Context instance on success.
     */
-    template <MK_MOCK(SSL_CTX_new), MK_MOCK(SSL_CTX_load_verify_locations)>
+    template <MK_MOCK(SSL_CTX_new), MK_MOCK(get_trust_store)>
     static ErrorOr<SharedPtr<Context>> make(
             std::string ca_bundle_path, SharedPtr<Logger> logger) {
         // Implementation note: we need to initialize libssl early otherwise
@@ -149,26 +464,45 @@ class Context : public NonCopyable, public NonMovable {
          * [1] https://wiki.openssl.org/index.php/Manual:SSL_CTX_new(3)
          */
         SSL_CTX_set_options(ctx, SSL_OP_NO_SSLv2 | SSL_OP_NO_SSLv3);
-        if (ca_bundle_path != "") {
-            if (!SSL_CTX_load_verify_locations(
-                        ctx, ca_bundle_path.c_str(), nullptr)) {
-                logger->warn("ssl: failed to load verify location");
-                SSL_CTX_free(ctx);
-                return {SslCtxLoadVerifyLocationsError(), {}};
-            }
-        } else {
+        if (ca_bundle_path == "") {
             SSL_CTX_free(ctx);
             return {MissingCaBundlePathError(), {}};
         }
+        ErrorOr<SharedPtr<TrustStore>> trust_store =
+                get_trust_store(ca_bundle_path, logger);
+        if (!trust_store) {
+            SSL_CTX_free(ctx);
+            return {trust_store.as_error(), {}};
+        }
+        // The SSL_CTX takes ownership of a reference to the store
+        X509_STORE *store = (*trust_store)->x509_store();
+#if OPENSSL_VERSION_NUMBER < 0x10100000L && !defined(LIBRESSL_VERSION_NUMBER)
+        CRYPTO_add(&store->references, 1, CRYPTO_LOCK_X509_STORE);
+#else
+        X509_STORE_up_ref(store);
+#endif
+        SSL_CTX_set_cert_store(ctx, store);
         SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER, nullptr);
+        // We manage client sessions ourselves, see SessionCache.
+        SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT |
+                                            SSL_SESS_CACHE_NO_INTERNAL_STORE);
+        SSL_CTX_sess_set_new_cb(ctx, SessionCache::on_new_session);
         SharedPtr<Context> context{new Context};
         context->ctx_ = ctx;
+        context->trust_store_ = *trust_store;
         return {NoError(), context};
     }
 
+    /// Returns true if the trust store used by this context is stale,
+    /// meaning that new connections should use a new context.
+    bool is_stale() const {
+        return !!trust_store_ && trust_store_->is_stale();
+    }
+
   private:
     Context() {}
     SSL_CTX *ctx_ = nullptr;
+    SharedPtr<TrustStore> trust_store_;
 };
 
 /*!
@@ -197,6 +531,11 @@ template <size_t max_cache_size = 64> class Cache {
         seem to be an over-assumption (see above for links), I decided to stay
         on the safe side an make the cache thread local.
 
+        The exception is the trust store, which is expensive to load and
+        which is shared by all threads (see TrustStore), so creating a
+        `SSL_CTX *` in a new thread is cheap. When the CA bundle changes, we
+        replace the cached `SSL_CTX *` with one using the new store.
+
         After #1297 is merged, this means that every "big" task (i.e. a test,
         orchestration, etc) will use its own thread local cache.
 
@@ -266,7 +605,8 @@ template <size_t max_cache_size = 64> class Cache {
             logger->warn("ssl: hit hard limit of maximum cached SSL_CTX");
             all_.clear();
         }
-        if (all_.count(ca_bundle_path) == 0) {
+        if (all_.count(ca_bundle_path) == 0 ||
+            all_[ca_bundle_path]->is_stale()) {
             ErrorOr<SharedPtr<Context>> maybe_context =
                     mkctx(ca_bundle_path, logger);
             if (!maybe_context) {
@@ -279,14 +619,65 @@ template <size_t max_cache_size = 64> class Cache {
         return context->get_client_ssl(hostname, logger);
     }
 
+    /*!
+        \brief Like the above factory but also resumes TLS sessions.
+
+        \param port The port to which we are connecting.
+
+        \param resume Whether to offer a session that we have previously
+        saved for the same server, if any, and to save the sessions that the
+        server gives us. Disable for measurements that must always perform
+        a full handshake.
+
+        \remark Sessions are saved for the combination of \p hostname,
+        \p port, SNI (currently the same as \p hostname) and
+        \p ca_bundle_path, so we never resume a session established with
+        a different server name or trust store.
+    */
+    template <MK_MOCK(mkctx)>
+    ErrorOr<SSL *> get_client_ssl(std::string ca_bundle_path,
+            std::string hostname, int port, bool resume,
+            SharedPtr<Logger> logger) {
+        ErrorOr<SSL *> maybe_ssl =
+                get_client_ssl<mkctx>(ca_bundle_path, hostname, logger);
+        if (!maybe_ssl || !resume) {
+            return maybe_ssl;
+        }
+        std::string key = session_key(ca_bundle_path, hostname, port, hostname);
+        SSL_SESSION *session = sessions_->take(key);
+        if (session != nullptr) {
+            logger->debug("ssl: offering saved session for %s:%d",
+                          hostname.c_str(), port);
+            SSL_set_session(*maybe_ssl, session);
+            SSL_SESSION_free(session);
+        }
+        SessionCache::track(sessions_, *maybe_ssl, key);
+        return maybe_ssl;
+    }
+
+    /// Return the key used to save sessions
+    static std::string session_key(const std::string &ca_bundle_path,
+            const std::string &hostname, int port, const std::string &sni) {
+        std::string key = hostname;
+        key += ":" + std::to_string(port);
+        // Use NUL as separator since it cannot appear in names or paths
+        key += std::string(1, '\0') + sni;
+        key += std::string(1, '\0') + ca_bundle_path;
+        return key;
+    }
+
     /// Return number of cached SSL_CTX
     size_t size() const { return all_.size(); }
 
+    /// Return the cache of TLS sessions
+    SessionCache &sessions() { return *sessions_; }
+
     /// Constructor
     Cache() {}
 
   private:
     std::map<std::string, SharedPtr<Context>> all_;
+    SharedPtr<SessionCache> sessions_{new SessionCache};
 };
 
 /*!
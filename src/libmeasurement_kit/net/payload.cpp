@@ -0,0 +1,96 @@
+// Part of Measurement Kit <https://measurement-kit.github.io/>.
+// Measurement Kit is free software under the BSD license. See AUTHORS
+// and LICENSE for more information on the copying conditions.
+
+#include "src/libmeasurement_kit/net/payload.hpp"
+
+#include <event2/buffer.h>
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <stdexcept>
+
+namespace mk {
+namespace net {
+
+// Returns a segment of an anonymous in-memory file containing `data`.
+static evbuffer_file_segment *make_file_segment(const std::string &data) {
+#if defined __linux__ && defined SYS_memfd_create
+    // Using syscall() because older libcs do not wrap memfd_create()
+    constexpr unsigned int mfd_cloexec = 1U;
+    int fd = (int)syscall(SYS_memfd_create, "mk-payload", mfd_cloexec);
+    if (fd == -1) {
+        return nullptr;
+    }
+    size_t off = 0;
+    while (off < data.size()) {
+        ssize_t n = ::write(fd, data.data() + off, data.size() - off);
+        if (n <= 0) {
+            ::close(fd);
+            return nullptr;
+        }
+        off += (size_t)n;
+    }
+    evbuffer_file_segment *segment = evbuffer_file_segment_new(
+            fd, 0, (ev_off_t)data.size(), EVBUF_FS_CLOSE_ON_FREE);
+    if (segment == nullptr) {
+        ::close(fd);
+    }
+    return segment;
+#else
+    (void)data;
+    return nullptr;
+#endif
+}
+
+/*static*/ SharedPtr<Payload> Payload::make(std::string data,
+                                            bool file_backed) {
+    SharedPtr<Payload> payload{new Payload};
+    payload->size_ = data.size();
+    if (file_backed && !data.empty()) {
+        payload->segment_ = make_file_segment(data);
+        if (payload->segment_ != nullptr) {
+            return payload;
+        }
+    }
+    payload->data_ = SharedPtr<std::string>::make(std::move(data));
+    return payload;
+}
+
+Payload::~Payload() {
+    // The segment is reference counted and lives as long as there are
+    // evbuffer chains still sending it
+    if (segment_ != nullptr) {
+        evbuffer_file_segment_free(segment_);
+    }
+}
+
+void Payload::add_to(evbuffer *dest) {
+    if (size_ == 0) {
+        return;
+    }
+    if (segment_ != nullptr) {
+        if (evbuffer_add_file_segment(dest, segment_, 0,
+                                      (ev_off_t)size_) != 0) {
+            throw std::runtime_error("evbuffer_add_file_segment failed");
+        }
+        return;
+    }
+    // Each chain keeps the data alive until libevent has sent it
+    auto ref = new SharedPtr<std::string>{data_};
+    if (evbuffer_add_reference(dest, ref->get()->data(), size_,
+                               [](const void *, size_t, void *opaque) {
+                                   delete static_cast<SharedPtr<std::string> *>(
+                                           opaque);
+                               },
+                               ref) != 0) {
+        delete ref;
+        throw std::runtime_error("evbuffer_add_reference failed");
+    }
+}
+
+} // namespace net
+} // namespace mk
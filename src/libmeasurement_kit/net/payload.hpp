@@ -0,0 +1,59 @@
+// Part of Measurement Kit <https://measurement-kit.github.io/>.
+// Measurement Kit is free software under the BSD license. See AUTHORS
+// and LICENSE for more information on the copying conditions.
+#ifndef SRC_LIBMEASUREMENT_KIT_NET_PAYLOAD_HPP
+#define SRC_LIBMEASUREMENT_KIT_NET_PAYLOAD_HPP
+
+#include "src/libmeasurement_kit/common/non_copyable.hpp"
+#include "src/libmeasurement_kit/common/non_movable.hpp"
+#include "src/libmeasurement_kit/net/buffer.hpp"
+
+struct evbuffer_file_segment; /* Forward declaration */
+
+namespace mk {
+namespace net {
+
+/*!
+    \brief Immutable data that is sent many times, e.g. the synthetic
+    payload of an upload test.
+
+    Writing a Payload does not copy it. The data is either referenced by
+    the evbuffer chains that send it or, when the payload is file backed,
+    lives in an anonymous in-memory file that the kernel sends using
+    sendfile() when the transport writes directly to a socket. In all the
+    other cases (e.g. SSL) libevent maps the file in memory.
+
+    \remark Since file backed payloads use memfd_create(), they are only
+    available on Linux. Elsewhere, or if creating the file fails, make()
+    falls back to keeping the payload in memory.
+*/
+class Payload : public NonCopyable, public NonMovable {
+  public:
+    /// Creates a payload, file backed if \p file_backed and possible.
+    static SharedPtr<Payload> make(std::string data, bool file_backed = false);
+
+    ~Payload();
+
+    /// Returns the size of the payload in bytes.
+    size_t size() const { return size_; }
+
+    /// Returns whether the payload is backed by an in-memory file.
+    bool file_backed() const { return segment_ != nullptr; }
+
+    /// Appends the payload to \p dest without copying it.
+    void add_to(evbuffer *dest);
+
+    /// Appends the payload to \p dest without copying it.
+    void add_to(Buffer &dest) { add_to(dest.evbuf.get()); }
+
+  private:
+    Payload() {}
+
+    size_t size_ = 0;
+    SharedPtr<std::string> data_;
+    evbuffer_file_segment *segment_ = nullptr;
+};
+
+} // namespace net
+} // namespace mk
+#endif
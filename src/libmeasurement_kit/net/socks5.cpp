@@ -3,6 +3,7 @@
 // and LICENSE for more information on the copying conditions.
 
 #include "src/libmeasurement_kit/net/socks5.hpp"
+#include "src/libmeasurement_kit/net/buffer_view.hpp"
 #include "src/libmeasurement_kit/net/connect_impl.hpp"
 
 #include "src/libmeasurement_kit/net/libevent_emitter.hpp"
@@ -30,16 +31,19 @@ Buffer socks5_format_auth_request(SharedPtr<Logger> logger) {
 }
 
 ErrorOr<bool> socks5_parse_auth_response(Buffer &buffer, SharedPtr<Logger> logger) {
-    auto readbuf = buffer.readn(2);
-    if (readbuf == "") {
+    BufferView view{buffer, 2};
+    if (view.length() < 2) {
         return {NoError(), false}; // Try again after next recv()
     }
-    logger->debug("socks5: << version=%d", readbuf[0]);
-    logger->debug("socks5: << preferred_auth=%d", readbuf[1]);
-    if (readbuf[0] != 5) {
+    uint8_t version = view.at(0);
+    uint8_t preferred_auth = view.at(1);
+    buffer.discard(2);
+    logger->debug("socks5: << version=%d", version);
+    logger->debug("socks5: << preferred_auth=%d", preferred_auth);
+    if (version != 5) {
         return {BadSocksVersionError(), {}};
     }
-    if (readbuf[1] != 0) {
+    if (preferred_auth != 0) {
         return {NoAvailableSocksAuthenticationError(), {}};
     }
     return {NoError(), true};
@@ -81,34 +85,33 @@ ErrorOr<Buffer> socks5_format_connect_request(Settings settings, SharedPtr<Logge
 }
 
 ErrorOr<bool> socks5_parse_connect_response(Buffer &buffer, SharedPtr<Logger> logger) {
-    if (buffer.length() < 5) {
+    BufferView peekbuf{buffer, 5};
+    if (peekbuf.length() < 5) {
         return {NoError(), false}; // Try again after next recv()
     }
 
-    auto peekbuf = buffer.peek(5);
+    logger->debug("socks5: << version=%d", peekbuf.at(0));
+    logger->debug("socks5: << reply=%d", peekbuf.at(1));
+    logger->debug("socks5: << reserved=%d", peekbuf.at(2));
+    logger->debug("socks5: << atype=%d", peekbuf.at(3));
 
-    logger->debug("socks5: << version=%d", peekbuf[0]);
-    logger->debug("socks5: << reply=%d", peekbuf[1]);
-    logger->debug("socks5: << reserved=%d", peekbuf[2]);
-    logger->debug("socks5: << atype=%d", peekbuf[3]);
-
-    if (peekbuf[0] != 5) {
+    if (peekbuf.at(0) != 5) {
         return {BadSocksVersionError(), {}};
     }
-    if (peekbuf[1] != 0) {
+    if (peekbuf.at(1) != 0) {
         return {SocksError(), {}}; // TODO: return actual error
     }
-    if (peekbuf[2] != 0) {
+    if (peekbuf.at(2) != 0) {
         return {BadSocksReservedFieldError(), {}};
     }
 
-    auto atype = peekbuf[3]; // Atype
+    auto atype = peekbuf.at(3); // Atype
 
     size_t total = 4; // Version .. Atype size
     if (atype == 1) {
         total += 4; // IPv4 addr size
     } else if (atype == 3) {
-        total += 1 + peekbuf[4]; // Len size + String size
+        total += 1 + peekbuf.at(4); // Len size + String size
     } else if (atype == 4) {
         total += 16; // IPv6 addr size
     } else {
@@ -164,14 +167,25 @@ void socks5_connect(std::string address, int port, Settings settings,
 }
 
 void Socks5::socks5_connect_() {
-    // Step #1: send out preferred authentication methods
+    // Step #1: send out preferred authentication methods. In optimistic
+    // mode we also send the connect request right away, since we only
+    // offer NO_AUTH, thus saving one round trip with the proxy. Errors
+    // are reported after the auth response, like in the normal flow.
 
     logger->debug("socks5: connected to Tor!");
-    conn->write(socks5_format_auth_request(logger));
+    Buffer out = socks5_format_auth_request(logger);
+    ErrorOr<bool> optimistic = settings.get_noexcept(
+            "net/socks5_optimistic", false);
+    ErrorOr<Buffer> request = socks5_format_connect_request(settings, logger);
+    bool request_sent = optimistic && *optimistic && request;
+    if (request_sent) {
+        out << *request;
+    }
+    conn->write(out);
 
     // Step #2: receive the allowed authentication methods
 
-    conn->on_data([this](Buffer d) {
+    conn->on_data([this, optimistic, request, request_sent](Buffer d) {
         buffer << d;
         ErrorOr<bool> result = socks5_parse_auth_response(buffer, logger);
         if (!result) {
@@ -184,45 +198,58 @@ void Socks5::socks5_connect_() {
 
         // Step #3: ask Tor to connect to remote host
 
-        ErrorOr<Buffer> out = socks5_format_connect_request(settings, logger);
-        if (!out) {
-            emit_error(out.as_error());
+        if (!optimistic) {
+            emit_error(optimistic.as_error());
+            return;
+        }
+        if (!request) {
+            emit_error(request.as_error());
             return;
         }
-        conn->write(*out);
+        if (!request_sent) {
+            conn->write(*request);
+        }
 
-        // Step #4: receive Tor's response
+        // Step #4: receive Tor's response, which in optimistic mode may
+        // have been received along with the auth response
 
         conn->on_data([this](Buffer d) {
             buffer << d;
-            ErrorOr<bool> rc = socks5_parse_connect_response(buffer, logger);
-            if (!rc) {
-                emit_error(rc.as_error());
-                return;
-            }
-            if (!*rc) {
-                return;
-            }
-
-            //
-            // Step #5: we are now connected
-            // Restore the original hooks
-            // Tell upstream we are connected
-            // If more data, pass it up
-            //
-
-            conn->on_data([this](Buffer d) { emit_data(d); });
-            conn->on_flush([this]() { emit_flush(); });
-
-            emit_connect();
-
-            // Note that emit_connect() may have called close()
-            if (!isclosed && buffer.length() > 0) {
-                emit_data(buffer);
-            }
+            socks5_handle_connect_response_();
         });
+        if (buffer.length() > 0) {
+            socks5_handle_connect_response_();
+        }
     });
 }
 
+void Socks5::socks5_handle_connect_response_() {
+    ErrorOr<bool> rc = socks5_parse_connect_response(buffer, logger);
+    if (!rc) {
+        emit_error(rc.as_error());
+        return;
+    }
+    if (!*rc) {
+        return;
+    }
+
+    //
+    // Step #5: we are now connected
+    // Restore the original hooks
+    // Tell upstream we are connected
+    // If more data, pass it up
+    //
+
+    conn->on_data([this](Buffer d) { emit_data(d); });
+    conn->on_flush([this]() { emit_flush(); });
+
+    emit_connect();
+
+    // Note that emit_connect() may have called close()
+    if (!isclosed && buffer.length() > 0) {
+        emit_data(buffer);
+    }
+}
+
 } // namespace net
 } // namespace mk
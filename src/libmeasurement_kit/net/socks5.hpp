@@ -24,11 +24,20 @@ class Socks5 : public Emitter {
 
     void clear_timeout() override { conn->clear_timeout(); }
 
+    void pause_reading() override { conn->pause_reading(); }
+
+    void resume_reading() override { conn->resume_reading(); }
+
   protected:
     void adjust_timeout(double) override { /* NOTHING */ }
 
     void start_writing() override { conn->write(output_buff); }
 
+    void start_writing_payload(SharedPtr<Payload> payload) override {
+        conn->write(output_buff);
+        conn->write(payload);
+    }
+
   public:
     void close(std::function<void()> callback) override {
         isclosed = true;
@@ -39,8 +48,11 @@ class Socks5 : public Emitter {
 
     std::string socks5_port() override { return proxy_port; }
 
+    ErrorOr<TcpInfo> tcp_info() override { return conn->tcp_info(); }
+
   protected:
     void socks5_connect_();
+    void socks5_handle_connect_response_();
 
     Settings settings;
     SharedPtr<Transport> conn;
@@ -55,6 +67,10 @@ ErrorOr<bool> socks5_parse_auth_response(Buffer &, SharedPtr<Logger>);
 ErrorOr<Buffer> socks5_format_connect_request(Settings, SharedPtr<Logger>);
 ErrorOr<bool> socks5_parse_connect_response(Buffer &, SharedPtr<Logger>);
 
+// Connects to `address` and `port` through the SOCKS5 proxy at the
+// "net/socks5_proxy" endpoint. When "net/socks5_optimistic" is true the
+// connect request is sent along with the greeting, saving one round trip,
+// which works with proxies that read requests in order (e.g. Tor).
 void socks5_connect(std::string address, int port, Settings settings,
         std::function<void(Error, SharedPtr<Transport>)> callback,
         SharedPtr<Reactor> reactor, SharedPtr<Logger> logger);
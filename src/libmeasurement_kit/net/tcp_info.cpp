@@ -0,0 +1,96 @@
+// Part of Measurement Kit <https://measurement-kit.github.io/>.
+// Measurement Kit is free software under the BSD license. See AUTHORS
+// and LICENSE for more information on the copying conditions.
+
+#include "src/libmeasurement_kit/net/tcp_info.hpp"
+#include "src/libmeasurement_kit/net/utils.hpp"
+
+#include <errno.h>
+#include <stddef.h>
+
+#ifdef __linux__
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#endif
+
+namespace mk {
+namespace net {
+
+#ifdef __linux__
+
+/*
+ * Linux's `struct tcp_info` up to `tcpi_sndbuf_limited`. We cannot use the
+ * libc's copy, which usually stops at `tcpi_total_retrans`, nor include
+ * <linux/tcp.h>, which clashes with <netinet/tcp.h>. New fields are only
+ * ever appended, so the layout is stable.
+ */
+struct LinuxTcpInfo {
+    uint8_t state, ca_state, retransmits, probes, backoff, options;
+    uint8_t wscale, app_limited;
+    uint32_t rto, ato, snd_mss, rcv_mss;
+    uint32_t unacked, sacked, lost, retrans, fackets;
+    uint32_t last_data_sent, last_ack_sent, last_data_recv, last_ack_recv;
+    uint32_t pmtu, rcv_ssthresh, rtt, rttvar, snd_ssthresh, snd_cwnd;
+    uint32_t advmss, reordering, rcv_rtt, rcv_space, total_retrans;
+    uint64_t pacing_rate, max_pacing_rate, bytes_acked, bytes_received;
+    uint32_t segs_out, segs_in, notsent_bytes, min_rtt;
+    uint32_t data_segs_in, data_segs_out;
+    uint64_t delivery_rate, busy_time, rwnd_limited, sndbuf_limited;
+};
+
+static_assert(offsetof(LinuxTcpInfo, total_retrans) ==
+                      offsetof(struct tcp_info, tcpi_total_retrans),
+              "LinuxTcpInfo does not match struct tcp_info");
+
+ErrorOr<TcpInfo> tcp_info_for_socket(evutil_socket_t fd) {
+    // Older kernels fill only part of the structure, and the missing
+    // fields keep the zero value they have been initialized with
+    LinuxTcpInfo ti{};
+    socklen_t len = sizeof(ti);
+    if (getsockopt(fd, IPPROTO_TCP, TCP_INFO, &ti, &len) != 0) {
+        return {map_errno(errno), {}};
+    }
+    TcpInfo info;
+    info.rtt = ti.rtt;
+    info.rttvar = ti.rttvar;
+    info.min_rtt = ti.min_rtt;
+    info.snd_cwnd = ti.snd_cwnd;
+    info.snd_mss = ti.snd_mss;
+    info.total_retrans = ti.total_retrans;
+    info.delivery_rate = ti.delivery_rate;
+    info.busy_time = ti.busy_time;
+    info.rwnd_limited = ti.rwnd_limited;
+    info.sndbuf_limited = ti.sndbuf_limited;
+    info.bytes_acked = ti.bytes_acked;
+    info.bytes_received = ti.bytes_received;
+    return {NoError(), info};
+}
+
+#else
+
+ErrorOr<TcpInfo> tcp_info_for_socket(evutil_socket_t) {
+    return {NotImplementedError(), {}};
+}
+
+#endif
+
+void to_json(nlohmann::json &j, const TcpInfo &info) {
+    j = nlohmann::json{
+            {"bytes_acked", info.bytes_acked},
+            {"bytes_received", info.bytes_received},
+            {"busy_time", info.busy_time},
+            {"delivery_rate", info.delivery_rate},
+            {"min_rtt", info.min_rtt},
+            {"rtt", info.rtt},
+            {"rttvar", info.rttvar},
+            {"rwnd_limited", info.rwnd_limited},
+            {"snd_cwnd", info.snd_cwnd},
+            {"snd_mss", info.snd_mss},
+            {"sndbuf_limited", info.sndbuf_limited},
+            {"total_retrans", info.total_retrans},
+    };
+}
+
+} // namespace net
+} // namespace mk
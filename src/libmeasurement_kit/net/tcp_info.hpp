@@ -0,0 +1,47 @@
+// Part of Measurement Kit <https://measurement-kit.github.io/>.
+// Measurement Kit is free software under the BSD license. See AUTHORS
+// and LICENSE for more information on the copying conditions.
+#ifndef SRC_LIBMEASUREMENT_KIT_NET_TCP_INFO_HPP
+#define SRC_LIBMEASUREMENT_KIT_NET_TCP_INFO_HPP
+
+#include "src/libmeasurement_kit/common/error_or.hpp"
+
+#include <measurement_kit/common/nlohmann/json.hpp>
+
+#include <event2/util.h>
+
+#include <stdint.h>
+
+namespace mk {
+namespace net {
+
+/*
+ * The kernel's view of a TCP connection, as returned by TCP_INFO. Times
+ * are in microseconds and rates in bytes per second. Fields the kernel
+ * does not know about (e.g. `delivery_rate` before Linux 4.9 and the
+ * `*_limited` times before Linux 4.10) are zero.
+ */
+class TcpInfo {
+  public:
+    uint64_t rtt = 0;
+    uint64_t rttvar = 0;
+    uint64_t min_rtt = 0;
+    uint64_t snd_cwnd = 0;       // In segments
+    uint64_t snd_mss = 0;        // In bytes
+    uint64_t total_retrans = 0;  // In segments
+    uint64_t delivery_rate = 0;
+    uint64_t busy_time = 0;
+    uint64_t rwnd_limited = 0;   // Sender limited by the receive window
+    uint64_t sndbuf_limited = 0; // Sender limited by the send buffer
+    uint64_t bytes_acked = 0;
+    uint64_t bytes_received = 0;
+};
+
+void to_json(nlohmann::json &, const TcpInfo &);
+
+// Samples TCP_INFO for the socket `fd`. Only implemented on Linux.
+ErrorOr<TcpInfo> tcp_info_for_socket(evutil_socket_t fd);
+
+} // namespace net
+} // namespace mk
+#endif
@@ -18,6 +18,7 @@ TransportSocks5::~TransportSocks5() {}
 TransportPollable::~TransportPollable() {}
 TransportConnectable::~TransportConnectable() {}
 TransportSockNamePeerName::~TransportSockNamePeerName() {}
+TransportTcpInfo::~TransportTcpInfo() {}
 Transport::~Transport() {}
 
 void write(SharedPtr<Transport> txp, Buffer buf, Callback<Error> cb) {
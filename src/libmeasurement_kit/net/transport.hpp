@@ -6,6 +6,7 @@
 
 #include "src/libmeasurement_kit/common/reactor.hpp"
 #include "src/libmeasurement_kit/net/buffer.hpp"
+#include "src/libmeasurement_kit/net/tcp_info.hpp"
 #include "src/libmeasurement_kit/net/utils.hpp"
 
 struct bufferevent; /* Forward declaration */
@@ -18,6 +19,8 @@ class ResolveHostnameResult; /* Forward declaration */
 
 namespace net {
 
+class Payload; /* Forward declaration */
+
 class TransportEmitter {
   public:
     virtual ~TransportEmitter();
@@ -54,6 +57,9 @@ class TransportWriter {
     virtual void write(const void *, size_t) = 0;
     virtual void write(std::string) = 0;
     virtual void write(Buffer) = 0;
+
+    // Writes a payload without copying it (see net/payload.hpp).
+    virtual void write(SharedPtr<Payload>) = 0;
 };
 
 class TransportSocks5 {
@@ -85,6 +91,12 @@ class TransportPollable {
     // we're using, a runtime exception will be raised.
     virtual void set_bufferevent(bufferevent *bev) = 0;
 
+    // `pause_reading` stops reading without unregistering the 'data'
+    // handler, e.g. while the reader is not ready for more data, and
+    // `resume_reading` starts reading again if a handler is registered.
+    virtual void pause_reading() = 0;
+    virtual void resume_reading() = 0;
+
     /*
      * This is the interface with the underlying I/O system. As such, it is
      * specified here, for clarity, but is also protected.
@@ -103,6 +115,18 @@ class TransportPollable {
     virtual void start_writing() = 0;
 };
 
+/*
+ * One connect() attempt made while establishing a connection. The times
+ * are in seconds; `start` is relative to when the first attempt started.
+ */
+class ConnectAttempt {
+  public:
+    std::string address;
+    double start = 0.0;
+    double elapsed = 0.0;
+    Error error;
+};
+
 class TransportConnectable {
   public:
     virtual ~TransportConnectable();
@@ -110,8 +134,15 @@ class TransportConnectable {
     virtual void set_connect_time_(double) = 0;
     virtual std::vector<Error> connect_errors() = 0;
     virtual void set_connect_errors_(std::vector<Error>) = 0;
+    virtual std::vector<ConnectAttempt> connect_attempts() = 0;
+    virtual void set_connect_attempts_(std::vector<ConnectAttempt>) = 0;
     virtual dns::ResolveHostnameResult dns_result() = 0;
     virtual void set_dns_result_(dns::ResolveHostnameResult) = 0;
+
+    // Whether the connection can carry another request. The application
+    // protocol sets this after each exchange (see http::request_close()).
+    virtual bool reusable() = 0;
+    virtual void set_reusable_(bool) = 0;
 };
 
 class TransportSockNamePeerName {
@@ -121,13 +152,24 @@ class TransportSockNamePeerName {
     virtual Endpoint peername() = 0;
 };
 
+class TransportTcpInfo {
+  public:
+    virtual ~TransportTcpInfo();
+
+    // Samples the kernel's view of the underlying TCP connection. Fails
+    // if the transport is not attached to a socket or on systems other
+    // than Linux.
+    virtual ErrorOr<TcpInfo> tcp_info() = 0;
+};
+
 class Transport : public TransportEmitter,
                   public TransportRecorder,
                   public TransportWriter,
                   public TransportSocks5,
                   public TransportPollable,
                   public TransportConnectable,
-                  public TransportSockNamePeerName {
+                  public TransportSockNamePeerName,
+                  public TransportTcpInfo {
   public:
     virtual ~Transport();
 };
@@ -5,6 +5,7 @@
 #include "src/libmeasurement_kit/common/fmap.hpp"
 #include "src/libmeasurement_kit/common/parallel.hpp"
 #include "src/libmeasurement_kit/common/range.hpp"
+#include "src/libmeasurement_kit/common/secure_random.hpp"
 #include "src/libmeasurement_kit/nettests/runnable.hpp"
 
 #include "src/libmeasurement_kit/common/utils.hpp"
@@ -16,7 +17,6 @@
 #include "src/libmeasurement_kit/report/ooni_reporter.hpp"
 
 #include <measurement_kit/internal/vendor/mkmmdb.hpp>
-#include <measurement_kit/internal/vendor/mkuuid4.hpp>
 
 #ifndef MK_WITHOUT_CURL
 #include <measurement_kit/internal/vendor/mkiplookup.hpp>
@@ -104,7 +104,7 @@ void Runnable::run_next_measurement(size_t thread_id, Callback<Error> cb,
         entry["measurement_start_time"] =
             *mk::timestamp(&measurement_start_time);
         entry["test_runtime"] = mk::time_now() - start_time;
-        entry["id"] = mk::uuid4::gen();
+        entry["id"] = secure_random_uuid4();
 
         // Until we have support for passing options, leave it empty
         entry["options"] = nlohmann::json::array();
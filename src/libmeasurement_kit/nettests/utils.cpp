@@ -4,6 +4,8 @@
 
 #include "src/libmeasurement_kit/nettests/utils_impl.hpp"
 
+#include "src/libmeasurement_kit/common/secure_random.hpp"
+
 namespace mk {
 namespace nettests {
 
@@ -17,9 +19,7 @@ bool readline_(std::istream &input, std::string &line) {
 
 void randomize_input_(std::deque<std::string> &inputs) {
     // See http://en.cppreference.com/w/cpp/algorithm/shuffle
-    std::random_device rd;
-    std::mt19937 g(rd());
-    std::shuffle(inputs.begin(), inputs.end(), g);
+    std::shuffle(inputs.begin(), inputs.end(), secure_random());
 }
 
 Error process_input_filepaths(std::deque<std::string> &input,
@@ -55,12 +55,12 @@
 #include "src/libmeasurement_kit/neubot/dash.hpp"
 
 #include "src/libmeasurement_kit/common/mock.hpp"
+#include "src/libmeasurement_kit/common/secure_random.hpp"
 #include "src/libmeasurement_kit/common/utils.hpp"
 #include "src/libmeasurement_kit/mlabns/mlabns.hpp"
 #include "src/libmeasurement_kit/http/http.hpp"
 
 #include <measurement_kit/common/nlohmann/json.hpp>
-#include <measurement_kit/internal/vendor/mkuuid4.hpp>
 
 #define DASH_INITIAL_RATE 3000
 #define DASH_MAX_ITERATIONS 15
@@ -326,6 +326,19 @@ void run_loop_(SharedPtr<DashLoopCtx> ctx) {
                                * 0.004016009: last Neubot version.
                                */
                               {"version", "0.007001000"}});
+                        /*
+                         * Also sample the kernel's view of the connection, to
+                         * tell whether the client or the network limited
+                         * the download. We keep the samples out of the
+                         * `receiver_data` that we send to the server.
+                         */
+                        ErrorOr<net::TcpInfo> tcp_info = ctx->txp->tcp_info();
+                        if (tcp_info) {
+                            nlohmann::json sample = *tcp_info;
+                            sample["elapsed"] = time_elapsed;
+                            sample["iteration"] = ctx->iteration;
+                            (*ctx->entry)["tcp_info"].push_back(sample);
+                        }
                         double speed = length / time_elapsed;
                         double s_k = (speed * 8) / 1000;
                         std::stringstream ss;
@@ -376,7 +389,7 @@ void run_impl(std::string url, std::string auth_token, std::string real_address,
     // a specific UUID has been removed and we generate a random new UUID
     // each time we run a new DASH test.
     //
-    ctx->uuid = mk::uuid4::gen();
+    ctx->uuid = mk::secure_random_uuid4();
     ctx->server_url = url;
     settings["http/url"] = url;
     settings["http/method"] = "GET";
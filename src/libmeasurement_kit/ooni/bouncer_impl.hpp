@@ -67,6 +67,15 @@ void post_net_tests_impl(std::string base_bouncer_url, std::string test_name,
     std::string bm = "POST";
     settings["http/url"] = bbu;
     settings["http/method"] = bm;
+    if (settings.find("http/keep_alive") == settings.end()) {
+        settings["http/keep_alive"] = true;
+    }
+    if (settings.find("dns/cache") == settings.end()) {
+        settings["dns/cache"] = "process";
+    }
+    if (settings.find("net/happy_eyeballs_delay") == settings.end()) {
+        settings["net/happy_eyeballs_delay"] = 0.25;
+    }
 
     http_request(settings, {{"Content-Type", "application/json"}},
                  request.dump(),
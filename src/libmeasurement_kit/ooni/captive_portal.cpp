@@ -160,7 +160,7 @@ static void http_many(SharedPtr<nlohmann::json> entry, Callback<Error> all_done_
                     http_cb(input, done_cb), reactor, logger);
         });
     }
-    mk::parallel(continuations, all_done_cb, 3);
+    mk::parallel(std::move(continuations), all_done_cb, 3);
 }
 
 static void dns_msft_ncsi(SharedPtr<nlohmann::json> entry, Callback<Error> done_cb,
@@ -206,51 +206,36 @@ static void dns_random_hostnames(size_t count, size_t length,
     // (true means unfiltered)
     (*entry)["vendor_dns_tests"]["google_dns_cp"]["result"] = true;
     (*entry)["vendor_dns_tests"]["google_dns_cp"]["addresses"] = nlohmann::json::array();
-    SharedPtr<size_t> names_tested(new size_t(0));
 
-    auto dns_cb = [=](std::string hostname) {
-        return [=](Error err, SharedPtr<dns::Message> message) {
-            if (!!err) {
-                if ((err == mk::dns::NotExistError()) ||
-                        (err == mk::dns::
-                                        HostOrServiceNotProvidedOrNotKnownError())) {
-                    logger->info("%s: NXDOMAIN", hostname.c_str());
-                } else {
-                    logger->info("%s", err.what());
-                    logger->info("captive_portal: dns error for %s",
-                            hostname.c_str());
-                }
+    auto dns_cb = [=](const dns::BulkResult &result) {
+        std::string hostname = result.query.name;
+        Error err = result.error;
+        if (!!err) {
+            if ((err == mk::dns::NotExistError()) ||
+                    (err == mk::dns::
+                                    HostOrServiceNotProvidedOrNotKnownError())) {
+                logger->info("%s: NXDOMAIN", hostname.c_str());
             } else {
-                for (auto answer : message->answers) {
-                    if ((answer.ipv4 != "")) {
-                        (*entry)["vendor_dns_tests"]["google_dns_cp"]
-                                ["result"] = false;
-                        logger->info("%s: %s", hostname.c_str(),
-                                answer.ipv4.c_str());
-                        (*entry)["vendor_dns_tests"]["google_dns_cp"]
-                                ["addresses"]
-                                        .push_back(answer.ipv4.c_str());
-                    } else {
-                        // XXX not sure how to treat blank answers
-                        logger->info("%s: blank", hostname.c_str());
-                    }
-                }
+                logger->info("%s", err.what());
+                logger->info("captive_portal: dns error for %s",
+                        hostname.c_str());
             }
-            *names_tested += 1;
-            assert(*names_tested <= count);
-            if (count == *names_tested) {
-                if ((*entry)["vendor_dns_tests"]["google_dns_cp"]["addresses"]
-                                .empty()) {
-                    logger->info(
-                            "all returned NXDOMAIN; we call this unfiltered");
+        } else {
+            for (auto answer : result.message->answers) {
+                if ((answer.ipv4 != "")) {
+                    (*entry)["vendor_dns_tests"]["google_dns_cp"]
+                            ["result"] = false;
+                    logger->info("%s: %s", hostname.c_str(),
+                            answer.ipv4.c_str());
+                    (*entry)["vendor_dns_tests"]["google_dns_cp"]
+                            ["addresses"]
+                                    .push_back(answer.ipv4.c_str());
                 } else {
-                    logger->info("unexpectedly resolved something random: "
-                                 "evidence of filtering");
+                    // XXX not sure how to treat blank answers
+                    logger->info("%s: blank", hostname.c_str());
                 }
-                done_cb(NoError());
-                return;
             }
-        };
+        }
     };
 
     std::vector<std::string> hostnames = {};
@@ -259,13 +244,22 @@ static void dns_random_hostnames(size_t count, size_t length,
                 mk::random_str_lower_alpha(length) + mk::random_tld());
     }
 
-    for (auto const &hostname : hostnames) {
-        // Note: we're passing in an empty nameserver, which rests on the
-        // assumption that we're using the `system` DNS resolver.
-        constexpr const char *nameserver = "";
-        templates::dns_query(entry, "A", "IN", hostname, nameserver,
-                dns_cb(hostname), options, reactor, logger);
-    }
+    // Note: we're passing in an empty nameserver, which rests on the
+    // assumption that we're using the `system` DNS resolver.
+    constexpr const char *nameserver = "";
+    templates::dns_query_many(entry, "A", "IN", hostnames, nameserver, dns_cb,
+            [=](std::vector<dns::BulkResult>) {
+                if ((*entry)["vendor_dns_tests"]["google_dns_cp"]["addresses"]
+                                .empty()) {
+                    logger->info(
+                            "all returned NXDOMAIN; we call this unfiltered");
+                } else {
+                    logger->info("unexpectedly resolved something random: "
+                                 "evidence of filtering");
+                }
+                done_cb(NoError());
+            },
+            options, reactor, logger);
 }
 
 void captiveportal(std::string /*input*/, Settings options,
@@ -51,6 +51,15 @@ void connect(Settings settings, Callback<Error, SharedPtr<Transport>> callback,
     connect_impl(settings, callback, reactor, logger);
 }
 
+void disconnect(SharedPtr<Transport> txp, Settings settings, Callback<> callback,
+                SharedPtr<Reactor> reactor, SharedPtr<Logger> logger) {
+    if (connect_settings(settings) != NoError()) {
+        txp->close(callback);
+        return;
+    }
+    http::request_close(txp, settings, callback, reactor, logger);
+}
+
 void create_report(SharedPtr<Transport> transport, nlohmann::json entry,
                    Callback<Error, std::string> callback, Settings settings,
                    SharedPtr<Reactor> reactor, SharedPtr<Logger> logger) {
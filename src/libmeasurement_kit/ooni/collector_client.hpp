@@ -39,6 +39,11 @@ void submit_report(std::string filepath, std::string collector_base_url,
 void connect(Settings, Callback<Error, SharedPtr<net::Transport>>,
              SharedPtr<Reactor>, SharedPtr<Logger>);
 
+// Closes a connection opened using connect() or, if we're using HTTP
+// keep-alive, keeps it open such that connect() can reuse it.
+void disconnect(SharedPtr<net::Transport>, Settings, Callback<>,
+                SharedPtr<Reactor>, SharedPtr<Logger>);
+
 void create_report(SharedPtr<net::Transport>, nlohmann::json,
                    Callback<Error, std::string>, Settings,
                    SharedPtr<Reactor>, SharedPtr<Logger>);
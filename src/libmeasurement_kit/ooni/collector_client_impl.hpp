@@ -100,13 +100,14 @@ Error valid_entry(nlohmann::json entry);
       |_|
 */
 
-template <MK_MOCK_AS(http::request_connect, http_request_connect)>
-void connect_impl(Settings settings, Callback<Error, SharedPtr<Transport>> callback,
-                  SharedPtr<Reactor> reactor, SharedPtr<Logger> logger) {
+// Adds to `settings` what we need to connect to the collector. Since we
+// submit each measurement separately, we use HTTP keep-alive and cache the
+// collector address unless the caller has explicitly disabled them. We also
+// use Happy Eyeballs, since this connection is not a measurement.
+static inline Error connect_settings(Settings &settings) {
     std::string url;
     if (settings.find("collector_base_url") == settings.end()) {
-        callback(MissingCollectorBaseUrlError(), nullptr);
-        return;
+        return MissingCollectorBaseUrlError();
     }
     if (settings.find("collector_front_domain") != settings.end()) {
         mk::http::Url base_url = mk::http::parse_url(settings["collector_base_url"]);
@@ -117,6 +118,26 @@ void connect_impl(Settings settings, Callback<Error, SharedPtr<Transport>> callb
         url = settings["collector_base_url"];
     }
     settings["http/url"] = url;
+    if (settings.find("http/keep_alive") == settings.end()) {
+        settings["http/keep_alive"] = true;
+    }
+    if (settings.find("dns/cache") == settings.end()) {
+        settings["dns/cache"] = "process";
+    }
+    if (settings.find("net/happy_eyeballs_delay") == settings.end()) {
+        settings["net/happy_eyeballs_delay"] = 0.25;
+    }
+    return NoError();
+}
+
+template <MK_MOCK_AS(http::request_connect, http_request_connect)>
+void connect_impl(Settings settings, Callback<Error, SharedPtr<Transport>> callback,
+                  SharedPtr<Reactor> reactor, SharedPtr<Logger> logger) {
+    Error err = connect_settings(settings);
+    if (err) {
+        callback(err, nullptr);
+        return;
+    }
     http_request_connect(settings, callback, reactor, logger);
 }
 
@@ -185,9 +206,9 @@ void connect_and_create_report_impl(nlohmann::json entry,
             return;
         }
         collector_create_report(txp, entry, [=](Error error, std::string rid) {
-            txp->close([=]() {
+            disconnect(txp, settings, [=]() {
                 callback(error, rid);
-            });
+            }, reactor, logger);
         }, settings, reactor, logger);
     }, reactor, logger);
 }
@@ -244,9 +265,9 @@ void connect_and_update_report_impl(std::string report_id, nlohmann::json entry,
             return;
         }
         collector_update_report(txp, report_id, entry, [=](Error error) {
-            txp->close([=]() {
+            disconnect(txp, settings, [=]() {
                 callback(error);
-            });
+            }, reactor, logger);
         }, settings, reactor, logger);
     }, reactor, logger);
 }
@@ -274,9 +295,9 @@ void connect_and_close_report_impl(std::string report_id,
             return;
         }
         collector_close_report(txp, report_id, [=](Error error) {
-            txp->close([=]() {
+            disconnect(txp, settings, [=]() {
                 callback(error);
-            });
+            }, reactor, logger);
         }, settings, reactor, logger);
     }, reactor, logger);
 }
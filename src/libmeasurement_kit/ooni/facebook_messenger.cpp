@@ -59,46 +59,39 @@ dns_many(Error error, SharedPtr<nlohmann::json> entry, Settings options, SharedP
         return;
     }
 
-    size_t names_count = FB_SERVICE_HOSTNAMES.size();
-    if (names_count == 0) {
-        cb(NoError(), entry, fb_service_ips, options, reactor, logger);
-        return;
+    std::vector<std::string> services;
+    std::vector<std::string> hostnames;
+    for (auto const &service_and_hostname : FB_SERVICE_HOSTNAMES) {
+        services.push_back(service_and_hostname.first);
+        hostnames.push_back(service_and_hostname.second);
     }
-    SharedPtr<size_t> names_tested(new size_t(0));
 
-    auto dns_cb = [=](std::string service, std::string hostname) {
-        return [=](Error err, SharedPtr<dns::Message> message) {
-            if (!!err) {
-                logger->info("fb_messenger: dns error for %s, %s",
-                             service.c_str(), hostname.c_str());
-            } else {
-                for (auto answer : message->answers) {
-                    if (answer.ipv4 != "") {
-                        logger->info("got ip %s for service %s",
-                            answer.ipv4.c_str(), service.c_str());
-                        (*fb_service_ips)[service].push_back(answer.ipv4);
-                    }
+    auto dns_cb = [=](const dns::BulkResult &result) {
+        std::string hostname = result.query.name;
+        std::string service = services[result.index];
+        if (!!result.error) {
+            logger->info("fb_messenger: dns error for %s, %s",
+                         service.c_str(), hostname.c_str());
+        } else {
+            for (auto answer : result.message->answers) {
+                if (answer.ipv4 != "") {
+                    logger->info("got ip %s for service %s",
+                        answer.ipv4.c_str(), service.c_str());
+                    (*fb_service_ips)[service].push_back(answer.ipv4);
                 }
             }
-            *names_tested += 1;
-            assert(*names_tested <= names_count);
-            if (names_count == *names_tested) {
-                cb(NoError(), entry, fb_service_ips, options, reactor, logger);
-                return;
-            }
-        };
+        }
     };
 
-    for (auto const &service_and_hostname : FB_SERVICE_HOSTNAMES) {
-        std::string service = service_and_hostname.first;
-        std::string hostname = service_and_hostname.second;
-        // Note: we're passing in an empty nameserver, which rests on the
-        // assumption that we're using the `system` DNS resolver.
-        constexpr const char *nameserver = "";
-        templates::dns_query(entry, "A", "IN", hostname, nameserver,
-                             dns_cb(service, hostname), options, reactor,
-                             logger);
-    }
+    // Note: we're passing in an empty nameserver, which rests on the
+    // assumption that we're using the `system` DNS resolver.
+    constexpr const char *nameserver = "";
+    templates::dns_query_many(entry, "A", "IN", hostnames, nameserver, dns_cb,
+                              [=](std::vector<dns::BulkResult>) {
+                                  cb(NoError(), entry, fb_service_ips, options,
+                                     reactor, logger);
+                              },
+                              options, reactor, logger);
 }
 
 static void
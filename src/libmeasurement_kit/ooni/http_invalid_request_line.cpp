@@ -51,9 +51,8 @@ static void send_receive_invalid_request_line(std::string subtestName,
         });
         txp->write(request_line);
 
-        // We assume to have received all the data after a timeout
-        // of 5 seconds.
-        reactor->call_later(timeout, [=]() {
+        SharedPtr<TimerHandle> timer{std::make_shared<TimerHandle>()};
+        auto finish = [=]() {
             if (*received_data != request_line) {
                 logger->warn("HIRL: %s: tampering detected", subtestName.c_str());
                 (*entry)["tampering"] = true;
@@ -64,7 +63,21 @@ static void send_receive_invalid_request_line(std::string subtestName,
             (*entry)["sent"] = represent_string(request_line);
             (*entry)["received"] = represent_string(redact(settings, *received_data));
             txp->close([=]() { cb(entry); });
+        };
+
+        // If the backend closes the connection we have all the data, so we
+        // do not need to wait for the timeout anymore.
+        txp->on_error([=](Error err) {
+            logger->debug("HIRL: %s, on_error: %s", subtestName.c_str(),
+                          err.what());
+            if (reactor->cancel(*timer)) {
+                finish();
+            }
         });
+
+        // Otherwise, we assume to have received all the data after a timeout
+        // of 5 seconds.
+        *timer = reactor->call_later(timeout, finish);
     }, reactor, logger);
 }
 
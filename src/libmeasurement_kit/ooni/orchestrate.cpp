@@ -5,6 +5,7 @@
 #include "src/libmeasurement_kit/ooni/orchestrate.hpp"
 #include "src/libmeasurement_kit/ooni/orchestrate_impl.hpp"
 #include "src/libmeasurement_kit/common/worker.hpp"
+#include "src/libmeasurement_kit/http/http.hpp"
 
 namespace mk {
 namespace ooni {
@@ -164,6 +165,15 @@ nlohmann::json ClientMetadata::as_json() const {
     return j;
 }
 
+// Closes the connections to the registry that login and update have kept
+// open for reuse. This closes all the idle connections of `reactor`, hence
+// it must only be called when we are done with a reactor that we own.
+static void close_idle_connections(SharedPtr<Reactor> reactor) {
+    reactor->run_with_initial_event([&]() {
+        http::close_idle_connections(reactor, nullptr);
+    });
+}
+
 void Client::register_probe(std::string &&password,
                             Callback<Error &&, Auth &&> &&cb) const {
     // Copy the data contained by this object so we completely detach the
@@ -182,6 +192,7 @@ void Client::register_probe(std::string &&password,
                                   cb(std::move(error), std::move(auth));
                               });
         });
+        close_idle_connections(reactor);
     });
 }
 
@@ -224,6 +235,7 @@ void Client::update(Auth &&auth, Callback<Error &&, Auth &&> &&cb) const {
                           cb(std::move(error), std::move(auth));
                       });
         });
+        close_idle_connections(reactor);
     });
 }
 
@@ -254,6 +254,10 @@ static inline void ctx_enter_(Auth &&auth, ClientMetadata &&meta,
     {
       meta.settings["net/ca_bundle_path"] = meta.ca_bundle_path;
     }
+    // Login and update go to the same registry, so reuse the connection
+    if (meta.settings.find("http/keep_alive") == meta.settings.end()) {
+        meta.settings["http/keep_alive"] = true;
+    }
     ctx->auth = std::move(auth);
     ctx->metadata = std::move(meta);
     ctx->reactor = reactor;
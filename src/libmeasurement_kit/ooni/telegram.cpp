@@ -63,7 +63,7 @@ static void tcp_many(const std::vector<std::string> ip_ports, SharedPtr<nlohmann
                 options, connected_cb(ip, port, done_cb), reactor, logger);
         });
     }
-    mk::parallel(continuations, all_done_cb, 3 /* parallelism */);
+    mk::parallel(std::move(continuations), all_done_cb, 3 /* parallelism */);
 }
 
 static void http_many(const std::vector<std::string> urls, std::string type,
@@ -116,7 +116,7 @@ static void http_many(const std::vector<std::string> urls, std::string type,
                 http_cb(url, done_cb), reactor, logger);
         });
     }
-    mk::parallel(continuations, all_done_cb, 3 /* parallelism */);
+    mk::parallel(std::move(continuations), all_done_cb, 3 /* parallelism */);
 }
 
 void telegram(Settings options, Callback<SharedPtr<nlohmann::json>> callback,
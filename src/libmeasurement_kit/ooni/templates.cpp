@@ -4,6 +4,7 @@
 
 #include <event2/dns.h>
 
+#include "src/libmeasurement_kit/common/encoding.hpp"
 #include "src/libmeasurement_kit/ooni/error.hpp"
 #include "src/libmeasurement_kit/ooni/templates_impl.hpp"
 #include "src/libmeasurement_kit/net/emitter.hpp"
@@ -14,31 +15,26 @@ namespace mk {
 namespace ooni {
 namespace templates {
 
-void dns_query(SharedPtr<nlohmann::json> entry, dns::QueryType query_type,
-               dns::QueryClass query_class, std::string query_name,
-               std::string nameserver, Callback<Error, SharedPtr<dns::Message>> cb,
-               Settings options, SharedPtr<Reactor> reactor, SharedPtr<Logger> logger) {
-
+// Adapts `options` to query `nameserver` and fills the resolver fields
+// of `query_entry` accordingly
+static Error dns_query_options(nlohmann::json &query_entry,
+                               std::string nameserver, Settings &options,
+                               SharedPtr<Logger> logger) {
     std::string engine = options.get("dns/engine", std::string{"system"});
-    bool not_system_engine = engine != "system";
-    uint16_t resolver_port = 0;
-    std::string resolver_hostname;
 
-    SharedPtr<nlohmann::json> query_entry{new nlohmann::json};
+    // Queries are measurements: never answer them from dns::ResolveCache
+    options.erase("dns/cache");
 
-    if (not_system_engine) {
+    if (engine != "system") {
         ErrorOr<net::Endpoint> maybe_epnt = net::parse_endpoint(nameserver, 53);
         if (!maybe_epnt) {
-            reactor->call_soon([=]() { cb(maybe_epnt.as_error(), nullptr); });
-            return;
+            return maybe_epnt.as_error();
         }
-        resolver_port = maybe_epnt->port;
-        resolver_hostname = maybe_epnt->hostname;
-        options["dns/nameserver"] = resolver_hostname;
-        options["dns/port"] = resolver_port;
+        options["dns/nameserver"] = maybe_epnt->hostname;
+        options["dns/port"] = maybe_epnt->port;
         options["dns/attempts"] = 1;
-        (*query_entry)["resolver_hostname"] = resolver_hostname;
-        (*query_entry)["resolver_port"] = resolver_port;
+        query_entry["resolver_hostname"] = maybe_epnt->hostname;
+        query_entry["resolver_port"] = maybe_epnt->port;
 
     } else {
         if (nameserver != "") {
@@ -51,44 +47,73 @@ void dns_query(SharedPtr<nlohmann::json> entry, dns::QueryType query_type,
             options["dns/resolve_also_cname"] = true;
         }
         // ooniprobe sets them to null when they are not available
-        (*query_entry)["resolver_hostname"] = nullptr;
-        (*query_entry)["resolver_port"] = nullptr;
+        query_entry["resolver_hostname"] = nullptr;
+        query_entry["resolver_port"] = nullptr;
+    }
+    return NoError();
+}
+
+// Adds to `entry` the result of querying for `query_name`
+static void dns_query_entry(SharedPtr<nlohmann::json> entry,
+                            nlohmann::json query_entry, std::string engine,
+                            dns::QueryType query_type, std::string query_name,
+                            Error error, SharedPtr<dns::Message> message) {
+    bool not_system_engine = engine != "system";
+    query_entry["engine"] = engine;
+    query_entry["failure"] = nullptr;
+    query_entry["answers"] = nlohmann::json::array();
+    if (query_type == dns::MK_DNS_TYPE_A) {
+        query_entry["query_type"] = "A";
+        query_entry["hostname"] = query_name;
+    }
+    if (!error) {
+        for (auto answer : message->answers) {
+            nlohmann::json ttl; // = `null`
+            if (not_system_engine) {
+                ttl = answer.ttl;
+            }
+            if (answer.type == dns::MK_DNS_TYPE_A) {
+                query_entry["answers"].push_back(
+                    {{"ttl", ttl},
+                     {"ipv4", answer.ipv4},
+                     {"answer_type", "A"}});
+            } else if (answer.type == dns::MK_DNS_TYPE_CNAME) {
+                query_entry["answers"].push_back(
+                    {{"ttl", ttl},
+                     {"hostname", answer.hostname},
+                     {"answer_type", "CNAME"}});
+            }
+        }
+    } else {
+        query_entry["failure"] = error.reason;
+    }
+    // Only the native engine sees the response on the wire
+    if (message && message->wire) {
+        query_entry["raw_response"] = base64_encode(message->wire->packet());
+    }
+    // TODO add support for bytes received
+    // query_entry["bytes"] = response.get_bytes();
+    (*entry)["queries"].push_back(query_entry);
+}
+
+void dns_query(SharedPtr<nlohmann::json> entry, dns::QueryType query_type,
+               dns::QueryClass query_class, std::string query_name,
+               std::string nameserver, Callback<Error, SharedPtr<dns::Message>> cb,
+               Settings options, SharedPtr<Reactor> reactor, SharedPtr<Logger> logger) {
+
+    std::string engine = options.get("dns/engine", std::string{"system"});
+    nlohmann::json query_entry;
+    Error error = dns_query_options(query_entry, nameserver, options, logger);
+    if (error) {
+        reactor->call_soon([=]() { cb(error, nullptr); });
+        return;
     }
 
     dns::query(query_class, query_type, query_name,
                [=](Error error, SharedPtr<dns::Message> message) {
                    logger->debug("dns_test: got response!");
-                   (*query_entry)["engine"] = engine;
-                   (*query_entry)["failure"] = nullptr;
-                   (*query_entry)["answers"] = nlohmann::json::array();
-                   if (query_type == dns::MK_DNS_TYPE_A) {
-                       (*query_entry)["query_type"] = "A";
-                       (*query_entry)["hostname"] = query_name;
-                   }
-                   if (!error) {
-                       for (auto answer : message->answers) {
-                           nlohmann::json ttl; // = `null`
-                           if (not_system_engine) {
-                               ttl = answer.ttl;
-                           }
-                           if (answer.type == dns::MK_DNS_TYPE_A) {
-                               (*query_entry)["answers"].push_back(
-                                   {{"ttl", ttl},
-                                    {"ipv4", answer.ipv4},
-                                    {"answer_type", "A"}});
-                           } else if (answer.type == dns::MK_DNS_TYPE_CNAME) {
-                               (*query_entry)["answers"].push_back(
-                                   {{"ttl", ttl},
-                                    {"hostname", answer.hostname},
-                                    {"answer_type", "CNAME"}});
-                           }
-                       }
-                   } else {
-                       (*query_entry)["failure"] = error.reason;
-                   }
-                   // TODO add support for bytes received
-                   // (*query_entry)["bytes"] = response.get_bytes();
-                   (*entry)["queries"].push_back(*query_entry);
+                   dns_query_entry(entry, query_entry, engine, query_type,
+                                   query_name, error, message);
                    logger->debug("dns_test: callbacking");
                    cb(error, message);
                    logger->debug("dns_test: callback called");
@@ -96,6 +121,56 @@ void dns_query(SharedPtr<nlohmann::json> entry, dns::QueryType query_type,
                options, reactor, logger);
 }
 
+void dns_query_many(SharedPtr<nlohmann::json> entry, dns::QueryType query_type,
+                    dns::QueryClass query_class,
+                    std::vector<std::string> query_names,
+                    std::string nameserver,
+                    Callback<const dns::BulkResult &> each,
+                    Callback<std::vector<dns::BulkResult>> cb,
+                    Settings options, SharedPtr<Reactor> reactor,
+                    SharedPtr<Logger> logger) {
+
+    std::string engine = options.get("dns/engine", std::string{"system"});
+    nlohmann::json query_entry;
+    std::vector<dns::BulkQuery> queries;
+    for (auto &query_name : query_names) {
+        dns::BulkQuery query;
+        query.type = query_type;
+        query.qclass = query_class;
+        query.name = query_name;
+        queries.push_back(query);
+    }
+    Error error = dns_query_options(query_entry, nameserver, options, logger);
+    if (error) {
+        reactor->call_soon([=]() {
+            std::vector<dns::BulkResult> results;
+            for (size_t i = 0; i < queries.size(); ++i) {
+                dns::BulkResult result;
+                result.index = i;
+                result.query = queries[i];
+                result.error = error;
+                if (each) {
+                    each(result);
+                }
+                results.push_back(result);
+            }
+            cb(results);
+        });
+        return;
+    }
+
+    dns::bulk_query(queries,
+                    [=](const dns::BulkResult &result) {
+                        dns_query_entry(entry, query_entry, engine, query_type,
+                                        result.query.name, result.error,
+                                        result.message);
+                        if (each) {
+                            each(result);
+                        }
+                    },
+                    cb, options, reactor, logger);
+}
+
 void http_request(SharedPtr<nlohmann::json> entry, Settings settings, http::Headers headers,
                   std::string body, Callback<Error, SharedPtr<http::Response>> cb,
                   SharedPtr<Reactor> reactor, SharedPtr<Logger> logger) {
@@ -119,6 +194,8 @@ void tcp_connect(Settings options,
                         std::make_shared<net::Emitter>(reactor, logger)});
         return;
     }
+    // Resolve the host anew even if the caller enabled the cache
+    options.erase("dns/cache");
     net::connect(options["host"], *port, cb, options, reactor, logger);
 }
 
@@ -6,6 +6,7 @@
 
 #include "src/libmeasurement_kit/net/connect.hpp"
 #include "src/libmeasurement_kit/net/transport.hpp"
+#include "src/libmeasurement_kit/dns/bulk_query.hpp"
 #include "src/libmeasurement_kit/dns/query.hpp"
 #include "src/libmeasurement_kit/http/http.hpp"
 
@@ -18,6 +19,17 @@ void dns_query(SharedPtr<nlohmann::json> entry, dns::QueryType, dns::QueryClass,
                Callback<Error, SharedPtr<dns::Message>>, Settings,
                SharedPtr<Reactor>, SharedPtr<Logger>);
 
+/// Like dns_query() for each name in \p query_names, using dns::bulk_query()
+/// to bound the number of queries in flight. Calls \p each (if not empty)
+/// for each result, as soon as it is available, then \p cb with all the
+/// results.
+void dns_query_many(SharedPtr<nlohmann::json> entry, dns::QueryType,
+                    dns::QueryClass, std::vector<std::string> query_names,
+                    std::string nameserver,
+                    Callback<const dns::BulkResult &> each,
+                    Callback<std::vector<dns::BulkResult>> cb, Settings,
+                    SharedPtr<Reactor>, SharedPtr<Logger>);
+
 void http_request(SharedPtr<nlohmann::json> entry, Settings settings, http::Headers headers,
                   std::string body, Callback<Error, SharedPtr<http::Response>> cb,
                   SharedPtr<Reactor> reactor, SharedPtr<Logger> logger);
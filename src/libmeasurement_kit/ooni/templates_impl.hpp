@@ -25,6 +25,10 @@ void http_request_impl(SharedPtr<nlohmann::json> entry, Settings settings,
 
     (*entry)["socksproxy"] = nullptr;
 
+    // The addresses we connect to are part of the measurement, hence we
+    // must not take them from dns::ResolveCache
+    settings.erase("dns/cache");
+
     // Include the name of the agent, like ooni-probe does
     (*entry)["agent"] = "agent";
     ErrorOr<int> max_redirects = settings.get_noexcept("http/max_redirects", 0);
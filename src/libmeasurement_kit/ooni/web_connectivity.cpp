@@ -397,6 +397,15 @@ static void control_request(http::Headers headers_to_pass_along,
     settings["net/timeout"] = 30.0;
     settings["http/url"] = settings["backend"];
     settings["http/method"] = "POST";
+    // Reuse the connection to the test helper, and its address, across
+    // inputs. This does not affect the measurements, which do not enable
+    // keep-alive and whose lookups are never cached.
+    if (settings.find("http/keep_alive") == settings.end()) {
+        settings["http/keep_alive"] = true;
+    }
+    if (settings.find("dns/cache") == settings.end()) {
+        settings["dns/cache"] = "process";
+    }
     headers_push_back(headers, "Content-Type", "application/json");
 
     if (settings["backend/type"] == "cloudfront") {
@@ -447,9 +456,13 @@ static void experiment_http_request(
      *   more wide range of servers
      *
      * - we allow SSL dirty shutdowns to gather more evidence
+     *
+     * - we always perform a full SSL handshake, because resuming a
+     *   session may hide what a censor would do on a new connection
      */
     options["net/allow_ssl23"] = true;
     options["net/ssl_allow_dirty_shutdown"] = true;
+    options["net/ssl_resume_sessions"] = false;
 
     logger->debug("Requesting url %s", url.c_str());
     templates::http_request(entry, options, headers, body,
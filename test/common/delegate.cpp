@@ -9,6 +9,9 @@
 #include "src/libmeasurement_kit/common/delegate.hpp"
 #include <measurement_kit/common.hpp>
 
+#include <stdexcept>
+#include <vector>
+
 using namespace mk;
 
 class Helper {
@@ -25,3 +28,71 @@ TEST_CASE("Delegate works as expected") {
     helper.on([&]() { helper.on([&]() {}); });
     helper.emit();
 }
+
+TEST_CASE("Delegate deals with reentrancy") {
+    SECTION("A function replacing itself is kept alive until it returns") {
+        Delegate<> delegate;
+        SharedPtr<int> value{new int{17}};
+        int seen = 0, replaced = 0;
+        delegate = [&, value]() {
+            delegate = [&]() { ++replaced; };
+            seen = *value; // Would crash if we had been destroyed
+        };
+        REQUIRE(value.use_count() == 2);
+        delegate();
+        REQUIRE(seen == 17);
+        REQUIRE(value.use_count() == 1);
+        delegate();
+        REQUIRE(replaced == 1);
+    }
+
+    SECTION("A function can call the delegate recursively") {
+        Delegate<int> delegate;
+        std::vector<int> calls;
+        delegate = [&](int depth) {
+            REQUIRE(!!delegate);
+            calls.push_back(depth);
+            if (depth < 3) {
+                delegate(depth + 1);
+            }
+        };
+        delegate(0);
+        delegate(2);
+        REQUIRE((calls == std::vector<int>{0, 1, 2, 3, 2, 3}));
+    }
+
+    SECTION("A function can clear the delegate") {
+        Delegate<> delegate;
+        delegate = [&]() {
+            delegate = nullptr;
+            REQUIRE(!delegate);
+        };
+        delegate();
+        REQUIRE(!delegate);
+        REQUIRE_THROWS_AS(delegate(), std::bad_function_call);
+    }
+
+    SECTION("A function can destroy the delegate") {
+        Delegate<> *delegate = new Delegate<>;
+        bool called = false;
+        *delegate = [&]() {
+            delete delegate;
+            called = true;
+        };
+        (*delegate)();
+        REQUIRE(called);
+    }
+
+    SECTION("The function is restored if it throws") {
+        Delegate<> delegate;
+        int count = 0;
+        delegate = [&]() {
+            ++count;
+            throw std::runtime_error("oops");
+        };
+        REQUIRE_THROWS_AS(delegate(), std::runtime_error);
+        REQUIRE(!!delegate);
+        REQUIRE_THROWS_AS(delegate(), std::runtime_error);
+        REQUIRE(count == 2);
+    }
+}
@@ -0,0 +1,78 @@
+// Part of Measurement Kit <https://measurement-kit.github.io/>.
+// Measurement Kit is free software under the BSD license. See AUTHORS
+// and LICENSE for more information on the copying conditions.
+
+#include "test/winsock.hpp"
+
+#include "include/private/catch.hpp"
+
+#include "src/libmeasurement_kit/common/histogram.hpp"
+
+#include <thread>
+#include <vector>
+
+using namespace mk;
+
+TEST_CASE("Histogram::bucket_of() works as expected") {
+    REQUIRE(Histogram::bucket_of(0) == 0);
+    REQUIRE(Histogram::bucket_of(1) == 1);
+    REQUIRE(Histogram::bucket_of(2) == 2);
+    REQUIRE(Histogram::bucket_of(3) == 2);
+    REQUIRE(Histogram::bucket_of(4) == 3);
+    REQUIRE(Histogram::bucket_of(1023) == 10);
+    REQUIRE(Histogram::bucket_of(1024) == 11);
+    REQUIRE(Histogram::bucket_of(~uint64_t{0}) == 64);
+}
+
+TEST_CASE("Histogram works as expected") {
+    SECTION("When empty") {
+        Histogram h;
+        REQUIRE(h.count() == 0);
+        REQUIRE(h.max() == 0);
+        REQUIRE(h.mean() == 0.0);
+        REQUIRE(h.percentile(0.5) == 0);
+    }
+
+    SECTION("With samples") {
+        Histogram h;
+        for (uint64_t i = 1; i <= 100; ++i) {
+            h.add(i);
+        }
+        REQUIRE(h.count() == 100);
+        REQUIRE(h.sum() == 5050);
+        REQUIRE(h.max() == 100);
+        REQUIRE(h.mean() == 50.5);
+        REQUIRE(h.bucket(7) == 37); // [64, 128)
+        // The percentile is the upper bound of the bucket containing it
+        REQUIRE(h.percentile(0.5) == 63);
+        REQUIRE(h.percentile(0.99) == 100);
+        REQUIRE(h.percentile(0.0) == 1);
+    }
+
+    SECTION("Copying takes a snapshot") {
+        Histogram h;
+        h.add(17);
+        Histogram snapshot = h;
+        h.add(42);
+        REQUIRE(snapshot.count() == 1);
+        REQUIRE(snapshot.max() == 17);
+        REQUIRE(h.count() == 2);
+    }
+
+    SECTION("Samples can be added concurrently") {
+        Histogram h;
+        std::vector<std::thread> threads;
+        for (size_t i = 0; i < 4; ++i) {
+            threads.emplace_back([&h, i]() {
+                for (uint64_t j = 0; j < 10000; ++j) {
+                    h.add(j * (i + 1));
+                }
+            });
+        }
+        for (auto &thread : threads) {
+            thread.join();
+        }
+        REQUIRE(h.count() == 40000);
+        REQUIRE(h.max() == 9999 * 4);
+    }
+}
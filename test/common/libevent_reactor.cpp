@@ -10,6 +10,17 @@
 #include "src/libmeasurement_kit/common/utils.hpp"
 #include <measurement_kit/common.hpp>
 
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <netinet/in.h>
+#endif
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <thread>
+#include <vector>
+
 using namespace mk;
 
 extern "C" {
@@ -101,12 +112,119 @@ STATIC int event_base_once_fail(event_base *, evutil_socket_t, short,
 
 } // extern "C"
 
-TEST_CASE("Reactor: call_later") {
+TEST_CASE("Reactor: call_soon") {
     SECTION("We deal with event_base_once() failure") {
         LibeventReactor<event_base_new, event_base_once_fail,
                 event_base_dispatch, event_base_loopbreak>
                 reactor;
-        REQUIRE_THROWS(reactor.call_later(0.0, []() {}));
+        REQUIRE_THROWS(reactor.call_soon([]() {}));
+    }
+}
+
+TEST_CASE("Reactor: call_later") {
+    SECTION("Callbacks are called in order of expiry") {
+        LibeventReactor<> reactor;
+        std::vector<int> order;
+        double begin = time_now();
+        reactor.run_with_initial_event([&]() {
+            reactor.call_later(0.03, [&]() { order.push_back(3); });
+            reactor.call_later(0.01, [&]() { order.push_back(1); });
+            reactor.call_later(0.02, [&]() { order.push_back(2); });
+            reactor.call_later(0.01, [&]() { order.push_back(10); });
+        });
+        REQUIRE((order == std::vector<int>{1, 10, 2, 3}));
+        REQUIRE(time_now() - begin >= 0.03);
+    }
+
+    SECTION("Callbacks are never called early") {
+        LibeventReactor<> reactor;
+        std::vector<double> early;
+        reactor.run_with_initial_event([&]() {
+            for (int i = 0; i < 20; ++i) {
+                // Schedule at different points within the current tick
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+                double begin = time_now();
+                reactor.call_later(0.002, [&early, begin]() {
+                    double elapsed = time_now() - begin;
+                    if (elapsed < 0.002) {
+                        early.push_back(elapsed);
+                    }
+                });
+            }
+        });
+        REQUIRE(early.empty());
+    }
+
+    SECTION("Cancelled callbacks are not called") {
+        LibeventReactor<> reactor;
+        bool called = false;
+        TimerHandle handle;
+        reactor.run_with_initial_event([&]() {
+            handle = reactor.call_later(0.01, [&]() { called = true; });
+            REQUIRE(handle.valid());
+            REQUIRE(reactor.cancel(handle));
+        });
+        REQUIRE(!called);
+        REQUIRE(!reactor.cancel(handle));
+        REQUIRE(!reactor.cancel(TimerHandle{}));
+    }
+
+    SECTION("Cancelled callbacks do not keep the loop alive") {
+        LibeventReactor<> reactor;
+        double begin = time_now();
+        reactor.run_with_initial_event([&]() {
+            auto handle = reactor.call_later(10.0, []() {});
+            reactor.call_later(0.01, [&reactor, handle]() {
+                REQUIRE(reactor.cancel(handle));
+            });
+        });
+        REQUIRE(time_now() - begin < 5.0);
+    }
+
+    SECTION("An expired callback can cancel one expiring at the same time") {
+        LibeventReactor<> reactor;
+        bool called = false;
+        TimerHandle second;
+        reactor.run_with_initial_event([&]() {
+            reactor.call_later(0.01, [&]() {
+                REQUIRE(reactor.cancel(second));
+            });
+            second = reactor.call_later(0.01, [&]() { called = true; });
+        });
+        REQUIRE(!called);
+    }
+
+    SECTION("Callbacks can schedule other callbacks") {
+        LibeventReactor<> reactor;
+        int count = 0;
+        std::function<void()> again = [&]() {
+            if (++count < 10) {
+                reactor.call_later(0.001, [&]() { again(); });
+            }
+        };
+        reactor.run_with_initial_event([&]() { again(); });
+        REQUIRE(count == 10);
+    }
+
+    SECTION("Callbacks can be scheduled from background threads") {
+        LibeventReactor<> reactor;
+        std::atomic_bool called{false};
+        reactor.run_with_initial_event([&]() {
+            reactor.call_in_thread(Logger::make(), [&]() {
+                reactor.call_later(0.01, [&]() { called = true; });
+            });
+        });
+        REQUIRE(called);
+    }
+
+    SECTION("A negative delay means that the callback is never called") {
+        LibeventReactor<> reactor;
+        bool called = false;
+        reactor.run_with_initial_event([&]() {
+            auto handle = reactor.call_later(-1.0, [&]() { called = true; });
+            REQUIRE(!handle.valid());
+        });
+        REQUIRE(!called);
     }
 }
 
@@ -115,6 +233,112 @@ TEST_CASE("Reactor: pollfd") {
         LibeventReactor<event_base_new, event_base_once_fail,
                 event_base_dispatch, event_base_loopbreak>
                 reactor;
-        REQUIRE_THROWS(reactor.pollfd(0, 0, 0.0, [](Error, short) {}));
+        REQUIRE_THROWS(reactor.pollfd(0, 0, 0.0, [](Error) {}));
+    }
+}
+
+TEST_CASE("Reactor: call_in_thread") {
+    SECTION("run() returns as soon as background work is done") {
+        LibeventReactor<> reactor;
+        bool called = false;
+        double begin = time_now();
+        reactor.run_with_initial_event([&]() {
+            reactor.call_in_thread(Logger::make(), [&]() {
+                std::this_thread::sleep_for(std::chrono::milliseconds(50));
+                reactor.call_soon([&]() { called = true; });
+            });
+        });
+        double elapsed = time_now() - begin;
+        REQUIRE(called);
+        // We used to poll every 250 ms while waiting for background work,
+        // hence this would take at least 250 ms.
+        REQUIRE(elapsed < 0.2);
+    }
+
+    SECTION("run() waits for background work that does not call back") {
+        LibeventReactor<> reactor;
+        std::atomic_bool called{false};
+        reactor.run_with_initial_event([&]() {
+            reactor.call_in_thread(Logger::make(), [&]() {
+                std::this_thread::sleep_for(std::chrono::milliseconds(50));
+                called = true;
+            });
+        });
+        REQUIRE(called);
+    }
+
+    SECTION("The reactor can be run again after background work") {
+        LibeventReactor<> reactor;
+        for (size_t i = 0; i < 3; ++i) {
+            size_t count = 0;
+            reactor.run_with_initial_event([&]() {
+                for (size_t j = 0; j < 16; ++j) {
+                    reactor.call_in_thread(Logger::make(), [&]() {
+                        reactor.call_soon([&]() { ++count; });
+                    });
+                }
+            });
+            REQUIRE(count == 16);
+        }
+    }
+}
+
+TEST_CASE("Reactor: instrumentation") {
+    SECTION("By default it is disabled") {
+        LibeventReactor<> reactor;
+        reactor.run_with_initial_event([&]() {
+            reactor.call_later(0.01, []() {});
+        });
+        auto stats = reactor.instrumentation_stats();
+        REQUIRE(stats.callback_time.count() == 0);
+        REQUIRE(stats.loop_lag.count() == 0);
+    }
+
+    SECTION("When enabled it collects statistics") {
+        LibeventReactor<> reactor;
+        reactor.set_instrumentation(true);
+        // A UDP socket is immediately writable
+        socket_t sock = ::socket(AF_INET, SOCK_DGRAM, 0);
+        REQUIRE(sock != -1);
+        reactor.run_with_initial_event([&]() {
+            reactor.call_later(0.01, []() {});
+            reactor.call_later(0.01, []() {});
+            reactor.call_soon([]() {
+                // Block the loop such that the timers are late
+                std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            });
+            reactor.call_in_thread(Logger::make(), []() {});
+            reactor.pollout_once(sock, 1.0, [](Error) {});
+        });
+        evutil_closesocket(sock);
+        auto stats = reactor.instrumentation_stats();
+        // initial event, call_soon, two timers, poll
+        REQUIRE(stats.callback_time.count() == 5);
+        REQUIRE(stats.callback_time.max() >= 40000);
+        // initial event, call_soon and two timers
+        REQUIRE(stats.loop_lag.count() == 4);
+        REQUIRE(stats.loop_lag.max() >= 20000);
+        REQUIRE(stats.pending_timers.max() == 2);
+        REQUIRE(stats.pending_polls.max() == 1);
+        REQUIRE(stats.worker_queue_depth.count() == 1);
+    }
+
+    SECTION("Timer lag is measured from the requested deadline") {
+        LibeventReactor<> reactor;
+        reactor.set_instrumentation(true);
+        std::chrono::steady_clock::time_point scheduled, fired;
+        reactor.run_with_initial_event([&]() {
+            scheduled = std::chrono::steady_clock::now();
+            reactor.call_later(0.01, [&]() {
+                fired = std::chrono::steady_clock::now();
+            });
+        });
+        auto stats = reactor.instrumentation_stats();
+        // The timer expires at a rounded up tick, hence it is always a bit
+        // late, and the lag must account for that
+        auto late = std::chrono::duration_cast<std::chrono::microseconds>(
+                fired - scheduled).count() - 10000;
+        REQUIRE(late > 0);
+        REQUIRE(stats.loop_lag.max() + 100 >= (uint64_t)late);
     }
 }
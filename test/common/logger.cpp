@@ -10,8 +10,14 @@
 
 #include <measurement_kit/common.hpp>
 
-#include <string>
+#include <stdio.h>
+
+#include <atomic>
+#include <chrono>
 #include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
 
 using namespace mk;
 
@@ -162,3 +168,247 @@ TEST_CASE("The logsv API works as expected") {
     logger->logsv(MK_LOG_INFO, foobar);
     REQUIRE(buffer == "Foo\nBar\nFoo\nBar\n");
 }
+
+static LogFlushPolicy slow_flush_policy() {
+    LogFlushPolicy policy;
+    policy.interval = 3600.0;
+    policy.on_warning = false;
+    return policy;
+}
+
+TEST_CASE("Asynchronous logging works as expected") {
+    SECTION("Log lines are written by a background thread in order") {
+        std::string buffer;
+        std::thread::id consumer_id;
+        auto logger = mk::Logger::make();
+        logger->on_log([&](uint32_t, const char *s) {
+            consumer_id = std::this_thread::get_id();
+            buffer += s;
+            buffer += "\n";
+        });
+        logger->set_verbosity(MK_LOG_INFO);
+        logger->set_async(true, slow_flush_policy());
+        logger->info("Foo %d", 17);
+        logger->debug("Antani");
+        logger->logs(MK_LOG_INFO, "Bar");
+        logger->logsv(MK_LOG_WARNING, {"Baz", "Qux"});
+        logger->flush();
+        REQUIRE(buffer == "Foo 17\nBar\nBaz\nQux\n");
+        // Note: flush() drains the queue in the calling thread, while with
+        // a shorter interval the background thread would have done that.
+        REQUIRE(consumer_id == std::this_thread::get_id());
+        logger->info("Quux");
+        logger->set_async(false, LogFlushPolicy{});
+        REQUIRE(buffer == "Foo 17\nBar\nBaz\nQux\nQuux\n");
+        // Note: the final drain runs in the thread disabling async logging.
+        REQUIRE(consumer_id == std::this_thread::get_id());
+    }
+
+    SECTION("The background thread flushes after the interval") {
+        std::atomic<int> count{0};
+        std::atomic_bool same_thread{false};
+        auto self = std::this_thread::get_id();
+        auto logger = mk::Logger::make();
+        logger->on_log([&](uint32_t, const char *) {
+            same_thread = (std::this_thread::get_id() == self);
+            ++count;
+        });
+        LogFlushPolicy policy = slow_flush_policy();
+        policy.interval = 0.01;
+        logger->set_async(true, policy);
+        logger->warn("Foo");
+        for (int i = 0; i < 500 && count == 0; ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        REQUIRE(count == 1);
+        REQUIRE(!same_thread);
+    }
+
+    SECTION("Warnings are written immediately if on_warning is set") {
+        std::atomic<int> count{0};
+        auto logger = mk::Logger::make();
+        logger->on_log([&](uint32_t, const char *) { ++count; });
+        logger->set_verbosity(MK_LOG_INFO);
+        LogFlushPolicy policy = slow_flush_policy();
+        policy.on_warning = true;
+        logger->set_async(true, policy);
+        logger->info("Foo");
+        logger->warn("Bar");
+        for (int i = 0; i < 500 && count < 2; ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        REQUIRE(count == 2);
+    }
+
+    SECTION("We do not lose lines when the queue is full") {
+        size_t count = 0;
+        auto logger = mk::Logger::make();
+        logger->on_log([&](uint32_t, const char *) { ++count; });
+        logger->set_async(true, slow_flush_policy());
+        for (size_t i = 0; i < 20000; ++i) {
+            logger->warn("Foo %zu", i);
+        }
+        logger->flush();
+        REQUIRE(count == 20000);
+    }
+
+    SECTION("Long lines are written in order") {
+        std::vector<std::string> lines;
+        auto logger = mk::Logger::make();
+        logger->on_log([&](uint32_t, const char *s) { lines.push_back(s); });
+        logger->set_async(true, slow_flush_policy());
+        std::string long_line(100000, 'x');
+        logger->warn("Foo");
+        logger->logs(MK_LOG_WARNING, long_line.c_str());
+        logger->warn("%s", std::string(20000, 'y').c_str());
+        logger->warn("Bar");
+        logger->flush();
+        REQUIRE(lines.size() == 4);
+        REQUIRE(lines[0] == "Foo");
+        REQUIRE(lines[1] == long_line);
+        REQUIRE(lines[2] == std::string(20000, 'y'));
+        REQUIRE(lines[3] == "Bar");
+    }
+
+    SECTION("Lines logged by many threads are written in per-thread order") {
+        // Note: lines may be written by any thread, which could hold the
+        // lock, and Catch assertions are not thread safe
+        std::vector<std::vector<int>> seen(4);
+        bool parsed = true;
+        auto logger = mk::Logger::make();
+        logger->on_log([&](uint32_t, const char *s) {
+            int thread = 0, line = 0;
+            if (sscanf(s, "%d %d", &thread, &line) != 2 || thread < 0 ||
+                thread >= 4) {
+                parsed = false;
+                return;
+            }
+            seen[thread].push_back(line);
+        });
+        logger->set_async(true, slow_flush_policy());
+        std::vector<std::thread> threads;
+        for (int i = 0; i < 4; ++i) {
+            threads.emplace_back([logger, i]() {
+                for (int j = 0; j < 1000; ++j) {
+                    logger->warn("%d %d", i, j);
+                }
+            });
+        }
+        for (auto &thread : threads) {
+            thread.join();
+        }
+        logger->flush();
+        REQUIRE(parsed);
+        for (auto &lines : seen) {
+            REQUIRE(lines.size() == 1000);
+            for (int j = 0; j < 1000; ++j) {
+                REQUIRE(lines[j] == j);
+            }
+        }
+    }
+
+    SECTION("We do not lose lines when async logging is disabled meanwhile") {
+        std::atomic<int> count{0};
+        std::atomic_bool started{false};
+        auto logger = mk::Logger::make();
+        logger->on_log([&](uint32_t, const char *) { ++count; });
+        logger->set_async(true, slow_flush_policy());
+        std::vector<std::thread> threads;
+        for (int i = 0; i < 4; ++i) {
+            threads.emplace_back([logger, &started]() {
+                for (int j = 0; j < 1000; ++j) {
+                    logger->warn("%d", j);
+                    started = true;
+                }
+            });
+        }
+        while (!started) {
+            std::this_thread::yield();
+        }
+        logger->set_async(false, LogFlushPolicy{});
+        for (auto &thread : threads) {
+            thread.join();
+        }
+        REQUIRE(count == 4000);
+    }
+
+    SECTION("Queued lines are written when the logger is destroyed") {
+        auto eof_called = false;
+        {
+            SharedPtr<Logger> logger = Logger::make();
+            logger->set_logfile("logfile_async.log");
+            logger->on_log(nullptr);
+            logger->on_eof([&]() { eof_called = true; });
+            logger->set_async(true, slow_flush_policy());
+            logger->warn("foo");
+            logger->warn("foobar");
+            logger->warn("bar");
+        }
+        REQUIRE(eof_called);
+        std::ifstream file("logfile_async.log");
+        std::string line;
+        std::string whole_file;
+        while ((std::getline(file, line))) {
+            whole_file += line;
+            whole_file += "\n";
+        }
+        REQUIRE(whole_file == "foo\nfoobar\nbar\n");
+    }
+}
+
+/*
+ * Benchmark comparing synchronous and asynchronous logging into a logfile
+ * at debug level. It is hidden, run it using `./test/common/logger
+ * [benchmark]`.
+ */
+
+static void log_many_lines(SharedPtr<Logger> logger, const char *what) {
+    static const size_t count = 200000;
+    auto begin = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < count; ++i) {
+        logger->debug("benchmark: line %zu with some more text: %s", i, what);
+    }
+    std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - begin;
+    logger->flush();
+    std::chrono::duration<double> total =
+            std::chrono::steady_clock::now() - begin;
+    printf("%-32s %8.3f s (including final flush: %.3f s)\n", what,
+           elapsed.count(), total.count());
+}
+
+TEST_CASE("Debug logging throughput", "[.benchmark]") {
+    SECTION("Synchronous logging") {
+        SharedPtr<Logger> logger = Logger::make();
+        logger->set_logfile("logfile_benchmark.log");
+        logger->set_verbosity(MK_LOG_DEBUG);
+        logger->on_log([](uint32_t, const char *) {});
+        log_many_lines(logger, "synchronous");
+    }
+
+    SECTION("Asynchronous logging") {
+        SharedPtr<Logger> logger = Logger::make();
+        logger->set_logfile("logfile_benchmark.log");
+        logger->set_verbosity(MK_LOG_DEBUG);
+        logger->on_log([](uint32_t, const char *) {});
+        logger->set_async(true, LogFlushPolicy{});
+        log_many_lines(logger, "asynchronous");
+    }
+
+    SECTION("Asynchronous logging from four threads") {
+        SharedPtr<Logger> logger = Logger::make();
+        logger->set_logfile("logfile_benchmark.log");
+        logger->set_verbosity(MK_LOG_DEBUG);
+        logger->on_log([](uint32_t, const char *) {});
+        logger->set_async(true, LogFlushPolicy{});
+        std::vector<std::thread> threads;
+        for (int i = 0; i < 4; ++i) {
+            threads.emplace_back([logger]() {
+                log_many_lines(logger, "asynchronous, 4 threads");
+            });
+        }
+        for (auto &thread : threads) {
+            thread.join();
+        }
+    }
+}
@@ -0,0 +1,76 @@
+// Part of Measurement Kit <https://measurement-kit.github.io/>.
+// Measurement Kit is free software under the BSD license. See AUTHORS
+// and LICENSE for more information on the copying conditions.
+
+#include "test/winsock.hpp"
+
+#include "include/private/catch.hpp"
+
+#include "src/libmeasurement_kit/common/mpmc_queue.hpp"
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+TEST_CASE("MpmcQueue rounds the capacity to a power of two") {
+    REQUIRE(mk::MpmcQueue<int>{0}.capacity() == 2);
+    REQUIRE(mk::MpmcQueue<int>{5}.capacity() == 8);
+    REQUIRE(mk::MpmcQueue<int>{64}.capacity() == 64);
+}
+
+TEST_CASE("MpmcQueue works as a FIFO in a single thread") {
+    mk::MpmcQueue<std::string> queue{4};
+    std::string value;
+    REQUIRE(!queue.try_pop(value));
+    for (auto s : {"a", "b", "c", "d"}) {
+        value = s;
+        REQUIRE(queue.try_push(value));
+    }
+    REQUIRE(queue.size_approx() == 4);
+    value = "e";
+    REQUIRE(!queue.try_push(value));
+    REQUIRE(value == "e"); // not moved on failure
+    for (auto s : {"a", "b", "c", "d"}) {
+        REQUIRE(queue.try_pop(value));
+        REQUIRE(value == s);
+    }
+    REQUIRE(!queue.try_pop(value));
+    REQUIRE(queue.size_approx() == 0);
+}
+
+TEST_CASE("MpmcQueue works with many producers and consumers") {
+    constexpr size_t producers = 4, consumers = 4, count = 20000;
+    mk::MpmcQueue<size_t> queue{128};
+    std::atomic<size_t> sum{0}, popped{0};
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < producers; ++i) {
+        threads.emplace_back([&, i]() {
+            for (size_t j = 0; j < count; ++j) {
+                size_t value = i * count + j + 1;
+                while (!queue.try_push(value)) {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+    for (size_t i = 0; i < consumers; ++i) {
+        threads.emplace_back([&]() {
+            size_t value = 0;
+            while (popped < producers * count) {
+                if (queue.try_pop(value)) {
+                    sum += value;
+                    ++popped;
+                } else {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    size_t n = producers * count;
+    REQUIRE(popped == n);
+    REQUIRE(sum == n * (n + 1) / 2);
+}
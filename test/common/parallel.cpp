@@ -89,3 +89,91 @@ TEST_CASE("mk::parallel() works as expected with all failures") {
         });
     });
 }
+
+TEST_CASE("mk::parallel() does not wait for slow operations to start others") {
+    // With two lanes and static assignment of operations to lanes, the
+    // fast operations behind the slow one would wait for it. Instead, the
+    // other lane should run all the fast operations meanwhile.
+    SharedPtr<Reactor> reactor = Reactor::make();
+    SharedPtr<std::vector<size_t>> order{new std::vector<size_t>};
+    reactor->run_with_initial_event([=]() {
+        std::vector<Continuation<Error>> input;
+        for (size_t i = 0; i < 8; ++i) {
+            input.push_back([=](Callback<Error> callback) {
+                reactor->call_later((i == 0) ? 0.5 : 0.01, [=]() {
+                    order->push_back(i);
+                    callback(NoError());
+                });
+            });
+        }
+        mk::parallel(std::move(input), [=](Error error) {
+            REQUIRE((error == NoError()));
+            reactor->stop();
+        }, 2);
+    });
+    REQUIRE((*order == std::vector<size_t>{1, 2, 3, 4, 5, 6, 7, 0}));
+}
+
+TEST_CASE("mk::parallel() does not start other operations on failure if "
+          "fail_fast is true") {
+    SharedPtr<Reactor> reactor = Reactor::make();
+    SharedPtr<size_t> started{new size_t{0}};
+    reactor->run_with_initial_event([=]() {
+        std::vector<Continuation<Error>> input;
+        for (size_t i = 0; i < 16; ++i) {
+            input.push_back([=](Callback<Error> callback) {
+                *started += 1;
+                reactor->call_later(0.01 * (i + 1), [=]() {
+                    callback((i == 1) ? Error{MockedError()} : NoError());
+                });
+            });
+        }
+        mk::parallel(std::move(input), [=](Error error) {
+            REQUIRE((error == ParallelOperationError()));
+            REQUIRE((error.child_errors.size() == 16));
+            REQUIRE((error.child_errors[0] == NoError()));
+            REQUIRE((error.child_errors[1] == MockedError()));
+            // Operation #2 was started when #0 completed
+            REQUIRE((error.child_errors[2] == NoError()));
+            for (size_t i = 3; i < 16; ++i) {
+                REQUIRE((error.child_errors[i] == OperationCancelledError()));
+            }
+            reactor->stop();
+        }, 2 /* parallelism */, true /* fail_fast */);
+    });
+    REQUIRE(*started == 3);
+}
+
+TEST_CASE("mk::parallel() works with operations completing in other threads") {
+    SharedPtr<Reactor> reactor = Reactor::make();
+    SharedPtr<std::vector<Error>> results{new std::vector<Error>};
+    reactor->run_with_initial_event([=]() {
+        std::vector<Continuation<Error>> input;
+        for (size_t i = 0; i < 64; ++i) {
+            input.push_back([=](Callback<Error> callback) {
+                // Note: call_in_thread() runs the function in a background
+                // thread, hence completions race with each other.
+                reactor->call_in_thread(Logger::make(), [=]() {
+                    callback(((i % 3) == 0) ? Error{MockedError()} : NoError());
+                });
+            });
+        }
+        mk::parallel(std::move(input), [=](Error error) {
+            // Note: this may run in a background thread, so we check the
+            // results after the reactor has stopped.
+            results->push_back(error);
+            reactor->stop();
+        }, 8);
+    });
+    REQUIRE(results->size() == 1);
+    Error error = results->at(0);
+    REQUIRE((error == ParallelOperationError()));
+    REQUIRE((error.child_errors.size() == 64));
+    for (size_t i = 0; i < 64; ++i) {
+        if ((i % 3) == 0) {
+            REQUIRE((error.child_errors[i] == MockedError()));
+        } else {
+            REQUIRE((error.child_errors[i] == NoError()));
+        }
+    }
+}
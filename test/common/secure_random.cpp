@@ -0,0 +1,163 @@
+// Part of Measurement Kit <https://measurement-kit.github.io/>.
+// Measurement Kit is free software under the BSD license. See AUTHORS
+// and LICENSE for more information on the copying conditions.
+
+#include "test/winsock.hpp"
+
+#include "include/private/catch.hpp"
+
+#include "src/libmeasurement_kit/common/secure_random.hpp"
+#include "src/libmeasurement_kit/common/utils.hpp"
+
+#include <measurement_kit/internal/vendor/mkuuid4.hpp>
+
+#include <event2/util.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <chrono>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace mk;
+
+TEST_CASE("chacha20_block() works as expected") {
+    // See RFC 7539 Sect. 2.3.2. The 32 bit block count is one and the
+    // 96 bit nonce is 00:00:00:09:00:00:00:4a:00:00:00:00, which in the
+    // original layout means counter 0x0900000000000001 and nonce 0x4a000000.
+    uint32_t key[8];
+    for (uint32_t i = 0; i < 8; ++i) {
+        key[i] = (4 * i) | ((4 * i + 1) << 8) | ((4 * i + 2) << 16) |
+                 ((4 * i + 3) << 24);
+    }
+    uint8_t out[64];
+    chacha20_block(key, 0x0900000000000001ULL, 0x4a000000ULL, out);
+    static const uint8_t expect[64] = {
+            0x10, 0xf1, 0xe7, 0xe4, 0xd1, 0x3b, 0x59, 0x15, 0x50, 0x0f, 0xdd,
+            0x1f, 0xa3, 0x20, 0x71, 0xc4, 0xc7, 0xd1, 0xf4, 0xc7, 0x33, 0xc0,
+            0x68, 0x03, 0x04, 0x22, 0xaa, 0x9a, 0xc3, 0xd4, 0x6c, 0x4e, 0xd2,
+            0x82, 0x64, 0x46, 0x07, 0x9f, 0xaa, 0x09, 0x14, 0xc2, 0xd7, 0x05,
+            0xd9, 0x8b, 0x02, 0xa2, 0xb5, 0x12, 0x9c, 0xd1, 0xde, 0x16, 0x4e,
+            0xb9, 0xcb, 0xd0, 0x83, 0xe8, 0xa2, 0x50, 0x3c, 0x4e,
+    };
+    REQUIRE(memcmp(out, expect, sizeof(out)) == 0);
+}
+
+TEST_CASE("SecureRandom works as expected") {
+    SECTION("Requests of any size are filled") {
+        // Zero the buffers and check that no large zero runs are left,
+        // which would mean that we did not write part of the output.
+        for (size_t size : {1, 7, 64, 255, 256, 257, 1000, 4096, 10000}) {
+            std::vector<uint8_t> a(size), b(size);
+            secure_random_bytes(a.data(), a.size());
+            secure_random_bytes(b.data(), b.size());
+            REQUIRE((size < 8 || a != b));
+            size_t zeroes = 0;
+            for (auto c : a) {
+                zeroes = (c == 0) ? zeroes + 1 : 0;
+                REQUIRE(zeroes < 8);
+            }
+        }
+    }
+
+    SECTION("Threads get different streams") {
+        std::vector<uint8_t> a(64), b(64);
+        std::thread t1{[&]() { secure_random_bytes(a.data(), a.size()); }};
+        std::thread t2{[&]() { secure_random_bytes(b.data(), b.size()); }};
+        t1.join();
+        t2.join();
+        REQUIRE(a != b);
+    }
+
+    SECTION("uniform() stays within bounds") {
+        SecureRandom &rng = secure_random();
+        REQUIRE_THROWS_AS(rng.uniform(0), std::runtime_error);
+        REQUIRE(rng.uniform(1) == 0);
+        std::set<uint64_t> seen;
+        for (int i = 0; i < 1000; ++i) {
+            uint64_t v = rng.uniform(7);
+            REQUIRE(v < 7);
+            seen.insert(v);
+        }
+        REQUIRE(seen.size() == 7);
+    }
+}
+
+TEST_CASE("random_within_charset() uses the whole charset") {
+    SECTION("With a charset that does not divide 256") {
+        std::string s = random_within_charset("abc", 3000);
+        REQUIRE(s.size() == 3000);
+        REQUIRE(s.find_first_not_of("abc") == std::string::npos);
+        REQUIRE(s.find('a') != std::string::npos);
+        REQUIRE(s.find('b') != std::string::npos);
+        REQUIRE(s.find('c') != std::string::npos);
+    }
+
+    SECTION("With a charset larger than 256 characters") {
+        std::string charset(300, 'x');
+        charset[299] = 'y';
+        std::string s = random_within_charset(charset, 3000);
+        REQUIRE(s.find_first_not_of("xy") == std::string::npos);
+        REQUIRE(s.find('y') != std::string::npos);
+    }
+
+    SECTION("With zero length") {
+        REQUIRE(random_within_charset("abc", 0) == "");
+    }
+}
+
+TEST_CASE("secure_random_uuid4() generates valid UUIDs") {
+    std::set<std::string> uuids;
+    for (int i = 0; i < 100; ++i) {
+        std::string uuid = secure_random_uuid4();
+        REQUIRE(uuid.size() == 36);
+        for (size_t j = 0; j < uuid.size(); ++j) {
+            if (j == 8 || j == 13 || j == 18 || j == 23) {
+                REQUIRE(uuid[j] == '-');
+            } else {
+                REQUIRE(strchr("0123456789abcdef", uuid[j]) != nullptr);
+            }
+        }
+        REQUIRE(uuid[14] == '4');
+        REQUIRE(strchr("89ab", uuid[19]) != nullptr);
+        uuids.insert(uuid);
+    }
+    REQUIRE(uuids.size() == 100);
+}
+
+/*
+ * Benchmark comparing the generator with what we used before. It is
+ * hidden, run it using `./test/common/secure_random [benchmark]`.
+ */
+
+template <typename Func>
+static void measure(const char *what, double units, const char *unit,
+                    Func &&func) {
+    static const int iterations = 2000;
+    auto begin = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        func();
+    }
+    std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - begin;
+    printf("%-40s %12.1f %s/s\n", what,
+           units * iterations / elapsed.count(), unit);
+}
+
+TEST_CASE("Random generation throughput", "[.benchmark]") {
+    std::vector<uint8_t> buffer(8192);
+    measure("evutil_secure_rng_get_bytes", 8192.0, "bytes", [&]() {
+        evutil_secure_rng_get_bytes(buffer.data(), buffer.size());
+    });
+    measure("secure_random_bytes", 8192.0, "bytes", [&]() {
+        secure_random_bytes(buffer.data(), buffer.size());
+    });
+    measure("random_printable(8192)", 8192.0, "bytes", [&]() {
+        (void)random_printable(8192);
+    });
+    measure("uuid4::gen", 1.0, "uuids", [&]() { (void)uuid4::gen(); });
+    measure("secure_random_uuid4", 1.0, "uuids",
+            [&]() { (void)secure_random_uuid4(); });
+}
@@ -8,6 +8,13 @@
 
 #include "src/libmeasurement_kit/common/settings.hpp"
 
+#include <stdio.h>
+
+#include <chrono>
+#include <map>
+#include <thread>
+#include <vector>
+
 using namespace mk;
 
 TEST_CASE("The settings class convert string to int") {
@@ -157,3 +164,201 @@ TEST_CASE("The Settings::get_noexcept() method works as expected "
     REQUIRE_THROWS_AS(*rv, std::runtime_error);
     REQUIRE(settings.find("key") != settings.end());
 }
+
+TEST_CASE("Copies of Settings do not see each other's changes") {
+    Settings original = {
+        {"key", 21},
+    };
+    Settings copy = original;
+    copy["key"] = 17;
+    copy["other"] = "x";
+    REQUIRE(original.get("key", 0) == 21);
+    REQUIRE(original.count("other") == 0);
+    REQUIRE(copy.get("key", 0) == 17);
+    original["key"] = 11;
+    REQUIRE(original.get("key", 0) == 11);
+    REQUIRE(copy.get("key", 0) == 17);
+    REQUIRE(copy.erase("key") == 1);
+    REQUIRE(copy.erase("key") == 0);
+    REQUIRE(original.count("key") == 1);
+    copy.clear();
+    REQUIRE(copy.empty());
+    REQUIRE(original.size() == 1);
+}
+
+TEST_CASE("References returned by operator[] do not alias copies") {
+    Settings settings = {
+        {"key", 21},
+    };
+    Scalar &value = settings["key"];
+    Settings copy = settings;
+    Settings other;
+    other = settings;
+    value = 17;
+    REQUIRE(settings.get("key", 0) == 17);
+    REQUIRE(copy.get("key", 0) == 21);
+    REQUIRE(other.get("key", 0) == 21);
+
+    SECTION("Copies of the copy still do not alias the original") {
+        Settings copy_of_copy = copy;
+        value = 11;
+        REQUIRE(copy_of_copy.get("key", 0) == 21);
+        REQUIRE(copy.get("key", 0) == 21);
+    }
+
+    SECTION("A moved object keeps not sharing its storage") {
+        Settings moved = std::move(settings);
+        Settings copy_of_moved = moved;
+        value = 11;
+        REQUIRE(moved.get("key", 0) == 11);
+        REQUIRE(copy_of_moved.get("key", 0) == 17);
+    }
+}
+
+TEST_CASE("Settings compare equal when they have the same entries") {
+    Settings settings = {
+        {"key", 21},
+    };
+    Settings copy = settings;
+    REQUIRE(copy == settings);
+    copy["key"] = "21";
+    REQUIRE(copy == settings);
+    copy["key"] = "22";
+    REQUIRE(copy != settings);
+    REQUIRE(Settings{} == Settings{});
+}
+
+TEST_CASE("Settings notice entries modified after being parsed") {
+    Settings settings;
+    settings["key"] = 21;
+    REQUIRE(settings.get("key", 0) == 21);
+    REQUIRE(settings.get("key", 0) == 21);
+    settings["key"] += "7";
+    REQUIRE(settings.get("key", 0) == 217);
+    settings["key"] = "x";
+    REQUIRE_THROWS_AS(settings.get("key", 0), std::runtime_error);
+    REQUIRE(!settings.get_noexcept("key", 0));
+    settings["key"] = 1;
+    REQUIRE(settings.get("key", false) == true);
+    REQUIRE(settings.get("key", 0.0) == 1.0);
+    REQUIRE(settings.erase("key") == 1);
+    settings["other"] = 3;
+    REQUIRE(settings.get("other", 0) == 3);
+}
+
+template <typename Type> static bool converts_like_scalar(const Settings &s) {
+    for (auto &entry : s) {
+        ErrorOr<Type> expect = entry.second.as_noexcept<Type>();
+        ErrorOr<Type> value = s.get_noexcept(entry.first, Type{});
+        if (!!expect != !!value || (expect && *expect != *value)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+TEST_CASE("Settings::get() converts parsed entries like Scalar::as()") {
+    Settings settings = {
+        {"a", ""}, {"b", "0"}, {"c", "1"}, {"d", "2"}, {"e", "-1"},
+        {"f", "1.5"}, {"g", "x"}, {"h", "70000"}, {"i", "4294967296"},
+        {"j", "18446744073709551615"}, {"k", "99999999999999999999"},
+        {"l", "-9223372036854775808"}, {"m", "1e400"}, {"n", " 17"},
+        {"o", "17 "},
+    };
+    REQUIRE(converts_like_scalar<bool>(settings));
+    REQUIRE(converts_like_scalar<short>(settings));
+    REQUIRE(converts_like_scalar<int>(settings));
+    REQUIRE(converts_like_scalar<long>(settings));
+    REQUIRE(converts_like_scalar<long long>(settings));
+    REQUIRE(converts_like_scalar<unsigned short>(settings));
+    REQUIRE(converts_like_scalar<unsigned int>(settings));
+    REQUIRE(converts_like_scalar<unsigned long>(settings));
+    REQUIRE(converts_like_scalar<unsigned long long>(settings));
+    REQUIRE(converts_like_scalar<float>(settings));
+    REQUIRE(converts_like_scalar<double>(settings));
+    REQUIRE(converts_like_scalar<char>(settings));
+}
+
+TEST_CASE("Copies parse the entries modified through operator[]") {
+    Settings settings = {
+        {"key", 21},
+    };
+    Scalar &value = settings["key"];
+    value = "x";
+    Settings copy = settings;
+    REQUIRE(!copy.get_noexcept("key", 0));
+    value = 17;
+    copy = settings;
+    REQUIRE(copy.get("key", 0) == 17);
+    REQUIRE(copy.get("key", 0.0) == 17.0);
+}
+
+TEST_CASE("Copies of Settings can be read from many threads") {
+    Settings settings = {
+        {"a", 1}, {"b", 2.5}, {"c", "x"},
+    };
+    std::vector<std::thread> threads;
+    std::vector<int> failures(4, 0);
+    for (size_t i = 0; i < failures.size(); ++i) {
+        threads.emplace_back([settings, i, &failures]() {
+            for (int j = 0; j < 1000; ++j) {
+                Settings copy = settings;
+                if (copy.get("a", 0) != 1 || copy.get("b", 0.0) != 2.5 ||
+                    copy.get_noexcept("c", 0)) {
+                    failures[i] += 1;
+                }
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    for (auto &failure : failures) {
+        REQUIRE(failure == 0);
+    }
+}
+
+/*
+ * Benchmark comparing passing around and parsing Settings with what we used
+ * to do with std::map<std::string, Scalar>. It is hidden, run it using
+ * `./test/common/settings [benchmark]`.
+ */
+
+template <typename Func> static void measure(const char *what, Func &&func) {
+    static const int iterations = 100000;
+    auto begin = std::chrono::steady_clock::now();
+    int64_t sum = 0;
+    for (int i = 0; i < iterations; ++i) {
+        sum += func();
+    }
+    std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - begin;
+    printf("%-40s %8.1f ns/iteration (%lld)\n", what,
+           elapsed.count() * 1e09 / iterations, (long long)sum);
+}
+
+static int64_t map_hop(std::map<std::string, Scalar> m) {
+    return m.at("net/timeout").as<int64_t>() +
+           m.at("dns/attempts").as<int64_t>();
+}
+
+static int64_t settings_hop(Settings s) {
+    return s.get("net/timeout", (int64_t)0) + s.get("dns/attempts", (int64_t)0);
+}
+
+TEST_CASE("Settings copy and parse cost", "[.benchmark]") {
+    std::map<std::string, Scalar> map = {
+        {"dns/attempts", 3},
+        {"dns/engine", "system"},
+        {"dns/nameserver", "8.8.8.8"},
+        {"dns/timeout", 5.0},
+        {"http/max_redirects", 20},
+        {"http/method", "GET"},
+        {"http/url", "https://www.example.com/"},
+        {"net/ca_bundle_path", "/etc/ssl/cert.pem"},
+        {"net/timeout", 10},
+    };
+    Settings settings{map.begin(), map.end()};
+    measure("std::map: copy and parse", [&]() { return map_hop(map); });
+    measure("Settings: copy and parse", [&]() { return settings_hop(settings); });
+}
@@ -0,0 +1,214 @@
+// Part of Measurement Kit <https://measurement-kit.github.io/>.
+// Measurement Kit is free software under the BSD license. See AUTHORS
+// and LICENSE for more information on the copying conditions.
+
+#include "test/winsock.hpp"
+
+#include "include/private/catch.hpp"
+
+#include "src/libmeasurement_kit/common/libevent_reactor.hpp"
+#include "src/libmeasurement_kit/common/timer_wheel.hpp"
+#include "src/libmeasurement_kit/common/utils.hpp"
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+using namespace mk;
+
+// Runs the expired timers and returns the number of timers that were run.
+static size_t run_expired(TimerWheel &wheel) {
+    size_t count = 0;
+    UniqueCallback<> func;
+    while (wheel.pop_expired(func)) {
+        func();
+        ++count;
+    }
+    return count;
+}
+
+TEST_CASE("TimerWheel works as expected") {
+    SECTION("Timers expire at the right tick") {
+        // Use a large initial time to check that we wrap around correctly
+        TimerWheel wheel{(1ULL << 40) + 17};
+        std::mt19937_64 rng{17};
+        std::vector<uint64_t> expected, expired;
+        for (size_t i = 0; i < 4096; ++i) {
+            uint64_t delay = rng() % (1ULL << (8 + (i % 17)));
+            delay = (delay > 0) ? delay : 1;
+            uint64_t when = wheel.now() + delay;
+            expected.push_back(when);
+            wheel.schedule(delay, [&expired, &wheel, when]() {
+                REQUIRE(wheel.now() == when);
+                expired.push_back(when);
+            });
+        }
+        REQUIRE(wheel.size() == 4096);
+        while (wheel.next_expiry() != 0) {
+            uint64_t next = wheel.next_expiry();
+            REQUIRE(next > wheel.now());
+            wheel.advance(next);
+            run_expired(wheel);
+        }
+        REQUIRE(wheel.size() == 0);
+        std::sort(expected.begin(), expected.end());
+        REQUIRE(expired == expected);
+    }
+
+    SECTION("Advancing in big steps works") {
+        TimerWheel wheel{0};
+        size_t called = 0;
+        wheel.schedule(10, [&]() { ++called; });
+        wheel.schedule(1000, [&]() { ++called; });
+        wheel.schedule(100000, [&]() { ++called; });
+        wheel.advance(9);
+        REQUIRE(run_expired(wheel) == 0);
+        wheel.advance(999999);
+        REQUIRE(run_expired(wheel) == 3);
+        REQUIRE(called == 3);
+        REQUIRE(wheel.now() == 999999);
+        REQUIRE(wheel.next_expiry() == 0);
+    }
+
+    SECTION("Timers with the same expiry run in FIFO order") {
+        TimerWheel wheel{0};
+        std::vector<int> order;
+        for (int i = 0; i < 8; ++i) {
+            wheel.schedule(300, [&order, i]() { order.push_back(i); });
+        }
+        wheel.advance(300);
+        REQUIRE(run_expired(wheel) == 8);
+        REQUIRE((order == std::vector<int>{0, 1, 2, 3, 4, 5, 6, 7}));
+    }
+
+    SECTION("A zero delay is rounded up to one tick") {
+        TimerWheel wheel{7};
+        wheel.schedule(0, []() {});
+        REQUIRE(wheel.next_expiry() == 8);
+    }
+
+    SECTION("Too long delays are truncated") {
+        TimerWheel wheel{0};
+        wheel.schedule(TimerWheel::max_delay + 1000, []() {});
+        wheel.advance(TimerWheel::max_delay);
+        REQUIRE(run_expired(wheel) == 1);
+    }
+
+    SECTION("Cancel works as expected") {
+        TimerWheel wheel{0};
+        bool called = false;
+        auto id = wheel.schedule(100000, [&]() { called = true; });
+        REQUIRE(wheel.cancel(id));
+        REQUIRE(!wheel.cancel(id));
+        REQUIRE(wheel.size() == 0);
+        REQUIRE(wheel.next_expiry() == 0);
+        wheel.advance(200000);
+        REQUIRE(run_expired(wheel) == 0);
+        REQUIRE(!called);
+    }
+
+    SECTION("Cancel works for expired timers not run yet") {
+        TimerWheel wheel{0};
+        auto id = wheel.schedule(10, []() {});
+        wheel.advance(10);
+        REQUIRE(wheel.cancel(id));
+        REQUIRE(run_expired(wheel) == 0);
+    }
+
+    SECTION("Cancel does not affect reused nodes") {
+        TimerWheel wheel{0};
+        auto id = wheel.schedule(10, []() {});
+        wheel.advance(10);
+        REQUIRE(run_expired(wheel) == 1);
+        bool called = false;
+        wheel.schedule(10, [&]() { called = true; }); // reuses the node
+        REQUIRE(!wheel.cancel(id));
+        wheel.advance(20);
+        REQUIRE(run_expired(wheel) == 1);
+        REQUIRE(called);
+    }
+
+    SECTION("Cancel deals with invalid ids") {
+        TimerWheel wheel{0};
+        REQUIRE(!wheel.cancel(0));
+        REQUIRE(!wheel.cancel(1234));
+    }
+}
+
+/*
+ * Benchmarks comparing the timer wheel with event_base_once(), which is
+ * what LibeventReactor::call_later() used before. They are hidden, run
+ * them using `./test/common/timer_wheel [benchmark]`.
+ */
+
+static const size_t timers_count = 100000;
+
+static void report(const char *what, double elapsed) {
+    printf("%-48s %8.3f s %10.0f timers/s\n", what, elapsed,
+           timers_count / elapsed);
+}
+
+extern "C" {
+static void benchmark_once_cb(evutil_socket_t, short, void *opaque) {
+    ++*static_cast<size_t *>(opaque);
+}
+} // extern "C"
+
+TEST_CASE("Timer arm/fire/cancel throughput", "[.benchmark]") {
+    std::mt19937_64 rng{17};
+    std::vector<double> delays;
+    for (size_t i = 0; i < timers_count; ++i) {
+        delays.push_back((rng() % 100) / 1000.0); // [0, 100) ms
+    }
+
+    SECTION("event_base_once() arm and fire") {
+        LibeventReactor<> reactor;
+        size_t fired = 0;
+        double begin = time_now();
+        for (auto delay : delays) {
+            timeval tv{};
+            if (event_base_once(reactor.get_event_base(), -1, EV_TIMEOUT,
+                        benchmark_once_cb, &fired,
+                        timeval_init(&tv, delay)) != 0) {
+                FAIL("event_base_once");
+            }
+        }
+        report("event_base_once: arm", time_now() - begin);
+        reactor.run();
+        report("event_base_once: arm and fire", time_now() - begin);
+        REQUIRE(fired == timers_count);
+    }
+
+    SECTION("call_later() arm and fire") {
+        LibeventReactor<> reactor;
+        size_t fired = 0;
+        double begin = time_now();
+        for (auto delay : delays) {
+            reactor.call_later(delay, [&]() { ++fired; });
+        }
+        report("call_later: arm", time_now() - begin);
+        reactor.run();
+        report("call_later: arm and fire", time_now() - begin);
+        REQUIRE(fired == timers_count);
+    }
+
+    SECTION("call_later() arm and cancel") {
+        LibeventReactor<> reactor;
+        std::vector<TimerHandle> handles;
+        handles.reserve(timers_count);
+        double begin = time_now();
+        for (auto delay : delays) {
+            handles.push_back(reactor.call_later(delay + 10.0, []() {}));
+        }
+        size_t cancelled = 0;
+        for (auto &handle : handles) {
+            cancelled += reactor.cancel(handle) ? 1 : 0;
+        }
+        report("call_later: arm and cancel", time_now() - begin);
+        REQUIRE(cancelled == timers_count);
+        reactor.run(); // should return immediately
+        report("call_later: arm, cancel and run", time_now() - begin);
+    }
+}
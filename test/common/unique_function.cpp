@@ -0,0 +1,215 @@
+// Part of Measurement Kit <https://measurement-kit.github.io/>.
+// Measurement Kit is free software under the BSD license. See AUTHORS
+// and LICENSE for more information on the copying conditions.
+
+#include "test/winsock.hpp"
+
+#include "include/private/catch.hpp"
+
+#include "src/libmeasurement_kit/common/callback.hpp"
+#include "src/libmeasurement_kit/common/delegate.hpp"
+#include "src/libmeasurement_kit/common/reactor.hpp"
+#include "src/libmeasurement_kit/common/unique_function.hpp"
+#include "src/libmeasurement_kit/http/http.hpp"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>
+
+using namespace mk;
+
+// Count heap allocations, so we can check what stays inline.
+static std::atomic<uint64_t> allocations{0};
+
+void *operator new(size_t size) {
+    ++allocations;
+    void *p = std::malloc((size > 0) ? size : 1);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+
+TEST_CASE("UniqueFunction works as expected") {
+    SECTION("An empty function is false and throws when called") {
+        UniqueCallback<> func;
+        REQUIRE(!func);
+        REQUIRE_THROWS_AS(func(), std::bad_function_call);
+        UniqueCallback<> other = nullptr;
+        REQUIRE(!other);
+        UniqueCallback<> from_empty = Callback<>{};
+        REQUIRE(!from_empty);
+    }
+
+    SECTION("Lambdas capturing a few SharedPtr are stored inline") {
+        SharedPtr<int> a{new int{1}}, b{new int{2}}, c{new int{3}};
+        uint64_t before = allocations;
+        UniqueFunction<int(int)> func = [a, b, c](int x) {
+            return *a + *b + *c + x;
+        };
+        UniqueFunction<int(int)> moved = std::move(func);
+        REQUIRE(allocations == before);
+        REQUIRE(!moved.heap_allocated());
+        REQUIRE(!func);
+        REQUIRE(moved(4) == 10);
+        REQUIRE(a.use_count() == 2);
+        moved = nullptr;
+        REQUIRE(a.use_count() == 1);
+    }
+
+    SECTION("Large callables are stored on the heap") {
+        char buffer[UniqueCallback<>::inline_size + 1] = {};
+        bool called = false;
+        UniqueCallback<> func = [buffer, &called]() {
+            called = (buffer[0] == 0);
+        };
+        REQUIRE(func.heap_allocated());
+        UniqueCallback<> moved = std::move(func);
+        moved();
+        REQUIRE(called);
+    }
+
+    SECTION("Move-only callables are supported") {
+        std::unique_ptr<std::string> str{new std::string{"foo"}};
+        UniqueFunction<std::string()> func = [str = std::move(str)]() {
+            return *str;
+        };
+        REQUIRE(func() == "foo");
+    }
+
+    SECTION("Arguments are forwarded") {
+        UniqueCallback<std::string &, std::unique_ptr<int>> func =
+                [](std::string &s, std::unique_ptr<int> p) {
+                    s += std::to_string(*p);
+                };
+        std::string s = "x";
+        func(s, std::unique_ptr<int>{new int{17}});
+        REQUIRE(s == "x17");
+    }
+
+    SECTION("The reactor does not allocate to move callbacks around") {
+        SharedPtr<Reactor> reactor = Reactor::make();
+        SharedPtr<int> a{new int{1}}, b{new int{2}}, c{new int{3}};
+        uint64_t delta = 0;
+        reactor->run_with_initial_event([&]() {
+            uint64_t before = allocations;
+            reactor->call_later(0.001, [a, b, c, &delta, before]() {
+                delta = allocations - before;
+            });
+        });
+        // The timer wheel may allocate its first node, while with
+        // std::function we would also allocate to store the lambda.
+        REQUIRE(delta <= 1);
+    }
+}
+
+TEST_CASE("Delegate stores handlers inline") {
+    SharedPtr<int> a{new int{1}}, b{new int{2}}, c{new int{3}};
+    Delegate<int> delegate;
+    int sum = 0;
+    uint64_t before = allocations;
+    for (int i = 0; i < 16; ++i) {
+        // Like an emitter hook registered again from within itself
+        delegate = [&, a, b, c](int x) {
+            delegate = [&, a, b, c](int y) { sum += *a + *b + *c + y; };
+            sum += x;
+        };
+        delegate(1);
+        delegate(2);
+    }
+    REQUIRE(allocations == before);
+    REQUIRE(sum == 16 * (1 + 6 + 2));
+}
+
+/*
+ * Benchmark counting the allocations of an HTTP request to a loopback
+ * server. It is hidden, run it using `./test/common/unique_function
+ * [benchmark]`.
+ */
+
+// Serves `count` HTTP requests using blocking I/O.
+static void serve(int fd, size_t count) {
+    static const char response[] = "HTTP/1.1 200 OK\r\n"
+                                   "Content-Type: text/plain\r\n"
+                                   "Content-Length: 13\r\n"
+                                   "Connection: close\r\n"
+                                   "\r\n"
+                                   "Hello, world!";
+    for (size_t i = 0; i < count; ++i) {
+        int conn = accept(fd, nullptr, nullptr);
+        if (conn == -1) {
+            return;
+        }
+        char buffer[4096];
+        std::string request;
+        while (request.find("\r\n\r\n") == std::string::npos) {
+            ssize_t n = recv(conn, buffer, sizeof(buffer), 0);
+            if (n <= 0) {
+                break;
+            }
+            request.append(buffer, (size_t)n);
+        }
+        (void)send(conn, response, sizeof(response) - 1, 0);
+        ::close(conn);
+    }
+}
+
+TEST_CASE("Allocations per HTTP request", "[.benchmark]") {
+    static const size_t requests_count = 200;
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    REQUIRE(fd != -1);
+    sockaddr_in sin{};
+    sin.sin_family = AF_INET;
+    sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(sin);
+    REQUIRE(bind(fd, (sockaddr *)&sin, sizeof(sin)) == 0);
+    REQUIRE(listen(fd, 128) == 0);
+    REQUIRE(getsockname(fd, (sockaddr *)&sin, &len) == 0);
+    std::thread server{serve, fd, requests_count};
+    std::string url = "http://127.0.0.1:";
+    url += std::to_string(ntohs(sin.sin_port));
+    url += "/";
+
+    SharedPtr<Reactor> reactor = Reactor::make();
+    SharedPtr<Logger> logger = Logger::make();
+    size_t successes = 0;
+    // Run the requests one after the other, to avoid measuring the
+    // allocations caused by having many pending requests.
+    Callback<size_t> next;
+    uint64_t before = allocations;
+    reactor->run_with_initial_event([&]() {
+        next = [&](size_t n) {
+            if (n >= requests_count) {
+                return;
+            }
+            http::request({{"http/url", url}}, {}, "",
+                    [&, n](Error error, SharedPtr<http::Response> response) {
+                        if (!error && response->status_code == 200) {
+                            ++successes;
+                        }
+                        reactor->call_soon([&, n]() { next(n + 1); });
+                    },
+                    reactor, logger);
+        };
+        next(0);
+    });
+    uint64_t total = allocations - before;
+    server.join();
+    ::close(fd);
+    printf("%-48s %10.1f\n", "http::request: allocations per request",
+           (double)total / requests_count);
+    REQUIRE(successes == requests_count);
+}
@@ -11,8 +11,10 @@
 
 #include <measurement_kit/common.hpp>
 
+#include <atomic>
 #include <chrono>
 #include <iostream>
+#include <mutex>
 #include <thread>
 
 TEST_CASE("The worker is robust to submitting many tasks in a row") {
@@ -29,8 +31,58 @@ TEST_CASE("The worker is robust to submitting many tasks in a row") {
         auto concurrency = worker->concurrency();
         std::cout << "Concurrency: " << concurrency << "\n";
         REQUIRE(concurrency <= worker->parallelism());
-        if (concurrency == 0) {
+        if (worker->pending() == 0) {
             break;
         }
     }
 }
+
+TEST_CASE("The worker reuses its threads") {
+    mk::Worker worker{2};
+    std::atomic<size_t> count{0};
+    for (size_t i = 0; i < 1000; ++i) {
+        worker.call_in_thread(mk::Logger::make(), [&]() { ++count; });
+    }
+    while (worker.pending() > 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    REQUIRE(count == 1000);
+    auto stats = worker.stats();
+    REQUIRE(stats.completed == 1000);
+    REQUIRE(stats.queue_depth == 0);
+    REQUIRE(stats.max_queue_depth >= 1);
+    REQUIRE(stats.threads >= 1);
+    REQUIRE(stats.threads <= 2);
+    REQUIRE(stats.total_wait_time >= stats.max_wait_time);
+}
+
+TEST_CASE("The worker runs work submitted after a period of inactivity") {
+    mk::Worker worker{1};
+    std::atomic<size_t> count{0};
+    for (size_t i = 0; i < 3; ++i) {
+        worker.call_in_thread(mk::Logger::make(), [&]() { ++count; });
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        REQUIRE(count == i + 1);
+        REQUIRE(worker.stats().threads == 1);
+    }
+}
+
+TEST_CASE("The worker throws when its queue is full") {
+    mk::Worker worker{1, 2};
+    std::mutex mutex;
+    std::unique_lock<std::mutex> lock{mutex};
+    auto blocking = [&]() { std::unique_lock<std::mutex> _{mutex}; };
+    worker.call_in_thread(mk::Logger::make(), blocking);
+    // Wait for the thread to pick up the first callback
+    while (worker.concurrency() == 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    worker.call_in_thread(mk::Logger::make(), blocking);
+    worker.call_in_thread(mk::Logger::make(), blocking);
+    REQUIRE_THROWS(worker.call_in_thread(mk::Logger::make(), blocking));
+    REQUIRE(worker.pending() == 3);
+    lock.unlock();
+    while (worker.pending() > 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+}
@@ -0,0 +1,238 @@
+// Part of Measurement Kit <https://measurement-kit.github.io/>.
+// Measurement Kit is free software under the BSD license. See AUTHORS
+// and LICENSE for more information on the copying conditions.
+
+#include "test/winsock.hpp"
+
+#include "include/private/catch.hpp"
+
+#include "src/libmeasurement_kit/dns/bulk_query.hpp"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <thread>
+
+using namespace mk;
+using namespace mk::dns;
+
+/*
+ * A local nameserver answering all A queries with 127.0.0.1, except the
+ * names starting with `nx` that do not exist.
+ */
+class Responder {
+  public:
+    Responder() {
+        sockaddr_in sin{};
+        sin.sin_family = AF_INET;
+        sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t sinlen = sizeof(sin);
+        fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+        REQUIRE(::bind(fd, (sockaddr *)&sin, sizeof(sin)) == 0);
+        REQUIRE(::getsockname(fd, (sockaddr *)&sin, &sinlen) == 0);
+        port = ntohs(sin.sin_port);
+        thread = std::thread{[this]() { loop(); }};
+    }
+
+    ~Responder() {
+        stop = true;
+        thread.join();
+        ::close(fd);
+    }
+
+    int port = 0;
+
+  private:
+    void loop() {
+        char buffer[512];
+        while (!stop) {
+            pollfd pfd = {fd, POLLIN, 0};
+            if (::poll(&pfd, 1, 50) <= 0) {
+                continue;
+            }
+            sockaddr_storage ss{};
+            socklen_t sslen = sizeof(ss);
+            ssize_t n = ::recvfrom(fd, buffer, sizeof(buffer), 0,
+                                   (sockaddr *)&ss, &sslen);
+            if (n < 17) {
+                continue;
+            }
+            // Echo the query without its OPT record, if any, and append
+            // an answer pointing to the question
+            size_t end = 12;
+            while (end < (size_t)n && buffer[end] != '\0') {
+                end += (uint8_t)buffer[end] + 1;
+            }
+            end += 5;
+            if (end > (size_t)n) {
+                continue;
+            }
+            std::string reply{buffer, end};
+            reply[2] = (char)0x81;
+            reply[11] = 0;
+            if (reply.compare(13, 2, "nx") == 0) {
+                reply[3] = (char)0x83; // NXDOMAIN
+            } else {
+                reply[3] = (char)0x80;
+                reply[7] = 1;
+                reply += std::string("\xc0\x0c\x00\x01\x00\x01\x00\x00\x00\x3c"
+                                     "\x00\x04\x7f\x00\x00\x01",
+                                     16);
+            }
+            ::sendto(fd, reply.data(), reply.size(), 0, (sockaddr *)&ss,
+                     sslen);
+        }
+    }
+
+    int fd = -1;
+    std::atomic<bool> stop{false};
+    std::thread thread;
+};
+
+static std::vector<BulkQuery> make_queries(size_t count) {
+    std::vector<BulkQuery> queries;
+    for (size_t i = 0; i < count; ++i) {
+        BulkQuery query;
+        query.type = MK_DNS_TYPE_A;
+        query.name = ((i % 10 == 0) ? "nx" : "www") + std::to_string(i) +
+                     ".example.com";
+        queries.push_back(query);
+    }
+    return queries;
+}
+
+TEST_CASE("bulk_window_key() works as expected") {
+    REQUIRE(bulk_window_key({}) == "system");
+    REQUIRE(bulk_window_key({{"dns/engine", "native"}}) ==
+            "resolv_conf=/etc/resolv.conf");
+    REQUIRE(bulk_window_key({{"dns/engine", "libevent"},
+                             {"dns/resolv_conf", "x.conf"}}) ==
+            "resolv_conf=x.conf");
+    // The engine does not matter when the nameserver is the same
+    REQUIRE(bulk_window_key({{"dns/engine", "libevent"},
+                             {"dns/nameserver", "8.8.8.8"}}) ==
+            bulk_window_key({{"dns/engine", "native"},
+                             {"dns/nameserver", "8.8.8.8"},
+                             {"dns/port", 53}}));
+}
+
+static Settings bulk_settings(std::string engine, int port) {
+    return {{"dns/engine", engine},
+            {"dns/nameserver", "127.0.0.1"},
+            {"dns/port", port},
+            {"dns/max_in_flight", 4}};
+}
+
+static void check_window(std::string engine) {
+    Responder responder;
+    Settings settings = bulk_settings(engine, responder.port);
+    std::string key = bulk_window_key(settings);
+    SharedPtr<Reactor> reactor = Reactor::make();
+    std::vector<BulkResult> streamed;
+    std::vector<BulkResult> results;
+    size_t max_in_flight = 0;
+    reactor->run_with_initial_event([&]() {
+        bulk_query(make_queries(200),
+                   [&](const BulkResult &result) {
+                       max_in_flight = std::max(
+                               max_in_flight, bulk_in_flight(reactor, key) + 1);
+                       streamed.push_back(result);
+                   },
+                   [&](std::vector<BulkResult> r) { results = r; },
+                   settings, reactor, Logger::make());
+    });
+    REQUIRE(max_in_flight <= 4);
+    REQUIRE(streamed.size() == 200);
+    REQUIRE(results.size() == 200);
+    for (size_t i = 0; i < results.size(); ++i) {
+        REQUIRE(results[i].index == i);
+        REQUIRE(results[i].query.name == make_queries(200)[i].name);
+        REQUIRE(results[i].queued >= 0.0);
+        REQUIRE(results[i].elapsed > 0.0);
+        if (i % 10 == 0) {
+            REQUIRE(results[i].error == NotExistError());
+        } else {
+            REQUIRE(results[i].error == NoError());
+            REQUIRE(results[i].message->answers.size() == 1);
+            REQUIRE(results[i].message->answers[0].ipv4 == "127.0.0.1");
+        }
+    }
+    // The last queries waited for the first ones
+    REQUIRE(results[199].queued > results[0].queued);
+}
+
+static void check_shared_window(std::string engine) {
+    Responder responder;
+    Settings settings = bulk_settings(engine, responder.port);
+    std::string key = bulk_window_key(settings);
+    SharedPtr<Reactor> reactor = Reactor::make();
+    size_t max_in_flight = 0;
+    size_t completed = 0;
+    auto on_result = [&](const BulkResult &) {
+        max_in_flight = std::max(max_in_flight,
+                                 bulk_in_flight(reactor, key) + 1);
+    };
+    reactor->run_with_initial_event([&]() {
+        for (int i = 0; i < 3; ++i) {
+            bulk_query(make_queries(50), on_result,
+                       [&](std::vector<BulkResult>) { completed += 1; },
+                       settings, reactor, Logger::make());
+        }
+        REQUIRE(bulk_in_flight(reactor, key) == 4);
+    });
+    REQUIRE(completed == 3);
+    REQUIRE(max_in_flight <= 4);
+}
+
+TEST_CASE("bulk_query() bounds the queries in flight") {
+    SECTION("With the libevent engine") {
+        check_window("libevent");
+    }
+    SECTION("With the native engine") {
+        check_window("native");
+    }
+}
+
+TEST_CASE("Batches using the same nameservers share the window") {
+    SECTION("With the libevent engine") {
+        check_shared_window("libevent");
+    }
+    SECTION("With the native engine") {
+        check_shared_window("native");
+    }
+}
+
+TEST_CASE("bulk_query() deals with corner cases") {
+    SharedPtr<Reactor> reactor = Reactor::make();
+
+    SECTION("With no queries") {
+        bool called = false;
+        reactor->run_with_initial_event([&]() {
+            bulk_query({}, nullptr,
+                       [&](std::vector<BulkResult> results) {
+                           REQUIRE(results.empty());
+                           called = true;
+                       },
+                       {}, reactor, Logger::make());
+            REQUIRE(!called); // Not immediately
+        });
+        REQUIRE(called);
+    }
+
+    SECTION("With an invalid window") {
+        std::vector<BulkResult> results;
+        reactor->run_with_initial_event([&]() {
+            bulk_query(make_queries(3), nullptr,
+                       [&](std::vector<BulkResult> r) { results = r; },
+                       {{"dns/max_in_flight", 0}}, reactor, Logger::make());
+        });
+        REQUIRE(results.size() == 3);
+        for (auto &result : results) {
+            REQUIRE(result.error == ValueError());
+        }
+    }
+}
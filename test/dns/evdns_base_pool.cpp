@@ -0,0 +1,98 @@
+// Part of Measurement Kit <https://measurement-kit.github.io/>.
+// Measurement Kit is free software under the BSD license. See AUTHORS
+// and LICENSE for more information on the copying conditions.
+
+#include "test/winsock.hpp"
+
+#include "include/private/catch.hpp"
+
+#include "src/libmeasurement_kit/dns/evdns_base_pool.hpp"
+#include "src/libmeasurement_kit/dns/query.hpp"
+
+#include <event2/dns.h>
+
+using namespace mk;
+using namespace mk::dns;
+
+TEST_CASE("evdns_base_key() only depends on the relevant settings") {
+    REQUIRE(evdns_base_key({}) == "");
+    REQUIRE(evdns_base_key({{"dns/engine", "libevent"}}) == "");
+    REQUIRE(evdns_base_key({{"dns/nameserver", "8.8.8.8"},
+                            {"dns/timeout", 1.5}}) ==
+            " dns/nameserver=8.8.8.8 dns/timeout=1.5");
+}
+
+TEST_CASE("EvdnsBasePool works as expected") {
+    EvdnsBasePool pool;
+    int created = 0;
+    auto create_for = [&](SharedPtr<Reactor> reactor) {
+        return [&created, reactor]() {
+            ++created;
+            return evdns_base_new(reactor->get_event_base(),
+                                  EVDNS_BASE_DISABLE_WHEN_INACTIVE);
+        };
+    };
+    Settings settings{{"dns/nameserver", "127.0.0.1"}};
+
+    SECTION("It shares bases with the same reactor and settings") {
+        SharedPtr<Reactor> reactor = Reactor::make();
+        SharedPtr<Reactor> other = Reactor::make();
+        evdns_base *base = pool.acquire(reactor, settings, create_for(reactor));
+        REQUIRE(pool.acquire(reactor, settings, create_for(reactor)) == base);
+        REQUIRE(created == 1);
+        Settings different = settings;
+        different["dns/timeout"] = 1.0;
+        REQUIRE(pool.acquire(reactor, different, create_for(reactor)) != base);
+        REQUIRE(pool.acquire(other, settings, create_for(other)) != base);
+        REQUIRE(created == 3);
+        REQUIRE(pool.size(reactor) == 2);
+        REQUIRE(pool.size(other) == 1);
+        pool.release(base);
+        pool.release(base);
+        SECTION("And frees them when the reactor stops") {
+            reactor->run();
+            REQUIRE(pool.size(reactor) == 0);
+            REQUIRE(pool.size(other) == 1);
+            pool.acquire(reactor, settings, create_for(reactor));
+            REQUIRE(created == 4);
+        }
+        SECTION("Or when the reactor is destroyed") {
+            reactor = nullptr;
+            other = nullptr;
+        }
+    }
+
+    SECTION("It keeps bases in use when the reactor stops") {
+        SharedPtr<Reactor> reactor = Reactor::make();
+        evdns_base *base = pool.acquire(reactor, settings, create_for(reactor));
+        reactor->run();
+        REQUIRE(pool.size(reactor) == 0);
+        // The base is not reused but it is still valid
+        REQUIRE(pool.acquire(reactor, settings, create_for(reactor)) != base);
+        REQUIRE(evdns_base_count_nameservers(base) == 0);
+        pool.release(base);
+    }
+}
+
+TEST_CASE("The libevent engine shares bases among queries") {
+    SharedPtr<Reactor> reactor = Reactor::make();
+    // Nobody is listening on this port, so queries fail quickly
+    Settings settings{{"dns/engine", "libevent"},
+                      {"dns/nameserver", "127.0.0.1"},
+                      {"dns/port", "9"},
+                      {"dns/attempts", 1},
+                      {"dns/timeout", 0.5}};
+    size_t pooled = 0;
+    int done = 0;
+    reactor->run_with_initial_event([&]() {
+        for (auto name : {"www.example.com", "www.example.org"}) {
+            query("IN", "A", name, [&](Error, SharedPtr<Message>) {
+                pooled = EvdnsBasePool::global().size(reactor);
+                ++done;
+            }, settings, reactor, Logger::make());
+        }
+    });
+    REQUIRE(done == 2);
+    REQUIRE(pooled == 1);
+    REQUIRE(EvdnsBasePool::global().size(reactor) == 0);
+}
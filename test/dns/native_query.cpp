@@ -0,0 +1,447 @@
+// Part of Measurement Kit <https://measurement-kit.github.io/>.
+// Measurement Kit is free software under the BSD license. See AUTHORS
+// and LICENSE for more information on the copying conditions.
+
+#include "test/winsock.hpp"
+
+#include "include/private/catch.hpp"
+
+#include "src/libmeasurement_kit/common/utils.hpp"
+#include "src/libmeasurement_kit/dns/native_query.hpp"
+
+#include <event2/dns.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdio.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+using namespace mk;
+using namespace mk::dns;
+
+TEST_CASE("parse_resolv_conf() works as expected") {
+    ResolvConf conf = parse_resolv_conf("# comment\n"
+                                        "search example.com\n"
+                                        "nameserver 8.8.8.8\n"
+                                        "nameserver\n"
+                                        "  nameserver   ::1  \n"
+                                        "options ndots:2 timeout:3 "
+                                        "attempts:9\n");
+    REQUIRE(conf.nameservers.size() == 2);
+    REQUIRE(conf.nameservers[0].address == "8.8.8.8");
+    REQUIRE(conf.nameservers[1].address == "::1");
+    REQUIRE(conf.nameservers[1].port == 53);
+    REQUIRE(conf.timeout == 3.0);
+    REQUIRE(conf.attempts == 2); // 9 is out of range
+}
+
+TEST_CASE("native_resolv_conf() works as expected") {
+    SECTION("When the nameserver is set") {
+        ErrorOr<ResolvConf> conf = native_resolv_conf(
+                {{"dns/nameserver", "127.0.0.1"}, {"dns/port", 5353},
+                 {"dns/timeout", 0.5}});
+        REQUIRE(!!conf);
+        REQUIRE(conf->nameservers.size() == 1);
+        REQUIRE(conf->nameservers[0].port == 5353);
+        REQUIRE(conf->timeout == 0.5);
+        REQUIRE(conf->attempts == 2);
+        REQUIRE(native_resolv_conf({{"dns/nameserver", "127.0.0.1"},
+                                    {"dns/port", 0}})
+                        .as_error() == ValueError());
+    }
+
+    SECTION("When reading the resolv.conf file") {
+        REQUIRE(overwrite_file("native_resolv.conf",
+                               "nameserver 1.1.1.1\noptions attempts:1\n") ==
+                NoError());
+        ErrorOr<ResolvConf> conf = native_resolv_conf(
+                {{"dns/resolv_conf", "native_resolv.conf"}});
+        REQUIRE(!!conf);
+        REQUIRE(conf->nameservers[0].address == "1.1.1.1");
+        REQUIRE(conf->attempts == 1);
+        REQUIRE(overwrite_file("native_resolv.conf", "") == NoError());
+        REQUIRE(native_resolv_conf({{"dns/resolv_conf", "native_resolv.conf"}})
+                        .as_error() == ResolverError());
+        REQUIRE(!native_resolv_conf({{"dns/resolv_conf", "/nonexistent"}}));
+    }
+}
+
+TEST_CASE("serialize_query() works as expected") {
+    REQUIRE(serialize_query(0x1234, "a.bc.", 1, 1, 0) ==
+            std::string("\x12\x34\x01\x00\x00\x01\x00\x00\x00\x00\x00\x00"
+                        "\x01" "a" "\x02" "bc" "\x00"
+                        "\x00\x01\x00\x01", 22));
+    std::string query = serialize_query(0, "a.bc", 28, 1, 1232);
+    REQUIRE(query.size() == 22 + 11);
+    REQUIRE(query[11] == 1); // ARCOUNT
+    REQUIRE(query.substr(22) ==
+            std::string("\x00\x00\x29\x04\xd0\x00\x00\x00\x00\x00\x00", 11));
+    REQUIRE(serialize_query(0, ".", 2, 1, 0).size() == 17);
+    REQUIRE_THROWS(serialize_query(0, "", 1, 1, 0));
+    REQUIRE_THROWS(serialize_query(0, "a..b", 1, 1, 0));
+    REQUIRE_THROWS(serialize_query(0, std::string(64, 'a'), 1, 1, 0));
+    std::string label(63, 'a');
+    REQUIRE_THROWS(serialize_query(
+            0, label + "." + label + "." + label + "." + label, 1, 1, 0));
+}
+
+TEST_CASE("wire_query_type() works as expected") {
+    REQUIRE(wire_query_type("A") == 1);
+    REQUIRE(wire_query_type("SOA") == 6);
+    REQUIRE(wire_query_type("TXT") == 16);
+    REQUIRE(wire_query_type("AAAA") == 28);
+    REQUIRE(wire_query_type("HTTPS") == 65);
+    REQUIRE(wire_query_type("REVERSE_A") == 0);
+    REQUIRE(wire_query_type("") == 0);
+}
+
+// Returns a response to `query` with the given flags and answers
+static std::string make_reply(const std::string &query, uint16_t flags,
+                              uint16_t ancount, const std::string &answers) {
+    size_t end = 12;
+    while (query[end] != '\0') {
+        end += (uint8_t)query[end] + 1;
+    }
+    end += 5;
+    std::string reply = query.substr(0, end);
+    reply[2] = (char)(flags >> 8);
+    reply[3] = (char)(flags & 0xff);
+    reply[6] = (char)(ancount >> 8);
+    reply[7] = (char)(ancount & 0xff);
+    reply[11] = 0; // No OPT record in the reply
+    return reply + answers;
+}
+
+// Answer whose name is a pointer to the question
+static std::string make_answer(uint16_t type, std::string rdata) {
+    std::string answer{"\xc0\x0c", 2};
+    answer += (char)(type >> 8);
+    answer += (char)(type & 0xff);
+    answer += std::string("\x00\x01\x00\x00\x01\x2c", 6); // IN, TTL 300
+    answer += (char)(rdata.size() >> 8);
+    answer += (char)(rdata.size() & 0xff);
+    return answer + rdata;
+}
+
+TEST_CASE("parse_reply() works as expected") {
+    std::string query = serialize_query(0xabcd, "www.example.com", 1, 1, 512);
+    Message message;
+
+    SECTION("With answers") {
+        std::string reply = make_reply(
+                query, 0x8180, 3,
+                make_answer(5, std::string("\x03" "www" "\x01" "x\xc0\x10",
+                                           8)) +
+                make_answer(16, std::string("\x03" "abc", 4)) +
+                make_answer(1, std::string("\x01\x02\x03\x04", 4)));
+        REQUIRE(is_reply_to(reply, query));
+        REQUIRE(parse_reply(reply, message) == NoError());
+        REQUIRE(message.error_code == DNS_ERR_NONE);
+        // TXT is only in message.wire because Answer cannot represent it
+        REQUIRE(message.answers.size() == 2);
+        REQUIRE(message.wire);
+        REQUIRE(message.wire->answers.size() == 3);
+        REQUIRE(message.wire->answers[1].type == MK_DNS_WIRE_TYPE_TXT);
+        REQUIRE(message.answers[0].type == MK_DNS_TYPE_CNAME);
+        REQUIRE(message.answers[0].name == "www.example.com");
+        REQUIRE(message.answers[0].hostname == "www.x.example.com");
+        REQUIRE(message.answers[0].ttl == 300);
+        REQUIRE(message.answers[1].type == MK_DNS_TYPE_A);
+        REQUIRE(message.answers[1].qclass == MK_DNS_CLASS_IN);
+        REQUIRE(message.answers[1].ipv4 == "1.2.3.4");
+    }
+
+    SECTION("With answers that Answer cannot represent") {
+        std::string reply = make_reply(
+                query, 0x8180, 2,
+                make_answer(16, std::string("\x03" "abc", 4)) +
+                make_answer(15, std::string("\x00\x0a" "\x02" "mx\xc0\x10",
+                                            7)));
+        REQUIRE(parse_reply(reply, message) == NoError());
+        REQUIRE(message.error_code == DNS_ERR_NONE);
+        REQUIRE(message.answers.empty());
+        REQUIRE(message.wire);
+        REQUIRE(message.wire->answers.size() == 2);
+        REQUIRE(message.wire->answers[0].type == MK_DNS_WIRE_TYPE_TXT);
+        REQUIRE(message.wire->answers[1].type == MK_DNS_WIRE_TYPE_MX);
+    }
+
+    SECTION("With an error") {
+        std::string reply = make_reply(query, 0x8183, 0, "");
+        REQUIRE(parse_reply(reply, message) == NotExistError());
+        REQUIRE(message.error_code == DNS_ERR_NOTEXIST);
+        REQUIRE(parse_reply(make_reply(query, 0x8180, 0, ""), message) ==
+                NoDataError());
+        REQUIRE(message.wire);
+    }
+
+    SECTION("With a truncated or malformed reply") {
+        REQUIRE(parse_reply(make_reply(query, 0x8380, 0, ""), message) ==
+                TruncatedError());
+        REQUIRE(parse_reply(make_reply(query, 0x8180, 2,
+                                       make_answer(1, "\x01\x02\x03\x04")),
+                            message) == TruncatedError());
+        // A compression pointer pointing to itself
+        std::string loop = make_reply(query, 0x8180, 1, "");
+        size_t here = loop.size();
+        loop += (char)(0xc0 | (here >> 8));
+        loop += (char)(here & 0xff);
+        loop += std::string("\x00\x01\x00\x01\x00\x00\x00\x00\x00\x00", 10);
+        REQUIRE(parse_reply(loop, message) == TruncatedError());
+        REQUIRE(message.answers.empty());
+        REQUIRE(!message.wire);
+    }
+
+    SECTION("is_reply_to() rejects other messages") {
+        std::string reply = make_reply(query, 0x8180, 0, "");
+        REQUIRE(!is_reply_to(query, query)); // Not a response
+        std::string other = reply;
+        other[1] = 0;
+        REQUIRE(!is_reply_to(other, query));
+        other = reply;
+        other[13] = 'W'; // Case differs
+        REQUIRE(!is_reply_to(other, query));
+        REQUIRE(!is_reply_to(reply.substr(0, 20), query));
+    }
+}
+
+/*
+ * A local nameserver standing in for an authoritative one. It answers
+ * over UDP and TCP on the same port. Names starting with `drop.` get no
+ * reply and names starting with `tc.` get a truncated reply over UDP.
+ */
+class StandIn {
+  public:
+    StandIn() {
+        sockaddr_in sin{};
+        sin.sin_family = AF_INET;
+        sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t sinlen = sizeof(sin);
+        udp = ::socket(AF_INET, SOCK_DGRAM, 0);
+        REQUIRE(::bind(udp, (sockaddr *)&sin, sizeof(sin)) == 0);
+        REQUIRE(::getsockname(udp, (sockaddr *)&sin, &sinlen) == 0);
+        port = ntohs(sin.sin_port);
+        tcp = ::socket(AF_INET, SOCK_STREAM, 0);
+        REQUIRE(::bind(tcp, (sockaddr *)&sin, sizeof(sin)) == 0);
+        REQUIRE(::listen(tcp, 8) == 0);
+        thread = std::thread{[this]() { loop(); }};
+    }
+
+    ~StandIn() {
+        stop = true;
+        thread.join();
+        ::close(udp);
+        ::close(tcp);
+    }
+
+    int port = 0;
+    std::atomic<int> udp_queries{0};
+    std::atomic<int> tcp_queries{0};
+
+  private:
+    static std::string answer(const std::string &query, bool truncate) {
+        size_t end = 12;
+        std::string name;
+        while (query[end] != '\0') {
+            name += query.substr(end + 1, (uint8_t)query[end]) + ".";
+            end += (uint8_t)query[end] + 1;
+        }
+        uint16_t type = (uint16_t)(((uint8_t)query[end + 1] << 8) |
+                                   (uint8_t)query[end + 2]);
+        if (truncate && startswith(lowercase(name), "tc.")) {
+            return make_reply(query, 0x8380, 0, "");
+        }
+        if (type == 28) {
+            return make_reply(query, 0x8580, 1,
+                              make_answer(28, std::string(15, '\0') + "\x01"));
+        }
+        return make_reply(query, 0x8580, 1,
+                          make_answer(1, std::string("\x7f\x00\x00\x01", 4)));
+    }
+
+    static std::string lowercase(std::string s) {
+        for (auto &c : s) {
+            c = (char)tolower(c);
+        }
+        return s;
+    }
+
+    void loop() {
+        char buffer[65536];
+        while (!stop) {
+            pollfd fds[2] = {{udp, POLLIN, 0}, {tcp, POLLIN, 0}};
+            if (::poll(fds, 2, 50) <= 0) {
+                continue;
+            }
+            if ((fds[0].revents & POLLIN) != 0) {
+                sockaddr_storage ss{};
+                socklen_t sslen = sizeof(ss);
+                ssize_t n = ::recvfrom(udp, buffer, sizeof(buffer), 0,
+                                       (sockaddr *)&ss, &sslen);
+                if (n < 17) {
+                    continue;
+                }
+                std::string query{buffer, (size_t)n};
+                udp_queries += 1;
+                if (startswith(lowercase(query.substr(13)), "drop")) {
+                    continue;
+                }
+                std::string reply = answer(query, true);
+                ::sendto(udp, reply.data(), reply.size(), 0, (sockaddr *)&ss,
+                         sslen);
+            }
+            if ((fds[1].revents & POLLIN) != 0) {
+                // Note: Catch assertions are not thread safe
+                int conn = ::accept(tcp, nullptr, nullptr);
+                uint8_t length[2];
+                size_t n = 0;
+                if (::recv(conn, length, 2, MSG_WAITALL) == 2 &&
+                    (n = ((size_t)length[0] << 8) | length[1]) >= 17 &&
+                    ::recv(conn, buffer, n, MSG_WAITALL) == (ssize_t)n) {
+                    tcp_queries += 1;
+                    std::string reply = answer(std::string{buffer, n}, false);
+                    std::string framed{(char)(reply.size() >> 8),
+                                       (char)(reply.size() & 0xff)};
+                    framed += reply;
+                    ::send(conn, framed.data(), framed.size(), 0);
+                }
+                ::close(conn);
+            }
+        }
+    }
+
+    int udp = -1;
+    int tcp = -1;
+    std::atomic<bool> stop{false};
+    std::thread thread;
+};
+
+TEST_CASE("The native engine works as expected") {
+    StandIn server;
+    SharedPtr<Reactor> reactor = Reactor::make();
+    SharedPtr<Logger> logger = Logger::make();
+    Settings settings{{"dns/engine", "native"},
+                      {"dns/nameserver", "127.0.0.1"},
+                      {"dns/port", server.port},
+                      {"dns/timeout", 0.2},
+                      {"dns/attempts", 2}};
+
+    SECTION("It runs many queries concurrently") {
+        settings["dns/randomize_case"] = true;
+        int ok = 0;
+        reactor->run_with_initial_event([&]() {
+            for (int i = 0; i < 600; ++i) {
+                query("IN", (i % 2) ? "AAAA" : "A",
+                      "host" + std::to_string(i) + ".example.com",
+                      [&](Error error, SharedPtr<Message> message) {
+                          REQUIRE(!error);
+                          REQUIRE(message->answers.size() == 1);
+                          REQUIRE(message->rtt > 0.0);
+                          ok += 1;
+                      },
+                      settings, reactor, logger);
+            }
+        });
+        REQUIRE(ok == 600);
+        REQUIRE(server.udp_queries == 600);
+    }
+
+    SECTION("It retries over TCP when the reply is truncated") {
+        Error error;
+        SharedPtr<Message> message;
+        reactor->run_with_initial_event([&]() {
+            query("IN", "A", "tc.example.com",
+                  [&](Error e, SharedPtr<Message> m) {
+                      error = e;
+                      message = m;
+                  },
+                  settings, reactor, logger);
+        });
+        REQUIRE(!error);
+        REQUIRE(message->answers[0].ipv4 == "127.0.0.1");
+        REQUIRE(server.tcp_queries == 1);
+    }
+
+    SECTION("It retries and then times out") {
+        Error error;
+        SharedPtr<Message> message;
+        reactor->run_with_initial_event([&]() {
+            query("IN", "A", "drop.example.com",
+                  [&](Error e, SharedPtr<Message> m) {
+                      error = e;
+                      message = m;
+                  },
+                  settings, reactor, logger);
+        });
+        REQUIRE(error == TimeoutError());
+        REQUIRE(message->error_code == DNS_ERR_TIMEOUT);
+        REQUIRE(server.udp_queries == 2);
+    }
+
+    SECTION("It rejects invalid queries") {
+        std::vector<Error> errors;
+        reactor->run_with_initial_event([&]() {
+            auto cb = [&](Error e, SharedPtr<Message>) {
+                errors.push_back(e);
+            };
+            query("IN", "REVERSE_A", "1.2.3.4", cb, settings, reactor, logger);
+            query("IN", "A", "a..b", cb, settings, reactor, logger);
+            Settings bad = settings;
+            bad["dns/edns0_payload_size"] = 100;
+            query("IN", "A", "a.b", cb, bad, reactor, logger);
+        });
+        REQUIRE((errors == std::vector<Error>{UnsupportedTypeError(),
+                                              ValueError(), ValueError()}));
+    }
+}
+
+/*
+ * Resolves many names against the stand-in nameserver using the libevent
+ * and the native engines. The system engine cannot be pointed to it. It
+ * is hidden, run it using `./test/dns/native_query [benchmark]`.
+ */
+
+TEST_CASE("Queries per second with the libevent and native engines",
+          "[.benchmark]") {
+    StandIn server;
+    SharedPtr<Logger> logger = Logger::make();
+    for (std::string engine : {"libevent", "native"}) {
+        for (int concurrency : {1, 100, 1000}) {
+            SharedPtr<Reactor> reactor = Reactor::make();
+            Settings settings{{"dns/engine", engine},
+                              {"dns/nameserver", "127.0.0.1"},
+                              {"dns/port", server.port}};
+            const int total = 20000;
+            int sent = 0;
+            int done = 0;
+            std::function<void()> next = [&]() {
+                int i = sent++;
+                query("IN", "A", "host" + std::to_string(i) + ".example.com",
+                      [&](Error error, SharedPtr<Message>) {
+                          REQUIRE(!error);
+                          if (++done + concurrency <= total) {
+                              next();
+                          }
+                      },
+                      settings, reactor, logger);
+            };
+            auto begin = std::chrono::steady_clock::now();
+            reactor->run_with_initial_event([&]() {
+                for (int i = 0; i < concurrency; ++i) {
+                    next();
+                }
+            });
+            std::chrono::duration<double> elapsed =
+                    std::chrono::steady_clock::now() - begin;
+            REQUIRE(done == total);
+            printf("%-8s %4d in flight %10.0f queries/s\n", engine.c_str(),
+                   concurrency, total / elapsed.count());
+        }
+    }
+}
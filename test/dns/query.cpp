@@ -157,7 +157,7 @@ TEST_CASE("throw error with ntop conversion error") {
 TEST_CASE("dns::query deals with failing evdns_base_resolve_ipv4") {
     SharedPtr<Reactor> reactor = Reactor::make();
     SharedPtr<Logger> logger = Logger::make();
-    libevent_query<::evdns_base_free, null_resolver>(
+    libevent_query<null_resolver>(
         "IN", "A", "www.google.com",
         [](Error e, SharedPtr<Message>) { REQUIRE(e == ResolverError()); }, {},
         reactor, logger);
@@ -166,7 +166,7 @@ TEST_CASE("dns::query deals with failing evdns_base_resolve_ipv4") {
 TEST_CASE("dns::query deals with failing evdns_base_resolve_ipv6") {
     SharedPtr<Reactor> reactor = Reactor::make();
     SharedPtr<Logger> logger = Logger::make();
-    libevent_query<::evdns_base_free, ::evdns_base_resolve_ipv4, null_resolver>(
+    libevent_query<::evdns_base_resolve_ipv4, null_resolver>(
         "IN", "AAAA", "github.com",
         [](Error e, SharedPtr<Message>) { REQUIRE(e == ResolverError()); }, {},
         reactor, logger);
@@ -175,7 +175,7 @@ TEST_CASE("dns::query deals with failing evdns_base_resolve_ipv6") {
 TEST_CASE("dns::query deals with failing evdns_base_resolve_reverse") {
     SharedPtr<Reactor> reactor = Reactor::make();
     SharedPtr<Logger> logger = Logger::make();
-    libevent_query<::evdns_base_free, ::evdns_base_resolve_ipv4,
+    libevent_query<::evdns_base_resolve_ipv4,
                 ::evdns_base_resolve_ipv6, null_resolver_reverse>(
         "IN", "REVERSE_A", "8.8.8.8",
         [](Error e, SharedPtr<Message>) { REQUIRE(e == ResolverError()); }, {},
@@ -185,7 +185,7 @@ TEST_CASE("dns::query deals with failing evdns_base_resolve_reverse") {
 TEST_CASE("dns::query deals with failing evdns_base_resolve_reverse_ipv6") {
     SharedPtr<Reactor> reactor = Reactor::make();
     SharedPtr<Logger> logger = Logger::make();
-    libevent_query<::evdns_base_free, ::evdns_base_resolve_ipv4,
+    libevent_query<::evdns_base_resolve_ipv4,
                 ::evdns_base_resolve_ipv6, ::evdns_base_resolve_reverse,
                 null_resolver_reverse>(
         "IN", "REVERSE_AAAA", "::1",
@@ -198,7 +198,7 @@ TEST_CASE("dns::query deals with inet_pton returning 0") {
     SharedPtr<Reactor> reactor = Reactor::make();
     SharedPtr<Logger> logger = Logger::make();
 
-    libevent_query<::evdns_base_free, ::evdns_base_resolve_ipv4,
+    libevent_query<::evdns_base_resolve_ipv4,
                 ::evdns_base_resolve_ipv6, ::evdns_base_resolve_reverse,
                 ::evdns_base_resolve_reverse_ipv6, null_inet_pton>(
         "IN", "REVERSE_A", "8.8.8.8",
@@ -206,7 +206,7 @@ TEST_CASE("dns::query deals with inet_pton returning 0") {
         [](Error e, SharedPtr<Message>) { REQUIRE(e == InvalidIPv4AddressError()); }, {},
         reactor, logger);
 
-    libevent_query<::evdns_base_free, ::evdns_base_resolve_ipv4,
+    libevent_query<::evdns_base_resolve_ipv4,
                 ::evdns_base_resolve_ipv6, ::evdns_base_resolve_reverse,
                 ::evdns_base_resolve_reverse_ipv6, null_inet_pton>(
         "IN", "REVERSE_AAAA", "::1",
@@ -0,0 +1,147 @@
+// Part of Measurement Kit <https://measurement-kit.github.io/>.
+// Measurement Kit is free software under the BSD license. See AUTHORS
+// and LICENSE for more information on the copying conditions.
+
+#include "test/winsock.hpp"
+
+#include "include/private/catch.hpp"
+
+#include "src/libmeasurement_kit/dns/resolve_cache.hpp"
+
+using namespace mk;
+using namespace mk::dns;
+
+static Answer make_answer(std::string ipv4, std::string ipv6, uint32_t ttl) {
+    Answer answer;
+    answer.ipv4 = ipv4;
+    answer.ipv6 = ipv6;
+    answer.ttl = ttl;
+    return answer;
+}
+
+TEST_CASE("resolve_cache_key() works as expected") {
+    REQUIRE(resolve_cache_key("a.org", {}) == "a.org dns/engine=system");
+    REQUIRE(resolve_cache_key("a.org", {{"dns/engine", "libevent"},
+                                        {"dns/nameserver", "8.8.8.8"},
+                                        {"net/timeout", 1.0}}) ==
+            "a.org dns/engine=libevent dns/nameserver=8.8.8.8");
+}
+
+TEST_CASE("resolve_cache_ttl() works as expected") {
+    ResolveHostnameResult r;
+
+    SECTION("For negative results") {
+        REQUIRE(resolve_cache_ttl(r, {}) == 5.0);
+        REQUIRE(resolve_cache_ttl(r, {{"dns/cache_negative_ttl", 1.0}}) == 1.0);
+    }
+
+    SECTION("For results of the system engine") {
+        r.addresses.push_back("127.0.0.1");
+        REQUIRE(resolve_cache_ttl(r, {}) == 60.0);
+        REQUIRE(resolve_cache_ttl(r, {{"dns/cache_system_ttl", 0.0}}) == 0.0);
+    }
+
+    SECTION("For results of other engines") {
+        Settings settings{{"dns/engine", "libevent"}};
+        r.addresses.push_back("127.0.0.1");
+        r.addresses.push_back("::1");
+        r.ipv4_reply.answers.push_back(make_answer("", "", 7));
+        r.ipv4_reply.answers.push_back(make_answer("127.0.0.1", "", 300));
+        r.ipv6_reply.answers.push_back(make_answer("", "::1", 120));
+        REQUIRE(resolve_cache_ttl(r, settings) == 120.0);
+    }
+}
+
+TEST_CASE("ResolveCache works as expected") {
+    ResolveCache cache;
+    SharedPtr<Reactor> reactor = Reactor::make();
+    SharedPtr<Logger> logger = Logger::make();
+    std::vector<Callback<ResolveHostnameResult>> lookups;
+    auto lookup = [&](Callback<ResolveHostnameResult> cb) {
+        lookups.push_back(cb);
+    };
+    ResolveHostnameResult positive;
+    positive.addresses.push_back("127.0.0.1");
+    std::vector<std::string> results;
+    auto resolve = [&](std::string hostname, Settings settings) {
+        cache.resolve(hostname, [&](ResolveHostnameResult r) {
+            results.push_back(r.addresses.empty() ? "" : r.addresses[0]);
+        }, settings, reactor, logger, lookup);
+    };
+
+    SECTION("It coalesces identical lookups and caches the result") {
+        Settings settings{{"dns/cache", "process"}};
+        reactor->run_with_initial_event([&]() {
+            resolve("a.org", settings);
+            resolve("a.org", settings);
+            resolve("b.org", settings);
+            REQUIRE(lookups.size() == 2);
+            REQUIRE(cache.in_flight(reactor) == 2);
+            lookups[0](positive);
+            REQUIRE((results == std::vector<std::string>{"127.0.0.1",
+                                                         "127.0.0.1"}));
+            REQUIRE(cache.in_flight(reactor) == 1);
+            REQUIRE(cache.size() == 1);
+            resolve("a.org", settings);
+            // Cached results are delivered in the next I/O cycle
+            REQUIRE(results.size() == 2);
+            reactor->call_soon([&]() {
+                REQUIRE(results.size() == 3);
+                lookups[1](ResolveHostnameResult{});
+                REQUIRE(results.size() == 4);
+            });
+        });
+        REQUIRE(lookups.size() == 2);
+        REQUIRE(cache.size() == 2);
+        REQUIRE(cache.in_flight(reactor) == 0);
+    }
+
+    SECTION("It forgets results scoped to the reactor when it stops") {
+        Settings settings{{"dns/cache", "reactor"}};
+        reactor->run_with_initial_event([&]() {
+            resolve("a.org", settings);
+            lookups[0](positive);
+            REQUIRE(cache.size(reactor) == 1);
+            REQUIRE(cache.size() == 0);
+        });
+        REQUIRE(cache.size(reactor) == 0);
+        reactor->run_with_initial_event([&]() {
+            resolve("a.org", settings);
+        });
+        REQUIRE(lookups.size() == 2);
+    }
+
+    SECTION("It does not cache results whose TTL is zero") {
+        Settings settings{{"dns/cache", "reactor"},
+                          {"dns/cache_negative_ttl", 0.0}};
+        reactor->run_with_initial_event([&]() {
+            resolve("a.org", settings);
+            lookups[0](ResolveHostnameResult{});
+            resolve("a.org", settings);
+            REQUIRE(lookups.size() == 2);
+            REQUIRE(cache.size(reactor) == 0);
+        });
+    }
+
+    SECTION("It deals with an invalid scope") {
+        ResolveHostnameResult result;
+        reactor->run_with_initial_event([&]() {
+            cache.resolve("a.org", [&](ResolveHostnameResult r) {
+                result = r;
+            }, {{"dns/cache", "antani"}}, reactor, logger, lookup);
+        });
+        REQUIRE(lookups.empty());
+        REQUIRE(result.ipv4_err == InvalidDnsCacheError());
+        REQUIRE(result.ipv6_err == InvalidDnsCacheError());
+    }
+}
+
+TEST_CASE("resolve_hostname() does not cache IP addresses") {
+    SharedPtr<Reactor> reactor = Reactor::make();
+    reactor->run_with_initial_event([&]() {
+        resolve_hostname("127.0.0.1", [&](ResolveHostnameResult r) {
+            REQUIRE(r.inet_pton_ipv4);
+        }, {{"dns/cache", "reactor"}}, reactor, Logger::make());
+    });
+    REQUIRE(ResolveCache::global().size(reactor) == 0);
+}
@@ -0,0 +1,353 @@
+// Part of Measurement Kit <https://measurement-kit.github.io/>.
+// Measurement Kit is free software under the BSD license. See AUTHORS
+// and LICENSE for more information on the copying conditions.
+
+#include "test/winsock.hpp"
+
+#include "include/private/catch.hpp"
+
+#include "src/libmeasurement_kit/dns/native_query.hpp"
+#include "src/libmeasurement_kit/dns/wire.hpp"
+
+#include <stdio.h>
+
+#include <chrono>
+#include <random>
+#include <stdexcept>
+
+using namespace mk;
+using namespace mk::dns;
+
+TEST_CASE("wire_query_type() and query_type_from_wire() agree") {
+#define XX(_name)                                                              \
+    {                                                                          \
+        uint16_t type = wire_query_type(MK_DNS_TYPE_##_name);                  \
+        if (type != 0) {                                                       \
+            REQUIRE(query_type_from_wire(type) == MK_DNS_TYPE_##_name);        \
+        }                                                                      \
+    }
+    MK_DNS_TYPE_IDS
+#undef XX
+    REQUIRE(wire_query_type("HTTPS") == MK_DNS_WIRE_TYPE_HTTPS);
+    REQUIRE(query_type_from_wire(MK_DNS_WIRE_TYPE_SVCB) == MK_DNS_TYPE_INVALID);
+}
+
+// A response to a TXT query for `example.com`, written by hand: the TXT
+// answer has two strings and the NS record in the authority section and
+// the A record in the additional section use compression pointers.
+static const std::string txt_response{
+        "\x12\x34\x85\x80\x00\x01\x00\x01\x00\x01\x00\x02"
+        "\x07" "example" "\x03" "com" "\x00" "\x00\x10\x00\x01"
+        "\xc0\x0c" "\x00\x10\x00\x01" "\x00\x00\x0e\x10" "\x00\x0a"
+        "\x03" "v=1" "\x05" "hello"
+        "\xc0\x0c" "\x00\x02\x00\x01" "\x00\x01\x51\x80" "\x00\x06"
+        "\x03" "ns1" "\xc0\x0c"
+        "\xc0\x3f" "\x00\x01\x00\x01" "\x00\x01\x51\x80" "\x00\x04"
+        "\xc0\x00\x02\x01"
+        "\x00" "\x00\x29\x04\xd0" "\x01\x00\x00\x00" "\x00\x00",
+        96};
+
+TEST_CASE("WireMessage::parse() works as expected") {
+    WireMessage message;
+
+    SECTION("With all sections and EDNS0") {
+        REQUIRE(message.parse(txt_response) == NoError());
+        REQUIRE(message.id == 0x1234);
+        REQUIRE(message.qr());
+        REQUIRE(message.aa());
+        REQUIRE(message.rd());
+        REQUIRE(message.ra());
+        REQUIRE(!message.tc());
+        REQUIRE(message.opcode() == 0);
+        REQUIRE(message.packet() == txt_response);
+
+        REQUIRE(message.questions.size() == 1);
+        REQUIRE(message.equals(message.questions[0].name, "example.com"));
+        REQUIRE(message.questions[0].type == MK_DNS_WIRE_TYPE_TXT);
+        REQUIRE(message.questions[0].qclass == 1);
+
+        REQUIRE(message.answers.size() == 1);
+        const WireRecord &txt = message.answers[0];
+        REQUIRE(message.str(txt.name) == "example.com");
+        REQUIRE(txt.ttl == 3600);
+        std::vector<WireSlice> strings = message.strings(txt);
+        REQUIRE(strings.size() == 2);
+        REQUIRE(message.str(strings[0]) == "v=1");
+        REQUIRE(message.str(strings[1]) == "hello");
+        // The strings are not copied out of the packet
+        REQUIRE(strings[0].offset < txt_response.size());
+
+        REQUIRE(message.authority.size() == 1);
+        REQUIRE(message.authority[0].type == MK_DNS_WIRE_TYPE_NS);
+        REQUIRE(message.str(message.authority[0].target) ==
+                "ns1.example.com");
+
+        REQUIRE(message.additional.size() == 2);
+        REQUIRE(message.str(message.additional[0].name) ==
+                "ns1.example.com");
+        REQUIRE(message.address(message.additional[0]) == "192.0.2.1");
+        REQUIRE(message.address(txt) == "");
+        REQUIRE(message.opt() == &message.additional[1]);
+        REQUIRE(message.opt()->qclass == 1232);
+        // The extended RCODE bits are the top byte of the OPT TTL
+        REQUIRE(message.rcode() == 16);
+    }
+
+    SECTION("With malformed packets") {
+        REQUIRE(message.parse("") == MalformedMessageError());
+        REQUIRE(message.parse(txt_response.substr(0, 11)) ==
+                MalformedMessageError());
+        // Any truncation must be detected
+        for (size_t i = 12; i < txt_response.size(); ++i) {
+            REQUIRE(message.parse(txt_response.substr(0, i)) ==
+                    MalformedMessageError());
+            REQUIRE(message.questions.empty());
+            REQUIRE(message.answers.empty());
+        }
+        REQUIRE(message.parse(txt_response + "x") == MalformedMessageError());
+        // A compression pointer pointing to itself
+        std::string loop = txt_response;
+        loop[29] = '\xc0';
+        loop[30] = '\x1d';
+        REQUIRE(message.parse(loop) == MalformedMessageError());
+        // A compression pointer pointing forward
+        std::string forward = txt_response;
+        forward[30] = '\x40';
+        REQUIRE(message.parse(forward) == MalformedMessageError());
+        // A TXT string longer than the RDATA
+        std::string txt = txt_response;
+        txt[41] = '\x0a';
+        REQUIRE(message.parse(txt) == MalformedMessageError());
+        // An A record with the wrong length
+        std::string a = txt_response;
+        a[80] = '\x05';
+        REQUIRE(message.parse(a) == MalformedMessageError());
+        // The message can be used again
+        REQUIRE(message.parse(txt_response) == NoError());
+        REQUIRE(message.answers.size() == 1);
+    }
+
+    SECTION("With a name longer than 255 bytes") {
+        std::string label = "\x3f" + std::string(63, 'a');
+        std::string packet{"\x00\x00\x00\x00\x00\x01\x00\x00\x00\x00\x00\x00",
+                           12};
+        packet += label + label + label + "\x3d" + std::string(61, 'a');
+        packet += std::string("\x00\x00\x01\x00\x01", 5);
+        REQUIRE(message.parse(packet) == NoError()); // 255 bytes
+        REQUIRE(message.questions[0].name.length == 253);
+        packet[12 + 3 * 64] = '\x3e';
+        packet.insert(12 + 3 * 64 + 1, "a");
+        REQUIRE(message.parse(packet) == MalformedMessageError());
+    }
+}
+
+TEST_CASE("WireMessage::serialize() works as expected") {
+
+    SECTION("It round trips parsed messages") {
+        WireMessage message;
+        REQUIRE(message.parse(txt_response) == NoError());
+        REQUIRE(message.serialize() == txt_response);
+    }
+
+    SECTION("It builds messages and compresses names") {
+        WireMessage message;
+        message.id = 7;
+        message.flags = 0x8180;
+        message.add_question("www.example.org.", MK_DNS_WIRE_TYPE_HTTPS, 1);
+        WireRecord &cname = message.add_record(
+                message.answers, "www.example.org", MK_DNS_WIRE_TYPE_CNAME, 1,
+                60);
+        cname.target = message.intern("cdn.example.org");
+        WireRecord &https = message.add_record(
+                message.answers, "cdn.example.org", MK_DNS_WIRE_TYPE_HTTPS, 1,
+                60);
+        https.priority = 1;
+        https.target = message.intern("");
+        // alpn=h2
+        https.params = message.intern(std::string("\x00\x01\x00\x03\x02h2", 7));
+        WireRecord &soa = message.add_record(
+                message.authority, "example.org", MK_DNS_WIRE_TYPE_SOA, 1, 60);
+        soa.mname = message.intern("ns.example.org");
+        soa.rname = message.intern("hostmaster.example.org");
+        soa.serial = 2024010101;
+        soa.minimum = 300;
+        WireRecord &mx = message.add_record(
+                message.additional, "example.org", MK_DNS_WIRE_TYPE_MX, 1, 60);
+        mx.priority = 10;
+        mx.target = message.intern("mail.example.org");
+        message.add_edns0(4096);
+
+        std::string packet = message.serialize();
+        // The owner of the SOA record is a pointer into the question
+        REQUIRE(packet.find(std::string("\x07" "example" "\x03" "org", 12)) ==
+                packet.rfind(std::string("\x07" "example" "\x03" "org", 12)));
+
+        WireMessage parsed;
+        REQUIRE(parsed.parse(packet) == NoError());
+        REQUIRE(parsed.id == 7);
+        REQUIRE(parsed.questions.size() == 1);
+        REQUIRE(parsed.str(parsed.questions[0].name) == "www.example.org");
+        REQUIRE(parsed.answers.size() == 2);
+        REQUIRE(parsed.str(parsed.answers[0].target) == "cdn.example.org");
+        REQUIRE(parsed.answers[1].type == MK_DNS_WIRE_TYPE_HTTPS);
+        REQUIRE(parsed.answers[1].priority == 1);
+        REQUIRE(parsed.answers[1].target.length == 0);
+        REQUIRE(parsed.str(parsed.answers[1].params) ==
+                std::string("\x00\x01\x00\x03\x02h2", 7));
+        REQUIRE(parsed.authority.size() == 1);
+        REQUIRE(parsed.str(parsed.authority[0].mname) == "ns.example.org");
+        REQUIRE(parsed.str(parsed.authority[0].rname) ==
+                "hostmaster.example.org");
+        REQUIRE(parsed.authority[0].serial == 2024010101);
+        REQUIRE(parsed.authority[0].minimum == 300);
+        REQUIRE(parsed.additional.size() == 2);
+        REQUIRE(parsed.additional[0].priority == 10);
+        REQUIRE(parsed.str(parsed.additional[0].target) ==
+                "mail.example.org");
+        REQUIRE(parsed.opt() != nullptr);
+        REQUIRE(parsed.opt()->qclass == 4096);
+        REQUIRE(parsed.serialize() == packet);
+    }
+
+    SECTION("It rejects invalid names") {
+        WireMessage message;
+        message.add_question("www..example.org", 1, 1);
+        REQUIRE_THROWS_AS(message.serialize(), std::runtime_error);
+        message.clear();
+        message.add_question(std::string(64, 'a') + ".org", 1, 1);
+        REQUIRE_THROWS_AS(message.serialize(), std::runtime_error);
+        message.clear();
+        std::string label(63, 'a');
+        message.add_question(label + "." + label + "." + label + "." + label,
+                             1, 1);
+        REQUIRE_THROWS_AS(message.serialize(), std::runtime_error);
+    }
+}
+
+TEST_CASE("WireMessage survives fuzzing") {
+    std::mt19937 rng{20240501};
+    std::uniform_int_distribution<int> byte{0, 255};
+    WireMessage message;
+    WireMessage again;
+    size_t parsed = 0;
+
+    auto check = [&](const std::string &packet) {
+        Error error = message.parse(packet);
+        REQUIRE((error == NoError() || error == MalformedMessageError()));
+        if (error) {
+            return;
+        }
+        parsed += 1;
+        for (auto section : {&message.answers, &message.authority,
+                             &message.additional}) {
+            for (auto &record : *section) {
+                REQUIRE(record.rdata.offset + record.rdata.length <=
+                        packet.size());
+                for (auto &s : message.strings(record)) {
+                    REQUIRE(s.offset + s.length <= packet.size());
+                }
+                (void)message.address(record);
+            }
+        }
+        std::string serialized;
+        try {
+            serialized = message.serialize();
+        } catch (const std::runtime_error &) {
+            return; // For example, a label containing a dot
+        }
+        REQUIRE(again.parse(serialized) == NoError());
+    };
+
+    SECTION("Mutating valid messages") {
+        for (int i = 0; i < 100000; ++i) {
+            std::string packet = txt_response;
+            int mutations = 1 + byte(rng) % 4;
+            for (int j = 0; j < mutations; ++j) {
+                packet[byte(rng) % packet.size()] = (char)byte(rng);
+            }
+            if (byte(rng) % 8 == 0) {
+                packet.resize(byte(rng) % packet.size());
+            }
+            check(packet);
+        }
+        REQUIRE(parsed > 0);
+    }
+
+    SECTION("Random bytes") {
+        for (int i = 0; i < 100000; ++i) {
+            std::string packet(12 + byte(rng) % 64, '\0');
+            for (auto &c : packet) {
+                c = (char)byte(rng);
+            }
+            // Small counts make it more likely to parse something
+            packet[4] = packet[6] = packet[8] = packet[10] = 0;
+            packet[5] = (char)(byte(rng) % 2);
+            packet[7] = (char)(byte(rng) % 3);
+            packet[9] = packet[11] = 0;
+            check(packet);
+        }
+    }
+}
+
+/*
+ * Benchmark of parsing and serializing a typical response. It is hidden,
+ * run it using `./test/dns/wire [benchmark]`.
+ */
+
+template <typename Func> static void measure(const char *what, Func &&func) {
+    const int count = 500000;
+    size_t total = 0;
+    auto begin = std::chrono::steady_clock::now();
+    for (int i = 0; i < count; ++i) {
+        total += func();
+    }
+    std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - begin;
+    printf("%-40s %10.0f messages/s (%zu)\n", what, count / elapsed.count(),
+           total);
+}
+
+TEST_CASE("Messages per second", "[.benchmark]") {
+    std::string query = serialize_query(0, "www.example.com", 1, 1, 1232);
+    WireMessage builder;
+    REQUIRE(builder.parse(query) == NoError());
+    builder.flags = 0x8180;
+    builder.additional.clear();
+    WireRecord &cname = builder.add_record(builder.answers, "www.example.com",
+                                           MK_DNS_WIRE_TYPE_CNAME, 1, 300);
+    cname.target = builder.intern("www.example.com.cdn.example.net");
+    for (int i = 0; i < 4; ++i) {
+        WireRecord &a = builder.add_record(
+                builder.answers, "www.example.com.cdn.example.net",
+                MK_DNS_WIRE_TYPE_A, 1, 60);
+        a.rdata = builder.intern(std::string{"\xc0\x00\x02", 3} + (char)i);
+    }
+    builder.add_edns0(1232);
+    std::string response = builder.serialize();
+
+    WireMessage message;
+    measure("WireMessage::parse()", [&]() {
+        message.parse(response);
+        return message.answers.size();
+    });
+    measure("WireMessage::parse() and address()", [&]() {
+        message.parse(response);
+        size_t n = 0;
+        for (auto &record : message.answers) {
+            n += message.address(record).size();
+        }
+        return n;
+    });
+    Message legacy;
+    measure("parse_reply()", [&]() {
+        parse_reply(response, legacy);
+        return legacy.answers.size();
+    });
+    REQUIRE(message.parse(response) == NoError());
+    measure("WireMessage::serialize()", [&]() {
+        return message.serialize().size();
+    });
+    measure("serialize_query()", [&]() {
+        return serialize_query(0, "www.example.com", 1, 1, 1232).size();
+    });
+}
@@ -0,0 +1,169 @@
+// Part of Measurement Kit <https://measurement-kit.github.io/>.
+// Measurement Kit is free software under the BSD license. See AUTHORS
+// and LICENSE for more information on the copying conditions.
+
+#include "test/winsock.hpp"
+
+#include "include/private/catch.hpp"
+
+#include "src/libmeasurement_kit/engine/scheduler.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace mk::engine;
+
+static void wait_for_queued(TaskScheduler &scheduler, size_t count) {
+    while (scheduler.queued() < count) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+}
+
+TEST_CASE("TaskScheduler honours the concurrency limit") {
+    TaskScheduler scheduler;
+    scheduler.set_max_concurrency(3);
+    std::atomic_bool interrupted{false};
+    std::atomic<size_t> running{0};
+    std::atomic<size_t> max_running{0};
+    std::atomic<size_t> failures{0};
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < 32; ++i) {
+        threads.emplace_back([&]() {
+            // Note: Catch assertions are not thread safe
+            if (!scheduler.acquire(0, interrupted)) {
+                ++failures;
+                return;
+            }
+            size_t cur = ++running;
+            size_t prev = max_running;
+            while (cur > prev && !max_running.compare_exchange_weak(prev, cur)) {
+                /* nothing */;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            --running;
+            scheduler.release();
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    REQUIRE(failures == 0);
+    REQUIRE(max_running <= 3);
+    REQUIRE(max_running >= 2);
+    REQUIRE(scheduler.active() == 0);
+    REQUIRE(scheduler.queued() == 0);
+}
+
+TEST_CASE("TaskScheduler admits tasks by priority and then FIFO") {
+    TaskScheduler scheduler;
+    std::atomic_bool interrupted{false};
+    REQUIRE(scheduler.acquire(0, interrupted)); // keep the only slot busy
+    std::mutex mutex;
+    std::vector<int> order;
+    std::vector<std::thread> threads;
+    auto start = [&](int id, int64_t priority) {
+        threads.emplace_back([&, id, priority]() {
+            if (!scheduler.acquire(priority, interrupted)) {
+                return;
+            }
+            {
+                std::unique_lock<std::mutex> _{mutex};
+                order.push_back(id);
+            }
+            scheduler.release();
+        });
+        wait_for_queued(scheduler, threads.size());
+    };
+    start(1, 0);
+    start(2, 10);
+    start(3, 0);
+    start(4, 10);
+    start(5, -1);
+    scheduler.release();
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    REQUIRE((order == std::vector<int>{2, 4, 1, 3, 5}));
+}
+
+TEST_CASE("TaskScheduler deals with extreme priorities") {
+    TaskScheduler scheduler;
+    std::atomic_bool interrupted{false};
+    REQUIRE(scheduler.acquire(0, interrupted)); // keep the only slot busy
+    std::mutex mutex;
+    std::vector<int> order;
+    std::vector<std::thread> threads;
+    auto start = [&](int id, int64_t priority) {
+        threads.emplace_back([&, id, priority]() {
+            if (!scheduler.acquire(priority, interrupted)) {
+                return;
+            }
+            {
+                std::unique_lock<std::mutex> _{mutex};
+                order.push_back(id);
+            }
+            scheduler.release();
+        });
+        wait_for_queued(scheduler, threads.size());
+    };
+    start(1, INT64_MIN);
+    start(2, 0);
+    start(3, INT64_MAX);
+    start(4, INT64_MIN);
+    scheduler.release();
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    REQUIRE((order == std::vector<int>{3, 2, 1, 4}));
+}
+
+TEST_CASE("TaskScheduler lets interrupted tasks leave the queue") {
+    TaskScheduler scheduler;
+    std::atomic_bool busy{false};
+    REQUIRE(scheduler.acquire(0, busy));
+    std::atomic_bool interrupted{false};
+    bool admitted = true;
+    std::thread thread{[&]() { admitted = scheduler.acquire(0, interrupted); }};
+    wait_for_queued(scheduler, 1);
+    interrupted = true;
+    scheduler.wakeup();
+    thread.join();
+    REQUIRE(admitted == false);
+    REQUIRE(scheduler.queued() == 0);
+    REQUIRE(scheduler.active() == 1);
+    scheduler.release();
+}
+
+TEST_CASE("TaskScheduler::set_max_concurrency() works as expected") {
+    TaskScheduler scheduler;
+    REQUIRE(scheduler.max_concurrency() ==
+            TaskScheduler::default_max_concurrency);
+
+    SECTION("Raising the limit admits queued tasks") {
+        std::atomic_bool interrupted{false};
+        REQUIRE(scheduler.acquire(0, interrupted));
+        bool admitted = false;
+        std::thread thread{[&]() {
+            admitted = scheduler.acquire(0, interrupted);
+            if (admitted) {
+                scheduler.release();
+            }
+        }};
+        wait_for_queued(scheduler, 1);
+        scheduler.set_max_concurrency(2);
+        thread.join();
+        REQUIRE(admitted);
+        scheduler.release();
+    }
+
+    SECTION("Zero restores the default") {
+        scheduler.set_max_concurrency(7);
+        REQUIRE(scheduler.max_concurrency() == 7);
+        scheduler.set_max_concurrency(0);
+        REQUIRE(scheduler.max_concurrency() ==
+                TaskScheduler::default_max_concurrency);
+    }
+}
@@ -0,0 +1,127 @@
+// Part of Measurement Kit <https://measurement-kit.github.io/>.
+// Measurement Kit is free software under the BSD license. See AUTHORS
+// and LICENSE for more information on the copying conditions.
+
+#include "test/winsock.hpp"
+
+#include "include/private/catch.hpp"
+
+#include <measurement_kit/ffi.h>
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <measurement_kit/common/nlohmann/json.hpp>
+
+#include "src/libmeasurement_kit/engine/scheduler.hpp"
+
+// The settings used here only connect to a closed port on localhost, so
+// the tasks complete quickly and do not require network access.
+static const char *settings = R"({
+    "name": "TcpConnect",
+    "inputs": ["127.0.0.1:1"],
+    "log_level": "WARNING",
+    "options": {
+        "no_bouncer": true,
+        "no_collector": true,
+        "no_file_report": true,
+        "no_geoip": true,
+        "no_resolver_lookup": true
+    }
+})";
+
+// run_task starts a task through the FFI and drains its events. Returns
+// true when we have seen the expected sequence of events.
+static bool run_task(std::atomic<size_t> &max_active) {
+    mk_unique_task task{mk_task_start(settings)};
+    if (!task) {
+        return false;
+    }
+    bool queued = false, started = false, ended = false;
+    while (!mk_task_is_done(task.get())) {
+        size_t active = mk::engine::TaskScheduler::global().active();
+        size_t prev = max_active;
+        while (active > prev && !max_active.compare_exchange_weak(prev, active)) {
+            /* nothing */;
+        }
+        mk_unique_event event{mk_task_wait_for_next_event(task.get())};
+        if (!event) {
+            return false;
+        }
+        auto json = nlohmann::json::parse(mk_event_serialization(event.get()));
+        auto key = json.at("key").get<std::string>();
+        if (key == "status.queued") {
+            queued = true;
+        } else if (key == "status.started") {
+            started = queued;
+        } else if (key == "status.end") {
+            ended = started;
+        }
+    }
+    return ended;
+}
+
+static void run_tasks_in_parallel(size_t count, std::atomic<size_t> &max_active) {
+    std::atomic<size_t> failures{0};
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < count; ++i) {
+        threads.emplace_back([&]() {
+            // Note: Catch assertions are not thread safe
+            if (!run_task(max_active)) {
+                ++failures;
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    REQUIRE(failures == 0);
+    REQUIRE(mk::engine::TaskScheduler::global().active() == 0);
+    REQUIRE(mk::engine::TaskScheduler::global().queued() == 0);
+}
+
+TEST_CASE("Many tasks can be started in parallel through the FFI") {
+    SECTION("With the default concurrency limit") {
+        std::atomic<size_t> max_active{0};
+        run_tasks_in_parallel(16, max_active);
+        REQUIRE(max_active <= 1);
+    }
+
+    SECTION("With an increased concurrency limit") {
+        mk_task_set_max_concurrency(4);
+        std::atomic<size_t> max_active{0};
+        run_tasks_in_parallel(64, max_active);
+        REQUIRE(max_active <= 4);
+        mk_task_set_max_concurrency(0);
+    }
+}
+
+TEST_CASE("An interrupted queued task terminates without running") {
+    auto &scheduler = mk::engine::TaskScheduler::global();
+    std::atomic_bool busy{false};
+    REQUIRE(scheduler.acquire(0, busy)); // keep the only slot busy
+    mk_unique_task task{mk_task_start(settings)};
+    REQUIRE(!!task);
+    while (scheduler.queued() < 1) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    mk_task_interrupt(task.get());
+    std::vector<std::string> keys;
+    while (!mk_task_is_done(task.get())) {
+        mk_unique_event event{mk_task_wait_for_next_event(task.get())};
+        REQUIRE(!!event);
+        auto json = nlohmann::json::parse(mk_event_serialization(event.get()));
+        keys.push_back(json.at("key").get<std::string>());
+    }
+    scheduler.release();
+    REQUIRE(!keys.empty());
+    REQUIRE(keys[0] == "status.queued");
+    for (size_t i = 1; i < keys.size(); ++i) {
+        REQUIRE(keys[i] == "task_terminated");
+    }
+    REQUIRE(scheduler.active() == 0);
+    REQUIRE(scheduler.queued() == 0);
+}
@@ -8,6 +8,12 @@
 
 #include <measurement_kit/ffi.h>
 
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <measurement_kit/common/nlohmann/json.hpp>
+
 TEST_CASE("mk_task_start() works as expected") {
     SECTION("With nullptr settings") {
         auto task = mk_task_start(nullptr);
@@ -19,3 +25,68 @@ TEST_CASE("mk_task_start() works as expected") {
         REQUIRE(task == nullptr);
     }
 }
+
+TEST_CASE("mk_task_start() emits reactor stats when requested") {
+    // This only connects to a closed port on localhost
+    mk_unique_task task{mk_task_start(R"({
+        "name": "TcpConnect",
+        "inputs": ["127.0.0.1:1"],
+        "log_level": "WARNING",
+        "options": {
+            "no_bouncer": true,
+            "no_collector": true,
+            "no_file_report": true,
+            "no_geoip": true,
+            "no_resolver_lookup": true,
+            "reactor_instrumentation": true
+        }
+    })")};
+    REQUIRE(!!task);
+    std::vector<std::string> keys;
+    nlohmann::json stats;
+    while (!mk_task_is_done(task.get())) {
+        mk_unique_event event{mk_task_wait_for_next_event(task.get())};
+        REQUIRE(!!event);
+        auto json = nlohmann::json::parse(mk_event_serialization(event.get()));
+        keys.push_back(json.at("key").get<std::string>());
+        if (keys.back() == "status.reactor_stats") {
+            stats = json.at("value");
+        }
+    }
+    auto it = std::find(keys.begin(), keys.end(), "status.reactor_stats");
+    REQUIRE(it != keys.end());
+    REQUIRE(it + 1 != keys.end());
+    REQUIRE(*(it + 1) == "status.end");
+    REQUIRE(stats.at("callbacks").get<int64_t>() > 0);
+    REQUIRE(stats.at("loop_lag_max").get<double>() >= 0.0);
+}
+
+TEST_CASE("mk_task_start() emits queued logs before status.end") {
+    // This only connects to a closed port on localhost
+    mk_unique_task task{mk_task_start(R"({
+        "name": "TcpConnect",
+        "inputs": ["127.0.0.1:1"],
+        "log_level": "DEBUG",
+        "options": {
+            "log_async": true,
+            "log_flush_interval": 3600.0,
+            "no_bouncer": true,
+            "no_collector": true,
+            "no_file_report": true,
+            "no_geoip": true,
+            "no_resolver_lookup": true
+        }
+    })")};
+    REQUIRE(!!task);
+    std::vector<std::string> keys;
+    while (!mk_task_is_done(task.get())) {
+        mk_unique_event event{mk_task_wait_for_next_event(task.get())};
+        REQUIRE(!!event);
+        auto json = nlohmann::json::parse(mk_event_serialization(event.get()));
+        keys.push_back(json.at("key").get<std::string>());
+    }
+    REQUIRE(std::find(keys.begin(), keys.end(), "log") != keys.end());
+    auto end = std::find(keys.begin(), keys.end(), "status.end");
+    REQUIRE(end != keys.end());
+    REQUIRE(std::find(end, keys.end(), "log") == keys.end());
+}
@@ -0,0 +1,178 @@
+// Part of Measurement Kit <https://measurement-kit.github.io/>.
+// Measurement Kit is free software under the BSD license. See AUTHORS
+// and LICENSE for more information on the copying conditions.
+
+#include "test/winsock.hpp"
+
+#include "include/private/catch.hpp"
+
+#include "src/libmeasurement_kit/http/connection_pool.hpp"
+#include "src/libmeasurement_kit/net/emitter.hpp"
+#include "src/libmeasurement_kit/net/libevent_emitter.hpp"
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace mk;
+using namespace mk::net;
+using namespace mk::http;
+
+class CountingEmitter : public Emitter {
+  public:
+    CountingEmitter(SharedPtr<Reactor> reactor, SharedPtr<int> closed)
+        : Emitter{reactor, Logger::make()}, closed{closed} {}
+
+    void close(Callback<> cb) override {
+        ++*closed;
+        Emitter::close(cb);
+    }
+
+    SharedPtr<int> closed;
+};
+
+static SharedPtr<Transport> make_emitter(SharedPtr<Reactor> reactor,
+                                         SharedPtr<int> closed) {
+    return SharedPtr<Transport>{
+            std::make_shared<CountingEmitter>(reactor, closed)};
+}
+
+static bool always_alive(SharedPtr<Transport>) { return true; }
+
+static bool never_alive(SharedPtr<Transport>) { return false; }
+
+TEST_CASE("ConnectionPool works as expected") {
+    SharedPtr<Reactor> reactor = Reactor::make();
+    SharedPtr<Logger> logger = Logger::make();
+    SharedPtr<int> closed = SharedPtr<int>::make(0);
+    ConnectionPool pool;
+
+    SECTION("Connections are indexed by reactor and key") {
+        SharedPtr<Reactor> other = Reactor::make();
+        auto txp = make_emitter(reactor, closed);
+        pool.put(reactor, "a", txp, 4, logger);
+        REQUIRE(pool.size(reactor) == 1);
+        REQUIRE(pool.size(other) == 0);
+        REQUIRE(!pool.take<always_alive>(other, "a", 15.0, logger));
+        REQUIRE(!pool.take<always_alive>(reactor, "b", 15.0, logger));
+        REQUIRE(pool.take<always_alive>(reactor, "a", 15.0, logger).get() ==
+                txp.get());
+        REQUIRE(pool.size(reactor) == 0);
+        REQUIRE(!pool.take<always_alive>(reactor, "a", 15.0, logger));
+        REQUIRE(*closed == 0);
+    }
+
+    SECTION("The most recently used connection is reused first") {
+        auto first = make_emitter(reactor, closed);
+        auto second = make_emitter(reactor, closed);
+        pool.put(reactor, "a", first, 4, logger);
+        pool.put(reactor, "a", second, 4, logger);
+        REQUIRE(pool.take<always_alive>(reactor, "a", 15.0, logger).get() ==
+                second.get());
+        REQUIRE(pool.take<always_alive>(reactor, "a", 15.0, logger).get() ==
+                first.get());
+    }
+
+    SECTION("The least recently used connection is closed when full") {
+        auto first = make_emitter(reactor, closed);
+        auto second = make_emitter(reactor, closed);
+        auto third = make_emitter(reactor, closed);
+        pool.put(reactor, "a", first, 2, logger);
+        pool.put(reactor, "a", second, 2, logger);
+        pool.put(reactor, "b", third, 2, logger);
+        REQUIRE(*closed == 0);
+        pool.put(reactor, "a", make_emitter(reactor, closed), 2, logger);
+        REQUIRE(*closed == 1);
+        REQUIRE(pool.size(reactor) == 3);
+        REQUIRE(pool.take<always_alive>(reactor, "a", 15.0, logger).get() !=
+                first.get());
+        REQUIRE(pool.take<always_alive>(reactor, "a", 15.0, logger).get() ==
+                second.get());
+        REQUIRE(!pool.take<always_alive>(reactor, "a", 15.0, logger));
+    }
+
+    SECTION("Expired connections are closed") {
+        pool.put(reactor, "a", make_emitter(reactor, closed), 4, logger);
+        pool.put(reactor, "b", make_emitter(reactor, closed), 4, logger);
+        REQUIRE(!pool.take<always_alive>(reactor, "a", -1.0, logger));
+        REQUIRE(*closed == 2);
+        REQUIRE(pool.size(reactor) == 0);
+    }
+
+    SECTION("Connections closed by the peer are not reused") {
+        pool.put(reactor, "a", make_emitter(reactor, closed), 4, logger);
+        REQUIRE(!pool.take<never_alive>(reactor, "a", 15.0, logger));
+        REQUIRE(*closed == 1);
+    }
+
+    SECTION("Connections reporting an error while idle are not reused") {
+        auto failing = make_emitter(reactor, closed);
+        auto good = make_emitter(reactor, closed);
+        pool.put(reactor, "a", good, 4, logger);
+        pool.put(reactor, "a", failing, 4, logger);
+        failing->emit_error(EofError());
+        REQUIRE(pool.take<always_alive>(reactor, "a", 15.0, logger).get() ==
+                good.get());
+        REQUIRE(*closed == 1);
+    }
+
+    SECTION("close_idle() closes all the connections of a reactor") {
+        SharedPtr<Reactor> other = Reactor::make();
+        pool.put(reactor, "a", make_emitter(reactor, closed), 4, logger);
+        pool.put(reactor, "b", make_emitter(reactor, closed), 4, logger);
+        pool.put(other, "a", make_emitter(other, closed), 4, logger);
+        bool called = false;
+        pool.close_idle(reactor, [&]() { called = true; });
+        REQUIRE(called);
+        REQUIRE(*closed == 2);
+        REQUIRE(pool.size(reactor) == 0);
+        REQUIRE(pool.size(other) == 1);
+        pool.close_idle(other, nullptr);
+        REQUIRE(*closed == 3);
+    }
+
+    SECTION("close_idle() calls the callback if there are no connections") {
+        bool called = false;
+        pool.close_idle(reactor, [&]() { called = true; });
+        REQUIRE(called);
+    }
+}
+
+TEST_CASE("idle_connection_is_alive() works as expected") {
+    SharedPtr<Reactor> reactor = Reactor::make();
+    SharedPtr<Logger> logger = Logger::make();
+
+    SECTION("When the transport is not attached to a socket") {
+        SharedPtr<int> closed = SharedPtr<int>::make(0);
+        REQUIRE(idle_connection_is_alive(make_emitter(reactor, closed)));
+    }
+
+    SECTION("When the transport is attached to a socket") {
+        evutil_socket_t fds[2];
+        REQUIRE(evutil_socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+        REQUIRE(evutil_make_socket_nonblocking(fds[0]) == 0);
+        bufferevent *bev = bufferevent_socket_new(
+                reactor->get_event_base(), fds[0], BEV_OPT_CLOSE_ON_FREE);
+        REQUIRE(bev != nullptr);
+        auto txp = LibeventEmitter::make(bev, reactor, logger);
+
+        SECTION("If the peer did nothing it is alive") {
+            REQUIRE(idle_connection_is_alive(txp));
+            ::close(fds[1]);
+        }
+
+        SECTION("If the peer closed the socket it is not alive") {
+            ::close(fds[1]);
+            REQUIRE(!idle_connection_is_alive(txp));
+        }
+
+        SECTION("If the peer sent data it is not alive") {
+            REQUIRE(::send(fds[1], "x", 1, 0) == 1);
+            REQUIRE(!idle_connection_is_alive(txp));
+            ::close(fds[1]);
+        }
+
+        reactor->run_with_initial_event([&]() {
+            txp->close([&]() { reactor->stop(); });
+        });
+    }
+}
@@ -9,8 +9,14 @@
 #include "src/libmeasurement_kit/http/request_impl.hpp"
 #include "src/libmeasurement_kit/net/error.hpp"
 
+#include <event2/buffer.h>
+#include <event2/bufferevent.h>
+#include <event2/listener.h>
 #include <openssl/md5.h>
 
+#include <map>
+#include <set>
+
 using namespace mk;
 using namespace mk::net;
 using namespace mk::http;
@@ -855,3 +861,248 @@ TEST_CASE("request_json_string() works as expected") {
         });
     }
 }
+
+/*
+ _                             _ _
+| | _____  ___ _ __       __ _| (_)_   _____
+| |/ / _ \/ _ \ '_ \____ / _` | | \ \ / / _ \
+|   <  __/  __/ |_) |___| (_| | | |\ V /  __/
+|_|\_\___|\___| .__/     \__,_|_|_| \_/ \___|
+              |_|
+*/
+
+// Minimal HTTP server that sends `response` for each request it receives
+// and that, if `close_after_response` is true, then closes the connection.
+// If `max_requests_per_connection` is positive, the server closes without
+// responding connections that exceed such number of requests.
+class LocalHttpServer {
+  public:
+    LocalHttpServer(SharedPtr<Reactor> reactor, std::string response,
+                    bool close_after_response = false)
+        : response{response}, close_after_response{close_after_response} {
+        sockaddr_in sin = {};
+        sin.sin_family = AF_INET;
+        sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        listener = evconnlistener_new_bind(
+                reactor->get_event_base(), on_accept, this,
+                LEV_OPT_CLOSE_ON_FREE | LEV_OPT_REUSEABLE, 8,
+                (sockaddr *)&sin, sizeof(sin));
+        REQUIRE(listener != nullptr);
+        socklen_t len = sizeof(sin);
+        REQUIRE(getsockname(evconnlistener_get_fd(listener),
+                            (sockaddr *)&sin, &len) == 0);
+        port = ntohs(sin.sin_port);
+    }
+
+    ~LocalHttpServer() {
+        close_connections();
+        evconnlistener_free(listener);
+    }
+
+    std::string url() {
+        return "http://127.0.0.1:" + std::to_string(port) + "/";
+    }
+
+    void close_connections() {
+        for (auto bev : connections) {
+            bufferevent_free(bev);
+        }
+        connections.clear();
+    }
+
+    int accepted = 0;
+    int requests = 0;
+    int max_requests_per_connection = 0;
+
+  private:
+    static void on_accept(evconnlistener *listener, evutil_socket_t fd,
+                          sockaddr *, int, void *opaque) {
+        auto self = static_cast<LocalHttpServer *>(opaque);
+        bufferevent *bev = bufferevent_socket_new(
+                evconnlistener_get_base(listener), fd, BEV_OPT_CLOSE_ON_FREE);
+        REQUIRE(bev != nullptr);
+        bufferevent_setcb(bev, on_read, nullptr, on_event, self);
+        REQUIRE(bufferevent_enable(bev, EV_READ) == 0);
+        self->connections.insert(bev);
+        self->accepted += 1;
+    }
+
+    static void on_read(bufferevent *bev, void *opaque) {
+        auto self = static_cast<LocalHttpServer *>(opaque);
+        evbuffer *input = bufferevent_get_input(bev);
+        for (;;) {
+            evbuffer_ptr end = evbuffer_search(input, "\r\n\r\n", 4, nullptr);
+            if (end.pos < 0) {
+                break;
+            }
+            REQUIRE(evbuffer_drain(input, (size_t)end.pos + 4) == 0);
+            if (self->max_requests_per_connection > 0 &&
+                ++self->served[bev] > self->max_requests_per_connection) {
+                on_flushed(bev, opaque);
+                return;
+            }
+            self->requests += 1;
+            REQUIRE(bufferevent_write(bev, self->response.data(),
+                                      self->response.size()) == 0);
+            if (self->close_after_response) {
+                bufferevent_setcb(bev, nullptr, on_flushed, on_event, self);
+                return;
+            }
+        }
+    }
+
+    static void on_flushed(bufferevent *bev, void *opaque) {
+        auto self = static_cast<LocalHttpServer *>(opaque);
+        self->connections.erase(bev);
+        self->served.erase(bev);
+        bufferevent_free(bev);
+    }
+
+    static void on_event(bufferevent *bev, short, void *opaque) {
+        on_flushed(bev, opaque);
+    }
+
+    std::string response;
+    bool close_after_response = false;
+    std::set<bufferevent *> connections;
+    std::map<bufferevent *, int> served;
+    evconnlistener *listener = nullptr;
+    uint16_t port = 0;
+};
+
+static const char *keep_alive_response =
+        "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok";
+
+// Sends two GET requests, one after the other, and then closes the idle
+// connections. Calls `between` after the first request.
+static void two_requests(SharedPtr<Reactor> reactor, Settings settings,
+                         Callback<Callback<>> between = nullptr) {
+    SharedPtr<Logger> logger = Logger::make();
+    auto second = [=]() {
+        request(settings, {}, "",
+                [=](Error error, SharedPtr<Response> response) {
+                    REQUIRE(error == NoError());
+                    REQUIRE(response->body == "ok");
+                    close_idle_connections(reactor, [=]() {
+                        reactor->stop();
+                    });
+                },
+                reactor, logger);
+    };
+    reactor->run_with_initial_event([=]() {
+        request(settings, {}, "",
+                [=](Error error, SharedPtr<Response> response) {
+                    REQUIRE(error == NoError());
+                    REQUIRE(response->body == "ok");
+                    if (between) {
+                        between(second);
+                        return;
+                    }
+                    second();
+                },
+                reactor, logger);
+    });
+}
+
+TEST_CASE("http::request() reuses connections with keep-alive") {
+    SharedPtr<Reactor> reactor = Reactor::make();
+
+    SECTION("When keep-alive is disabled") {
+        LocalHttpServer server{reactor, keep_alive_response};
+        two_requests(reactor, {{"http/url", server.url()}});
+        REQUIRE(server.requests == 2);
+        REQUIRE(server.accepted == 2);
+    }
+
+    SECTION("When keep-alive is enabled") {
+        LocalHttpServer server{reactor, keep_alive_response};
+        two_requests(reactor, {{"http/url", server.url()},
+                               {"http/keep_alive", true}});
+        REQUIRE(server.requests == 2);
+        REQUIRE(server.accepted == 1);
+        REQUIRE(ConnectionPool::global().size(reactor) == 0);
+    }
+
+    SECTION("When the server does not allow keep-alive") {
+        LocalHttpServer server{
+                reactor,
+                "HTTP/1.1 200 OK\r\nConnection: close\r\n"
+                "Content-Length: 2\r\n\r\nok",
+                true};
+        two_requests(reactor, {{"http/url", server.url()},
+                               {"http/keep_alive", true}});
+        REQUIRE(server.requests == 2);
+        REQUIRE(server.accepted == 2);
+    }
+
+    SECTION("When the response ends with EOF") {
+        LocalHttpServer server{reactor, "HTTP/1.1 200 OK\r\n\r\nok", true};
+        two_requests(reactor, {{"http/url", server.url()},
+                               {"http/keep_alive", true}});
+        REQUIRE(server.requests == 2);
+        REQUIRE(server.accepted == 2);
+    }
+
+    SECTION("When the server closes the idle connection") {
+        LocalHttpServer server{reactor, keep_alive_response};
+        two_requests(reactor,
+                     {{"http/url", server.url()}, {"http/keep_alive", true}},
+                     [&server, reactor](Callback<> next) {
+                         server.close_connections();
+                         // Give the FIN time to reach the client
+                         reactor->call_later(0.1, [=]() { next(); });
+                     });
+        REQUIRE(server.requests == 2);
+        REQUIRE(server.accepted == 2);
+    }
+
+    SECTION("When the server closes the connection when we reuse it") {
+        LocalHttpServer server{reactor, keep_alive_response};
+        server.max_requests_per_connection = 1;
+        two_requests(reactor, {{"http/url", server.url()},
+                               {"http/keep_alive", true}});
+        REQUIRE(server.requests == 2);
+        REQUIRE(server.accepted == 2);
+    }
+
+    SECTION("When the server closes the connection when we reuse it "
+            "to send a POST request") {
+        LocalHttpServer server{reactor, keep_alive_response};
+        server.max_requests_per_connection = 1;
+        Settings settings{{"http/url", server.url()},
+                          {"http/method", "POST"},
+                          {"http/keep_alive", true}};
+        SharedPtr<Logger> logger = Logger::make();
+        Error second_error;
+        reactor->run_with_initial_event([&]() {
+            request(settings, {}, "{}",
+                    [&](Error error, SharedPtr<Response> response) {
+                        REQUIRE(error == NoError());
+                        REQUIRE(response->body == "ok");
+                        request(settings, {}, "{}",
+                                [&](Error error, SharedPtr<Response>) {
+                                    second_error = error;
+                                    close_idle_connections(reactor, [=]() {
+                                        reactor->stop();
+                                    });
+                                },
+                                reactor, logger);
+                    },
+                    reactor, logger);
+        });
+        // The server may have processed the request, so we must not
+        // send it again using a new connection
+        REQUIRE(second_error != NoError());
+        REQUIRE(server.requests == 1);
+        REQUIRE(server.accepted == 1);
+    }
+
+    SECTION("When the idle connection has expired") {
+        LocalHttpServer server{reactor, keep_alive_response};
+        two_requests(reactor, {{"http/url", server.url()},
+                               {"http/keep_alive", true},
+                               {"http/keep_alive_idle_timeout", -1.0}});
+        REQUIRE(server.requests == 2);
+        REQUIRE(server.accepted == 2);
+    }
+}
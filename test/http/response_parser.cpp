@@ -8,6 +8,10 @@
 
 #include "src/libmeasurement_kit/http/response_parser.hpp"
 
+#include <stdio.h>
+
+#include <chrono>
+
 using namespace mk;
 using namespace mk::net;
 using namespace mk::http;
@@ -209,3 +213,73 @@ TEST_CASE("ResponseParserNg eof() works as expected") {
 
     REQUIRE(called);
 }
+
+TEST_CASE("ResponseParserNg parses and consumes a Buffer in place") {
+    ResponseParserNg parser{Logger::make()};
+    std::string body;
+    bool called = false;
+    parser.on_body([&body](std::string s) { body += s; });
+    parser.on_end([&called]() { called = true; });
+
+    // Build the buffer out of more segments than are peeked at once
+    Buffer data;
+    data << std::string{"HTTP/1.1 200 Ok\r\nContent-Length: 40\r\n\r\n"};
+    for (int i = 0; i < 20; ++i) {
+        Buffer segment;
+        segment << std::string{"ab"};
+        data << segment;
+    }
+    parser.feed(data);
+
+    REQUIRE(called);
+    REQUIRE(data.length() == 0);
+    std::string expect;
+    for (int i = 0; i < 20; ++i) {
+        expect += "ab";
+    }
+    REQUIRE(body == expect);
+}
+
+/*
+ * Benchmark comparing parsing a Buffer in place with what we would do if we
+ * first copied its content into a string. It is hidden, run it using
+ * `./test/http/response_parser [benchmark]`.
+ */
+
+template <typename Func> static void measure(const char *what, Func &&func) {
+    static const int iterations = 200;
+    auto begin = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        func();
+    }
+    std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - begin;
+    printf("%-40s %8.1f us/response\n", what,
+           elapsed.count() * 1e06 / iterations);
+}
+
+// Returns a 1 MiB response split into 4 KiB segments, like those we read
+static Buffer make_big_response() {
+    Buffer data;
+    data << std::string{"HTTP/1.1 200 Ok\r\nContent-Length: 1048576\r\n\r\n"};
+    std::string chunk(4096, 'x');
+    for (int i = 0; i < 256; ++i) {
+        Buffer segment;
+        segment << chunk;
+        data << segment;
+    }
+    return data;
+}
+
+TEST_CASE("ResponseParserNg parsing cost", "[.benchmark]") {
+    measure("ResponseParserNg: feed Buffer", []() {
+        Buffer data = make_big_response();
+        ResponseParserNg parser{Logger::make()};
+        parser.feed(data);
+    });
+    measure("ResponseParserNg: feed std::string", []() {
+        Buffer data = make_big_response();
+        ResponseParserNg parser{Logger::make()};
+        parser.feed(data.read());
+    });
+}
@@ -7,38 +7,83 @@
 #include "include/private/catch.hpp"
 
 #include "src/libmeasurement_kit/ndt/messages_impl.hpp"
+#include "src/libmeasurement_kit/net/emitter.hpp"
 
 using namespace mk;
 using namespace mk::ndt;
 using namespace mk::net;
 
-static void fail(SharedPtr<Transport>, SharedPtr<Buffer>, size_t, Callback<Error> cb,
-                 SharedPtr<Reactor> = Reactor::make()) {
-    cb(MockedError());
+static SharedPtr<Context> make_context(SharedPtr<Reactor> reactor) {
+    SharedPtr<Context> ctx(new Context);
+    ctx->reactor = reactor;
+    ctx->txp = SharedPtr<Transport>{
+            std::make_shared<Emitter>(reactor, Logger::make())};
+    return ctx;
 }
 
-static void succeed(SharedPtr<Transport>, SharedPtr<Buffer>, size_t, Callback<Error> cb,
-                    SharedPtr<Reactor> = Reactor::make()) {
-    cb(NoError());
+TEST_CASE("read_ll() deals with error while reading type and length") {
+    auto ctx = make_context(Reactor::make());
+    Error error;
+    messages::read_ll_impl(ctx, [&](Error err, uint8_t, std::string) {
+        error = err;
+    }, ctx->reactor);
+    ctx->txp->emit_data(Buffer{"\x01"});
+    ctx->txp->emit_error(MockedError());
+    REQUIRE(error == ReadingMessageTypeLengthError());
+    ctx->reader = {};
 }
 
-TEST_CASE("read_ndt() deals with the first readn() error") {
-    SharedPtr<Context> ctx(new Context);
-    messages::read_ll_impl<fail>(ctx, [](Error err, uint8_t, std::string) {
-        REQUIRE(err == ReadingMessageTypeLengthError());
-    }, Reactor::make());
+TEST_CASE("read_ll() deals with error while reading the payload") {
+    auto ctx = make_context(Reactor::make());
+    Error error;
+    messages::read_ll_impl(ctx, [&](Error err, uint8_t, std::string) {
+        error = err;
+    }, ctx->reactor);
+    Buffer data;
+    data.write_uint8(1);
+    data.write_uint16(3);
+    data.write("a");
+    ctx->txp->emit_data(data);
+    ctx->txp->emit_error(MockedError());
+    REQUIRE(error == ReadingMessagePayloadError());
+    ctx->reader = {};
 }
 
-TEST_CASE("read_ndt() deals with the second readn() error") {
-    SharedPtr<Context> ctx(new Context);
-    // Now we have enough bytes to read type and lenght such that we
-    // arrive to invoke readn() one second time
+TEST_CASE("read_ll() reads one message at a time") {
+    auto ctx = make_context(Reactor::make());
+    // What is left in the buffer after receiving the kickoff message
     ctx->buff->write_uint8(1);
     ctx->buff->write_uint16(3);
-    messages::read_ll_impl<succeed, fail>(
-        ctx, [](Error err, uint8_t, std::string) {
-            REQUIRE(err == ReadingMessagePayloadError());
-        }, Reactor::make());
+    ctx->buff->write("abc");
+    ctx->buff->write_uint8(2);
+    std::vector<std::pair<uint8_t, std::string>> messages;
+    ctx->reactor->run_with_initial_event([&]() {
+        messages::read_ll_impl(ctx, [&](Error err, uint8_t type,
+                                        std::string s) {
+            REQUIRE(!err);
+            messages.push_back({type, s});
+            // The second message must not be delivered without asking
+            Buffer data;
+            data.write_uint16(2);
+            data.write("de");
+            ctx->txp->emit_data(data);
+            ctx->reactor->call_soon([&]() {
+                REQUIRE(messages.size() == 1);
+                messages::read_ll_impl(ctx, [&](Error err, uint8_t type,
+                                                std::string s) {
+                    REQUIRE(!err);
+                    messages.push_back({type, s});
+                    ctx->reactor->stop();
+                }, ctx->reactor);
+            });
+        }, ctx->reactor);
+    });
+    REQUIRE(messages.size() == 2);
+    REQUIRE(messages[0].first == 1);
+    REQUIRE(messages[0].second == "abc");
+    REQUIRE(messages[1].first == 2);
+    REQUIRE(messages[1].second == "de");
+    ctx->reader = {};
 }
 
 static void fail(SharedPtr<Context>, Callback<Error, uint8_t, std::string> cb,
@@ -24,6 +24,14 @@ TEST_CASE("coroutine() is robust to connect error") {
         2.0, {}, Reactor::make(), Logger::make());
 }
 
+TEST_CASE("coroutine() fails if net/zero_copy is invalid") {
+    SharedPtr<nlohmann::json> entry{new nlohmann::json};
+    test_c2s::coroutine_impl<fail>(
+        entry, "www.google.com", 3301, 10.0,
+        [](Error err, Continuation<Error>) { REQUIRE(err == ValueError()); },
+        2.0, {{"net/zero_copy", "maybe"}}, Reactor::make(), Logger::make());
+}
+
 static void fail(SharedPtr<Context>, Callback<Error, uint8_t, std::string> cb,
                  SharedPtr<Reactor> = Reactor::make()) {
     cb(MockedError(), 0, "");
@@ -464,3 +464,44 @@ TEST_CASE("Write into works correctly") {
         });
     }
 }
+
+TEST_CASE("remove() works correctly") {
+    Buffer buff;
+    buff << "0123456789";
+    char data[4];
+    buff.remove(data, sizeof(data));
+    REQUIRE(std::string(data, sizeof(data)) == "0123");
+    REQUIRE(buff.length() == 6);
+    char more[8];
+    REQUIRE_THROWS(buff.remove(more, sizeof(more)));
+}
+
+TEST_CASE("write_copy() works correctly") {
+    Buffer source;
+    source << std::string(65536, 'A');
+    source.write_rand(1024);
+
+    SECTION("The source is not drained and later changes are not seen") {
+        Buffer copy;
+        copy.write_copy(source);
+        REQUIRE(copy.length() == source.length());
+        REQUIRE(copy.peek() == source.peek());
+        std::string expect = copy.peek();
+        source.discard(32768);
+        source << std::string(65536, 'B');
+        REQUIRE(copy.read() == expect);
+    }
+
+    SECTION("We can copy a buffer that contains shared memory") {
+        Buffer copy;
+        copy.write_copy(source);
+        Buffer second;
+        second.write_copy(copy);
+        REQUIRE(second.peek() == source.peek());
+        REQUIRE(copy.peek() == source.peek());
+    }
+
+    SECTION("We cannot copy a buffer into itself") {
+        REQUIRE_THROWS(source.write_copy(source));
+    }
+}
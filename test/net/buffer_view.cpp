@@ -0,0 +1,168 @@
+// Part of Measurement Kit <https://measurement-kit.github.io/>.
+// Measurement Kit is free software under the BSD license. See AUTHORS
+// and LICENSE for more information on the copying conditions.
+
+#include "test/winsock.hpp"
+
+#include "include/private/catch.hpp"
+
+#include "src/libmeasurement_kit/net/buffer_view.hpp"
+
+#include <stdio.h>
+
+#include <chrono>
+
+using namespace mk;
+using namespace mk::net;
+
+// Creates a buffer made of many small, separately allocated segments.
+static Buffer make_segmented_buffer(std::string s, size_t segment_size) {
+    Buffer buff;
+    for (size_t i = 0; i < s.size(); i += segment_size) {
+        Buffer segment{s.substr(i, segment_size)};
+        buff << segment;
+    }
+    return buff;
+}
+
+TEST_CASE("BufferView works as expected") {
+    std::string text = "HTTP/1.1 200 Ok\r\nContent-Length: 13\r\n\r\nHello, world!";
+    Buffer buff = make_segmented_buffer(text, 7);
+
+    SECTION("The view does not change the buffer") {
+        BufferView view{buff};
+        REQUIRE(view.length() == text.size());
+        REQUIRE(view.str() == text);
+        REQUIRE(buff.length() == text.size());
+    }
+
+    SECTION("The view is limited to the requested size") {
+        BufferView view{buff, 10};
+        REQUIRE(view.length() == 10);
+        REQUIRE(view.str() == text.substr(0, 10));
+        BufferView larger{buff, 1 << 20};
+        REQUIRE(larger.length() == text.size());
+    }
+
+    SECTION("A view of an empty buffer is empty") {
+        Buffer empty;
+        BufferView view{empty};
+        REQUIRE(view.empty());
+        REQUIRE(view.find('H') == BufferView::npos);
+        REQUIRE(view.str() == "");
+    }
+
+    SECTION("at() works across segments") {
+        for (size_t i = 0; i < text.size(); ++i) {
+            REQUIRE(BufferView{buff}.at(i) == (uint8_t)text[i]);
+        }
+        REQUIRE_THROWS_AS(BufferView{buff}.at(text.size()), std::out_of_range);
+    }
+
+    SECTION("find() works across segments") {
+        BufferView view{buff};
+        REQUIRE(view.find('\r') == text.find('\r'));
+        REQUIRE(view.find('\r', 16) == text.find('\r', 16));
+        REQUIRE(view.find('x') == BufferView::npos);
+        REQUIRE(view.find("\r\n\r\n") == text.find("\r\n\r\n"));
+        REQUIRE(view.find("Content-Length") == text.find("Content-Length"));
+        REQUIRE(view.find("world!") == text.find("world!"));
+        REQUIRE(view.find("world!!") == BufferView::npos);
+        REQUIRE(view.find("HTTP", 1) == BufferView::npos);
+        REQUIRE(view.find("") == 0);
+    }
+
+    SECTION("compare() works across segments") {
+        BufferView view{buff};
+        REQUIRE(view.starts_with("HTTP/1.1 "));
+        REQUIRE(!view.starts_with("HTTP/1.0 "));
+        REQUIRE(view.compare(9, 3, "200") == 0);
+        REQUIRE(view.compare(9, 3, "201") < 0);
+        REQUIRE(view.compare(9, 3, "2000") < 0);
+        REQUIRE(view.compare(9, 4, "200") > 0);
+        REQUIRE(view.compare(text.size() - 6, 100, "world!") == 0);
+        REQUIRE_THROWS_AS(view.compare(text.size() + 1, 1, ""),
+                          std::out_of_range);
+    }
+
+    SECTION("copy() works across segments") {
+        BufferView view{buff};
+        char data[8];
+        REQUIRE(view.copy(data, sizeof(data), 5) == sizeof(data));
+        REQUIRE(std::string(data, sizeof(data)) == text.substr(5, 8));
+        REQUIRE(view.copy(data, sizeof(data), text.size() - 3) == 3);
+    }
+
+    SECTION("slice() works across segments") {
+        BufferView view{buff};
+        BufferView slice = view.slice(5, 20);
+        REQUIRE(slice.length() == 20);
+        REQUIRE(slice.str() == text.substr(5, 20));
+        REQUIRE(slice.find('\r') == text.substr(5, 20).find('\r'));
+        REQUIRE(view.slice(text.size()).empty());
+        REQUIRE(view.slice(text.size() - 5).str() == "orld!");
+    }
+
+    SECTION("for_each() visits each segment in order") {
+        std::string out;
+        size_t count = 0;
+        BufferView{buff}.for_each([&](const char *p, size_t n) {
+            out.append(p, n);
+            ++count;
+            return true;
+        });
+        REQUIRE(out == text);
+        REQUIRE(count > 1);
+    }
+
+    SECTION("Consuming after use works") {
+        BufferView view{buff};
+        size_t pos = view.find("\r\n\r\n");
+        REQUIRE(pos != BufferView::npos);
+        buff.discard(pos + 4);
+        REQUIRE(BufferView{buff}.str() == "Hello, world!");
+    }
+}
+
+/*
+ * Benchmark comparing the receive path using a string copy and using a
+ * view. It is hidden, run it using `./test/net/buffer_view [benchmark]`.
+ */
+
+static const size_t chunk_size = 16384;
+static const size_t chunks = 4096;
+
+template <typename Func> static void measure(const char *what, Func &&func) {
+    Buffer chunk{std::string(chunk_size - 1, 'A') + "\n"};
+    Buffer record;
+    size_t total = 0;
+    auto begin = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < chunks; ++i) {
+        Buffer data;
+        data.write_copy(chunk);
+        total += func(data, record);
+    }
+    std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - begin;
+    printf("%-40s %10.1f MB/s (%zu)\n", what,
+           chunk_size * chunks / elapsed.count() / 1e06, total);
+}
+
+TEST_CASE("Receive path throughput", "[.benchmark]") {
+    measure("peek() and search for EOL", [](Buffer &data, Buffer &) {
+        return data.peek().find('\n');
+    });
+    measure("BufferView and search for EOL", [](Buffer &data, Buffer &) {
+        return BufferView{data}.find('\n');
+    });
+    measure("record using write(peek())", [](Buffer &data, Buffer &record) {
+        record.write(data.peek());
+        record.discard();
+        return data.length();
+    });
+    measure("record using write_copy()", [](Buffer &data, Buffer &record) {
+        record.write_copy(data);
+        record.discard();
+        return data.length();
+    });
+}
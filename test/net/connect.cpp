@@ -12,6 +12,10 @@
 
 #include <event2/bufferevent.h>
 
+#include <stdio.h>
+
+#include <algorithm>
+#include <chrono>
 #include <iostream>
 
 using namespace mk;
@@ -131,6 +135,253 @@ TEST_CASE("net::connect_many() correctly handles net::connect() failure") {
     connect_many_impl<fail>(ctx);
 }
 
+class ClosableEmitter : public Emitter {
+  public:
+    using Emitter::Emitter;
+    bool closed = false;
+    void close(Callback<> cb) override {
+        closed = true;
+        Emitter::close(cb);
+    }
+};
+
+// Mocked connect() that completes only when we say so
+static std::vector<Callback<Error, SharedPtr<Transport>>> pending_connects;
+static std::vector<SharedPtr<Transport>> opened_transports;
+static size_t max_pending_connects = 0;
+
+static void deferred(std::string, int,
+                     Callback<Error, SharedPtr<Transport>> cb, Settings,
+                     SharedPtr<Reactor> r, SharedPtr<Logger> logger) {
+    pending_connects.push_back(cb);
+    size_t running = (size_t)std::count_if(
+            pending_connects.begin(), pending_connects.end(),
+            [](const Callback<Error, SharedPtr<Transport>> &f) { return !!f; });
+    max_pending_connects = std::max(max_pending_connects, running);
+    SharedPtr<Transport> txp{new ClosableEmitter(r, logger)};
+    txp->set_connect_time_((double)opened_transports.size());
+    opened_transports.push_back(txp);
+}
+
+static void complete_pending_connect(size_t idx, Error err) {
+    auto cb = pending_connects[idx];
+    pending_connects[idx] = nullptr;
+    for (size_t i = 0; i < opened_transports.size(); ++i) {
+        if (opened_transports[i]->connect_time() == (double)idx) {
+            cb(err, opened_transports[i]);
+            return;
+        }
+    }
+    REQUIRE(false);
+}
+
+TEST_CASE("net::connect_many() connects in parallel") {
+    pending_connects.clear();
+    opened_transports.clear();
+    max_pending_connects = 0;
+    SharedPtr<Reactor> reactor = Reactor::make();
+    bool called = false;
+
+    SECTION("Results are in order when connections complete out of order") {
+        SharedPtr<ConnectManyCtx> ctx = connect_many_make(
+            "www.google.com", 80, 4,
+            [&](Error err, std::vector<SharedPtr<Transport>> conns) {
+                REQUIRE(!err);
+                REQUIRE(conns.size() == 4);
+                for (size_t i = 0; i < conns.size(); ++i) {
+                    REQUIRE(conns[i]->connect_time() == (double)i);
+                }
+                called = true;
+            },
+            {}, reactor, Logger::make());
+        connect_many_impl<deferred>(ctx);
+        REQUIRE(pending_connects.size() == 4);
+        for (size_t i = 4; i > 0; --i) {
+            complete_pending_connect(i - 1, NoError());
+        }
+        REQUIRE(called);
+    }
+
+    SECTION("The number of concurrent connects is capped") {
+        SharedPtr<ConnectManyCtx> ctx = connect_many_make(
+            "www.google.com", 80, 5,
+            [&](Error err, std::vector<SharedPtr<Transport>> conns) {
+                REQUIRE(!err);
+                REQUIRE(conns.size() == 5);
+                called = true;
+            },
+            {{"net/connect_many_parallelism", 2}}, reactor, Logger::make());
+        connect_many_impl<deferred>(ctx);
+        REQUIRE(pending_connects.size() == 2);
+        for (size_t i = 0; i < 5; ++i) {
+            complete_pending_connect(i, NoError());
+        }
+        REQUIRE(max_pending_connects == 2);
+        REQUIRE(called);
+    }
+
+    SECTION("Open connections are closed on failure") {
+        SharedPtr<ConnectManyCtx> ctx = connect_many_make(
+            "www.google.com", 80, 4,
+            [&](Error err, std::vector<SharedPtr<Transport>> conns) {
+                REQUIRE(err == GenericError());
+                REQUIRE(conns.size() == 1);
+                REQUIRE(conns[0]->connect_time() == 0.0);
+                called = true;
+            },
+            {{"net/connect_many_parallelism", 2}}, reactor, Logger::make());
+        connect_many_impl<deferred>(ctx);
+        REQUIRE(pending_connects.size() == 2);
+        complete_pending_connect(1, NoError());
+        REQUIRE(pending_connects.size() == 3);
+        // The failure prevents the fourth connect from starting but we
+        // need to wait for the third to complete
+        complete_pending_connect(0, GenericError());
+        REQUIRE(pending_connects.size() == 3);
+        REQUIRE(!called);
+        complete_pending_connect(2, NoError());
+        REQUIRE(called);
+        REQUIRE(opened_transports.size() == 3);
+        for (auto &txp : opened_transports) {
+            auto emitter = static_cast<ClosableEmitter *>(txp.get());
+            bool failed = txp->connect_time() == 0.0;
+            REQUIRE(emitter->closed == !failed);
+        }
+    }
+}
+
+static evutil_socket_t listen_on_loopback(uint16_t *port) {
+    evutil_socket_t fd = socket(AF_INET, SOCK_STREAM, 0);
+    REQUIRE(fd != -1);
+    sockaddr_in sin = {};
+    sin.sin_family = AF_INET;
+    sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    REQUIRE(bind(fd, (sockaddr *)&sin, sizeof(sin)) == 0);
+    REQUIRE(listen(fd, 8) == 0);
+    socklen_t len = sizeof(sin);
+    REQUIRE(getsockname(fd, (sockaddr *)&sin, &len) == 0);
+    *port = ntohs(sin.sin_port);
+    return fd;
+}
+
+static std::vector<std::string>
+attempted_addresses(SharedPtr<ConnectResult> result) {
+    std::vector<std::string> v;
+    for (auto &attempt : result->connect_attempts) {
+        v.push_back(attempt.address);
+    }
+    return v;
+}
+
+TEST_CASE("connect_first_of interleaves address families") {
+    // Note: connectivity not required to run this test
+    auto run = [](std::string preference) {
+        SharedPtr<Reactor> reactor = Reactor::make();
+        SharedPtr<ConnectResult> result(new ConnectResult);
+        result->resolve_result.addresses = {
+            "127.0.0.1", "127.0.0.2", "::1",
+        };
+        reactor->run_with_initial_event([=]() {
+            connect_first_of(result, 1,
+                             [=](std::vector<Error> errors, bufferevent *bev) {
+                                 REQUIRE(errors.size() == 3);
+                                 for (Error err : errors) {
+                                     REQUIRE(err);
+                                 }
+                                 REQUIRE(bev == nullptr);
+                                 reactor->stop();
+                             },
+                             {{"net/happy_eyeballs_delay", 0.0},
+                              {"net/happy_eyeballs_preference", preference},
+                              {"net/timeout", 1.0}},
+                             reactor, Logger::make());
+        });
+        return attempted_addresses(result);
+    };
+
+    SECTION("When IPv4 is preferred") {
+        REQUIRE((run("ipv4") == std::vector<std::string>{
+                "127.0.0.1", "::1", "127.0.0.2"}));
+    }
+
+    SECTION("When IPv6 is preferred") {
+        REQUIRE((run("ipv6") == std::vector<std::string>{
+                "::1", "127.0.0.1", "127.0.0.2"}));
+    }
+}
+
+TEST_CASE("connect_first_of keeps the resolution order by default") {
+    // Note: connectivity not required to run this test
+    SharedPtr<Reactor> reactor = Reactor::make();
+    SharedPtr<ConnectResult> result(new ConnectResult);
+    result->resolve_result.addresses = {
+        "127.0.0.1", "127.0.0.2", "::1",
+    };
+    reactor->run_with_initial_event([=]() {
+        connect_first_of(result, 1,
+                         [=](std::vector<Error> errors, bufferevent *bev) {
+                             REQUIRE(errors.size() == 3);
+                             for (Error err : errors) {
+                                 REQUIRE(err);
+                                 REQUIRE(err != OperationCancelledError());
+                             }
+                             REQUIRE(bev == nullptr);
+                             reactor->stop();
+                         },
+                         {{"net/happy_eyeballs_preference", "ipv6"},
+                          {"net/timeout", 1.0}},
+                         reactor, Logger::make());
+    });
+    REQUIRE((attempted_addresses(result) == std::vector<std::string>{
+            "127.0.0.1", "127.0.0.2", "::1"}));
+}
+
+TEST_CASE("connect_first_of does not wait for a slow attempt") {
+    // Note: connectivity not required to run this test. The first address
+    // is not routable, so the connect() either hangs or fails quickly.
+    uint16_t port = 0;
+    evutil_socket_t fd = listen_on_loopback(&port);
+    SharedPtr<Reactor> reactor = Reactor::make();
+    SharedPtr<ConnectResult> result(new ConnectResult);
+    result->resolve_result.addresses = {"10.255.255.1", "127.0.0.1"};
+    reactor->run_with_initial_event([=]() {
+        connect_first_of(result, port,
+                         [=](std::vector<Error> errors, bufferevent *bev) {
+                             REQUIRE(errors.size() == 2);
+                             REQUIRE(errors[0]);
+                             REQUIRE(errors[1] == NoError());
+                             REQUIRE(bev);
+                             ::bufferevent_free(bev);
+                             reactor->stop();
+                         },
+                         {{"net/happy_eyeballs_delay", 0.1},
+                          {"net/timeout", 5.0}},
+                         reactor, Logger::make());
+    });
+    evutil_closesocket(fd);
+    REQUIRE(result->connect_attempts.size() == 2);
+    REQUIRE(result->connect_attempts[1].address == "127.0.0.1");
+    REQUIRE(result->connect_attempts[1].error == NoError());
+    REQUIRE(result->connect_attempts[1].start < 1.0);
+}
+
+TEST_CASE("connect_first_of deals with invalid happy eyeballs settings") {
+    SharedPtr<Reactor> reactor = Reactor::make();
+    SharedPtr<ConnectResult> result(new ConnectResult);
+    result->resolve_result.addresses = {"127.0.0.1"};
+    reactor->run_with_initial_event([=]() {
+        connect_first_of(result, 80,
+                         [=](std::vector<Error> errors, bufferevent *bev) {
+                             REQUIRE(errors.size() == 1);
+                             REQUIRE(errors[0] == ValueError());
+                             REQUIRE(bev == nullptr);
+                             reactor->stop();
+                         },
+                         {{"net/happy_eyeballs_preference", "ipv5"}},
+                         reactor, Logger::make());
+    });
+}
+
 /*
  _       _                       _   _
 (_)_ __ | |_ ___  __ _ _ __ __ _| |_(_) ___  _ __
@@ -432,3 +683,52 @@ TEST_CASE("net::connect() works in case of error") {
                 reactor, Logger::make());
     });
 }
+
+/*
+ * Benchmark measuring how long it takes to resolve a name using the system
+ * resolver, which runs getaddrinfo() in a background thread, and then to
+ * connect to the result. Connecting to an address literal, which does not
+ * involve background threads, is the baseline. It is hidden, run it using
+ * `./test/net/connect [benchmark]`.
+ */
+
+static void measure_connect(const char *what, std::string address) {
+    static const int iterations = 50;
+    uint16_t port = 0;
+    evutil_socket_t fd = listen_on_loopback(&port);
+    SharedPtr<Reactor> reactor = Reactor::make();
+    SharedPtr<int> count = SharedPtr<int>::make(0);
+    SharedPtr<std::function<void()>> next{
+            std::make_shared<std::function<void()>>()};
+    *next = [=]() {
+        connect(address, port,
+                [=](Error error, SharedPtr<Transport> txp) {
+                    REQUIRE(!error);
+                    // Accept and close, so the backlog does not fill up
+                    evutil_socket_t conn = accept(fd, nullptr, nullptr);
+                    REQUIRE(conn != -1);
+                    evutil_closesocket(conn);
+                    txp->close([=]() {
+                        if (++*count < iterations) {
+                            (*next)();
+                            return;
+                        }
+                        *next = nullptr; // Break the reference cycle
+                    });
+                },
+                {{"net/timeout", 5.0}}, reactor, Logger::make());
+    };
+    auto begin = std::chrono::steady_clock::now();
+    reactor->run_with_initial_event([=]() { (*next)(); });
+    std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - begin;
+    evutil_closesocket(fd);
+    REQUIRE(*count == iterations);
+    printf("%-40s %8.1f us/connect\n", what,
+           elapsed.count() * 1e06 / iterations);
+}
+
+TEST_CASE("Resolve and connect latency", "[.benchmark]") {
+    measure_connect("connect to 127.0.0.1", "127.0.0.1");
+    measure_connect("resolve localhost and connect", "localhost");
+}
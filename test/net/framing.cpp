@@ -0,0 +1,143 @@
+// Part of Measurement Kit <https://measurement-kit.github.io/>.
+// Measurement Kit is free software under the BSD license. See AUTHORS
+// and LICENSE for more information on the copying conditions.
+
+#include "test/winsock.hpp"
+
+#include "include/private/catch.hpp"
+
+#include "src/libmeasurement_kit/net/emitter.hpp"
+#include "src/libmeasurement_kit/net/error.hpp"
+#include "src/libmeasurement_kit/net/framing.hpp"
+
+using namespace mk;
+using namespace mk::net;
+
+static size_t first_byte(const std::string &header) {
+    return (uint8_t)header[0];
+}
+
+TEST_CASE("Framing::exact() works as expected") {
+    auto framing = Framing::exact(4);
+    Buffer buff{"abc"};
+    REQUIRE(*framing->frame_length(buff) == 0);
+    buff.write("defgh");
+    REQUIRE(*framing->frame_length(buff) == 4);
+    REQUIRE_THROWS(Framing::exact(0));
+}
+
+TEST_CASE("Framing::delimited() works as expected") {
+    auto framing = Framing::delimited("\r\n", 16);
+
+    SECTION("When the delimiter is split across reads") {
+        Buffer buff{"HTTP/1.1 200\r"};
+        REQUIRE(*framing->frame_length(buff) == 0);
+        buff.write("\nServer");
+        REQUIRE(*framing->frame_length(buff) == 14);
+        buff.discard(14);
+        REQUIRE(*framing->frame_length(buff) == 0);
+        buff.write(": x\r\n");
+        REQUIRE(*framing->frame_length(buff) == 11);
+    }
+
+    SECTION("When there is no delimiter in the first bytes") {
+        Buffer buff{std::string(15, 'x')};
+        REQUIRE(*framing->frame_length(buff) == 0);
+        buff.write("x");
+        REQUIRE(framing->frame_length(buff).as_error() == FrameTooLargeError());
+    }
+
+    SECTION("When the delimiter comes too late") {
+        Buffer buff{std::string(15, 'x') + "\r\n"};
+        REQUIRE(framing->frame_length(buff).as_error() == FrameTooLargeError());
+    }
+
+    REQUIRE_THROWS(Framing::delimited("", 16));
+}
+
+TEST_CASE("Framing::length_prefixed() works as expected") {
+    auto framing = Framing::length_prefixed(1, first_byte, 8);
+    Buffer buff;
+    REQUIRE(*framing->frame_length(buff) == 0);
+    buff.write_uint8(3);
+    buff.write("ab");
+    REQUIRE(*framing->frame_length(buff) == 0);
+    buff.write("c");
+    REQUIRE(*framing->frame_length(buff) == 4);
+    buff.discard(4);
+    buff.write_uint8(0);
+    REQUIRE(*framing->frame_length(buff) == 1);
+    buff.discard(1);
+    buff.write_uint8(8);
+    REQUIRE(framing->frame_length(buff).as_error() == FrameTooLargeError());
+}
+
+TEST_CASE("FramedReader works as expected") {
+    SharedPtr<Reactor> reactor = Reactor::make();
+    SharedPtr<Transport> txp{std::make_shared<Emitter>(reactor, Logger::make())};
+    SharedPtr<Buffer> buff = Buffer::make();
+    auto reader = FramedReader::make(txp, Framing::delimited("\n", 8), buff,
+                                     reactor);
+    std::vector<std::string> frames;
+    Error error;
+    reader->on_frame([&](Error err, Buffer frame) {
+        if (err) {
+            error = err;
+            return;
+        }
+        frames.push_back(frame.read());
+    });
+
+    SECTION("It does not deliver frames until resumed") {
+        txp->emit_data(Buffer{"a\n"});
+        REQUIRE(frames.empty());
+    }
+
+    SECTION("It delivers all the frames to the same callback") {
+        reader->resume();
+        txp->emit_data(Buffer{"a\nbb"});
+        txp->emit_data(Buffer{"b\ncccc\nd"});
+        REQUIRE((frames == std::vector<std::string>{"a\n", "bbb\n", "cccc\n"}));
+        REQUIRE(reader->buffered() == 1);
+        txp->emit_error(EofError());
+        REQUIRE(error == EofError());
+    }
+
+    SECTION("It fails when a frame is too large") {
+        reader->resume();
+        txp->emit_data(Buffer{"a\n123456789"});
+        REQUIRE((frames == std::vector<std::string>{"a\n"}));
+        REQUIRE(error == FrameTooLargeError());
+        // The reader detached from the transport
+        txp->emit_data(Buffer{"\n"});
+        REQUIRE(reader->buffered() == 9);
+    }
+
+    SECTION("It delivers errors occurring while paused after resume()") {
+        buff->write("a\nb\n");
+        reactor->run_with_initial_event([&]() {
+            reader->on_frame([&](Error err, Buffer frame) {
+                if (err) {
+                    error = err;
+                    reactor->stop();
+                    return;
+                }
+                frames.push_back(frame.read());
+                reader->pause();
+                txp->emit_error(EofError());
+                REQUIRE(!error);
+                reactor->call_soon([&]() { reader->resume(); });
+            });
+            reader->resume();
+        });
+        REQUIRE((frames == std::vector<std::string>{"a\n", "b\n"}));
+        REQUIRE(error == EofError());
+    }
+
+    SECTION("It stops reading after detach()") {
+        reader->resume();
+        reader->detach();
+        txp->emit_data(Buffer{"a\n"});
+        REQUIRE(frames.empty());
+    }
+}
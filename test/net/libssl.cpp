@@ -9,6 +9,17 @@
 #include "src/libmeasurement_kit/common/error_or.hpp"
 #include "src/libmeasurement_kit/common/logger.hpp"
 #include "src/libmeasurement_kit/net/libssl.hpp"
+
+#include <openssl/ec.h>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/x509.h>
+
+#include <stdio.h>
+#include <utime.h>
+
+#include <chrono>
+#include <fstream>
 #include <future>
 
 using namespace mk::net::libssl;
@@ -31,9 +42,9 @@ TEST_CASE("Context::get_client_ssl() works") {
 
 static SSL_CTX *ssl_ctx_new_fail(const SSL_METHOD *) { return nullptr; }
 
-static int ssl_ctx_load_verify_locations_fail(SSL_CTX *, const char *,
-                                              const char *) {
-    return 0;
+static ErrorOr<SharedPtr<TrustStore>> get_trust_store_fail(
+        std::string, SharedPtr<Logger>) {
+    return {SslCtxLoadVerifyLocationsError(), {}};
 }
 
 TEST_CASE("Context::make() works") {
@@ -49,15 +60,109 @@ TEST_CASE("Context::make() works") {
         REQUIRE(maybe_ctx.as_error() == SslCtxNewError());
     }
 
-    SECTION("when SSL_CTX_load_verify_locations() fails") {
+    SECTION("when loading the trust store fails") {
         auto maybe_ctx =
-              Context::make<SSL_CTX_new, ssl_ctx_load_verify_locations_fail>(
+              Context::make<SSL_CTX_new, get_trust_store_fail>(
                     default_cert, Logger::make());
         REQUIRE(!maybe_ctx);
         REQUIRE(maybe_ctx.as_error() == SslCtxLoadVerifyLocationsError());
     }
 }
 
+static int x509_store_load_locations_fail(X509_STORE *, const char *,
+                                          const char *) {
+    return 0;
+}
+
+static void copy_file(const char *from, const char *to) {
+    std::ifstream src{from, std::ios::binary};
+    std::ofstream dst{to, std::ios::binary | std::ios::trunc};
+    dst << src.rdbuf();
+}
+
+static void set_mtime(const char *path, time_t mtime) {
+    utimbuf times;
+    times.actime = mtime;
+    times.modtime = mtime;
+    REQUIRE(utime(path, &times) == 0);
+}
+
+TEST_CASE("TrustStoreRegistry works as expected") {
+    TrustStoreRegistry registry;
+
+    SECTION("when the CA bundle does not exist") {
+        auto r = registry.get("/nonexistent", Logger::make());
+        REQUIRE(!r);
+        REQUIRE(r.as_error() == SslCtxLoadVerifyLocationsError());
+        REQUIRE(registry.size() == 0);
+    }
+
+    SECTION("when X509_STORE_load_locations() fails") {
+        auto r = registry.get<x509_store_load_locations_fail>(
+              default_cert, Logger::make());
+        REQUIRE(!r);
+        REQUIRE(r.as_error() == SslCtxLoadVerifyLocationsError());
+        REQUIRE(registry.size() == 0);
+    }
+
+    SECTION("the same store is shared by all threads") {
+        auto get = [&registry]() {
+            return *registry.get(default_cert, Logger::make());
+        };
+        auto first = std::async(std::launch::async, get).get();
+        auto second = std::async(std::launch::async, get).get();
+        REQUIRE(first.get() == second.get());
+        REQUIRE(registry.size() == 1);
+    }
+
+    SECTION("the store is reloaded when the CA bundle changes") {
+        static const char *path = "./test_net_libssl_reload.pem";
+        copy_file("./test/fixtures/basic_ca.pem", path);
+        set_mtime(path, 1000000000);
+        auto first = *registry.get(path, Logger::make());
+        REQUIRE(!first->is_stale());
+        REQUIRE((*registry.get(path, Logger::make())).get() == first.get());
+        copy_file(default_cert, path);
+        set_mtime(path, 1000000010);
+        REQUIRE(first->is_stale());
+        auto second = *registry.get(path, Logger::make());
+        REQUIRE(second.get() != first.get());
+        REQUIRE(!second->is_stale());
+        remove(path);
+    }
+}
+
+TEST_CASE("Contexts in different threads share the trust store") {
+    auto make = []() {
+        auto ssl = *Cache<>::thread_local_instance()->get_client_ssl(
+              default_cert, "www.google.com", Logger::make());
+        X509_STORE *store = SSL_CTX_get_cert_store(SSL_get_SSL_CTX(ssl));
+        SSL_free(ssl);
+        return store;
+    };
+    auto first = std::async(std::launch::async, make).get();
+    auto second = std::async(std::launch::async, make).get();
+    REQUIRE(first == second);
+}
+
+TEST_CASE("Cache replaces the SSL_CTX when the CA bundle changes") {
+    static const char *path = "./test_net_libssl_cache_reload.pem";
+    copy_file(default_cert, path);
+    set_mtime(path, 1000000000);
+    Cache<> cache;
+    auto first = *cache.get_client_ssl(path, "x.org", Logger::make());
+    auto second = *cache.get_client_ssl(path, "x.org", Logger::make());
+    REQUIRE(SSL_get_SSL_CTX(first) == SSL_get_SSL_CTX(second));
+    set_mtime(path, 1000000010);
+    auto third = *cache.get_client_ssl(path, "x.org", Logger::make());
+    REQUIRE(SSL_get_SSL_CTX(first) != SSL_get_SSL_CTX(third));
+    REQUIRE(cache.size() == 1);
+    SSL_free(first);
+    SSL_free(second);
+    SSL_free(third);
+    remove(path);
+}
+
 static ErrorOr<SharedPtr<Context>> context_make_fail(std::string, SharedPtr<Logger>) {
     return {MockedError(), {}};
 }
@@ -162,3 +267,254 @@ TEST_CASE("enable_hostname_validation works as expected") {
         SSL_free(ssl);
     }
 }
+
+static SSL_SESSION *make_session(uint8_t id, long timeout = 300) {
+    SSL_SESSION *session = SSL_SESSION_new();
+    REQUIRE(session != nullptr);
+    REQUIRE(SSL_SESSION_set1_id(session, &id, sizeof(id)) == 1);
+    SSL_SESSION_set_time(session, (long)time(nullptr));
+    SSL_SESSION_set_timeout(session, timeout);
+    return session;
+}
+
+TEST_CASE("SessionCache works as expected") {
+    SessionCache cache;
+
+    SECTION("when the key is not present") {
+        REQUIRE(cache.take("x") == nullptr);
+    }
+
+    SECTION("TLS 1.2 sessions can be taken many times") {
+        SSL_SESSION *session = make_session(1);
+        REQUIRE(SSL_SESSION_set_protocol_version(
+                      session, TLS1_2_VERSION) == 1);
+        cache.put("x", session);
+        for (int i = 0; i < 3; ++i) {
+            SSL_SESSION *taken = cache.take("x");
+            REQUIRE(taken == session);
+            SSL_SESSION_free(taken);
+        }
+        REQUIRE(cache.count("x") == 1);
+    }
+
+    SECTION("TLS 1.3 tickets are taken only once, newest first") {
+        SSL_SESSION *first = make_session(1);
+        SSL_SESSION *second = make_session(2);
+        REQUIRE(SSL_SESSION_set_protocol_version(first, TLS1_3_VERSION) == 1);
+        REQUIRE(SSL_SESSION_set_protocol_version(second, TLS1_3_VERSION) == 1);
+        cache.put("x", first);
+        cache.put("x", second);
+        SSL_SESSION *taken = cache.take("x");
+        REQUIRE(taken == second);
+        SSL_SESSION_free(taken);
+        taken = cache.take("x");
+        REQUIRE(taken == first);
+        SSL_SESSION_free(taken);
+        REQUIRE(cache.take("x") == nullptr);
+        REQUIRE(cache.size() == 0);
+    }
+
+    SECTION("expired sessions are dropped") {
+        SSL_SESSION *session = make_session(1, 0);
+        SSL_SESSION_set_time(session, (long)time(nullptr) - 10);
+        cache.put("x", session);
+        REQUIRE(cache.take("x") == nullptr);
+        REQUIRE(cache.size() == 0);
+    }
+
+    SECTION("we keep a bounded number of sessions per key") {
+        for (size_t i = 0; i < SessionCache::max_sessions + 3; ++i) {
+            cache.put("x", make_session((uint8_t)i));
+        }
+        REQUIRE(cache.count("x") == (size_t)SessionCache::max_sessions);
+    }
+
+    SECTION("the least recently used key is evicted") {
+        for (size_t i = 0; i < SessionCache::max_keys; ++i) {
+            cache.put(std::to_string(i), make_session((uint8_t)i));
+        }
+        SSL_SESSION_free(cache.take("0")); // Now "1" is the LRU key
+        cache.put("new", make_session(0));
+        REQUIRE(cache.size() == (size_t)SessionCache::max_keys);
+        REQUIRE(cache.count("0") == 1);
+        REQUIRE(cache.count("1") == 0);
+        REQUIRE(cache.count("new") == 1);
+    }
+}
+
+TEST_CASE("Cache::session_key() distinguishes all its inputs") {
+    auto key = Cache<>::session_key("ca.pem", "a.org", 443, "a.org");
+    REQUIRE(key != Cache<>::session_key("ca2.pem", "a.org", 443, "a.org"));
+    REQUIRE(key != Cache<>::session_key("ca.pem", "b.org", 443, "a.org"));
+    REQUIRE(key != Cache<>::session_key("ca.pem", "a.org", 444, "a.org"));
+    REQUIRE(key != Cache<>::session_key("ca.pem", "a.org", 443, "b.org"));
+}
+
+/*
+ * To test resumption we run handshakes in memory against a server using a
+ * self signed certificate, which we also save as the CA bundle. Since trust
+ * stores are shared and reloaded only when the CA bundle modification time
+ * (in seconds) or size changes, each server uses a different CA bundle.
+ */
+
+class LoopbackServer {
+  public:
+    LoopbackServer() {
+        static int count = 0;
+        cert_path = "./test_net_libssl_loopback_" +
+                    std::to_string(++count) + ".pem";
+        EVP_PKEY_CTX *kctx = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, nullptr);
+        REQUIRE(kctx != nullptr);
+        REQUIRE(EVP_PKEY_keygen_init(kctx) == 1);
+        REQUIRE(EVP_PKEY_CTX_set_ec_paramgen_curve_nid(
+                      kctx, NID_X9_62_prime256v1) == 1);
+        REQUIRE(EVP_PKEY_keygen(kctx, &pkey) == 1);
+        EVP_PKEY_CTX_free(kctx);
+        cert = X509_new();
+        REQUIRE(cert != nullptr);
+        X509_set_version(cert, 2);
+        ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+        X509_gmtime_adj(X509_get_notBefore(cert), -3600);
+        X509_gmtime_adj(X509_get_notAfter(cert), 3600);
+        X509_NAME *name = X509_get_subject_name(cert);
+        X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC,
+                                   (const unsigned char *)"localhost", -1,
+                                   -1, 0);
+        X509_set_issuer_name(cert, name);
+        X509_set_pubkey(cert, pkey);
+        REQUIRE(X509_sign(cert, pkey, EVP_sha256()) != 0);
+        FILE *fp = fopen(cert_path.c_str(), "w");
+        REQUIRE(fp != nullptr);
+        REQUIRE(PEM_write_X509(fp, cert) == 1);
+        fclose(fp);
+        ctx = SSL_CTX_new(SSLv23_server_method());
+        REQUIRE(ctx != nullptr);
+        REQUIRE(SSL_CTX_use_certificate(ctx, cert) == 1);
+        REQUIRE(SSL_CTX_use_PrivateKey(ctx, pkey) == 1);
+        SSL_CTX_set_session_id_context(ctx, (const unsigned char *)"mk", 2);
+    }
+
+    ~LoopbackServer() {
+        SSL_CTX_free(ctx);
+        X509_free(cert);
+        EVP_PKEY_free(pkey);
+        remove(cert_path.c_str());
+    }
+
+    // Performs the handshake and returns whether the session was resumed
+    bool handshake(SSL *client) {
+        SSL *server = SSL_new(ctx);
+        REQUIRE(server != nullptr);
+        BIO *client_bio = nullptr, *server_bio = nullptr;
+        REQUIRE(BIO_new_bio_pair(&client_bio, 0, &server_bio, 0) == 1);
+        SSL_set_bio(client, client_bio, client_bio);
+        SSL_set_bio(server, server_bio, server_bio);
+        SSL_set_connect_state(client);
+        SSL_set_accept_state(server);
+        bool client_done = false, server_done = false;
+        for (int i = 0; i < 100 && !(client_done && server_done); ++i) {
+            client_done = client_done || SSL_do_handshake(client) == 1;
+            server_done = server_done || SSL_do_handshake(server) == 1;
+        }
+        REQUIRE(client_done);
+        REQUIRE(server_done);
+        // With TLS 1.3 the tickets arrive after the handshake
+        char c = 0;
+        REQUIRE(SSL_read(client, &c, 1) <= 0);
+        bool reused = SSL_session_reused(client) == 1;
+        SSL_free(server);
+        return reused;
+    }
+
+    std::string cert_path;
+    EVP_PKEY *pkey = nullptr;
+    X509 *cert = nullptr;
+    SSL_CTX *ctx = nullptr;
+};
+
+TEST_CASE("Cache resumes sessions") {
+    LoopbackServer server;
+    Cache<> cache;
+    auto connect = [&](std::string hostname, int port, bool resume) {
+        SSL *ssl = *cache.get_client_ssl(server.cert_path, hostname, port,
+                                         resume, Logger::make());
+        bool reused = server.handshake(ssl);
+        SSL_free(ssl);
+        return reused;
+    };
+
+    SECTION("when connecting again to the same server") {
+        REQUIRE(connect("localhost", 443, true) == false);
+        REQUIRE(cache.sessions().size() == 1);
+        REQUIRE(connect("localhost", 443, true) == true);
+        REQUIRE(connect("localhost", 443, true) == true);
+    }
+
+    SECTION("but not when connecting to another server") {
+        REQUIRE(connect("localhost", 443, true) == false);
+        REQUIRE(connect("localhost", 8443, true) == false);
+        REQUIRE(cache.sessions().size() == 2);
+    }
+
+    SECTION("but not when resuming is disabled") {
+        REQUIRE(connect("localhost", 443, false) == false);
+        REQUIRE(cache.sessions().size() == 0);
+        REQUIRE(connect("localhost", 443, true) == false);
+        REQUIRE(connect("localhost", 443, false) == false);
+        REQUIRE(connect("localhost", 443, true) == true);
+    }
+}
+
+/*
+ * Benchmark comparing full handshakes with resumed handshakes. It is
+ * hidden, run it using `./test/net/libssl [benchmark]`.
+ */
+
+TEST_CASE("Handshake time with and without resumption", "[.benchmark]") {
+    static const int iterations = 500;
+    LoopbackServer server;
+    Cache<> cache;
+    for (bool resume : {false, true}) {
+        auto begin = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; ++i) {
+            SSL *ssl = *cache.get_client_ssl(server.cert_path, "localhost",
+                                             443, resume, Logger::make());
+            server.handshake(ssl);
+            SSL_free(ssl);
+        }
+        std::chrono::duration<double> elapsed =
+                std::chrono::steady_clock::now() - begin;
+        printf("%-32s %10.1f us/handshake\n",
+               resume ? "with resumption" : "without resumption",
+               elapsed.count() * 1e6 / iterations);
+    }
+}
+
+/*
+ * Benchmark comparing the time to create a SSL_CTX parsing the CA bundle
+ * each time, as we used to do in each thread, with using the shared trust
+ * store. It is hidden, run it using `./test/net/libssl [benchmark]`.
+ */
+
+TEST_CASE("SSL_CTX creation time with and without shared trust store",
+          "[.benchmark]") {
+    static const int iterations = 100;
+    auto measure = [](const char *what, std::function<void()> func) {
+        auto begin = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; ++i) {
+            func();
+        }
+        std::chrono::duration<double> elapsed =
+                std::chrono::steady_clock::now() - begin;
+        printf("%-32s %10.1f us/SSL_CTX\n", what,
+               elapsed.count() * 1e6 / iterations);
+    };
+    measure("SSL_CTX_load_verify_locations", []() {
+        SSL_CTX *ctx = SSL_CTX_new(SSLv23_client_method());
+        REQUIRE(SSL_CTX_load_verify_locations(ctx, default_cert, nullptr));
+        SSL_CTX_free(ctx);
+    });
+    measure("shared trust store", []() {
+        REQUIRE(!!Context::make(default_cert, Logger::make()));
+    });
+}
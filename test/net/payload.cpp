@@ -0,0 +1,211 @@
+// Part of Measurement Kit <https://measurement-kit.github.io/>.
+// Measurement Kit is free software under the BSD license. See AUTHORS
+// and LICENSE for more information on the copying conditions.
+
+#include "test/winsock.hpp"
+
+#include "include/private/catch.hpp"
+
+#include "src/libmeasurement_kit/net/libevent_emitter.hpp"
+#include "src/libmeasurement_kit/net/payload.hpp"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <thread>
+
+using namespace mk;
+using namespace mk::net;
+
+// Writes `payload` twice, between two strings, using a LibeventEmitter
+// attached to one end of a socketpair and returns what the other end got.
+static std::string send_over_socketpair(SharedPtr<Payload> payload,
+                                        std::string *recorded) {
+    SharedPtr<Reactor> reactor = Reactor::make();
+    evutil_socket_t fds[2];
+    REQUIRE(evutil_socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    REQUIRE(evutil_make_socket_nonblocking(fds[0]) == 0);
+    bufferevent *bev = bufferevent_socket_new(reactor->get_event_base(),
+                                              fds[0], BEV_OPT_CLOSE_ON_FREE);
+    REQUIRE(bev != nullptr);
+    auto txp = LibeventEmitter::make(bev, reactor, Logger::make());
+    txp->record_sent_data();
+    reactor->run_with_initial_event([&]() {
+        txp->on_flush([&]() {
+            ::shutdown(fds[0], SHUT_WR);
+            txp->close(nullptr);
+        });
+        txp->write("<");
+        txp->write(payload);
+        txp->write(payload);
+        txp->write(">");
+    });
+    *recorded = txp->sent_data().read();
+    std::string received;
+    char buff[4096];
+    ssize_t n = 0;
+    while ((n = ::recv(fds[1], buff, sizeof(buff), 0)) > 0) {
+        received.append(buff, (size_t)n);
+    }
+    ::close(fds[1]);
+    return received;
+}
+
+TEST_CASE("Payload works as expected") {
+    std::string data = random_printable(20000);
+
+    SECTION("A payload kept in memory") {
+        auto payload = Payload::make(data);
+        REQUIRE(!payload->file_backed());
+        REQUIRE(payload->size() == data.size());
+
+        SECTION("Can be added to a buffer many times") {
+            Buffer buff;
+            payload->add_to(buff);
+            payload->add_to(buff);
+            REQUIRE(buff.read() == data + data);
+        }
+
+        SECTION("Outlives the Payload object when added to a buffer") {
+            Buffer buff;
+            payload->add_to(buff);
+            payload = nullptr;
+            REQUIRE(buff.read() == data);
+        }
+
+        SECTION("Is sent correctly") {
+            std::string recorded;
+            REQUIRE(send_over_socketpair(payload, &recorded) ==
+                    "<" + data + data + ">");
+            REQUIRE(recorded == "<" + data + data + ">");
+        }
+    }
+
+    SECTION("A file backed payload") {
+        auto payload = Payload::make(data, true);
+#ifdef __linux__
+        REQUIRE(payload->file_backed());
+#endif
+        REQUIRE(payload->size() == data.size());
+
+        SECTION("Can be added to a buffer many times") {
+            Buffer buff;
+            payload->add_to(buff);
+            payload->add_to(buff);
+            REQUIRE(buff.read() == data + data);
+        }
+
+        SECTION("Outlives the Payload object when added to a buffer") {
+            Buffer buff;
+            payload->add_to(buff);
+            payload = nullptr;
+            REQUIRE(buff.read() == data);
+        }
+
+        SECTION("Is sent correctly") {
+            std::string recorded;
+            REQUIRE(send_over_socketpair(payload, &recorded) ==
+                    "<" + data + data + ">");
+            REQUIRE(recorded == "<" + data + data + ">");
+        }
+    }
+
+    SECTION("An empty payload is never file backed") {
+        auto payload = Payload::make("", true);
+        REQUIRE(!payload->file_backed());
+        Buffer buff;
+        payload->add_to(buff);
+        REQUIRE(buff.length() == 0);
+    }
+}
+
+TEST_CASE("Emitter accounts for payloads like for other data") {
+    SharedPtr<Reactor> reactor = Reactor::make();
+    Emitter emitter{reactor, Logger::make()};
+    emitter.record_sent_data();
+    emitter.write(Payload::make("abc"));
+    emitter.write(Payload::make("def", true));
+    REQUIRE(emitter.sent_data().read() == "abcdef");
+}
+
+/*
+ * Compares the upload throughput over loopback when writing a string, which
+ * is copied, and when writing payloads. It is hidden, run it using
+ * `./test/net/payload [benchmark]`.
+ */
+
+static const size_t total_size = 2UL << 30;
+
+template <typename Func>
+static void measure(const char *what, size_t chunk_size, Func &&write_chunk) {
+    evutil_socket_t listener = ::socket(AF_INET, SOCK_STREAM, 0);
+    REQUIRE(listener != -1);
+    sockaddr_in sin{};
+    sin.sin_family = AF_INET;
+    sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t sinlen = sizeof(sin);
+    REQUIRE(::bind(listener, (sockaddr *)&sin, sizeof(sin)) == 0);
+    REQUIRE(::getsockname(listener, (sockaddr *)&sin, &sinlen) == 0);
+    REQUIRE(::listen(listener, 1) == 0);
+    evutil_socket_t client = ::socket(AF_INET, SOCK_STREAM, 0);
+    REQUIRE(::connect(client, (sockaddr *)&sin, sizeof(sin)) == 0);
+    evutil_socket_t server = ::accept(listener, nullptr, nullptr);
+    REQUIRE(server != -1);
+    ::close(listener);
+
+    size_t received = 0;
+    std::thread discard{[&]() {
+        char buff[131072];
+        ssize_t n = 0;
+        while ((n = ::recv(server, buff, sizeof(buff), 0)) > 0) {
+            received += (size_t)n;
+        }
+        ::close(server);
+    }};
+
+    SharedPtr<Reactor> reactor = Reactor::make();
+    REQUIRE(evutil_make_socket_nonblocking(client) == 0);
+    bufferevent *bev = bufferevent_socket_new(reactor->get_event_base(),
+                                              client, BEV_OPT_CLOSE_ON_FREE);
+    REQUIRE(bev != nullptr);
+    auto txp = LibeventEmitter::make(bev, reactor, Logger::make());
+    size_t sent = 0;
+    auto begin = std::chrono::steady_clock::now();
+    reactor->run_with_initial_event([&]() {
+        txp->on_flush([&]() {
+            if (sent >= total_size) {
+                ::shutdown(client, SHUT_WR);
+                txp->close(nullptr);
+                return;
+            }
+            write_chunk(txp);
+            sent += chunk_size;
+        });
+        write_chunk(txp);
+        sent += chunk_size;
+    });
+    discard.join();
+    std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - begin;
+    REQUIRE(received == sent);
+    printf("%-32s %6zu %10.1f MB/s\n", what, chunk_size,
+           received / elapsed.count() / 1e06);
+}
+
+TEST_CASE("Upload throughput over loopback", "[.benchmark]") {
+    for (size_t chunk_size : {8192UL, 65536UL, 1048576UL}) {
+        std::string str = random_printable(chunk_size);
+        auto in_memory = Payload::make(str);
+        auto file_backed = Payload::make(str, true);
+        measure("write(std::string)", chunk_size,
+                [&](SharedPtr<Transport> txp) { txp->write(str); });
+        measure("write(Payload) (in memory)", chunk_size,
+                [&](SharedPtr<Transport> txp) { txp->write(in_memory); });
+        measure("write(Payload) (file backed)", chunk_size,
+                [&](SharedPtr<Transport> txp) { txp->write(file_backed); });
+    }
+}
@@ -6,9 +6,16 @@
 
 #include "include/private/catch.hpp"
 
+#include "src/libmeasurement_kit/common/utils.hpp"
 #include "src/libmeasurement_kit/net/socks5.hpp"
 #include "src/libmeasurement_kit/net/error.hpp"
 
+#include <event2/buffer.h>
+#include <event2/bufferevent.h>
+#include <event2/listener.h>
+
+#include <set>
+
 using namespace mk;
 using namespace mk::net;
 
@@ -243,3 +250,138 @@ TEST_CASE("parse_connect_response() works as expected") {
         REQUIRE(input.length() == 0);
     }
 }
+
+/*
+ * A SOCKS5 proxy that only accepts NO_AUTH and echoes back what it receives
+ * once connected. It sends all the replies due after a read at once, after
+ * `delay` seconds, to simulate the round trip time to a remote proxy.
+ */
+class LocalSocks5Proxy {
+  public:
+    LocalSocks5Proxy(SharedPtr<Reactor> reactor, double delay)
+        : reactor{reactor}, delay{delay} {
+        sockaddr_in sin = {};
+        sin.sin_family = AF_INET;
+        sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        listener = evconnlistener_new_bind(
+                reactor->get_event_base(), on_accept, this,
+                LEV_OPT_CLOSE_ON_FREE | LEV_OPT_REUSEABLE, 8,
+                (sockaddr *)&sin, sizeof(sin));
+        REQUIRE(listener != nullptr);
+        socklen_t len = sizeof(sin);
+        REQUIRE(getsockname(evconnlistener_get_fd(listener),
+                            (sockaddr *)&sin, &len) == 0);
+        port = ntohs(sin.sin_port);
+    }
+
+    ~LocalSocks5Proxy() {
+        for (auto &kv : connections) {
+            bufferevent_free(kv.first);
+        }
+        evconnlistener_free(listener);
+    }
+
+    std::string endpoint() { return "127.0.0.1:" + std::to_string(port); }
+
+  private:
+    enum class State { GREETING, REQUEST, CONNECTED };
+
+    static void on_accept(evconnlistener *listener, evutil_socket_t fd,
+                          sockaddr *, int, void *opaque) {
+        auto self = static_cast<LocalSocks5Proxy *>(opaque);
+        bufferevent *bev = bufferevent_socket_new(
+                evconnlistener_get_base(listener), fd, BEV_OPT_CLOSE_ON_FREE);
+        REQUIRE(bev != nullptr);
+        bufferevent_setcb(bev, on_read, nullptr, on_event, self);
+        REQUIRE(bufferevent_enable(bev, EV_READ) == 0);
+        self->connections[bev] = State::GREETING;
+    }
+
+    static void on_read(bufferevent *bev, void *opaque) {
+        auto self = static_cast<LocalSocks5Proxy *>(opaque);
+        Buffer input{bufferevent_get_input(bev)};
+        Buffer output;
+        State &state = self->connections[bev];
+        for (;;) {
+            if (state == State::GREETING && input.length() >= 3) {
+                REQUIRE(input.read(3) == std::string{"\5\1\0", 3});
+                output.write(std::string{"\5\0", 2});
+                state = State::REQUEST;
+                continue;
+            }
+            if (state == State::REQUEST && input.length() >= 5) {
+                size_t total = 4 + 1 + (uint8_t)input.peek(5)[4] + 2;
+                if (input.length() < total) {
+                    break;
+                }
+                input.discard(total);
+                output.write(std::string{"\5\0\0\1\177\0\0\1\0\120", 10});
+                state = State::CONNECTED;
+                continue;
+            }
+            if (state == State::CONNECTED) {
+                output << input;
+            }
+            break;
+        }
+        // Put back what we could not parse yet
+        input >> bufferevent_get_input(bev);
+        if (output.length() <= 0) {
+            return;
+        }
+        self->reactor->call_later(self->delay, [self, bev, output]() mutable {
+            if (self->connections.count(bev) > 0) {
+                output >> bufferevent_get_output(bev);
+            }
+        });
+    }
+
+    static void on_event(bufferevent *bev, short, void *opaque) {
+        auto self = static_cast<LocalSocks5Proxy *>(opaque);
+        self->connections.erase(bev);
+        bufferevent_free(bev);
+    }
+
+    SharedPtr<Reactor> reactor;
+    double delay = 0.0;
+    std::map<bufferevent *, State> connections;
+    evconnlistener *listener = nullptr;
+    uint16_t port = 0;
+};
+
+// Connects through the proxy, checks that data flows, and returns the time
+// it took to be connected.
+static double socks5_time_to_connected(bool optimistic) {
+    SharedPtr<Reactor> reactor = Reactor::make();
+    LocalSocks5Proxy proxy{reactor, 0.1};
+    Settings settings;
+    settings["net/socks5_proxy"] = proxy.endpoint();
+    settings["net/socks5_optimistic"] = optimistic;
+    double elapsed = 0.0;
+    reactor->run_with_initial_event([&]() {
+        double begin = time_now();
+        socks5_connect("example.com", 80, settings,
+                       [&, begin](Error error, SharedPtr<Transport> txp) {
+                           REQUIRE(error == NoError());
+                           elapsed = time_now() - begin;
+                           txp->on_data([&, txp](Buffer data) {
+                               REQUIRE(data.read() == "hello");
+                               txp->close(nullptr);
+                               reactor->stop();
+                           });
+                           txp->write("hello");
+                       },
+                       reactor, Logger::make());
+    });
+    return elapsed;
+}
+
+TEST_CASE("socks5_connect() works with a local proxy") {
+    SECTION("The handshake takes two round trips by default") {
+        REQUIRE(socks5_time_to_connected(false) >= 0.2);
+    }
+
+    SECTION("The handshake takes one round trip in optimistic mode") {
+        REQUIRE(socks5_time_to_connected(true) < 0.2);
+    }
+}
@@ -0,0 +1,125 @@
+// Part of Measurement Kit <https://measurement-kit.github.io/>.
+// Measurement Kit is free software under the BSD license. See AUTHORS
+// and LICENSE for more information on the copying conditions.
+
+#include "test/winsock.hpp"
+
+#include "include/private/catch.hpp"
+
+#include "src/libmeasurement_kit/net/libevent_emitter.hpp"
+#include "src/libmeasurement_kit/net/tcp_info.hpp"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace mk;
+using namespace mk::net;
+
+// Creates a connected pair of TCP sockets over loopback.
+static void tcp_socketpair(evutil_socket_t fds[2]) {
+    evutil_socket_t listener = ::socket(AF_INET, SOCK_STREAM, 0);
+    REQUIRE(listener != -1);
+    sockaddr_in sin{};
+    sin.sin_family = AF_INET;
+    sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t sinlen = sizeof(sin);
+    REQUIRE(::bind(listener, (sockaddr *)&sin, sizeof(sin)) == 0);
+    REQUIRE(::getsockname(listener, (sockaddr *)&sin, &sinlen) == 0);
+    REQUIRE(::listen(listener, 1) == 0);
+    fds[0] = ::socket(AF_INET, SOCK_STREAM, 0);
+    REQUIRE(::connect(fds[0], (sockaddr *)&sin, sizeof(sin)) == 0);
+    fds[1] = ::accept(listener, nullptr, nullptr);
+    REQUIRE(fds[1] != -1);
+    ::close(listener);
+}
+
+#ifdef __linux__
+
+TEST_CASE("tcp_info_for_socket() works for TCP sockets") {
+    evutil_socket_t fds[2];
+    tcp_socketpair(fds);
+    std::string data(65536, 'A');
+    REQUIRE(::send(fds[0], data.data(), data.size(), 0) ==
+            (ssize_t)data.size());
+    std::string received;
+    char buff[8192];
+    while (received.size() < data.size()) {
+        ssize_t n = ::recv(fds[1], buff, sizeof(buff), 0);
+        REQUIRE(n > 0);
+        received.append(buff, (size_t)n);
+    }
+    ErrorOr<TcpInfo> sender = tcp_info_for_socket(fds[0]);
+    REQUIRE(!!sender);
+    REQUIRE(sender->snd_mss > 0);
+    REQUIRE(sender->snd_cwnd > 0);
+    REQUIRE(sender->rtt > 0);
+    REQUIRE(sender->total_retrans == 0);
+    REQUIRE(sender->bytes_acked <= data.size() + 1); // Counts the SYN
+    ErrorOr<TcpInfo> receiver = tcp_info_for_socket(fds[1]);
+    REQUIRE(!!receiver);
+    // Zero with kernels older than 4.1
+    REQUIRE((receiver->bytes_received == 0 ||
+             receiver->bytes_received == data.size()));
+    ::close(fds[0]);
+    ::close(fds[1]);
+}
+
+TEST_CASE("tcp_info_for_socket() fails for other sockets") {
+    evutil_socket_t fds[2];
+    REQUIRE(evutil_socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    REQUIRE(!tcp_info_for_socket(fds[0]));
+    ::close(fds[0]);
+    ::close(fds[1]);
+}
+
+#else
+
+TEST_CASE("tcp_info_for_socket() is not implemented") {
+    evutil_socket_t fds[2];
+    tcp_socketpair(fds);
+    REQUIRE(tcp_info_for_socket(fds[0]).as_error() == NotImplementedError());
+    ::close(fds[0]);
+    ::close(fds[1]);
+}
+
+#endif
+
+TEST_CASE("Transports expose TCP_INFO") {
+    SharedPtr<Reactor> reactor = Reactor::make();
+
+    SECTION("For emitters not attached to a socket") {
+        Emitter emitter{reactor, Logger::make()};
+        REQUIRE(emitter.tcp_info().as_error() == NotImplementedError());
+    }
+
+    SECTION("For emitters attached to a socket") {
+        evutil_socket_t fds[2];
+        tcp_socketpair(fds);
+        bufferevent *bev = bufferevent_socket_new(
+                reactor->get_event_base(), fds[0], BEV_OPT_CLOSE_ON_FREE);
+        REQUIRE(bev != nullptr);
+        auto txp = LibeventEmitter::make(bev, reactor, Logger::make());
+        ErrorOr<TcpInfo> info = txp->tcp_info();
+#ifdef __linux__
+        REQUIRE(!!info);
+        REQUIRE(info->snd_mss > 0);
+#else
+        REQUIRE(info.as_error() == NotImplementedError());
+#endif
+        txp->close(nullptr);
+        ::close(fds[1]);
+    }
+}
+
+TEST_CASE("TcpInfo is serialized to JSON") {
+    TcpInfo info;
+    info.rtt = 1000;
+    info.rwnd_limited = 17;
+    nlohmann::json j = info;
+    REQUIRE(j.size() == 12);
+    REQUIRE(j["rtt"] == 1000);
+    REQUIRE(j["rwnd_limited"] == 17);
+    REQUIRE(j["sndbuf_limited"] == 0);
+}
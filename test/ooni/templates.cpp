@@ -114,6 +114,28 @@ TEST_CASE("dns query template works as expected with system engine") {
     });
 }
 
+TEST_CASE("dns query many template deals with an invalid nameserver") {
+    SharedPtr<Reactor> reactor = Reactor::make();
+    SharedPtr<nlohmann::json> entry(new nlohmann::json);
+    size_t streamed = 0;
+    std::vector<dns::BulkResult> results;
+    reactor->run_with_initial_event([&]() {
+        templates::dns_query_many(
+            entry, "A", "IN", {"dns.google", "nexa.polito.it"}, "[::1",
+            [&](const dns::BulkResult &result) {
+                REQUIRE(result.index == streamed);
+                streamed += 1;
+            },
+            [&](std::vector<dns::BulkResult> r) { results = r; },
+            {{"dns/engine", "libevent"}}, reactor, Logger::make());
+    });
+    REQUIRE(streamed == 2);
+    REQUIRE(results.size() == 2);
+    REQUIRE(results[1].query.name == "nexa.polito.it");
+    REQUIRE(!!results[1].error);
+    REQUIRE(entry->count("queries") == 0);
+}
+
 TEST_CASE("tcp connect returns error if port is missing") {
     SharedPtr<Reactor> reactor = Reactor::make();
     reactor->run_with_initial_event([=]() {